@@ -0,0 +1,889 @@
+/*****************************************************************************
+   alsastate.c - Store and restore card settings in alsactl's file format
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+******************************************************************************/
+
+/*
+ * The ALSA section of each card in profiles.conf is what "alsactl -f file
+ * store" writes and "alsactl -f file restore" reads: a "state.<card id>"
+ * compound holding one "control.<numid>" compound per element. Profiles
+ * used to be saved and recalled by running alsactl on a temporary file,
+ * which forked, waited in the GUI thread and went through the disk.
+ *
+ * alsa_state_store() and alsa_state_restore() do the same on the already
+ * open control handle, producing and parsing that text in memory with
+ * alsa-lib's own configuration parser, so profiles stay interchangeable
+ * with alsactl. A restore reads every element once, then writes only those
+ * the profile changes. alsa_state_compile() turns a profile into a binary
+ * scene once, so that recalling it again skips the parsing and lookups.
+ */
+
+#include "controls.h"
+
+/* "access" string of the alsactl comment */
+static void state_access_string(snd_ctl_elem_info_t *info, char *buf, size_t size)
+{
+	snprintf(buf, size, "%s%s%s",
+		 snd_ctl_elem_info_is_readable(info) ? "read" : "",
+		 snd_ctl_elem_info_is_writable(info) ? " write" : "",
+		 snd_ctl_elem_info_is_volatile(info) ? " volatile" : "");
+}
+
+static int state_make_comment(snd_ctl_t *handle, snd_ctl_elem_info_t *info, snd_config_t **comment)
+{
+	snd_config_t *node, *items;
+	snd_ctl_elem_info_t *item_info;
+	snd_ctl_elem_type_t type = snd_ctl_elem_info_get_type(info);
+	char buf[64];
+	unsigned int i;
+	int err;
+
+	if ((err = snd_config_make_compound(comment, "comment", 0)) < 0)
+		return err;
+	state_access_string(info, buf, sizeof(buf));
+	if ((err = snd_config_imake_string(&node, "access", buf)) < 0 ||
+	    (err = snd_config_add(*comment, node)) < 0)
+		return err;
+	if ((err = snd_config_imake_string(&node, "type", snd_ctl_elem_type_name(type))) < 0 ||
+	    (err = snd_config_add(*comment, node)) < 0)
+		return err;
+	if ((err = snd_config_imake_integer(&node, "count", snd_ctl_elem_info_get_count(info))) < 0 ||
+	    (err = snd_config_add(*comment, node)) < 0)
+		return err;
+	switch (type) {
+	case SND_CTL_ELEM_TYPE_INTEGER:
+		if (snd_ctl_elem_info_get_step(info))
+			snprintf(buf, sizeof(buf), "%li - %li (step %li)",
+				 snd_ctl_elem_info_get_min(info), snd_ctl_elem_info_get_max(info),
+				 snd_ctl_elem_info_get_step(info));
+		else
+			snprintf(buf, sizeof(buf), "%li - %li",
+				 snd_ctl_elem_info_get_min(info), snd_ctl_elem_info_get_max(info));
+		if ((err = snd_config_imake_string(&node, "range", buf)) < 0 ||
+		    (err = snd_config_add(*comment, node)) < 0)
+			return err;
+		break;
+	case SND_CTL_ELEM_TYPE_ENUMERATED:
+		if ((err = snd_config_make_compound(&items, "item", 1)) < 0 ||
+		    (err = snd_config_add(*comment, items)) < 0)
+			return err;
+		snd_ctl_elem_info_alloca(&item_info);
+		snd_ctl_elem_info_copy(item_info, info);
+		for (i = 0; i < snd_ctl_elem_info_get_items(info); i++) {
+			snd_ctl_elem_info_set_item(item_info, i);
+			if (snd_ctl_elem_info(handle, item_info) < 0)
+				continue;
+			snprintf(buf, sizeof(buf), "%u", i);
+			if ((err = snd_config_imake_string(&node, buf, snd_ctl_elem_info_get_item_name(item_info))) < 0 ||
+			    (err = snd_config_add(items, node)) < 0)
+				return err;
+		}
+		break;
+	default:
+		break;
+	}
+	return 0;
+}
+
+/* Value 'idx' of 'value' as a config node called 'key' */
+static int state_make_value(snd_ctl_t *handle, snd_ctl_elem_info_t *info, snd_ctl_elem_value_t *value,
+			    unsigned int idx, const char *key, snd_config_t **node)
+{
+	snd_ctl_elem_info_t *item_info;
+	unsigned int item;
+
+	switch (snd_ctl_elem_info_get_type(info)) {
+	case SND_CTL_ELEM_TYPE_BOOLEAN:
+		return snd_config_imake_string(node, key, snd_ctl_elem_value_get_boolean(value, idx) ? "true" : "false");
+	case SND_CTL_ELEM_TYPE_INTEGER:
+		return snd_config_imake_integer(node, key, snd_ctl_elem_value_get_integer(value, idx));
+	case SND_CTL_ELEM_TYPE_INTEGER64:
+		return snd_config_imake_integer64(node, key, snd_ctl_elem_value_get_integer64(value, idx));
+	case SND_CTL_ELEM_TYPE_ENUMERATED:
+		item = snd_ctl_elem_value_get_enumerated(value, idx);
+		snd_ctl_elem_info_alloca(&item_info);
+		snd_ctl_elem_info_copy(item_info, info);
+		snd_ctl_elem_info_set_item(item_info, item);
+		if (snd_ctl_elem_info(handle, item_info) < 0)
+			return snd_config_imake_integer(node, key, item);
+		return snd_config_imake_string(node, key, snd_ctl_elem_info_get_item_name(item_info));
+	default:
+		return -EINVAL;
+	}
+}
+
+/* BYTES and IEC958 elements are stored as a single hex string, as alsactl does */
+static int state_make_bytes(snd_ctl_elem_value_t *value, unsigned int size, snd_config_t **node)
+{
+	char *hex;
+	unsigned int i;
+	int err;
+
+	if ((hex = malloc(size * 2 + 1)) == NULL)
+		return -ENOMEM;
+	for (i = 0; i < size; i++)
+		sprintf(hex + i * 2, "%02x", snd_ctl_elem_value_get_byte(value, i));
+	hex[size * 2] = '\0';
+	err = snd_config_imake_string(node, "value", hex);
+	free(hex);
+	return err;
+}
+
+static int state_add_control(snd_ctl_t *handle, snd_config_t *controls, snd_ctl_elem_id_t *id)
+{
+	snd_ctl_elem_info_t *info;
+	snd_ctl_elem_value_t *value;
+	snd_config_t *control, *node, *values;
+	snd_ctl_elem_type_t type;
+	unsigned int i, count;
+	char key[16];
+	int err;
+
+	snd_ctl_elem_info_alloca(&info);
+	snd_ctl_elem_value_alloca(&value);
+	snd_ctl_elem_info_set_id(info, id);
+	if ((err = snd_ctl_elem_info(handle, info)) < 0)
+		return err;
+	/* as restoring them is impossible, skip what can't be written */
+	if (snd_ctl_elem_info_is_inactive(info) ||
+	    !snd_ctl_elem_info_is_readable(info) ||
+	    !snd_ctl_elem_info_is_writable(info))
+		return 0;
+	snd_ctl_elem_value_set_id(value, id);
+	if ((err = snd_ctl_elem_read(handle, value)) < 0)
+		return err;
+
+	snprintf(key, sizeof(key), "%u", snd_ctl_elem_id_get_numid(id));
+	if ((err = snd_config_make_compound(&control, key, 0)) < 0)
+		return err;
+	if ((err = snd_config_add(controls, control)) < 0) {
+		snd_config_delete(control);
+		return err;
+	}
+	if ((err = snd_config_imake_string(&node, "iface", snd_ctl_elem_iface_name(snd_ctl_elem_id_get_interface(id)))) < 0 ||
+	    (err = snd_config_add(control, node)) < 0)
+		return err;
+	if ((err = snd_config_imake_string(&node, "name", snd_ctl_elem_id_get_name(id))) < 0 ||
+	    (err = snd_config_add(control, node)) < 0)
+		return err;
+	if (snd_ctl_elem_id_get_index(id) &&
+	    ((err = snd_config_imake_integer(&node, "index", snd_ctl_elem_id_get_index(id))) < 0 ||
+	     (err = snd_config_add(control, node)) < 0))
+		return err;
+	if (snd_ctl_elem_id_get_device(id) &&
+	    ((err = snd_config_imake_integer(&node, "device", snd_ctl_elem_id_get_device(id))) < 0 ||
+	     (err = snd_config_add(control, node)) < 0))
+		return err;
+	if (snd_ctl_elem_id_get_subdevice(id) &&
+	    ((err = snd_config_imake_integer(&node, "subdevice", snd_ctl_elem_id_get_subdevice(id))) < 0 ||
+	     (err = snd_config_add(control, node)) < 0))
+		return err;
+
+	type = snd_ctl_elem_info_get_type(info);
+	count = snd_ctl_elem_info_get_count(info);
+	if (type == SND_CTL_ELEM_TYPE_BYTES)
+		err = state_make_bytes(value, count, &node);
+	else if (type == SND_CTL_ELEM_TYPE_IEC958)
+		err = state_make_bytes(value, sizeof(snd_aes_iec958_t), &node);
+	else if (count == 1)
+		err = state_make_value(handle, info, value, 0, "value", &node);
+	else if ((err = snd_config_make_compound(&node, "value", 1)) >= 0) {
+		for (i = 0; i < count; i++) {
+			snprintf(key, sizeof(key), "%u", i);
+			if ((err = state_make_value(handle, info, value, i, key, &values)) < 0 ||
+			    (err = snd_config_add(node, values)) < 0)
+				break;
+		}
+	}
+	if (err < 0 || (err = snd_config_add(control, node)) < 0)
+		return err;
+	if ((err = state_make_comment(handle, info, &node)) < 0 ||
+	    (err = snd_config_add(control, node)) < 0)
+		return err;
+	return 0;
+}
+
+/*
+ * Store the settings of the card open on 'handle' as alsactl would.
+ * On success '*text' is a malloc()ed, NUL terminated "state.<id> { ... }"
+ * section and its length is returned; otherwise a negative errno.
+ */
+int alsa_state_store(snd_ctl_t *handle, char **text)
+{
+	snd_ctl_card_info_t *card_info;
+	snd_ctl_elem_list_t *list;
+	snd_ctl_elem_id_t *id;
+	snd_config_t *top, *state, *card, *controls;
+	snd_output_t *out;
+	char *buf;
+	size_t length;
+	unsigned int i;
+	int err;
+
+	snd_ctl_card_info_alloca(&card_info);
+	snd_ctl_elem_list_alloca(&list);
+	snd_ctl_elem_id_alloca(&id);
+	if ((err = snd_ctl_card_info(handle, card_info)) < 0)
+		return err;
+	if ((err = snd_ctl_elem_list(handle, list)) < 0)
+		return err;
+	if ((err = snd_ctl_elem_list_alloc_space(list, snd_ctl_elem_list_get_count(list))) < 0)
+		return err;
+	if ((err = snd_ctl_elem_list(handle, list)) < 0)
+		goto __list;
+
+	if ((err = snd_config_top(&top)) < 0)
+		goto __list;
+	if ((err = snd_config_make_compound(&state, "state", 1)) < 0 ||
+	    (err = snd_config_add(top, state)) < 0 ||
+	    (err = snd_config_make_compound(&card, snd_ctl_card_info_get_id(card_info), 0)) < 0 ||
+	    (err = snd_config_add(state, card)) < 0 ||
+	    (err = snd_config_make_compound(&controls, "control", 1)) < 0 ||
+	    (err = snd_config_add(card, controls)) < 0)
+		goto __config;
+	for (i = 0; i < snd_ctl_elem_list_get_used(list); i++) {
+		snd_ctl_elem_list_get_id(list, i, id);
+		if ((err = state_add_control(handle, controls, id)) < 0)
+			fprintf(stderr, "Cannot store control '%s': %s\n",
+				snd_ctl_elem_id_get_name(id), snd_strerror(err));
+	}
+
+	if ((err = snd_output_buffer_open(&out)) < 0)
+		goto __config;
+	if ((err = snd_config_save(top, out)) >= 0) {
+		length = snd_output_buffer_string(out, &buf);
+		if ((*text = malloc(length + 1)) == NULL) {
+			err = -ENOMEM;
+		} else {
+			memcpy(*text, buf, length);
+			(*text)[length] = '\0';
+			err = length;
+		}
+	}
+	snd_output_close(out);
+ __config:
+	snd_config_delete(top);
+ __list:
+	snd_ctl_elem_list_free_space(list);
+	return err;
+}
+
+static int state_parse_iface(snd_config_t *node, snd_ctl_elem_iface_t *iface)
+{
+	const char *str;
+	long val;
+	int i;
+
+	if (snd_config_get_integer(node, &val) >= 0) {
+		*iface = val;
+		return 0;
+	}
+	if (snd_config_get_string(node, &str) < 0)
+		return -EINVAL;
+	for (i = 0; i <= SND_CTL_ELEM_IFACE_LAST; i++) {
+		if (!strcasecmp(str, snd_ctl_elem_iface_name(i))) {
+			*iface = i;
+			return 0;
+		}
+	}
+	return -EINVAL;
+}
+
+/* Parse one boolean, integer or enumerated value from 'node' into 'value' */
+static int state_parse_value(snd_ctl_t *handle, snd_ctl_elem_info_t *info, snd_config_t *node,
+			     snd_ctl_elem_value_t *value, unsigned int idx)
+{
+	snd_ctl_elem_info_t *item_info;
+	const char *str = NULL;
+	long long val64;
+	long val;
+	unsigned int i;
+
+	if (snd_config_get_type(node) == SND_CONFIG_TYPE_STRING) {
+		snd_config_get_string(node, &str);
+	} else if (snd_config_get_integer(node, &val) < 0) {
+		if (snd_config_get_integer64(node, &val64) < 0)
+			return -EINVAL;
+		val = val64;
+	}
+
+	switch (snd_ctl_elem_info_get_type(info)) {
+	case SND_CTL_ELEM_TYPE_BOOLEAN:
+		if (str) {
+			if (!strcasecmp(str, "true") || !strcasecmp(str, "on") || !strcasecmp(str, "yes"))
+				val = 1;
+			else if (!strcasecmp(str, "false") || !strcasecmp(str, "off") || !strcasecmp(str, "no"))
+				val = 0;
+			else
+				return -EINVAL;
+		}
+		snd_ctl_elem_value_set_boolean(value, idx, val);
+		return 0;
+	case SND_CTL_ELEM_TYPE_INTEGER:
+		if (str)
+			val = strtol(str, NULL, 0);
+		snd_ctl_elem_value_set_integer(value, idx, val);
+		return 0;
+	case SND_CTL_ELEM_TYPE_INTEGER64:
+		if (str)
+			val64 = strtoll(str, NULL, 0);
+		else if (snd_config_get_integer64(node, &val64) < 0)
+			val64 = val;
+		snd_ctl_elem_value_set_integer64(value, idx, val64);
+		return 0;
+	case SND_CTL_ELEM_TYPE_ENUMERATED:
+		if (str) {
+			snd_ctl_elem_info_alloca(&item_info);
+			snd_ctl_elem_info_copy(item_info, info);
+			for (i = 0; i < snd_ctl_elem_info_get_items(info); i++) {
+				snd_ctl_elem_info_set_item(item_info, i);
+				if (snd_ctl_elem_info(handle, item_info) >= 0 &&
+				    !strcmp(str, snd_ctl_elem_info_get_item_name(item_info)))
+					break;
+			}
+			if (i == snd_ctl_elem_info_get_items(info))
+				return -EINVAL;
+			val = i;
+		}
+		snd_ctl_elem_value_set_enumerated(value, idx, val);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+static int state_parse_bytes(snd_config_t *node, snd_ctl_elem_value_t *value, unsigned int size)
+{
+	const char *str;
+	unsigned int i, byte;
+
+	if (snd_config_get_string(node, &str) < 0 || strlen(str) != size * 2)
+		return -EINVAL;
+	for (i = 0; i < size; i++) {
+		if (sscanf(str + i * 2, "%2x", &byte) != 1)
+			return -EINVAL;
+		snd_ctl_elem_value_set_byte(value, i, byte);
+	}
+	return 0;
+}
+
+/*
+ * A recall only writes the controls whose value differs from the card's,
+ * in an order that doesn't let anything through on the way: first the
+ * switches turning off, then routes and other settings, then volumes, and
+ * last the switches turning on. A switch element with channels going both
+ * ways is written in the first and the last step.
+ */
+enum {
+	STATE_MUTE,
+	STATE_ROUTE,
+	STATE_VOLUME,
+	STATE_UNMUTE,
+	STATE_STEPS
+};
+
+typedef struct {
+	snd_ctl_elem_value_t *target;
+	snd_ctl_elem_value_t *current;	/* the card's value, kept up to date while writing */
+	snd_ctl_elem_type_t type;
+	unsigned int count;
+	int readable;
+} state_control_t;
+
+/*
+ * Parse 'control' into 'target', starting from the card's 'current' value
+ * so values not given keep their current setting. Returns 1, 0 if the
+ * element can't be written, or a negative errno.
+ */
+static int state_parse_control(snd_ctl_t *handle, snd_config_t *control, state_control_t *parsed)
+{
+	snd_config_iterator_t i, next;
+	snd_config_t *node, *value_node = NULL;
+	snd_ctl_elem_id_t *id;
+	snd_ctl_elem_info_t *info;
+	snd_ctl_elem_iface_t iface = SND_CTL_ELEM_IFACE_MIXER;
+	const char *key, *name = NULL;
+	long val;
+	unsigned int idx;
+	int err;
+
+	snd_ctl_elem_id_alloca(&id);
+	snd_ctl_elem_info_alloca(&info);
+	if (snd_config_get_type(control) != SND_CONFIG_TYPE_COMPOUND)
+		return -EINVAL;
+	snd_config_for_each(i, next, control) {
+		node = snd_config_iterator_entry(i);
+		if (snd_config_get_id(node, &key) < 0)
+			continue;
+		if (!strcmp(key, "iface")) {
+			if ((err = state_parse_iface(node, &iface)) < 0)
+				return err;
+		} else if (!strcmp(key, "name")) {
+			if (snd_config_get_string(node, &name) < 0)
+				return -EINVAL;
+		} else if (!strcmp(key, "index") && snd_config_get_integer(node, &val) >= 0) {
+			snd_ctl_elem_id_set_index(id, val);
+		} else if (!strcmp(key, "device") && snd_config_get_integer(node, &val) >= 0) {
+			snd_ctl_elem_id_set_device(id, val);
+		} else if (!strcmp(key, "subdevice") && snd_config_get_integer(node, &val) >= 0) {
+			snd_ctl_elem_id_set_subdevice(id, val);
+		} else if (!strcmp(key, "value")) {
+			value_node = node;
+		}
+	}
+	if (name == NULL || value_node == NULL)
+		return -EINVAL;
+	snd_ctl_elem_id_set_interface(id, iface);
+	snd_ctl_elem_id_set_name(id, name);
+
+	snd_ctl_elem_info_set_id(info, id);
+	if ((err = snd_ctl_elem_info(handle, info)) < 0)
+		return err;
+	if (snd_ctl_elem_info_is_inactive(info) || !snd_ctl_elem_info_is_writable(info))
+		return 0;
+	snd_ctl_elem_info_get_id(info, id);
+	snd_ctl_elem_value_set_id(parsed->current, id);
+	parsed->type = snd_ctl_elem_info_get_type(info);
+	parsed->count = snd_ctl_elem_info_get_count(info);
+	parsed->readable = snd_ctl_elem_info_is_readable(info);
+	if (parsed->readable && (err = snd_ctl_elem_read(handle, parsed->current)) < 0)
+		return err;
+	snd_ctl_elem_value_copy(parsed->target, parsed->current);
+
+	if (parsed->type == SND_CTL_ELEM_TYPE_BYTES)
+		err = state_parse_bytes(value_node, parsed->target, parsed->count);
+	else if (parsed->type == SND_CTL_ELEM_TYPE_IEC958)
+		err = state_parse_bytes(value_node, parsed->target, sizeof(snd_aes_iec958_t));
+	else if (snd_config_get_type(value_node) != SND_CONFIG_TYPE_COMPOUND)
+		err = parsed->count == 1 ? state_parse_value(handle, info, value_node, parsed->target, 0) : -EINVAL;
+	else {
+		snd_config_for_each(i, next, value_node) {
+			node = snd_config_iterator_entry(i);
+			if (snd_config_get_id(node, &key) < 0)
+				continue;
+			idx = atoi(key);
+			if (idx >= parsed->count)
+				continue;
+			if ((err = state_parse_value(handle, info, node, parsed->target, idx)) < 0)
+				break;
+		}
+	}
+	if (err < 0)
+		return err;
+	return 1;
+}
+
+static int state_values_differ(state_control_t *control)
+{
+	snd_aes_iec958_t target, current;
+	unsigned int idx;
+
+	if (control->type == SND_CTL_ELEM_TYPE_IEC958) {
+		snd_ctl_elem_value_get_iec958(control->target, &target);
+		snd_ctl_elem_value_get_iec958(control->current, &current);
+		return memcmp(&target, &current, sizeof(target)) != 0;
+	}
+	for (idx = 0; idx < control->count; idx++) {
+		switch (control->type) {
+		case SND_CTL_ELEM_TYPE_BOOLEAN:
+			if (snd_ctl_elem_value_get_boolean(control->target, idx) !=
+			    snd_ctl_elem_value_get_boolean(control->current, idx))
+				return TRUE;
+			break;
+		case SND_CTL_ELEM_TYPE_INTEGER:
+			if (snd_ctl_elem_value_get_integer(control->target, idx) !=
+			    snd_ctl_elem_value_get_integer(control->current, idx))
+				return TRUE;
+			break;
+		case SND_CTL_ELEM_TYPE_INTEGER64:
+			if (snd_ctl_elem_value_get_integer64(control->target, idx) !=
+			    snd_ctl_elem_value_get_integer64(control->current, idx))
+				return TRUE;
+			break;
+		case SND_CTL_ELEM_TYPE_ENUMERATED:
+			if (snd_ctl_elem_value_get_enumerated(control->target, idx) !=
+			    snd_ctl_elem_value_get_enumerated(control->current, idx))
+				return TRUE;
+			break;
+		case SND_CTL_ELEM_TYPE_BYTES:
+			if (snd_ctl_elem_value_get_byte(control->target, idx) !=
+			    snd_ctl_elem_value_get_byte(control->current, idx))
+				return TRUE;
+			break;
+		default:
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/* The value to write for 'control' in 'step', or NULL if there is nothing to write */
+static snd_ctl_elem_value_t *state_step_value(state_control_t *control, int step)
+{
+	unsigned int idx;
+	int muting = FALSE;
+
+	if (!control->readable)		/* nothing to compare with, write it once */
+		return step == STATE_ROUTE ? control->target : NULL;
+	switch (control->type) {
+	case SND_CTL_ELEM_TYPE_BOOLEAN:
+		if (step == STATE_UNMUTE)
+			break;
+		if (step != STATE_MUTE)
+			return NULL;
+		/* turn off what the profile has off, leave the rest as is for now */
+		for (idx = 0; idx < control->count; idx++) {
+			if (snd_ctl_elem_value_get_boolean(control->current, idx) &&
+			    !snd_ctl_elem_value_get_boolean(control->target, idx)) {
+				snd_ctl_elem_value_set_boolean(control->current, idx, 0);
+				muting = TRUE;
+			}
+		}
+		return muting ? control->current : NULL;
+	case SND_CTL_ELEM_TYPE_INTEGER:
+	case SND_CTL_ELEM_TYPE_INTEGER64:
+		if (step != STATE_VOLUME)
+			return NULL;
+		break;
+	default:
+		if (step != STATE_ROUTE)
+			return NULL;
+		break;
+	}
+	return state_values_differ(control) ? control->target : NULL;
+}
+
+/*
+ * A compiled profile (alsa_scene_t) is a packed array of records, each
+ * the element's numid, type and value count followed by the values: 32
+ * bits per boolean or enumerated value, 64 per integer, and the raw bytes
+ * of BYTES and IEC958 elements. Records are padded to 8 bytes. Applying a
+ * scene needs no parsing and no info ioctls, only a read per element for
+ * the comparison and the writes themselves.
+ */
+typedef struct {
+	guint32 numid;
+	guint16 type;
+	guint16 count;
+} state_record_t;
+
+#define STATE_RECORD_ALIGN 8
+
+static size_t state_record_size(snd_ctl_elem_type_t type, unsigned int count)
+{
+	size_t size;
+
+	switch (type) {
+	case SND_CTL_ELEM_TYPE_BOOLEAN:
+	case SND_CTL_ELEM_TYPE_ENUMERATED:
+		size = count * sizeof(gint32);
+		break;
+	case SND_CTL_ELEM_TYPE_INTEGER:
+	case SND_CTL_ELEM_TYPE_INTEGER64:
+		size = count * sizeof(gint64);
+		break;
+	case SND_CTL_ELEM_TYPE_BYTES:
+	case SND_CTL_ELEM_TYPE_IEC958:
+		size = count;
+		break;
+	default:
+		return 0;
+	}
+	size += sizeof(state_record_t);
+	return (size + STATE_RECORD_ALIGN - 1) & ~(size_t)(STATE_RECORD_ALIGN - 1);
+}
+
+/* Append the target value of 'control', element 'numid', to 'scene' */
+static void state_add_record(alsa_scene_t *scene, size_t *allocated, unsigned int numid, state_control_t *control)
+{
+	state_record_t *record;
+	snd_aes_iec958_t iec958;
+	unsigned int count = control->count, idx;
+	size_t size;
+
+	if (control->type == SND_CTL_ELEM_TYPE_IEC958)
+		count = sizeof(snd_aes_iec958_t);
+	if ((size = state_record_size(control->type, count)) == 0)
+		return;
+	while (scene->length + size > *allocated) {
+		*allocated = *allocated ? *allocated * 2 : 4096;
+		scene->records = g_realloc(scene->records, *allocated);
+	}
+	record = (state_record_t *)(scene->records + scene->length);
+	memset(record, 0, size);
+	record->numid = numid;
+	record->type = control->type;
+	record->count = count;
+	for (idx = 0; idx < count; idx++) {
+		switch (control->type) {
+		case SND_CTL_ELEM_TYPE_BOOLEAN:
+			((gint32 *)(record + 1))[idx] = snd_ctl_elem_value_get_boolean(control->target, idx);
+			break;
+		case SND_CTL_ELEM_TYPE_ENUMERATED:
+			((gint32 *)(record + 1))[idx] = snd_ctl_elem_value_get_enumerated(control->target, idx);
+			break;
+		case SND_CTL_ELEM_TYPE_INTEGER:
+			((gint64 *)(record + 1))[idx] = snd_ctl_elem_value_get_integer(control->target, idx);
+			break;
+		case SND_CTL_ELEM_TYPE_INTEGER64:
+			((gint64 *)(record + 1))[idx] = snd_ctl_elem_value_get_integer64(control->target, idx);
+			break;
+		case SND_CTL_ELEM_TYPE_BYTES:
+			((guint8 *)(record + 1))[idx] = snd_ctl_elem_value_get_byte(control->target, idx);
+			break;
+		default:
+			break;
+		}
+	}
+	if (control->type == SND_CTL_ELEM_TYPE_IEC958) {
+		snd_ctl_elem_value_get_iec958(control->target, &iec958);
+		memcpy(record + 1, &iec958, sizeof(iec958));
+	}
+	scene->length += size;
+}
+
+/* Set the target value of 'control' from 'record', on top of the current one */
+static void state_set_record(state_control_t *control, const state_record_t *record)
+{
+	snd_aes_iec958_t iec958;
+	unsigned int idx;
+
+	control->type = record->type;
+	control->count = record->count;
+	snd_ctl_elem_value_copy(control->target, control->current);
+	for (idx = 0; idx < record->count; idx++) {
+		switch (record->type) {
+		case SND_CTL_ELEM_TYPE_BOOLEAN:
+			snd_ctl_elem_value_set_boolean(control->target, idx, ((const gint32 *)(record + 1))[idx]);
+			break;
+		case SND_CTL_ELEM_TYPE_ENUMERATED:
+			snd_ctl_elem_value_set_enumerated(control->target, idx, ((const gint32 *)(record + 1))[idx]);
+			break;
+		case SND_CTL_ELEM_TYPE_INTEGER:
+			snd_ctl_elem_value_set_integer(control->target, idx, ((const gint64 *)(record + 1))[idx]);
+			break;
+		case SND_CTL_ELEM_TYPE_INTEGER64:
+			snd_ctl_elem_value_set_integer64(control->target, idx, ((const gint64 *)(record + 1))[idx]);
+			break;
+		case SND_CTL_ELEM_TYPE_BYTES:
+			snd_ctl_elem_value_set_byte(control->target, idx, ((const guint8 *)(record + 1))[idx]);
+			break;
+		default:
+			break;
+		}
+	}
+	if (record->type == SND_CTL_ELEM_TYPE_IEC958) {
+		memcpy(&iec958, record + 1, sizeof(iec958));
+		snd_ctl_elem_value_set_iec958(control->target, &iec958);
+	}
+}
+
+/*
+ * Compile the settings in the alsactl-format 'text' (of 'length' bytes)
+ * for the card open on 'handle' into 'scene', whose records are to be
+ * freed with g_free(). The "state.<id>" section for the card is used, or
+ * the only one in 'text' should the card id differ. Returns the number
+ * of elements compiled, or a negative errno.
+ */
+int alsa_state_compile(snd_ctl_t *handle, const char *text, size_t length, alsa_scene_t *scene)
+{
+	snd_ctl_card_info_t *card_info;
+	snd_config_t *top, *state, *card = NULL, *controls, *control;
+	snd_config_iterator_t i, next;
+	snd_input_t *in;
+	state_control_t parsed;
+	const char *key;
+	size_t allocated = 0;
+	int err, compiled = 0;
+
+	scene->records = NULL;
+	scene->length = 0;
+	snd_ctl_card_info_alloca(&card_info);
+	snd_ctl_elem_value_alloca(&parsed.target);
+	snd_ctl_elem_value_alloca(&parsed.current);
+	if ((err = snd_ctl_card_info(handle, card_info)) < 0)
+		return err;
+	if ((err = snd_input_buffer_open(&in, text, length)) < 0)
+		return err;
+	if ((err = snd_config_top(&top)) < 0) {
+		snd_input_close(in);
+		return err;
+	}
+	err = snd_config_load(top, in);
+	snd_input_close(in);
+	if (err < 0) {
+		fprintf(stderr, "Cannot parse ALSA settings: %s\n", snd_strerror(err));
+		goto __config;
+	}
+	if ((err = snd_config_search(top, "state", &state)) < 0)
+		goto __config;
+	if (snd_config_search(state, snd_ctl_card_info_get_id(card_info), &card) < 0) {
+		snd_config_for_each(i, next, state) {
+			if (card != NULL) {	/* more than one card, and none is ours */
+				card = NULL;
+				break;
+			}
+			card = snd_config_iterator_entry(i);
+		}
+		if (card == NULL) {
+			err = -ENOENT;
+			goto __config;
+		}
+	}
+	if ((err = snd_config_search(card, "control", &controls)) < 0)
+		goto __config;
+	snd_config_for_each(i, next, controls) {
+		control = snd_config_iterator_entry(i);
+		snd_ctl_elem_value_clear(parsed.current);
+		if ((err = state_parse_control(handle, control, &parsed)) < 0) {
+			if (snd_config_get_id(control, &key) < 0)
+				key = "?";
+			fprintf(stderr, "Cannot restore control #%s: %s\n", key, snd_strerror(err));
+		}
+		if (err <= 0)
+			continue;
+		state_add_record(scene, &allocated, snd_ctl_elem_value_get_numid(parsed.current), &parsed);
+		compiled++;
+	}
+	err = compiled;
+ __config:
+	snd_config_delete(top);
+	return err;
+}
+
+/*
+ * Bring the card open on 'handle' to the settings of 'scene', writing only
+ * the elements whose value differs. Returns the number of writes issued,
+ * or a negative errno; 'stats' may be NULL.
+ */
+int alsa_state_apply(snd_ctl_t *handle, const alsa_scene_t *scene, alsa_state_stats_t *stats)
+{
+	snd_ctl_elem_value_t *value;
+	state_control_t *controls = NULL;
+	const state_record_t *record;
+	size_t pos, size;
+	guint64 start;
+	int err = 0, step, c, count = 0, allocated = 0, writes = 0;
+
+	for (pos = 0; pos + sizeof(state_record_t) <= scene->length; pos += size) {
+		record = (const state_record_t *)(scene->records + pos);
+		if ((size = state_record_size(record->type, record->count)) == 0 || pos + size > scene->length) {
+			err = -EINVAL;		/* can only be a damaged cache */
+			goto __free;
+		}
+		if (count == allocated) {
+			allocated = allocated ? allocated * 2 : 64;
+			controls = g_renew(state_control_t, controls, allocated);
+		}
+		snd_ctl_elem_value_malloc(&controls[count].target);
+		snd_ctl_elem_value_malloc(&controls[count].current);
+		snd_ctl_elem_value_set_numid(controls[count].current, record->numid);
+		controls[count].readable = snd_ctl_elem_read(handle, controls[count].current) >= 0;
+		state_set_record(&controls[count], record);
+		count++;
+	}
+
+	start = monotonic_usec();
+	for (step = 0; step < STATE_STEPS; step++) {
+		for (c = 0; c < count; c++) {
+			if ((value = state_step_value(&controls[c], step)) == NULL)
+				continue;
+			if ((err = snd_ctl_elem_write(handle, value)) < 0) {
+				fprintf(stderr, "Cannot restore control #%u: %s\n",
+					snd_ctl_elem_value_get_numid(value), snd_strerror(err));
+				continue;
+			}
+			if (value != controls[c].current)
+				snd_ctl_elem_value_copy(controls[c].current, value);
+			writes++;
+		}
+	}
+	if (stats != NULL) {
+		stats->controls = count;
+		stats->writes = writes;
+		stats->usec = monotonic_usec() - start;
+	}
+	err = writes;
+
+ __free:
+	for (c = 0; c < count; c++) {
+		snd_ctl_elem_value_free(controls[c].target);
+		snd_ctl_elem_value_free(controls[c].current);
+	}
+	g_free(controls);
+	return err;
+}
+
+/*
+ * Restore the settings in the alsactl-format 'text' (of 'length' bytes)
+ * to the card open on 'handle': alsa_state_compile() and then
+ * alsa_state_apply(). Returns the number of writes issued, or a negative
+ * errno; 'stats' may be NULL.
+ */
+int alsa_state_restore(snd_ctl_t *handle, const char *text, size_t length, alsa_state_stats_t *stats)
+{
+	alsa_scene_t scene;
+	int err;
+
+	if ((err = alsa_state_compile(handle, text, length, &scene)) >= 0)
+		err = alsa_state_apply(handle, &scene, stats);
+	g_free(scene.records);
+	return err;
+}
+
+/*
+ * A signature of the card's elements, their numids, types and names, to
+ * tell whether scenes compiled earlier still fit the card and driver.
+ */
+int alsa_state_signature(snd_ctl_t *handle, guint64 *signature)
+{
+	snd_ctl_elem_list_t *list;
+	snd_ctl_elem_id_t *id;
+	unsigned int i, numid;
+	const char *name;
+	int err;
+
+	snd_ctl_elem_list_alloca(&list);
+	snd_ctl_elem_id_alloca(&id);
+	if ((err = snd_ctl_elem_list(handle, list)) < 0)
+		return err;
+	if ((err = snd_ctl_elem_list_alloc_space(list, snd_ctl_elem_list_get_count(list))) < 0)
+		return err;
+	if ((err = snd_ctl_elem_list(handle, list)) >= 0) {
+		*signature = ALSA_STATE_HASH_INIT;
+		for (i = 0; i < snd_ctl_elem_list_get_used(list); i++) {
+			snd_ctl_elem_list_get_id(list, i, id);
+			numid = snd_ctl_elem_id_get_numid(id);
+			name = snd_ctl_elem_id_get_name(id);
+			*signature = alsa_state_hash(&numid, sizeof(numid), *signature);
+			*signature = alsa_state_hash(name, strlen(name) + 1, *signature);
+		}
+	}
+	snd_ctl_elem_list_free_space(list);
+	return err;
+}
+
+/* FNV-1a, for the keys of the scene cache */
+guint64 alsa_state_hash(const void *data, size_t length, guint64 hash)
+{
+	const guint8 *byte = data;
+
+	while (length--) {
+		hash ^= *byte++;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
@@ -0,0 +1,219 @@
+/*****************************************************************************
+   ballistics.c - Meter ballistics and timed peak hold for the level meters
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+******************************************************************************/
+
+/*
+ * The meters normally show the raw "Multi Track Peak" values, with the
+ * peak marker held until "Reset Peaks" is pressed. With --meter_mode the
+ * bars instead follow one of the standard meter ballistics, and with
+ * --peak_hold the peak marker falls back after being held for a while.
+ *
+ * Each channel's state lives in flat arrays, and ballistics_process()
+ * updates all 22 channels in a single loop per set of peak values. It is
+ * called either from the peak sampler thread for every frame sampled, or
+ * from envy24control_poll() at 10Hz when the sampler is not running;
+ * never from both, so the state has a single writer.
+ *
+ * Levels are kept in the hardware's linear 0..MAX_METERING_LEVEL units,
+ * as used by the meter drawing tables; the K-System modes integrate the
+ * square of the level and display its root.
+ */
+
+#include <math.h>
+#include "controls.h"
+
+typedef struct {
+	const char *name;
+	double attack;		/* integration time constant, seconds */
+	double release;		/* first-order release time constant, seconds; or */
+	double fallback;	/* constant fall-back rate, dB per second */
+	int power;		/* integrate level squared (RMS) */
+	int reference;		/* K-System 0dB reference, dBFS */
+} meter_mode_t;
+
+/*
+ * PPM type I (DIN 45406) and type II (BBC) per IEC 60268-10: 5 and 10ms
+ * integration; fall-back of 20dB in 1.5s and 24dB in 2.8s. VU: 300ms to
+ * reach 99% of a step, i.e. a time constant of 300ms / ln(100) in both
+ * directions. K-System: RMS with VU-like 300ms averaging, scaled so that
+ * the zone colors reflect the K-12/14/20 reference level.
+ */
+static const meter_mode_t meter_modes[] = {
+	{ "peak", 0.0,   0.0,           0.0,         FALSE, 0 },
+	{ "ppm1", 0.005, 0.0,           20.0 / 1.5,  FALSE, 0 },
+	{ "ppm2", 0.010, 0.0,           24.0 / 2.8,  FALSE, 0 },
+	{ "vu",   0.300 / 4.605, 0.300 / 4.605, 0.0, FALSE, 0 },
+	{ "k12",  0.300 / 4.605, 0.300 / 4.605, 0.0, TRUE, -12 },
+	{ "k14",  0.300 / 4.605, 0.300 / 4.605, 0.0, TRUE, -14 },
+	{ "k20",  0.300 / 4.605, 0.300 / 4.605, 0.0, TRUE, -20 },
+	{ NULL }
+};
+
+static const meter_mode_t *mode = &meter_modes[METER_MODE_PEAK];
+static double hold_time = 0.0;		/* seconds, 0 for infinite hold */
+static double hold_fallback = 0.0;	/* dB per second after hold_time */
+
+/* per-channel state */
+static float level[MULTI_TRACK_PEAK_CHANNELS];
+static float hold[MULTI_TRACK_PEAK_CHANNELS];
+static float hold_left[MULTI_TRACK_PEAK_CHANNELS];
+
+/* coefficients for the period 'coef_dt' between calls */
+static double coef_dt = -1.0;
+static float attack_mul, release_mul, release_add, hold_fall_mul;
+
+static volatile int reset_pending = FALSE;
+
+/* Returns the index into meter_modes[] of 'name', or -1 */
+int ballistics_parse_mode(const char *name)
+{
+	int i;
+
+	for (i = 0; meter_modes[i].name != NULL; i++)
+		if (!strcmp(name, meter_modes[i].name))
+			return i;
+	return -1;
+}
+
+void ballistics_init(int mode_index, int hold_ms, double fallback_db_per_sec)
+{
+	mode = &meter_modes[mode_index];
+	hold_time = hold_ms / 1000.0;
+	hold_fallback = fallback_db_per_sec;
+	coef_dt = -1.0;
+	memset(level, 0, sizeof(level));
+	memset(hold, 0, sizeof(hold));
+	memset(hold_left, 0, sizeof(hold_left));
+}
+
+/*
+ * FALSE when neither ballistics nor timed peak hold is in use, in which
+ * case levelmeters.c displays the raw peak values as it always has.
+ */
+int ballistics_active(void)
+{
+	return (mode != &meter_modes[METER_MODE_PEAK]) || (hold_time > 0.0);
+}
+
+/* Request the peak holds to be cleared, by whichever thread next runs ballistics_process() */
+void ballistics_reset(void)
+{
+	reset_pending = TRUE;
+}
+
+/* dB per second --> per-period multiplier in the linear (or squared) domain */
+static float fallback_multiplier(double db_per_sec, double dt, int power)
+{
+	return pow(10.0, -(db_per_sec * dt * (power ? 2 : 1)) / 20.0);
+}
+
+static void compute_coefficients(double dt)
+{
+	attack_mul = (mode->attack > 0.0) ? 1.0 - exp(-dt / mode->attack) : 1.0;
+	if (mode->release > 0.0) {
+		release_mul = exp(-dt / mode->release);
+		release_add = 1.0 - release_mul;
+	} else if (mode->fallback > 0.0) {
+		release_mul = fallback_multiplier(mode->fallback, dt, FALSE);
+		release_add = 0.0;
+	} else {		/* "peak": follow the input */
+		release_mul = 0.0;
+		release_add = 1.0;
+	}
+	hold_fall_mul = fallback_multiplier(hold_fallback, dt, FALSE);
+	coef_dt = dt;
+}
+
+/*
+ * Feed one set of peak values 'in', taken 'dt' seconds after the previous
+ * set, through the meter ballistics and the peak hold.
+ */
+void ballistics_process(const unsigned char *in, double dt)
+{
+	int i;
+	float x, y, r;
+
+	if (reset_pending) {
+		memset(hold, 0, sizeof(hold));
+		memset(hold_left, 0, sizeof(hold_left));
+		reset_pending = FALSE;
+	}
+	if (dt != coef_dt)
+		compute_coefficients(dt);
+
+	for (i = 0; i < MULTI_TRACK_PEAK_CHANNELS; i++) {
+		x = in[i];
+		/* peak hold, on the raw sample peaks */
+		if (x >= hold[i]) {
+			hold[i] = x;
+			hold_left[i] = hold_time;
+		} else if (hold_time > 0.0) {
+			if (hold_left[i] > 0.0)
+				hold_left[i] -= dt;
+			else if ((hold[i] *= hold_fall_mul) < x)
+				hold[i] = x;
+		}
+		/* bar ballistics */
+		if (mode->power)
+			x *= x;
+		y = level[i];
+		if (x > y)
+			y += (x - y) * attack_mul;
+		else if ((r = y * release_mul + x * release_add) > x)
+			y = r;
+		else
+			y = x;
+		level[i] = y;
+	}
+}
+
+/*
+ * Copy out the current bar levels and held peaks, rounded to the hardware
+ * 0..MAX_METERING_LEVEL scale.
+ */
+void ballistics_get(unsigned char *meter, unsigned char *peak)
+{
+	int i;
+	float y;
+
+	for (i = 0; i < MULTI_TRACK_PEAK_CHANNELS; i++) {
+		y = mode->power ? sqrtf(level[i]) : level[i];
+		meter[i] = (y >= MAX_METERING_LEVEL) ? MAX_METERING_LEVEL : (unsigned char)(y + 0.5);
+		peak[i] = (unsigned char)(hold[i] + 0.5);
+	}
+}
+
+/*
+ * Peak value thresholds above which the peak marker is drawn white, orange
+ * and red. Normally -6dB, -3dB and -1dB; for the K-System modes: 6dB below
+ * the reference, the reference, and 4dB above it.
+ */
+void ballistics_color_thresholds(int *white, int *orange, int *red)
+{
+	double ref;
+
+	if (!mode->power) {
+		*white = 128;
+		*orange = 181;
+		*red = 228;
+		return;
+	}
+	ref = MAX_METERING_LEVEL * pow(10.0, mode->reference / 20.0);
+	*white = (int)(ref * pow(10.0, -6.0 / 20.0));
+	*orange = (int)ref;
+	*red = (int)(ref * pow(10.0, 4.0 / 20.0));
+}
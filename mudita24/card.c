@@ -0,0 +1,179 @@
+/*****************************************************************************
+   card.c - Find and open the Envy24 card
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+******************************************************************************/
+
+/*
+ * The card's control handle and what its EEPROM says about it, for the
+ * daemon and the GUI alike; a GUI that is a client of the daemon has no
+ * handle, and learns the rest from card_unpack(). The numbers of channels
+ * are those shown in the window; the daemon leaves them at the maximum,
+ * so that it serves whatever the card has.
+ */
+
+#include "controls.h"
+#include "ctlserver.h"
+
+int input_channels = MAX_INPUT_CHANNELS;
+int output_channels = MAX_OUTPUT_CHANNELS;
+int pcm_output_channels = MAX_PCM_OUTPUT_CHANNELS;
+int spdif_channels = MAX_SPDIF_CHANNELS;
+int view_spdif_playback = 0;
+int card_number = 0;
+int card_is_dmx6fire = FALSE;
+int card_has_delta_iec958_input_status = FALSE; /* NPM added to support "Delta IEC958 Input Status" */
+
+ice1712_eeprom_t card_eeprom;
+snd_ctl_t *ctl;
+
+static char card_ctl_name[64];
+static char *card_long_name = NULL;
+
+/* The number of the first ICE1712 card, or -ENODEV */
+int card_find(void)
+{
+	snd_ctl_card_info_t *hw_info;
+	snd_ctl_t *handle;
+	char ctl_name[16];
+	int number, found;
+
+	snd_ctl_card_info_alloca(&hw_info);
+	/* FIXME: hardcoded max number of cards */
+	for (number = 0; number < 8; number++) {
+		sprintf(ctl_name, "hw:%d", number);
+		if (snd_ctl_open(&handle, ctl_name, 0) < 0)
+			continue;
+		found = snd_ctl_card_info(handle, hw_info) >= 0 &&
+			!strcmp(snd_ctl_card_info_get_driver(hw_info), "ICE1712");
+		snd_ctl_close(handle);
+		if (found)
+			return number;
+	}
+	return -ENODEV;
+}
+
+/*
+ * Open the control device 'name', or the first ICE1712 card if NULL, and
+ * read its EEPROM. Returns 0, or -1 after saying why not.
+ */
+int card_open(const char *name)
+{
+	snd_ctl_card_info_t *hw_info;
+	snd_ctl_elem_value_t *val;
+	int err;
+
+	snd_ctl_card_info_alloca(&hw_info);
+	snd_ctl_elem_value_alloca(&val);
+
+	if (! name) {
+		/* probe cards */
+		if ((card_number = card_find()) < 0) {
+			fprintf(stderr, "No ICE1712 cards found\n");
+			return -1;
+		}
+		sprintf(card_ctl_name, "hw:%d", card_number);
+	} else
+		g_strlcpy(card_ctl_name, name, sizeof(card_ctl_name));
+	if ((err = snd_ctl_open(&ctl, card_ctl_name, 0)) < 0) {
+		fprintf(stderr, "snd_ctl_open: %s\n", snd_strerror(err));
+		return -1;
+	}
+	if ((err = snd_ctl_card_info(ctl, hw_info)) < 0) {
+		fprintf(stderr, "snd_ctl_card_info: %s\n", snd_strerror(err));
+		return -1;
+	}
+	if (strcmp(snd_ctl_card_info_get_driver(hw_info), "ICE1712")) {
+		fprintf(stderr, "invalid card type (driver is %s)\n", snd_ctl_card_info_get_driver(hw_info));
+		return -1;
+	}
+	card_long_name = g_strdup(snd_ctl_card_info_get_longname(hw_info));
+
+	snd_ctl_elem_value_set_interface(val, SND_CTL_ELEM_IFACE_CARD);
+	snd_ctl_elem_value_set_name(val, "ICE1712 EEPROM");
+	if ((err = snd_ctl_elem_read(ctl, val)) < 0) {
+		fprintf(stderr, "Unable to read EEPROM contents: %s\n", snd_strerror(err));
+		return -1;
+	}
+	memcpy(&card_eeprom, snd_ctl_elem_value_get_bytes(val), 32);
+
+	if(card_eeprom.subvendor == ICE1712_SUBDEVICE_DMX6FIRE)
+		card_is_dmx6fire = TRUE;
+
+	/* NPM: determine if "Delta IEC958 Input Status" available
+	   excluding ICE1712_SUBDEVICE_DELTA44 since it has no IEC958 in */
+	if ((card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTA1010
+	     || card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTA1010LT
+	     || card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTA66
+	     || card_eeprom.subvendor == ICE1712_SUBDEVICE_AUDIOPHILE
+	     || card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTADIO2496
+	     || card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTA410))
+	  card_has_delta_iec958_input_status = TRUE;
+	return 0;
+}
+
+/* The control device opened, for the handles of the worker threads */
+const char *card_name(void)
+{
+	return card_ctl_name;
+}
+
+/* e.g. "M Audio Delta 66 at 0xd800, irq 19", for the window title */
+const char *card_longname(void)
+{
+	return card_long_name != NULL ? card_long_name : "";
+}
+
+/*
+ * The card as at most 'max' numbers for CTL_MSG_CARD: its number, the
+ * CTL_CARD_* flags, the EEPROM and the long name. Returns how many.
+ */
+int card_pack(gint32 *values, int max)
+{
+	int eeprom = sizeof(card_eeprom) / sizeof(gint32);
+
+	if (max < 2 + eeprom)
+		return 0;
+	values[0] = card_number;
+	values[1] = (card_is_dmx6fire ? CTL_CARD_DMX6FIRE : 0) |
+		    (card_has_delta_iec958_input_status ? CTL_CARD_IEC958_STATUS : 0);
+	memcpy(values + 2, &card_eeprom, sizeof(card_eeprom));
+	return 2 + eeprom + ctl_pack_string(card_longname(), values + 2 + eeprom, max - 2 - eeprom);
+}
+
+/* Take the card to be the one described by card_pack() of mudita24d */
+void card_unpack(const gint32 *values, int count)
+{
+	int eeprom = sizeof(card_eeprom) / sizeof(gint32);
+	char name[CTL_MESSAGE_MAX_VALUES * sizeof(gint32) + 1];
+
+	if (count < 2 + eeprom)
+		return;
+	card_number = values[0];
+	card_is_dmx6fire = (values[1] & CTL_CARD_DMX6FIRE) != 0;
+	card_has_delta_iec958_input_status = (values[1] & CTL_CARD_IEC958_STATUS) != 0;
+	memcpy(&card_eeprom, values + 2, sizeof(card_eeprom));
+	ctl_unpack_string(name, sizeof(name), values + 2 + eeprom, count - 2 - eeprom);
+	g_free(card_long_name);
+	card_long_name = g_strdup(name);
+}
+
+void card_close(void)
+{
+	if (ctl != NULL)
+		snd_ctl_close(ctl);
+	g_free(card_long_name);
+	card_long_name = NULL;
+}
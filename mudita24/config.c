@@ -1,5 +1,5 @@
-#include <gtk/gtk.h>
-#include "envy24control.h"
+#include "controls.h"
+#include "midi.h"
 
 #if GLIB_CHECK_VERSION(2,2,0)
 
@@ -17,9 +17,20 @@ gchar *config_filename;
 
 void config_open()
 {
+  gint i;
+  gsize len=0;
+  gboolean *s;
   config_filename=g_strdup_printf("%s/%s", g_get_user_config_dir(), "envy24control");
   config_file=g_key_file_new();
   g_key_file_load_from_file(config_file, config_filename, G_KEY_FILE_KEEP_COMMENTS, NULL);
+  s=g_key_file_get_boolean_list(config_file, "mixer", "stereo", &len, NULL);
+  if(s)
+    {
+      for(i=0; i!=len && i!=sizeof(config_stereo)/sizeof(config_stereo[0]); ++i)
+	config_stereo[i]=s[i];
+      g_free(s);
+    }
+  midi_learn_load(config_file);
 }
 
 void config_close()
@@ -28,6 +39,7 @@ void config_close()
   gchar *s;
   g_key_file_set_boolean_list(config_file, "mixer", "stereo",
 			      config_stereo, sizeof(config_stereo)/sizeof(config_stereo[0]));
+  midi_learn_save(config_file);
   s=g_key_file_to_data(config_file, &len, NULL);
   if(s && len)
     {
@@ -44,24 +56,16 @@ void config_close()
   g_key_file_free(config_file); config_file=0;
 }
 
-void config_set_stereo(GtkWidget *but, gpointer data)
+/* The "L/R Gang" of 'stream' changed, to be saved */
+void config_set_stereo(int stream, int on)
 {
-  gint i=(gint)((long)data); /* NPM: "(gint)((long)data)" suppress "config.c:49: warning: cast from pointer to integer of different size" */
-  config_stereo[i]=GTK_TOGGLE_BUTTON(but)->active;
+  config_stereo[stream-1]=on;
 }
 
-void config_restore_stereo()
+/* The "L/R Gang" of 'stream' as saved, for the mixer to start from with or without the toggles */
+int config_get_stereo(int stream)
 {
-  gint i;
-  gsize len=0;
-  gboolean *s=g_key_file_get_boolean_list(config_file, "mixer", "stereo", &len, NULL);
-  if(s)
-      for(i=0; i!=len; ++i)
-	{
-	  config_stereo[i]=s[i];
-	  if(mixer_stereo_toggle[i])
-	    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(mixer_stereo_toggle[i]), s[i]);
-	}
+  return config_stereo[stream-1];
 }
 
 #else
@@ -69,7 +73,7 @@ void config_restore_stereo()
 /* to be done */
 void config_open() { }
 void config_close() { }
-void config_set_stereo(GtkWidget *but, gpointer data) { }
-void config_restore_stereo() { }
+void config_set_stereo(int stream, int on) { }
+int config_get_stereo(int stream) { return FALSE; }
 
 #endif
@@ -3,7 +3,7 @@
 
 void config_open();
 void config_close();
-void config_set_stereo(GtkWidget *but, gpointer data);
-void config_restore_stereo();
+void config_set_stereo(int stream, int on);
+int config_get_stereo(int stream);
 
 #endif
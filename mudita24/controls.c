@@ -0,0 +1,727 @@
+/*****************************************************************************
+   controls.c - Numid resolution of the card's controls
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+******************************************************************************/
+
+/*
+ * An element addressed by interface, name and index makes the kernel
+ * search the card's control list by name on every read and write. An
+ * element addressed by numid is found directly. controls_init() lists the
+ * card's controls once with snd_ctl_elem_list() and, for each control
+ * used by this program, keeps the complete element id (including the
+ * numid) and a preallocated snd_ctl_elem_value_t per index. Everything
+ * else reads and writes through control_value(), so that slider drags
+ * and event storms never touch a control name.
+ *
+ * A control or index the card doesn't have is still given a value,
+ * addressed by name as before, so that reading it fails the same way it
+ * always did.
+ *
+ * The values double as a shadow of the card's state: each is read once by
+ * controls_init(), and control_event() re-reads one whenever the driver
+ * reports that it changed. control_read() therefore costs nothing for a
+ * shadowed control, a write is made straight from the shadow with
+ * control_write() without first reading the other channels back, and
+ * the GUI refreshes from memory. Controls whose value changes without a
+ * control event (status, clock and meter readings) are never shadowed
+ * and are read from the card every time.
+ *
+ * Fader drags and MIDI sweeps change a volume far more often than is
+ * worth writing it, each write also echoing back as a control event.
+ * They use control_queue() instead of control_write(): the control is
+ * marked dirty, and controls_flush() writes whatever value each dirty
+ * control has by then, at most once every --write_interval ms, as soon as
+ * a scale is released, and before profiles are saved or restored and on
+ * exit, so the final value always lands. While a control is dirty, its
+ * shadow is not refreshed from events: the pending value wins. Setting
+ * the environment variable MUDITA24_WRITE_STATS reports the number of
+ * writes submitted and issued every ten seconds and on exit.
+ *
+ * A burst of changes decoded together, such as the MIDI events read in one
+ * go, is queued between controls_batch_begin() and controls_batch_end(),
+ * so that none of it is written before the rest has been queued.
+ *
+ * A GUI that is a client of mudita24d (see ctlclient.c) has no 'ctl' at
+ * all. Its entries are described by the daemon instead of by the card:
+ * ranges, dB scales and item names all come over the socket when it
+ * connects, the shadow is kept up to date from the daemon's changes, a
+ * write sends the value there, and a control that isn't shadowed is read
+ * by asking for it, its value arriving a little later.
+ */
+
+#include "controls.h"
+#include "midi.h"
+
+#define IEC958_STATUS_VALUES 6	/* 24 status bytes, packed */
+#define CONTROL_TLV_SIZE 64	/* unsigned ints read of a control's TLV */
+
+typedef struct {
+	const char *name;
+	snd_ctl_elem_iface_t iface;
+	int polled;		/* changes without a control event; always read from the card */
+} control_desc_t;
+
+/* indexed by control_t */
+static const control_desc_t control_descs[CTL_COUNT] = {
+	[CTL_MULTI_PLAYBACK_SWITCH]	  = { "Multi Playback Switch",		SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_MULTI_PLAYBACK_VOLUME]	  = { "Multi Playback Volume",		SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_HW_MULTI_CAPTURE_SWITCH]	  = { "H/W Multi Capture Switch",	SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_HW_MULTI_CAPTURE_VOLUME]	  = { "H/W Multi Capture Volume",	SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_IEC958_MULTI_CAPTURE_SWITCH] = { "IEC958 Multi Capture Switch",	SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_IEC958_MULTI_CAPTURE_VOLUME] = { "IEC958 Multi Capture Volume",	SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_HW_PLAYBACK_ROUTE]		  = { "H/W Playback Route",		SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_IEC958_PLAYBACK_ROUTE]	  = { "IEC958 Playback Route",		SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_DAC_VOLUME]		  = { "DAC Volume",			SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_ADC_VOLUME]		  = { "ADC Volume",			SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_IPGA_VOLUME]		  = { "IPGA Analog Capture Volume",	SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_DAC_SENSE]			  = { "Output Sensitivity Switch",	SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_ADC_SENSE]			  = { "Input Sensitivity Switch",	SND_CTL_ELEM_IFACE_MIXER },
+	/* follows the rate set by PCM applications, without a control event */
+	[CTL_INTERNAL_CLOCK]		  = { "Multi Track Internal Clock",	SND_CTL_ELEM_IFACE_MIXER, TRUE },
+	[CTL_INTERNAL_CLOCK_DEFAULT]	  = { "Multi Track Internal Clock Default", SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_WORD_CLOCK_SYNC]		  = { "Word Clock Sync",		SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_WORD_CLOCK_STATUS]		  = { "Word Clock Status",		SND_CTL_ELEM_IFACE_MIXER, TRUE },
+	[CTL_RATE_LOCKING]		  = { "Multi Track Rate Locking",	SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_RATE_RESET]		  = { "Multi Track Rate Reset",		SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_VOLUME_RATE]		  = { "Multi Track Volume Rate",	SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_IEC958_INPUT_OPTICAL]	  = { "IEC958 Input Optical",		SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_OPTICAL_DIGITAL_INPUT]	  = { "Optical Digital Input Switch",	SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_FRONT_DIGITAL_INPUT]	  = { "Front Digital Input Switch",	SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_IEC958_PLAYBACK_DEFAULT]	  = { "IEC958 Playback Default",	SND_CTL_ELEM_IFACE_PCM },
+	[CTL_ANALOG_INPUT_SELECT]	  = { "Analog Input Select",		SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_BREAKBOX_LED]		  = { "Breakbox LED",			SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_PHONO_INPUT]		  = { "Phono Analog Input Switch",	SND_CTL_ELEM_IFACE_MIXER },
+	[CTL_IEC958_INPUT_STATUS]	  = { "Delta IEC958 Input Status",	SND_CTL_ELEM_IFACE_MIXER, TRUE },
+	/* PCM; older ALSA drivers register it as MIXER, so matched by name alone */
+	[CTL_MULTI_TRACK_PEAK]		  = { "Multi Track Peak",		SND_CTL_ELEM_IFACE_PCM, TRUE },
+};
+
+typedef struct {
+	control_t control;
+	int index;
+	snd_ctl_elem_id_t *id;
+	snd_ctl_elem_value_t *value;
+	int shadowed;		/* 'value' is kept equal to the card's */
+	int queued;		/* 'value' is waiting in write_queue[] */
+	int ranged;		/* 'range' was read */
+	control_range_t range;
+	int scaled;		/* 'db_scale' was looked for */
+	unsigned int *db_scale;	/* the dB scale's TLV record, NULL if none */
+	int db_scale_len;	/* in unsigned ints */
+	char **items;		/* item names of an enumeration, as read */
+} control_entry_t;
+
+static control_entry_t controls[CTL_COUNT][MAX_CONTROL_INDEX];
+static control_entry_t **controls_by_numid;	/* resolved entries, indexed by numid */
+static unsigned int max_numid;
+
+#define WRITE_STATS_PERIOD 10000 /* ms */
+static control_entry_t *write_queue[CTL_COUNT * MAX_CONTROL_INDEX];
+static int write_queued = 0;
+static int write_interval = DEFAULT_WRITE_INTERVAL; /* ms */
+static guint write_timeout = 0;
+static gint64 last_flush = 0, last_stats = 0; /* ms */
+static unsigned long writes_submitted = 0, writes_issued = 0;
+static int write_stats = FALSE;
+static int write_batch = 0;	/* nesting of controls_batch_begin() */
+
+static void control_alloc(control_entry_t *entry, control_t c, int index)
+{
+	if (snd_ctl_elem_id_malloc(&entry->id) < 0 ||
+	    snd_ctl_elem_value_malloc(&entry->value) < 0) {
+		g_print("Cannot allocate memory\n");
+		exit(1);
+	}
+	entry->control = c;
+	entry->index = index;
+}
+
+/* The control named 'name', or -1 */
+int control_lookup(const char *name)
+{
+	int c;
+
+	for (c = 0; c < CTL_COUNT; c++)
+		if (!strcmp(name, control_descs[c].name))
+			return c;
+	return -1;
+}
+
+/* Read the initial value of a resolved entry, and shadow it from then on if possible */
+static void control_shadow(control_t c, control_entry_t *entry)
+{
+	snd_ctl_elem_info_t *info;
+
+	snd_ctl_elem_info_alloca(&info);
+	snd_ctl_elem_info_set_id(info, entry->id);
+	if (control_descs[c].polled ||
+	    snd_ctl_elem_info(ctl, info) < 0 ||
+	    snd_ctl_elem_info_is_volatile(info) ||
+	    !snd_ctl_elem_info_is_readable(info))
+		return;
+	entry->shadowed = (snd_ctl_elem_read(ctl, entry->value) >= 0);
+}
+
+/*
+ * List the card's controls, resolve those in control_descs[] to their
+ * numids and read their current values. Call once, after 'ctl' is opened
+ * and before any *_init(). Queued writes are flushed at most every
+ * 'interval' ms.
+ */
+void controls_init(int interval)
+{
+	snd_ctl_elem_list_t *list;
+	control_entry_t *entry;
+	unsigned int i, index, numid;
+	int err, c;
+
+	write_interval = interval;
+	write_stats = (getenv("MUDITA24_WRITE_STATS") != NULL);
+	if (ctlclient_connected())
+		return;		/* the entries are described by the daemon */
+	snd_ctl_elem_list_alloca(&list);
+	if ((err = snd_ctl_elem_list(ctl, list)) < 0 ||
+	    (err = snd_ctl_elem_list_alloc_space(list, snd_ctl_elem_list_get_count(list))) < 0 ||
+	    (err = snd_ctl_elem_list(ctl, list)) < 0) {
+		g_print("Unable to list controls: %s\n", snd_strerror(err));
+		return;
+	}
+	for (i = 0; i < snd_ctl_elem_list_get_used(list); i++)
+		if ((numid = snd_ctl_elem_list_get_numid(list, i)) > max_numid)
+			max_numid = numid;
+	controls_by_numid = g_new0(control_entry_t *, max_numid + 1);
+	for (i = 0; i < snd_ctl_elem_list_get_used(list); i++) {
+		if ((c = control_lookup(snd_ctl_elem_list_get_name(list, i))) < 0)
+			continue;
+		index = snd_ctl_elem_list_get_index(list, i);
+		if (index >= MAX_CONTROL_INDEX)
+			continue;
+		entry = &controls[c][index];
+		control_alloc(entry, c, index);
+		snd_ctl_elem_list_get_id(list, i, entry->id);
+		snd_ctl_elem_value_set_id(entry->value, entry->id);
+		controls_by_numid[snd_ctl_elem_list_get_numid(list, i)] = entry;
+		control_shadow(c, entry);
+	}
+	snd_ctl_elem_list_free_space(list);
+}
+
+/* The entry for 'index' of control 'c'; addressed by name if not on the card */
+static control_entry_t *control_entry(control_t c, int index)
+{
+	control_entry_t *entry;
+
+	assert(c >= 0 && c < CTL_COUNT && index >= 0 && index < MAX_CONTROL_INDEX);
+	entry = &controls[c][index];
+	if (entry->value == NULL) {
+		control_alloc(entry, c, index);
+		snd_ctl_elem_id_set_interface(entry->id, control_descs[c].iface);
+		snd_ctl_elem_id_set_name(entry->id, control_descs[c].name);
+		snd_ctl_elem_id_set_index(entry->id, index);
+		snd_ctl_elem_value_set_id(entry->value, entry->id);
+	}
+	return entry;
+}
+
+/*
+ * The shadow value for 'index' of control 'c'. It is shared by all users
+ * of that control: call control_read() before relying on its contents,
+ * and control_write() after changing them.
+ */
+snd_ctl_elem_value_t *control_value(control_t c, int index)
+{
+	return control_entry(c, index)->value;
+}
+
+/* The element id for 'index' of control 'c', e.g. for snd_ctl_convert_to_dB() */
+snd_ctl_elem_id_t *control_id(control_t c, int index)
+{
+	return control_entry(c, index)->id;
+}
+
+const char *control_name(control_t c)
+{
+	return control_descs[c].name;
+}
+
+/*
+ * TRUE when the driver sends an event whenever 'index' of control 'c'
+ * changes, so that it never needs polling; FALSE for status, volatile and
+ * missing controls, which only a read from the card brings up to date.
+ */
+int control_notifies(control_t c, int index)
+{
+	return control_entry(c, index)->shadowed;
+}
+
+/*
+ * The type, number of channels and range of 'index' of control 'c', read
+ * from the card the first time only; the type is SND_CTL_ELEM_TYPE_NONE
+ * if the card does not have it.
+ */
+const control_range_t *control_range(control_t c, int index)
+{
+	control_entry_t *entry = control_entry(c, index);
+	control_range_t *r = &entry->range;
+	snd_ctl_elem_info_t *info;
+
+	if (entry->ranged || ctlclient_connected())
+		return r;	/* SND_CTL_ELEM_TYPE_NONE unless described */
+	entry->ranged = TRUE;
+	r->type = SND_CTL_ELEM_TYPE_NONE;
+	snd_ctl_elem_info_alloca(&info);
+	snd_ctl_elem_info_set_id(info, entry->id);
+	if (snd_ctl_elem_info(ctl, info) < 0)
+		return r;
+	r->type = snd_ctl_elem_info_get_type(info);
+	r->count = snd_ctl_elem_info_get_count(info);
+	r->writable = snd_ctl_elem_info_is_writable(info);
+	switch (r->type) {
+	case SND_CTL_ELEM_TYPE_INTEGER:
+		r->min = snd_ctl_elem_info_get_min(info);
+		r->max = snd_ctl_elem_info_get_max(info);
+		break;
+	case SND_CTL_ELEM_TYPE_ENUMERATED:
+		r->min = 0;
+		r->max = (long)snd_ctl_elem_info_get_items(info) - 1;
+		break;
+	default:
+		r->min = 0;
+		r->max = 1;
+		break;
+	}
+	return r;
+}
+
+/*
+ * 'channel' of the value of 'index' of control 'c' as a number, whatever
+ * its type; call control_read() first.
+ */
+long control_get(control_t c, int index, int channel)
+{
+	snd_ctl_elem_value_t *val = control_entry(c, index)->value;
+
+	switch (control_range(c, index)->type) {
+	case SND_CTL_ELEM_TYPE_BOOLEAN:
+		return snd_ctl_elem_value_get_boolean(val, channel);
+	case SND_CTL_ELEM_TYPE_ENUMERATED:
+		return snd_ctl_elem_value_get_enumerated(val, channel);
+	default:
+		return snd_ctl_elem_value_get_integer(val, channel);
+	}
+}
+
+/*
+ * Set 'channel' of the value of 'index' of control 'c' to 'v', within its
+ * range. Returns TRUE if that changed it; control_queue() or
+ * control_write() it then.
+ */
+int control_set(control_t c, int index, int channel, long v)
+{
+	const control_range_t *r = control_range(c, index);
+	snd_ctl_elem_value_t *val = control_entry(c, index)->value;
+
+	if (channel < 0 || channel >= r->count)
+		return FALSE;
+	v = CLAMP(v, r->min, r->max);
+	if (v == control_get(c, index, channel))
+		return FALSE;
+	switch (r->type) {
+	case SND_CTL_ELEM_TYPE_BOOLEAN:
+		snd_ctl_elem_value_set_boolean(val, channel, v);
+		return TRUE;
+	case SND_CTL_ELEM_TYPE_INTEGER:
+		snd_ctl_elem_value_set_integer(val, channel, v);
+		return TRUE;
+	case SND_CTL_ELEM_TYPE_ENUMERATED:
+		snd_ctl_elem_value_set_enumerated(val, channel, v);
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/*
+ * The value of 'index' of control 'c' as at most 'max' numbers, for the
+ * control socket; call control_read() first. Returns how many.
+ */
+int control_pack(control_t c, int index, gint32 *values, int max)
+{
+	const control_range_t *r = control_range(c, index);
+	snd_aes_iec958_t iec958;
+	int i, count;
+
+	if (r->type == SND_CTL_ELEM_TYPE_IEC958) {
+		snd_ctl_elem_value_get_iec958(control_entry(c, index)->value, &iec958);
+		count = MIN(IEC958_STATUS_VALUES, max);
+		memcpy(values, iec958.status, count * sizeof(gint32));
+		return count;
+	}
+	count = MIN(r->count, max);
+	for (i = 0; i < count; i++)
+		values[i] = control_get(c, index, i);
+	return count;
+}
+
+/*
+ * Set channels 'first'... of 'index' of control 'c' to 'count' numbers as
+ * packed by control_pack(). Returns TRUE if that changed its value.
+ */
+int control_unpack(control_t c, int index, int first, const gint32 *values, int count)
+{
+	snd_ctl_elem_value_t *val = control_entry(c, index)->value;
+	snd_aes_iec958_t iec958;
+	int i, changed = FALSE;
+
+	if (control_range(c, index)->type == SND_CTL_ELEM_TYPE_IEC958) {
+		if (first < 0 || first >= IEC958_STATUS_VALUES)
+			return FALSE;
+		count = MIN(count, IEC958_STATUS_VALUES - first);
+		snd_ctl_elem_value_get_iec958(val, &iec958);
+		if (!memcmp(iec958.status + first * sizeof(gint32), values, count * sizeof(gint32)))
+			return FALSE;
+		memcpy(iec958.status + first * sizeof(gint32), values, count * sizeof(gint32));
+		snd_ctl_elem_value_set_iec958(val, &iec958);
+		return TRUE;
+	}
+	for (i = 0; i < count; i++)
+		changed |= control_set(c, index, first + i, values[i]);
+	return changed;
+}
+
+/*
+ * mudita24d sent the value of 'index' of control 'c': update the shadow,
+ * unless a write of ours is queued. Returns TRUE if that changed it.
+ */
+int control_received(control_t c, int index, const gint32 *values, int count)
+{
+	if (control_entry(c, index)->queued)
+		return FALSE;
+	return control_unpack(c, index, 0, values, count);
+}
+
+/* Look for the dB scale of 'entry' on the card, once */
+static void control_scale(control_entry_t *entry)
+{
+	snd_ctl_elem_info_t *info;
+	unsigned int tlv[CONTROL_TLV_SIZE], *rec;
+	int len;
+
+	if (entry->scaled || ctlclient_connected())
+		return;
+	entry->scaled = TRUE;
+	snd_ctl_elem_info_alloca(&info);
+	snd_ctl_elem_info_set_id(info, entry->id);
+	if (snd_ctl_elem_info(ctl, info) < 0 || !snd_ctl_elem_info_is_tlv_readable(info) ||
+	    snd_ctl_elem_tlv_read(ctl, entry->id, tlv, sizeof(tlv)) < 0 ||
+	    (len = snd_tlv_parse_dB_info(tlv, sizeof(tlv), &rec)) <= 0)
+		return;
+	entry->db_scale_len = MIN(len / sizeof(unsigned int), CONTROL_TLV_SIZE);
+	entry->db_scale = g_malloc(entry->db_scale_len * sizeof(unsigned int));
+	memcpy(entry->db_scale, rec, entry->db_scale_len * sizeof(unsigned int));
+}
+
+/*
+ * 'value' of 'index' of control 'c' in 0.01 dB, by its dB scale, like
+ * snd_ctl_convert_to_dB(); a negative error if it has none.
+ */
+int control_db(control_t c, int index, long value, long *db)
+{
+	control_entry_t *entry = control_entry(c, index);
+	const control_range_t *r = control_range(c, index);
+
+	control_scale(entry);
+	if (entry->db_scale == NULL)
+		return -EINVAL;
+	return snd_tlv_convert_to_dB(entry->db_scale, r->min, r->max, value, db);
+}
+
+/* The range of 'index' of control 'c' in 0.01 dB, like snd_ctl_get_dB_range() */
+int control_db_range(control_t c, int index, long *min, long *max)
+{
+	control_entry_t *entry = control_entry(c, index);
+	const control_range_t *r = control_range(c, index);
+
+	control_scale(entry);
+	if (entry->db_scale == NULL)
+		return -EINVAL;
+	return snd_tlv_get_dB_range(entry->db_scale, r->min, r->max, min, max);
+}
+
+/* The value of 'index' of control 'c' nearest 'db', like snd_ctl_convert_from_dB() */
+int control_from_db(control_t c, int index, long db, long *value, int xdir)
+{
+	control_entry_t *entry = control_entry(c, index);
+	const control_range_t *r = control_range(c, index);
+
+	control_scale(entry);
+	if (entry->db_scale == NULL)
+		return -EINVAL;
+	return snd_tlv_convert_from_dB(entry->db_scale, r->min, r->max, db, value, xdir);
+}
+
+/* The name of 'item' of the enumeration 'index' of control 'c', or NULL */
+const char *control_item_name(control_t c, int index, int item)
+{
+	control_entry_t *entry = control_entry(c, index);
+	const control_range_t *r = control_range(c, index);
+	snd_ctl_elem_info_t *info;
+	int i;
+
+	if (r->type != SND_CTL_ELEM_TYPE_ENUMERATED || item < 0 || item > r->max)
+		return NULL;
+	if (entry->items == NULL && !ctlclient_connected()) {
+		entry->items = g_new0(char *, r->max + 1);
+		snd_ctl_elem_info_alloca(&info);
+		snd_ctl_elem_info_set_id(info, entry->id);
+		for (i = 0; i <= r->max; i++) {
+			snd_ctl_elem_info_set_item(info, i);
+			if (snd_ctl_elem_info(ctl, info) >= 0)
+				entry->items[i] = g_strdup(snd_ctl_elem_info_get_item_name(info));
+		}
+	}
+	return entry->items != NULL ? entry->items[item] : NULL;
+}
+
+/*
+ * What control_range(), control_notifies() and the dB scale report of
+ * 'index' of control 'c', as at most 'max' numbers for CTL_MSG_INFO.
+ * Returns how many.
+ */
+int control_pack_info(control_t c, int index, gint32 *values, int max)
+{
+	control_entry_t *entry = control_entry(c, index);
+	const control_range_t *r = control_range(c, index);
+	int len;
+
+	values[0] = r->type;
+	if (r->type == SND_CTL_ELEM_TYPE_NONE || max < 6)
+		return 1;
+	values[1] = r->count;
+	values[2] = r->writable;
+	values[3] = entry->shadowed;
+	values[4] = r->min;
+	values[5] = r->max;
+	control_scale(entry);
+	len = entry->db_scale_len <= max - 6 ? entry->db_scale_len : 0;
+	memcpy(values + 6, entry->db_scale, len * sizeof(gint32));
+	return 6 + len;
+}
+
+/* Describe 'index' of control 'c' by the numbers of control_pack_info() */
+void control_unpack_info(control_t c, int index, const gint32 *values, int count)
+{
+	control_entry_t *entry = control_entry(c, index);
+	control_range_t *r = &entry->range;
+
+	entry->ranged = entry->scaled = TRUE;
+	r->type = count >= 6 ? values[0] : SND_CTL_ELEM_TYPE_NONE;
+	if (r->type == SND_CTL_ELEM_TYPE_NONE)
+		return;
+	r->count = values[1];
+	r->writable = values[2];
+	entry->shadowed = values[3];
+	r->min = values[4];
+	r->max = values[5];
+	g_free(entry->db_scale);
+	entry->db_scale = NULL;
+	if ((entry->db_scale_len = count - 6) > 0) {
+		entry->db_scale = g_malloc(entry->db_scale_len * sizeof(unsigned int));
+		memcpy(entry->db_scale, values + 6, entry->db_scale_len * sizeof(unsigned int));
+	}
+	if (r->type == SND_CTL_ELEM_TYPE_ENUMERATED && entry->items == NULL)
+		entry->items = g_new0(char *, r->max + 1);
+}
+
+/* Name 'item' of the enumeration 'index' of control 'c', as described by the daemon */
+void control_unpack_item(control_t c, int index, int item, const char *name)
+{
+	control_entry_t *entry = control_entry(c, index);
+
+	if (entry->items == NULL || item < 0 || item > entry->range.max)
+		return;
+	g_free(entry->items[item]);
+	entry->items[item] = g_strdup(name);
+}
+
+
+/*
+ * Bring the value of 'index' of control 'c' up to date. Free for shadowed
+ * controls; otherwise the result of reading it from the card.
+ */
+int control_read(control_t c, int index)
+{
+	control_entry_t *entry = control_entry(c, index);
+
+	if (entry->shadowed || entry->queued)
+		return 0;
+	if (ctlclient_connected()) {
+		if (entry->range.type == SND_CTL_ELEM_TYPE_NONE)
+			return -ENOENT;
+		ctlclient_read(c, index);	/* the value is that of the last answer */
+		return 0;
+	}
+	return snd_ctl_elem_read(ctl, entry->value);
+}
+
+static int control_entry_write(control_entry_t *entry)
+{
+	int err;
+
+	if (ctlclient_connected())
+		return ctlclient_write(entry->control, entry->index);
+	if ((err = snd_ctl_elem_write(ctl, entry->value)) < 0 && entry->shadowed)
+		snd_ctl_elem_read(ctl, entry->value);
+	return err;
+}
+
+/*
+ * Write the value of 'index' of control 'c' to the card. Should the write
+ * fail, the shadow is re-read so that it keeps matching the card.
+ */
+int control_write(control_t c, int index)
+{
+	midi_learn_control(c, index);
+	return control_entry_write(control_entry(c, index));
+}
+
+/*
+ * Called for each control event, before it is dispatched: update the
+ * shadow of element 'numid'. Returns TRUE and sets 'c' and 'index' when
+ * 'numid' is one of control_descs[], FALSE for elements we do not use.
+ */
+int control_event(unsigned int numid, control_t *c, int *index)
+{
+	control_entry_t *entry;
+
+	if (numid > max_numid || (entry = controls_by_numid[numid]) == NULL)
+		return FALSE;
+	*c = entry->control;
+	*index = entry->index;
+	if (entry->shadowed && !entry->queued &&
+	    snd_ctl_elem_read(ctl, entry->value) < 0)
+		entry->shadowed = FALSE;	/* e.g. removed; read it on demand from now on */
+	return TRUE;
+}
+
+/*
+ * Run 'func' on the main loop whenever 'fd' is ready for 'condition', for
+ * as long as it returns TRUE or until g_source_remove() of the id returned.
+ */
+guint watch_fd(int fd, GIOCondition condition, GIOFunc func, gpointer data)
+{
+	GIOChannel *channel = g_io_channel_unix_new(fd);
+	guint id = g_io_add_watch(channel, condition, func, data);
+
+	g_io_channel_unref(channel);	/* the watch holds its own reference */
+	return id;
+}
+
+static gint64 controls_now(void)
+{
+	return monotonic_usec() / 1000;
+}
+
+static void write_stats_report(void)
+{
+	g_print("control writes: %lu submitted, %lu issued (%.0f%% coalesced)\n",
+		writes_submitted, writes_issued,
+		writes_submitted ? 100.0 * (writes_submitted - writes_issued) / writes_submitted : 0.0);
+}
+
+/* Write every queued control to the card now */
+void controls_flush(void)
+{
+	control_entry_t *entry;
+	int i, err;
+
+	if (write_timeout) {
+		g_source_remove(write_timeout);
+		write_timeout = 0;
+	}
+	for (i = 0; i < write_queued; i++) {
+		entry = write_queue[i];
+		entry->queued = FALSE;
+		writes_issued++;
+		if ((err = control_entry_write(entry)) < 0 && err != -EBUSY)
+			g_print("Unable to write %s: %s\n", control_descs[entry->control].name, snd_strerror(err));
+	}
+	write_queued = 0;
+	last_flush = controls_now();
+	if (write_stats && last_flush - last_stats >= WRITE_STATS_PERIOD) {
+		write_stats_report();
+		last_stats = last_flush;
+	}
+}
+
+static gboolean controls_flush_timeout(gpointer data)
+{
+	write_timeout = 0;
+	controls_flush();
+	return FALSE;
+}
+
+/*
+ * Write the value of 'index' of control 'c' to the card soon: at once if
+ * nothing was written during the last write interval, otherwise at the
+ * end of it, together with any later changes.
+ */
+void control_queue(control_t c, int index)
+{
+	control_entry_t *entry = control_entry(c, index);
+	gint64 elapsed;
+
+	midi_learn_control(c, index);
+	writes_submitted++;
+	if (!entry->queued) {
+		entry->queued = TRUE;
+		write_queue[write_queued++] = entry;
+	}
+	if (write_timeout || write_batch)
+		return;
+	elapsed = controls_now() - last_flush;
+	if (elapsed < 0 || elapsed >= write_interval)
+		controls_flush();
+	else
+		write_timeout = g_timeout_add(write_interval - elapsed, controls_flush_timeout, NULL);
+}
+
+/* Hold back the writes queued from now until controls_batch_end() */
+void controls_batch_begin(void)
+{
+	write_batch++;
+}
+
+/* Schedule the writes queued since controls_batch_begin() like control_queue() does */
+void controls_batch_end(void)
+{
+	gint64 elapsed;
+
+	if (write_batch == 0 || --write_batch > 0 || write_queued == 0 || write_timeout)
+		return;
+	elapsed = controls_now() - last_flush;
+	if (elapsed < 0 || elapsed >= write_interval)
+		controls_flush();
+	else
+		write_timeout = g_timeout_add(write_interval - elapsed, controls_flush_timeout, NULL);
+}
+
+/* Flush queued writes before exiting */
+void controls_close(void)
+{
+	controls_flush();
+	if (write_stats)
+		write_stats_report();
+}
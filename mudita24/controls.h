@@ -0,0 +1,380 @@
+#ifndef CONTROLS__H
+#define CONTROLS__H
+
+/*
+ * What the daemon (mudita24d) and the GUI share: the card, its controls
+ * and their shadow, MIDI, OSC, the control socket and the profiles. None
+ * of it needs GTK; envy24control.h adds the GUI on top.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <assert.h>
+#include <glib.h>
+#include <alsa/asoundlib.h>
+
+#include "globaldefs.h"
+
+/* Profiles */
+#ifdef PACKAGE
+#define PROGRAM_NAME PACKAGE
+#else
+#define PROGRAM_NAME "envy24control"
+#endif
+#define DEFAULT_PROFILES 8	/* profile buttons shown at least */
+#define MAX_PROFILE_NAME_LENGTH 20
+#define DEFAULT_PROFILERC "~/.envy24control/profiles.conf" /* NPM: use hidden directory for profiles */
+#define SYS_PROFILERC "/etc/envy24control/profiles.conf"
+#ifndef ALSACTL
+#define ALSACTL "/usr/sbin/alsactl"
+#endif
+
+#include "profiles.h"
+
+/* MidiMan */
+#define ICE1712_SUBDEVICE_DELTA1010	0x121430d6
+#define ICE1712_SUBDEVICE_DELTADIO2496	0x121431d6
+#define ICE1712_SUBDEVICE_DELTA66	0x121432d6
+#define ICE1712_SUBDEVICE_DELTA44	0x121433d6
+#define ICE1712_SUBDEVICE_AUDIOPHILE    0x121434d6
+#define ICE1712_SUBDEVICE_DELTA410      0x121438d6
+#define ICE1712_SUBDEVICE_DELTA1010LT   0x12143bd6
+
+/* Terratec */
+#define ICE1712_SUBDEVICE_EWX2496       0x3b153011
+#define ICE1712_SUBDEVICE_EWS88MT       0x3b151511
+#define ICE1712_SUBDEVICE_EWS88D        0x3b152b11
+#define ICE1712_SUBDEVICE_DMX6FIRE      0x3b153811
+
+/* Hoontech */
+#define ICE1712_SUBDEVICE_STDSP24       0x12141217      /* Hoontech SoundTrack Audio DSP 24 */
+
+/* max number of cards for alsa */
+#define MAX_CARD_NUMBERS	8
+/* max number of HW input/output channels (analog lines)
+ * the number of available HW input/output channels is defined
+ * at 'adcs/dacs' in the driver
+ */
+/* max number of HW input channels (analog lines) */
+#define MAX_INPUT_CHANNELS	8
+/* max number of HW output channels (analog lines) */
+#define MAX_OUTPUT_CHANNELS	8
+/* max number of spdif input/output channels */
+#define MAX_SPDIF_CHANNELS	2
+/* max number of PCM output channels */
+#define MAX_PCM_OUTPUT_CHANNELS	8
+/* NPM: the digital mixer max-attenuation in dB, per snd ice1712 architecture diagram
+   http://nielsmayer.com/npm/envy24mixer-architecture.png
+   taken from http://alsa.cybermirror.org/manuals/icensemble/envy24.pdf */
+/* NPM: the control values for the digital mixer are 0-96 and not the
+   dB attenuation values of MAX_MIXER_ATTENUATION_DB...
+   The following values comprise all the signals mixed in the ice1712's digital
+   mixer: MULTI_PLAYBACK_VOLUME, HW_MULTI_CAPTURE_VOLUME, IEC958_MULTI_CAPTURE_VOLUME:
+    > amixer -c M66 cget iface=MIXER,name='Multi Playback Volume'
+    numid=11,iface=MIXER,name='Multi Playback Volume'
+      ; type=INTEGER,access=rw---R--,values=2,min=0,max=96,step=0
+      : values=78,67
+      | dBscale-min=-144.00dB,step=1.50dB,mute=0
+    > amixer -c M66 cget iface=MIXER,name="H/W Multi Capture Volume"
+    numid=27,iface=MIXER,name='H/W Multi Capture Volume'
+      ; type=INTEGER,access=rw---R--,values=2,min=0,max=96,step=0
+      : values=0,0
+      | dBscale-min=-144.00dB,step=1.50dB,mute=0
+    > amixer -c M66 cget iface=MIXER,name="IEC958 Multi Capture Volume"
+    numid=31,iface=MIXER,name='IEC958 Multi Capture Volume'
+      ; type=INTEGER,access=rw------,values=2,min=0,max=96,step=0
+      : values=16,0
+*/
+#define MAX_MIXER_ATTENUATION_VALUE 96 /* for -144dB */
+#define LOW_MIXER_ATTENUATION_VALUE 33 /* for -49.5dB nb: 64-->-48dB where 96-64=32 */
+#define MIN_MIXER_ATTENUATION_VALUE 0  /* for 0dB */
+
+/*
+ * NPM: DAC and ADC constants
+ */
+#define MIN_ADC_GAIN -63
+#define MAX_ADC_GAIN 18
+#define MIN_DAC_GAIN -63
+#define MAX_DAC_GAIN 0
+#define ANALOG_GAIN_STEP_SIZE 12  /* this value gives a known -18dB step size for 24 bit attenuators, -6dB step for 16 bit attenuators */
+// TER: Changed.
+//#define MIXER_ATTENUATOR_STEP_SIZE 8  /* this value gives a known -12dB step size for 24 bit attenuators, -6dB step for 16 bit attenuators */
+#define MIXER_ATTENUATOR_STEP_SIZE 4  /* this value gives a known -6dB step size for 24 bit attenuators, -6dB step for 16 bit attenuators */
+
+/*
+ * NPM: For peak meters
+ */
+#define MULTI_TRACK_PEAK_CHANNELS 22
+#define IDX_LMIX 20
+#define IDX_RMIX 21
+#define MAX_METERING_LEVEL 255 	/* level corresponding to 0dB output for ice1712 hardware peak meters */
+// #define MIN_METERING_LEVEL_DB -48.164799306 /* == 20*log10(1/(MAX_METERING_LEVEL+1)) */
+// #define MIN_METERING_LEVEL_DB −48.130803609 /* == 20*log10(1/MAX_METERING_LEVEL)     */
+
+/*
+ * For --peak_sample_rate: sampler thread reading "Multi Track Peak" between GUI polls
+ */
+#define MIN_PEAK_SAMPLE_RATE 10	/* Hz, same as envy24control_poll() */
+#define MAX_PEAK_SAMPLE_RATE 4000
+typedef struct {
+	guint64 timestamp;	/* usec, CLOCK_MONOTONIC, of newest frame consumed */
+	unsigned int frames;	/* frames aggregated since previous peak_sampler_consume() */
+	unsigned int overruns;	/* total frames dropped because the ring was full */
+	unsigned char level[MULTI_TRACK_PEAK_CHANNELS]; /* max level over 'frames' */
+	unsigned char meter[MULTI_TRACK_PEAK_CHANNELS]; /* newest ballistics output, if ballistics_active() */
+	unsigned char hold[MULTI_TRACK_PEAK_CHANNELS];	/* newest held peak, if ballistics_active() */
+} peak_aggregate_t;
+
+/*
+ * For --meter_mode, --peak_hold and --peak_fallback
+ */
+#define METER_MODE_PEAK 0	/* index of "peak" in ballistics.c meter_modes[] */
+#define DEFAULT_PEAK_FALLBACK 20.0 /* dB per second */
+
+/*
+ * Profile operations queued for the worker thread of profilejobs.c
+ */
+enum {
+	PROFILE_JOB_RESTORE,
+	PROFILE_JOB_SAVE,
+	PROFILE_JOB_DELETE,
+	PROFILE_JOB_PRELOAD
+};
+
+enum {
+	PROFILE_JOB_QUEUED,
+	PROFILE_JOB_RUNNING,
+	PROFILE_JOB_DONE,
+	PROFILE_JOB_CANCELLED
+};
+
+typedef struct profile_job profile_job_t;
+typedef void (*profile_job_callback_t)(profile_job_t *job, gpointer data);
+
+struct profile_job {
+	int operation;		/* PROFILE_JOB_RESTORE, ... */
+	int profile_number;
+	char *profile_name;	/* to save the profile under */
+	int state;		/* PROFILE_JOB_QUEUED, ... */
+	int result;		/* of the operation, -ECANCELED if cancelled */
+	profile_job_callback_t progress;	/* when the job starts running */
+	profile_job_callback_t done;	/* when it is done or cancelled */
+	gpointer data;
+	guint64 submitted;	/* usec, CLOCK_MONOTONIC */
+	guint64 finished;	/* usec, when the operation returned on the worker */
+	profile_job_t *next;
+};
+
+/*
+ * Controls resolved to numids at startup by controls_init(), see controls.c
+ */
+typedef enum {
+	CTL_MULTI_PLAYBACK_SWITCH,
+	CTL_MULTI_PLAYBACK_VOLUME,
+	CTL_HW_MULTI_CAPTURE_SWITCH,
+	CTL_HW_MULTI_CAPTURE_VOLUME,
+	CTL_IEC958_MULTI_CAPTURE_SWITCH,
+	CTL_IEC958_MULTI_CAPTURE_VOLUME,
+	CTL_HW_PLAYBACK_ROUTE,
+	CTL_IEC958_PLAYBACK_ROUTE,
+	CTL_DAC_VOLUME,
+	CTL_ADC_VOLUME,
+	CTL_IPGA_VOLUME,
+	CTL_DAC_SENSE,
+	CTL_ADC_SENSE,
+	CTL_INTERNAL_CLOCK,
+	CTL_INTERNAL_CLOCK_DEFAULT,
+	CTL_WORD_CLOCK_SYNC,
+	CTL_WORD_CLOCK_STATUS,
+	CTL_RATE_LOCKING,
+	CTL_RATE_RESET,
+	CTL_VOLUME_RATE,
+	CTL_IEC958_INPUT_OPTICAL,
+	CTL_OPTICAL_DIGITAL_INPUT,
+	CTL_FRONT_DIGITAL_INPUT,
+	CTL_IEC958_PLAYBACK_DEFAULT,
+	CTL_ANALOG_INPUT_SELECT,
+	CTL_BREAKBOX_LED,
+	CTL_PHONO_INPUT,
+	CTL_IEC958_INPUT_STATUS,
+	CTL_MULTI_TRACK_PEAK,
+	CTL_COUNT
+} control_t;
+#define MAX_CONTROL_INDEX 16	/* indices per control; "Multi Playback *" has 10 */
+#define DEFAULT_WRITE_INTERVAL 20 /* ms between writes of queued controls, for --write_interval */
+#define MAX_WRITE_INTERVAL 1000
+#define WIDGET_REFRESH_INTERVAL 40 /* ms between redraws of widgets changed from MIDI */
+
+/* what control_range() reports of a control */
+typedef struct {
+	int type;		/* SND_CTL_ELEM_TYPE_*; _NONE if not on the card */
+	int count;		/* channels */
+	int writable;
+	long min, max;		/* integer range; 0 and items - 1 for an enumeration */
+} control_range_t;
+
+/*
+ * NPM: 
+ */
+
+typedef struct {
+	unsigned int subvendor;	/* PCI[2c-2f] */
+	unsigned char size;	/* size of EEPROM image in bytes */
+	unsigned char version;	/* must be 1 */
+	unsigned char codec;	/* codec configuration PCI[60] */
+	unsigned char aclink;	/* ACLink configuration PCI[61] */
+	unsigned char i2sID;	/* PCI[62] */
+	unsigned char spdif;	/* S/PDIF configuration PCI[63] */
+	unsigned char gpiomask;	/* GPIO initial mask, 0 = write, 1 = don't */
+	unsigned char gpiostate; /* GPIO initial state */
+	unsigned char gpiodir;	/* GPIO direction state */
+	unsigned short ac97main;
+	unsigned short ac97pcm;
+	unsigned short ac97rec;
+	unsigned char ac97recsrc;
+	unsigned char dacID[4];	/* I2S IDs for DACs */
+	unsigned char adcID[4];	/* I2S IDs for ADCs */
+	unsigned char extra[4];
+} ice1712_eeprom_t;
+
+/* card.c */
+extern snd_ctl_t *ctl;
+extern int card_number;
+extern ice1712_eeprom_t card_eeprom;
+extern int card_is_dmx6fire;
+extern int card_has_delta_iec958_input_status; /* NPM added to support "Delta IEC958 Input Status" */
+int card_find(void);
+int card_open(const char *name);
+const char *card_name(void);
+const char *card_longname(void);
+int card_pack(gint32 *values, int max);
+void card_unpack(const gint32 *values, int count);
+void card_close(void);
+
+/* meters.c */
+void meters_init(void);
+void meters_read(void);
+int meters_level(int channel);
+int meters_held(int channel);
+int meters_remote(void);
+void meters_suspend(int suspended);
+void meters_hook(void (*changed)(void));
+void meters_received(const gint32 *levels, int count);
+void metering_changed(void);
+
+gint64 monotonic_usec(void);
+int peak_sampler_start(const char *ctl_name, int rate);
+void peak_sampler_stop(void);
+int peak_sampler_running(void);
+void peak_sampler_pause(void);
+void peak_sampler_resume(void);
+int peak_sampler_consume(peak_aggregate_t *agg);
+
+#define DEFAULT_OSC_PING_COUNT 100
+int osc_init(int port);
+void osc_close(void);
+int osc_metering(void);
+void osc_meters(snd_ctl_elem_value_t *peaks);
+int osc_ping(int port, int count);
+
+int ctlserver_init(const char *path);
+void ctlserver_close(void);
+char *ctlserver_default_path(int card);
+void ctlserver_changed(control_t c, int index);
+int ctlserver_metering(void);
+void ctlserver_meters(snd_ctl_elem_value_t *peaks);
+
+/* ctlclient.c: the GUI as a client of mudita24d */
+int ctlclient_open(const char *path, void (*lost)(void));
+int ctlclient_connected(void);
+int ctlclient_has_midi(void);
+void ctlclient_read(control_t c, int index);
+int ctlclient_write(control_t c, int index);
+void ctlclient_meters(int on);
+void ctlclient_stereo(int stream, int on);
+int ctlclient_profile(profile_job_t *job);
+int ctlclient_profiles(void);
+const char *ctlclient_profile_name(int profile_number);
+int ctlclient_profile_number(const char *name);
+void ctlclient_learn(void (*done)(gpointer data), gpointer data);
+void ctlclient_close(void);
+
+int profile_jobs_start(const char *ctl_name, int card_number, char *cfgfile);
+void profile_jobs_stop(void);
+profile_job_t *profile_job_submit(int operation, int profile_number, const char *profile_name,
+				  profile_job_callback_t progress, profile_job_callback_t done, gpointer data);
+int profile_job_cancel(profile_job_t *job);
+void profile_job_finish(profile_job_t *job, int result);
+const char *profile_jobs_name(int profile_number);
+int profile_jobs_max_number(void);
+void recall_profile(int profile_number, profile_job_callback_t done, gpointer data);
+void recall_profile_hook(void (*recalled)(int profile_number));
+
+int ballistics_parse_mode(const char *name);
+void ballistics_init(int mode_index, int hold_ms, double fallback_db_per_sec);
+int ballistics_active(void);
+void ballistics_reset(void);
+void ballistics_process(const unsigned char *in, double dt);
+void ballistics_get(unsigned char *meter, unsigned char *peak);
+void ballistics_color_thresholds(int *white, int *orange, int *red);
+
+#define WATCH_READ (G_IO_IN | G_IO_HUP | G_IO_ERR)
+#define WATCH_WRITE (G_IO_OUT | G_IO_ERR)
+guint watch_fd(int fd, GIOCondition condition, GIOFunc func, gpointer data);
+void controls_init(int interval);
+snd_ctl_elem_value_t *control_value(control_t c, int index);
+snd_ctl_elem_id_t *control_id(control_t c, int index);
+const char *control_name(control_t c);
+int control_lookup(const char *name);
+int control_notifies(control_t c, int index);
+const control_range_t *control_range(control_t c, int index);
+long control_get(control_t c, int index, int channel);
+int control_set(control_t c, int index, int channel, long v);
+int control_pack(control_t c, int index, gint32 *values, int max);
+int control_unpack(control_t c, int index, int first, const gint32 *values, int count);
+int control_received(control_t c, int index, const gint32 *values, int count);
+int control_pack_info(control_t c, int index, gint32 *values, int max);
+void control_unpack_info(control_t c, int index, const gint32 *values, int count);
+void control_unpack_item(control_t c, int index, int item, const char *name);
+int control_db(control_t c, int index, long value, long *db);
+int control_db_range(control_t c, int index, long *min, long *max);
+int control_from_db(control_t c, int index, long db, long *value, int xdir);
+const char *control_item_name(control_t c, int index, int item);
+int control_read(control_t c, int index);
+int control_write(control_t c, int index);
+int control_event(unsigned int numid, control_t *c, int *index);
+void control_queue(control_t c, int index);
+void controls_batch_begin(void);
+void controls_batch_end(void);
+void controls_flush(void);
+void controls_close(void);
+
+/* driverevents.c: what to refresh when a control changed */
+typedef struct {
+	void (*update)(int index);	/* refresh one element of the control */
+	void (*update_all)(void);	/* or refresh everything the control affects */
+} control_handler_t;
+void control_handlers(const control_handler_t *handlers);
+void control_changed(control_t c, int index);
+void control_changes_dispatch(void);
+void control_refresh_later(control_t c, int index);
+void controls_watch(void);
+
+/* mixerstate.c */
+control_t mixer_stream_control(int stream, int volume, int *index);
+int mixer_stream_is_active(int stream);
+int mixer_stream_is_stereo(int stream);
+void mixer_set_stereo(int stream, int on);
+void mixer_stereo_received(int first, const gint32 *on, int count);
+void mixer_stream_changed(int stream, int vol_flag, int sw_flag);
+void mixer_set_volume(int stream, int channel, int value);
+void mixer_set_switch(int stream, int left, int right);
+int mixer_get_volume(int stream, int channel);
+int mixer_get_switch(int stream, int channel);
+void mixer_init(void);
+void analog_volume_set(control_t c, int idx, int value);
+
+#endif
@@ -0,0 +1,573 @@
+/*****************************************************************************
+   ctlclient.c - Work the card through mudita24d's control socket
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+******************************************************************************/
+
+/*
+ * When mudita24d (or another mudita24 with --socket) already serves the
+ * card, the GUI becomes one of its clients instead of opening the card
+ * a second time. ctlclient_open() asks for the card, the gangs, the
+ * description of every control and their values, and waits for all of it;
+ * from then on the daemon's changes come in as CTL_MSG_VALUE, update the
+ * shadow of controls.c and are dispatched to the widgets like the card's
+ * events, and controls.c sends the GUI's writes as CTL_MSG_WRITE. MIDI,
+ * the surfaces, OSC and the profiles stay the daemon's; the meters are
+ * subscribed to while the GUI shows them. The names of the profiles are
+ * asked for with the rest, and again once a save or delete is answered,
+ * the job being finished when they are in.
+ *
+ * Each write is followed by a CTL_MSG_SYNC. Values of a control that
+ * arrive before the sync of its last write is answered may predate it
+ * (the daemon's echo of an earlier step of a drag) and are dropped, the
+ * control being read again once the sync is answered.
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "controls.h"
+#include "ctlserver.h"
+
+#define CLIENT_INPUT_BUFFER	4096
+#define CLIENT_OUTPUT_BUFFER	65536
+#define CLIENT_TIMEOUT		5000	/* ms, for the daemon to answer ctlclient_open() */
+#define CLIENT_MAX_JOBS		64	/* profile jobs waiting for their answer */
+#define CLIENT_MAX_PROFILES	65536	/* names taken from the daemon */
+#define HANDSHAKE_TAG		0
+
+static int client_fd = -1;
+static int ready = FALSE;		/* ctlclient_open() has all it asked for */
+static int has_midi = FALSE;
+static void (*lost_hook)(void) = NULL;
+static guint input_watch = 0, output_watch = 0;
+static char in[CLIENT_INPUT_BUFFER];
+static int in_len = 0;
+static char out[CLIENT_OUTPUT_BUFFER];
+static int out_len = 0;
+
+static guint16 next_tag = HANDSHAKE_TAG + 1;
+static guint16 synced = HANDSHAKE_TAG;	/* tag of the last sync answered */
+static guint16 write_tag[CTL_COUNT][MAX_CONTROL_INDEX];	/* of the sync after the last write */
+static guint8 writing[CTL_COUNT][MAX_CONTROL_INDEX];	/* its sync is not answered yet */
+static guint8 reading[CTL_COUNT][MAX_CONTROL_INDEX];	/* a read is not answered yet */
+static guint8 stale[CTL_COUNT][MAX_CONTROL_INDEX];	/* a value was dropped meanwhile */
+
+static struct {
+	profile_job_t *job;
+	guint16 tag;
+	int answered;		/* with 'result', waiting for the names */
+	int result;
+	unsigned int names;	/* the listing of the names it waits for */
+} jobs[CLIENT_MAX_JOBS];
+static int njobs = 0;
+static char **profile_names = NULL;	/* of profiles 1... as the daemon has them */
+static int nprofile_names = 0;
+static char **names_in = NULL;		/* the names being received */
+static int nnames_in = 0;
+static unsigned int names_asked = 0, names_listed = 0;	/* CTL_MSG_NAMES sent, and answered */
+static void (*learn_done)(gpointer data) = NULL;
+static gpointer learn_done_data;
+
+static void client_lost(void);
+
+/* Write out what we can; with 'block', all of it or lose the connection */
+static int client_flush(int block)
+{
+	struct pollfd pfd;
+	ssize_t n;
+
+	while (out_len > 0) {
+		if ((n = write(client_fd, out, out_len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				return -errno;
+			if (!block)
+				return 0;
+			pfd.fd = client_fd;
+			pfd.events = POLLOUT;
+			if (poll(&pfd, 1, CLIENT_TIMEOUT) <= 0)
+				return -ETIMEDOUT;
+			continue;
+		}
+		memmove(out, out + n, out_len - n);
+		out_len -= n;
+	}
+	return 0;
+}
+
+static gboolean client_output(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+	if (client_flush(FALSE) < 0) {
+		output_watch = 0;
+		client_lost();
+		return FALSE;
+	}
+	if (out_len > 0)
+		return TRUE;
+	output_watch = 0;
+	return FALSE;
+}
+
+/* Send a message to the daemon; once ready, as soon as the socket takes it */
+static void client_send(int type, int control, int index, int first, int count, int tag, const gint32 *values)
+{
+	ctl_message_t msg;
+	int size = sizeof(msg) + count * sizeof(gint32);
+
+	if (client_fd < 0)
+		return;
+	if (out_len + size > CLIENT_OUTPUT_BUFFER && client_flush(TRUE) < 0) {
+		client_lost();
+		return;
+	}
+	msg.type = type;
+	msg.control = control;
+	msg.index = index;
+	msg.first = first;
+	msg.count = count;
+	msg.tag = tag;
+	memcpy(out + out_len, &msg, sizeof(msg));
+	memcpy(out + out_len + sizeof(msg), values, count * sizeof(gint32));
+	out_len += size;
+	if (!ready)
+		return;		/* ctlclient_open() writes it all at once */
+	if (client_flush(FALSE) < 0)
+		client_lost();
+	else if (out_len > 0 && !output_watch)
+		output_watch = watch_fd(client_fd, WATCH_WRITE, client_output, NULL);
+}
+
+/* The sync of 'tag' was answered: read again what was dropped before it */
+static void client_synced(guint16 tag)
+{
+	control_t c;
+	int index;
+
+	synced = tag;
+	for (c = 0; c < CTL_COUNT; c++)
+		for (index = 0; index < MAX_CONTROL_INDEX; index++) {
+			if (!writing[c][index] || (gint16)(synced - write_tag[c][index]) < 0)
+				continue;
+			writing[c][index] = FALSE;
+			if (stale[c][index]) {
+				stale[c][index] = FALSE;
+				reading[c][index] = TRUE;
+				client_send(CTL_MSG_READ, c, index, 0, 0, 0, NULL);
+			}
+		}
+}
+
+/* Finish profile job 'i', with the result it was answered */
+static void client_job_done(int i)
+{
+	profile_job_t *job = jobs[i].job;
+	int result = jobs[i].result;
+
+	jobs[i] = jobs[--njobs];
+	profile_job_finish(job, result);
+}
+
+/* Ask for the names of the profiles; returns which listing they will be */
+static unsigned int client_ask_names(void)
+{
+	client_send(CTL_MSG_NAMES, 0, 0, 0, 0, 0, NULL);
+	return ++names_asked;
+}
+
+static void client_free_names(char **names, int count)
+{
+	while (count > 0)
+		g_free(names[--count]);
+	g_free(names);
+}
+
+/* Carry out a message of the daemon; TRUE if a control changed */
+static int client_message(const ctl_message_t *msg, const gint32 *values)
+{
+	char name[CTL_MESSAGE_MAX_VALUES * sizeof(gint32) + 1];
+	control_t c = msg->control;
+	int i;
+
+	switch (msg->type) {
+	case CTL_MSG_CARD:
+		card_unpack(values, msg->count);
+		has_midi = msg->count > 1 && (values[1] & CTL_CARD_MIDI);
+		return FALSE;
+	case CTL_MSG_STEREO:
+		mixer_stereo_received(msg->first, values, msg->count);
+		return FALSE;
+	case CTL_MSG_METERS:
+		meters_received(values, msg->count);
+		return FALSE;
+	case CTL_MSG_SYNC:
+		if (msg->tag == HANDSHAKE_TAG)
+			ready = TRUE;
+		else
+			client_synced(msg->tag);
+		return FALSE;
+	case CTL_MSG_PROFILE:
+		for (i = 0; i < njobs && (jobs[i].answered || jobs[i].tag != msg->tag); i++)
+			;
+		if (i == njobs)
+			return FALSE;
+		jobs[i].result = msg->count > 0 ? values[0] : -EIO;
+		if (jobs[i].job->operation == PROFILE_JOB_SAVE || jobs[i].job->operation == PROFILE_JOB_DELETE) {
+			/* its 'done' shows the names as they are now */
+			jobs[i].answered = TRUE;
+			jobs[i].names = client_ask_names();
+		} else
+			client_job_done(i);
+		return FALSE;
+	case CTL_MSG_NAMES:
+		if (msg->count > 1 && values[0] >= 1 && values[0] <= CLIENT_MAX_PROFILES) {
+			ctl_unpack_string(name, sizeof(name), values + 1, msg->count - 1);
+			if (values[0] > nnames_in) {
+				names_in = g_renew(char *, names_in, values[0]);
+				while (nnames_in < values[0])
+					names_in[nnames_in++] = NULL;
+			}
+			g_free(names_in[values[0] - 1]);
+			names_in[values[0] - 1] = g_strdup(name);
+		} else if (msg->count == 0) {
+			client_free_names(profile_names, nprofile_names);
+			profile_names = names_in;
+			nprofile_names = nnames_in;
+			names_in = NULL;
+			nnames_in = 0;
+			names_listed++;
+			for (i = njobs - 1; i >= 0; i--)
+				if (jobs[i].answered && (int)(names_listed - jobs[i].names) >= 0)
+					client_job_done(i);
+		}
+		return FALSE;
+	case CTL_MSG_LEARN:
+		if (learn_done != NULL) {
+			void (*done)(gpointer data) = learn_done;
+
+			learn_done = NULL;
+			done(learn_done_data);
+		}
+		return FALSE;
+	}
+	if (c >= CTL_COUNT || msg->index >= MAX_CONTROL_INDEX)
+		return FALSE;
+	switch (msg->type) {
+	case CTL_MSG_INFO:
+		control_unpack_info(c, msg->index, values, msg->count);
+		break;
+	case CTL_MSG_ITEM:
+		ctl_unpack_string(name, sizeof(name), values, msg->count);
+		control_unpack_item(c, msg->index, msg->first, name);
+		break;
+	case CTL_MSG_VALUE:
+		reading[c][msg->index] = FALSE;
+		if (writing[c][msg->index]) {
+			stale[c][msg->index] = TRUE;
+			break;
+		}
+		/* only the card's events refresh widgets, the rest is polled */
+		if (control_received(c, msg->index, values, msg->count) &&
+		    ready && control_notifies(c, msg->index)) {
+			control_changed(c, msg->index);
+			return TRUE;
+		}
+		break;
+	}
+	return FALSE;
+}
+
+/* Carry out the complete messages in the input; TRUE if a control changed */
+static int client_parse(void)
+{
+	ctl_message_t msg;
+	gint32 values[CTL_MESSAGE_MAX_VALUES];
+	int pos, size, changed = FALSE;
+
+	for (pos = 0; in_len - pos >= (int)sizeof(msg); pos += size) {
+		memcpy(&msg, in + pos, sizeof(msg));
+		if (msg.count > CTL_MESSAGE_MAX_VALUES)
+			return -EPROTO;
+		size = sizeof(msg) + msg.count * sizeof(gint32);
+		if (in_len - pos < size)
+			break;
+		memcpy(values, in + pos + sizeof(msg), msg.count * sizeof(gint32));
+		changed |= client_message(&msg, values);
+		if (client_fd < 0)
+			return -ENOTCONN;	/* lost while answering it */
+	}
+	memmove(in, in + pos, in_len - pos);
+	in_len -= pos;
+	return changed;
+}
+
+/* Read what the daemon sent, and dispatch the controls it changed */
+static gboolean client_input(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+	ssize_t n;
+	int changed = FALSE, err;
+
+	for (;;) {
+		if ((n = read(client_fd, in + in_len, sizeof(in) - in_len)) <= 0) {
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+				input_watch = 0;
+				client_lost();
+				return FALSE;
+			}
+			break;
+		}
+		in_len += n;
+		if ((err = client_parse()) < 0) {
+			input_watch = 0;
+			client_lost();
+			return FALSE;
+		}
+		changed |= err;
+	}
+	if (changed)
+		control_changes_dispatch();
+	return TRUE;
+}
+
+static void client_disconnect(void)
+{
+	if (input_watch)
+		g_source_remove(input_watch);
+	if (output_watch)
+		g_source_remove(output_watch);
+	input_watch = output_watch = 0;
+	if (client_fd >= 0)
+		close(client_fd);
+	client_fd = -1;
+	ready = FALSE;
+	in_len = out_len = 0;
+}
+
+/* The daemon went away: so does the GUI, which has no card of its own */
+static void client_lost(void)
+{
+	if (client_fd < 0)
+		return;
+	fprintf(stderr, "Lost the connection to mudita24d\n");
+	client_disconnect();
+	if (lost_hook != NULL)
+		lost_hook();
+}
+
+/*
+ * Work the card through the instance serving the control socket 'path',
+ * if one does: learn all about the card and its controls, and from then
+ * on follow its changes. 'lost' is called should it go away. Returns 0,
+ * or a negative errno: -ENOENT or -ECONNREFUSED if nothing serves 'path'.
+ */
+int ctlclient_open(const char *path, void (*lost)(void))
+{
+	struct sockaddr_un addr;
+	struct pollfd pfd;
+	gint32 flags = CTL_SUBSCRIBE_CHANGES;
+	control_t c;
+	int index, n, err;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -ENAMETOOLONG;
+	strcpy(addr.sun_path, path);
+	if ((client_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		return -errno;
+	if (connect(client_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		err = -errno;
+		client_disconnect();
+		return err;
+	}
+	fcntl(client_fd, F_SETFL, O_NONBLOCK);
+
+	client_send(CTL_MSG_CARD, 0, 0, 0, 0, 0, NULL);
+	client_send(CTL_MSG_STEREO, 0, 0, 0, 0, 0, NULL);
+	for (c = 0; c < CTL_COUNT; c++)
+		for (index = 0; index < MAX_CONTROL_INDEX; index++)
+			client_send(CTL_MSG_INFO, c, index, 0, 0, 0, NULL);
+	client_send(CTL_MSG_SUBSCRIBE, flags, 0, 0, 0, 0, NULL);
+	for (c = 0; c < CTL_COUNT; c++)
+		for (index = 0; index < MAX_CONTROL_INDEX; index++)
+			client_send(CTL_MSG_READ, c, index, 0, 0, 0, NULL);
+	client_ask_names();
+	client_send(CTL_MSG_SYNC, 0, 0, 0, 0, HANDSHAKE_TAG, NULL);
+	if ((err = client_flush(TRUE)) < 0)
+		goto __error;
+
+	pfd.fd = client_fd;
+	pfd.events = POLLIN;
+	while (!ready) {
+		if ((n = poll(&pfd, 1, CLIENT_TIMEOUT)) <= 0) {
+			err = n < 0 ? -errno : -ETIMEDOUT;
+			if (err == -EINTR)
+				continue;
+			goto __error;
+		}
+		if ((n = read(client_fd, in + in_len, sizeof(in) - in_len)) <= 0) {
+			if (n < 0 && (errno == EINTR || errno == EAGAIN))
+				continue;
+			err = n < 0 ? -errno : -ECONNRESET;
+			goto __error;
+		}
+		in_len += n;
+		if ((err = client_parse()) < 0)
+			goto __error;
+	}
+	lost_hook = lost;
+	input_watch = watch_fd(client_fd, WATCH_READ, client_input, NULL);
+	return 0;
+
+ __error:
+	client_disconnect();
+	return err;
+}
+
+/* TRUE while the GUI works the card through mudita24d */
+int ctlclient_connected(void)
+{
+	return client_fd >= 0;
+}
+
+/* The daemon has a MIDI port, for MIDI learn */
+int ctlclient_has_midi(void)
+{
+	return has_midi;
+}
+
+/* Ask for the value of 'index' of control 'c', which isn't shadowed */
+void ctlclient_read(control_t c, int index)
+{
+	if (reading[c][index])
+		return;
+	reading[c][index] = TRUE;
+	client_send(CTL_MSG_READ, c, index, 0, 0, 0, NULL);
+}
+
+/* Send the shadow value of 'index' of control 'c' to the daemon */
+int ctlclient_write(control_t c, int index)
+{
+	gint32 values[CTL_MESSAGE_MAX_VALUES];
+
+	if (client_fd < 0)
+		return -ENOTCONN;
+	client_send(CTL_MSG_WRITE, c, index, 0,
+		    control_pack(c, index, values, CTL_MESSAGE_MAX_VALUES), 0, values);
+	write_tag[c][index] = next_tag;
+	writing[c][index] = TRUE;
+	client_send(CTL_MSG_SYNC, 0, 0, 0, 0, next_tag, NULL);
+	if (++next_tag == HANDSHAKE_TAG)
+		next_tag++;
+	return 0;
+}
+
+/* Have the meters sent, or no longer */
+void ctlclient_meters(int on)
+{
+	client_send(CTL_MSG_SUBSCRIBE, CTL_SUBSCRIBE_CHANGES | (on ? CTL_SUBSCRIBE_METERS : 0),
+		    0, 0, 0, 0, NULL);
+}
+
+/* Gang the channels of 'stream' in the daemon, or ungang them */
+void ctlclient_stereo(int stream, int on)
+{
+	gint32 value = on;
+
+	client_send(CTL_MSG_STEREO, 0, 0, stream, 1, 0, &value);
+}
+
+/*
+ * Have the daemon run 'job'; it is finished by its answer. Returns FALSE
+ * if it could not be sent, the job being finished (and freed) already.
+ */
+int ctlclient_profile(profile_job_t *job)
+{
+	gint32 values[CTL_MESSAGE_MAX_VALUES];
+	int count;
+
+	if (client_fd < 0 || njobs == CLIENT_MAX_JOBS) {
+		profile_job_finish(job, client_fd < 0 ? -ENOTCONN : -EBUSY);
+		return FALSE;
+	}
+	values[0] = job->profile_number;
+	count = 1 + ctl_pack_string(job->profile_name != NULL ? job->profile_name : "",
+				    values + 1, CTL_MESSAGE_MAX_VALUES - 1);
+	jobs[njobs].job = job;
+	jobs[njobs].tag = next_tag;
+	jobs[njobs].answered = FALSE;
+	njobs++;
+	client_send(CTL_MSG_PROFILE, job->operation, 0, 0, count, next_tag, values);
+	if (++next_tag == HANDSHAKE_TAG)
+		next_tag++;
+	return TRUE;
+}
+
+/* The highest profile number the daemon has stored for the card, 0 if none */
+int ctlclient_profiles(void)
+{
+	return nprofile_names;
+}
+
+/* The name of 'profile_number' in the daemon's profiles; NULL past the last */
+const char *ctlclient_profile_name(int profile_number)
+{
+	if (profile_number < 1 || profile_number > nprofile_names)
+		return NULL;
+	return profile_names[profile_number - 1];
+}
+
+/* The number of the profile named 'name' in the daemon's profiles, or NOTFOUND */
+int ctlclient_profile_number(const char *name)
+{
+	int i;
+
+	for (i = 0; i < nprofile_names; i++)
+		if (profile_names[i] != NULL && profile_name_matches(profile_names[i], name))
+			return i + 1;
+	return NOTFOUND;
+}
+
+/* Start MIDI learn in the daemon, 'done' being called once it bound; NULL cancels it */
+void ctlclient_learn(void (*done)(gpointer data), gpointer data)
+{
+	learn_done = done;
+	learn_done_data = data;
+	client_send(CTL_MSG_LEARN, done != NULL, 0, 0, 0, 0, NULL);
+}
+
+/* Send what is left to send, and leave the daemon */
+void ctlclient_close(void)
+{
+	if (client_fd < 0)
+		return;
+	client_flush(TRUE);
+	client_disconnect();
+	/* the main loop is gone, free the jobs it didn't see finish */
+	while (njobs > 0) {
+		njobs--;
+		jobs[njobs].job->done = NULL;
+		profile_job_finish(jobs[njobs].job, -ECANCELED);
+	}
+	client_free_names(profile_names, nprofile_names);
+	client_free_names(names_in, nnames_in);
+	profile_names = names_in = NULL;
+	nprofile_names = nnames_in = 0;
+	names_asked = names_listed = 0;
+}
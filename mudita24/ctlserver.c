@@ -0,0 +1,578 @@
+/*****************************************************************************
+   ctlserver.c - Share the card's controls over a Unix socket
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+******************************************************************************/
+
+/*
+ * mudita24d, or mudita24 with --socket, the instance that owns the card
+ * serves its controls to other programs on a Unix stream socket, by the
+ * binary messages of ctlserver.h. Only one instance serves a socket: a
+ * second one finds it answering and does not take it over.
+ *
+ * Everything a client has sent when we get to read it is applied as one
+ * batch of writes, like the MIDI and OSC input, coalesced per control.
+ * Answers and notifications are not written as they come up: each client
+ * has a set of controls whose value it is owed (those it read, and those
+ * that changed if it subscribed to changes), sent from the shadow values
+ * of controls.c in one write once the main loop is idle. However many
+ * clients there are, a change costs the one read of the card that
+ * control_event() already made, and a client that doesn't keep up only
+ * ever gets each control's latest value. Meter frames are dropped for a
+ * client whose output is full.
+ *
+ * A client can also have a control described (CTL_MSG_INFO), the card
+ * (CTL_MSG_CARD), gang streams, work the profiles and learn MIDI bindings:
+ * all the GUI needs to be one client among others, see ctlclient.c.
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "controls.h"
+#include "ctlserver.h"
+#include "midi.h"
+
+#define CTL_MAX_CLIENTS		32
+#define CTL_INPUT_BUFFER	4096
+#define CTL_OUTPUT_BUFFER	65536
+#define CTL_MAX_SYNCS		16	/* unanswered per client; more replace the last */
+
+/* what a client is owed of a control */
+#define OWE_VALUE		1
+#define OWE_INFO		2
+
+typedef struct {
+	int fd;
+	guint serial;		/* tells the client apart from a later one in its place */
+	guint input, output;	/* watch_fd() ids; 'output' while the socket is full */
+	int subscribed;		/* CTL_SUBSCRIBE_* */
+	char in[CTL_INPUT_BUFFER];
+	int in_len;
+	char *out;		/* CTL_OUTPUT_BUFFER, not yet written */
+	int out_len;
+	guint8 owed[CTL_COUNT][MAX_CONTROL_INDEX];
+	guint16 owed_list[CTL_COUNT * MAX_CONTROL_INDEX];	/* control * MAX_CONTROL_INDEX + index */
+	int nowed;
+	int names_next, names_max;	/* profile names owed, from 'names_next' (0 for none) */
+	guint16 syncs[CTL_MAX_SYNCS];	/* tags of the CTL_MSG_SYNC to answer */
+	int nsyncs;
+} client_t;
+
+#define client_owes(cl)	((cl)->nowed || (cl)->names_next || (cl)->nsyncs)
+
+static int listen_fd = -1;
+static guint listen_input = 0;
+static char *socket_path = NULL;
+static client_t *clients[CTL_MAX_CLIENTS];
+static int nclients = 0;
+static guint next_serial = 1;
+static guint learner = 0;	/* serial of the client learning MIDI */
+static guint flush_idle = 0;
+
+static void client_write(client_t *cl);
+
+static void client_close(client_t *cl)
+{
+	int i;
+
+	for (i = 0; i < nclients && clients[i] != cl; i++)
+		;
+	if (i < nclients)
+		clients[i] = clients[--nclients];
+	g_source_remove(cl->input);
+	if (cl->output)
+		g_source_remove(cl->output);
+	close(cl->fd);
+	g_free(cl->out);
+	if (cl->subscribed & CTL_SUBSCRIBE_METERS)
+		metering_changed();
+	if (learner == cl->serial) {
+		midi_learn_cancel();
+		learner = 0;
+	}
+	g_free(cl);
+}
+
+/* The client of 'serial', NULL if it has gone */
+static client_t *client_find(guint serial)
+{
+	int i;
+
+	for (i = 0; i < nclients; i++)
+		if (clients[i]->serial == serial)
+			return clients[i];
+	return NULL;
+}
+
+/* Pack 's' as many bytes to a value, up to its NUL, into at most 'max' values; returns how many */
+int ctl_pack_string(const char *s, gint32 *values, int max)
+{
+	int size = MIN((int)strlen(s) + 1, max * (int)sizeof(gint32));
+
+	if (size <= 0)
+		return 0;
+	memset(values, 0, ((size + sizeof(gint32) - 1) / sizeof(gint32)) * sizeof(gint32));
+	memcpy(values, s, size - 1);
+	return (size + sizeof(gint32) - 1) / sizeof(gint32);
+}
+
+/* Unpack a string packed by ctl_pack_string() into 's' of 'size' bytes */
+void ctl_unpack_string(char *s, int size, const gint32 *values, int count)
+{
+	int len = MIN(size - 1, count * (int)sizeof(gint32));
+
+	memcpy(s, values, len);
+	s[len] = '\0';
+}
+
+/* Append a message to the output of 'cl'; FALSE if there is no room */
+static int client_put(client_t *cl, int type, int control, int index, int first,
+		      int count, int tag, const gint32 *values)
+{
+	ctl_message_t msg;
+
+	if (cl->out_len + sizeof(msg) + count * sizeof(gint32) > CTL_OUTPUT_BUFFER)
+		return FALSE;
+	msg.type = type;
+	msg.control = control;
+	msg.index = index;
+	msg.first = first;
+	msg.count = count;
+	msg.tag = tag;
+	memcpy(cl->out + cl->out_len, &msg, sizeof(msg));
+	cl->out_len += sizeof(msg);
+	if (count) {
+		memcpy(cl->out + cl->out_len, values, count * sizeof(gint32));
+		cl->out_len += count * sizeof(gint32);
+	}
+	return TRUE;
+}
+
+/* Owe 'cl' the value (OWE_VALUE) or description (OWE_INFO) of 'index' of control 'c' */
+static void client_owe(client_t *cl, control_t c, int index, int what)
+{
+	if (!cl->owed[c][index])
+		cl->owed_list[cl->nowed++] = c * MAX_CONTROL_INDEX + index;
+	cl->owed[c][index] |= what;
+}
+
+/* Put the description of 'index' of control 'c', and the names of its items */
+static void client_put_info(client_t *cl, control_t c, int index)
+{
+	gint32 values[CTL_MESSAGE_MAX_VALUES];
+	const control_range_t *r = control_range(c, index);
+	const char *name;
+	int item;
+
+	client_put(cl, CTL_MSG_INFO, c, index, 0,
+		   control_pack_info(c, index, values, CTL_MESSAGE_MAX_VALUES), 0, values);
+	if (r->type != SND_CTL_ELEM_TYPE_ENUMERATED)
+		return;
+	for (item = 0; item <= r->max; item++) {
+		if ((name = control_item_name(c, index, item)) == NULL)
+			name = "";
+		client_put(cl, CTL_MSG_ITEM, c, index, item,
+			   ctl_pack_string(name, values, CTL_MESSAGE_MAX_VALUES), 0, values);
+	}
+}
+
+/* Move what 'cl' is owed into its output, as far as there is room */
+static void client_fill(client_t *cl)
+{
+	gint32 values[CTL_MESSAGE_MAX_VALUES];
+	const size_t most = sizeof(ctl_message_t) + sizeof(values);
+	control_t c;
+	int n, index, items;
+
+	for (n = 0; n < cl->nowed; n++) {
+		c = cl->owed_list[n] / MAX_CONTROL_INDEX;
+		index = cl->owed_list[n] % MAX_CONTROL_INDEX;
+		/* the description, its items and the value, or none of them */
+		items = control_range(c, index)->type == SND_CTL_ELEM_TYPE_ENUMERATED ?
+			control_range(c, index)->max + 1 : 0;
+		if (cl->out_len + (items + 2) * most > CTL_OUTPUT_BUFFER)
+			break;
+		if (cl->owed[c][index] & OWE_INFO)
+			client_put_info(cl, c, index);
+		if ((cl->owed[c][index] & OWE_VALUE) &&
+		    control_range(c, index)->type != SND_CTL_ELEM_TYPE_NONE) {
+			control_read(c, index);
+			client_put(cl, CTL_MSG_VALUE, c, index, 0,
+				   control_pack(c, index, values, CTL_MESSAGE_MAX_VALUES), 0, values);
+		}
+		cl->owed[c][index] = 0;
+	}
+	memmove(cl->owed_list, cl->owed_list + n, (cl->nowed - n) * sizeof(cl->owed_list[0]));
+	cl->nowed -= n;
+	/* then the profile names, and the empty CTL_MSG_NAMES after them */
+	while (!cl->nowed && cl->names_next) {
+		if (cl->names_next > cl->names_max) {
+			if (client_put(cl, CTL_MSG_NAMES, 0, 0, 0, 0, 0, NULL))
+				cl->names_next = 0;
+			break;
+		}
+		values[0] = cl->names_next;
+		n = 1 + ctl_pack_string(profile_jobs_name(cl->names_next), values + 1, CTL_MESSAGE_MAX_VALUES - 1);
+		if (!client_put(cl, CTL_MSG_NAMES, 0, 0, 0, n, 0, values))
+			break;
+		cl->names_next++;
+	}
+	/* the answer to a sync follows everything owed before it */
+	for (n = 0; !cl->nowed && !cl->names_next && n < cl->nsyncs; n++)
+		if (!client_put(cl, CTL_MSG_SYNC, 0, 0, 0, 0, cl->syncs[n], NULL))
+			break;
+	if (n) {
+		memmove(cl->syncs, cl->syncs + n, (cl->nsyncs - n) * sizeof(cl->syncs[0]));
+		cl->nsyncs -= n;
+	}
+}
+
+static gboolean client_output(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+	client_t *cl = data;
+
+	client_fill(cl);
+	client_write(cl);
+	return TRUE;
+}
+
+/* Write what we can of the output of 'cl'; watch its socket for the rest */
+static void client_write(client_t *cl)
+{
+	ssize_t n;
+
+	while (cl->out_len > 0) {
+		if ((n = write(cl->fd, cl->out, cl->out_len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			client_close(cl);
+			return;
+		}
+		memmove(cl->out, cl->out + n, cl->out_len - n);
+		cl->out_len -= n;
+	}
+	if ((cl->out_len || client_owes(cl)) && !cl->output)
+		cl->output = watch_fd(cl->fd, WATCH_WRITE, client_output, cl);
+	else if (!cl->out_len && !client_owes(cl) && cl->output) {
+		g_source_remove(cl->output);
+		cl->output = 0;
+	}
+}
+
+static gboolean flush_clients(gpointer data)
+{
+	int i;
+
+	flush_idle = 0;
+	for (i = nclients - 1; i >= 0; i--) {
+		client_fill(clients[i]);
+		client_write(clients[i]);	/* may close it */
+	}
+	return FALSE;
+}
+
+static void flush_later(void)
+{
+	if (!flush_idle)
+		flush_idle = g_idle_add(flush_clients, NULL);
+}
+
+/* A profile job of a client is done: answer it, with the tag it sent */
+static void client_profile_done(profile_job_t *job, gpointer data)
+{
+	client_t *cl = client_find(GPOINTER_TO_UINT(data) >> 16);
+	gint32 result = job->result;
+
+	if (cl == NULL)
+		return;
+	client_put(cl, CTL_MSG_PROFILE, job->operation, 0, 0, 1, GPOINTER_TO_UINT(data) & 0xffff, &result);
+	flush_later();
+}
+
+/* MIDI learn bound a control for a client: tell it */
+static void client_learn_done(gpointer data)
+{
+	client_t *cl = client_find(GPOINTER_TO_UINT(data));
+
+	learner = 0;
+	if (cl == NULL)
+		return;
+	client_put(cl, CTL_MSG_LEARN, 0, 0, 0, 0, 0, NULL);
+	flush_later();
+}
+
+/* Carry out the request 'msg' of 'cl' */
+static void client_request(client_t *cl, const ctl_message_t *msg, const gint32 *values)
+{
+	gint32 answer[CTL_MESSAGE_MAX_VALUES];
+	char name[CTL_MESSAGE_MAX_VALUES * sizeof(gint32) + 1];
+	const control_range_t *r;
+	int i, n, metering;
+
+	switch (msg->type) {
+	case CTL_MSG_SUBSCRIBE:
+		metering = cl->subscribed & CTL_SUBSCRIBE_METERS;
+		cl->subscribed = msg->control & (CTL_SUBSCRIBE_CHANGES | CTL_SUBSCRIBE_METERS);
+		if ((cl->subscribed & CTL_SUBSCRIBE_METERS) != metering)
+			metering_changed();
+		return;
+	case CTL_MSG_RECALL:
+		if (msg->count > 0)
+			recall_profile(values[0], NULL, NULL);
+		return;
+	case CTL_MSG_SYNC:
+		if (cl->nsyncs < CTL_MAX_SYNCS)
+			cl->syncs[cl->nsyncs++] = msg->tag;
+		else	/* answering it answers the one it replaces */
+			cl->syncs[CTL_MAX_SYNCS - 1] = msg->tag;
+		flush_later();
+		return;
+	case CTL_MSG_CARD:
+		n = card_pack(answer, CTL_MESSAGE_MAX_VALUES);
+		if (n > 1 && midi_active())
+			answer[1] |= CTL_CARD_MIDI;
+		client_put(cl, CTL_MSG_CARD, 0, 0, 0, n, msg->tag, answer);
+		flush_later();
+		return;
+	case CTL_MSG_STEREO:
+		for (i = 0; i < msg->count; i++)
+			if (msg->first + i >= 1 && msg->first + i <= 20)
+				mixer_set_stereo(msg->first + i, values[i] != 0);
+		if (msg->count)
+			return;
+		for (i = 0; i < 20; i++)
+			answer[i] = mixer_stream_is_stereo(i + 1);
+		client_put(cl, CTL_MSG_STEREO, 0, 0, 1, 20, msg->tag, answer);
+		flush_later();
+		return;
+	case CTL_MSG_PROFILE:
+		if (msg->control > PROFILE_JOB_PRELOAD || msg->count < 1)
+			return;
+		ctl_unpack_string(name, sizeof(name), values + 1, msg->count - 1);
+		profile_job_submit(msg->control, values[0], name, NULL, client_profile_done,
+				   GUINT_TO_POINTER(cl->serial << 16 | msg->tag));
+		return;
+	case CTL_MSG_NAMES:
+		cl->names_max = profile_jobs_max_number();
+		cl->names_next = 1;
+		flush_later();
+		return;
+	case CTL_MSG_LEARN:
+		if (msg->control) {
+			learner = cl->serial;
+			midi_learn_start(client_learn_done, GUINT_TO_POINTER(cl->serial));
+		} else if (learner == cl->serial) {
+			midi_learn_cancel();
+			learner = 0;
+		}
+		return;
+	}
+	if (msg->control >= CTL_COUNT || msg->index >= MAX_CONTROL_INDEX)
+		return;
+	if (msg->type == CTL_MSG_INFO) {
+		client_owe(cl, msg->control, msg->index, OWE_INFO);
+		flush_later();
+		return;
+	}
+	r = control_range(msg->control, msg->index);
+	if (r->type != SND_CTL_ELEM_TYPE_BOOLEAN && r->type != SND_CTL_ELEM_TYPE_INTEGER &&
+	    r->type != SND_CTL_ELEM_TYPE_ENUMERATED && r->type != SND_CTL_ELEM_TYPE_IEC958)
+		return;
+	switch (msg->type) {
+	case CTL_MSG_READ:
+		client_owe(cl, msg->control, msg->index, OWE_VALUE);
+		flush_later();
+		break;
+	case CTL_MSG_WRITE:
+		if (!r->writable)
+			break;
+		control_read(msg->control, msg->index);
+		if (control_unpack(msg->control, msg->index, msg->first, values, msg->count))
+			control_queue(msg->control, msg->index);
+		break;
+	}
+}
+
+/* Apply all the requests 'cl' has sent as one batch of writes */
+static gboolean client_input(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+	client_t *cl = data;
+	ctl_message_t msg;
+	gint32 values[CTL_MESSAGE_MAX_VALUES];
+	ssize_t n;
+	int pos, size;
+
+	controls_batch_begin();
+	for (;;) {
+		if ((n = read(cl->fd, cl->in + cl->in_len, sizeof(cl->in) - cl->in_len)) <= 0) {
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+				client_close(cl);
+			break;
+		}
+		cl->in_len += n;
+		for (pos = 0; cl->in_len - pos >= (int)sizeof(msg); pos += size) {
+			memcpy(&msg, cl->in + pos, sizeof(msg));
+			if (msg.count > CTL_MESSAGE_MAX_VALUES) {
+				client_close(cl);	/* not speaking our protocol */
+				controls_batch_end();
+				return TRUE;
+			}
+			size = sizeof(msg) + msg.count * sizeof(gint32);
+			if (cl->in_len - pos < size)
+				break;
+			memcpy(values, cl->in + pos + sizeof(msg), msg.count * sizeof(gint32));
+			client_request(cl, &msg, values);
+		}
+		memmove(cl->in, cl->in + pos, cl->in_len - pos);
+		cl->in_len -= pos;
+	}
+	controls_batch_end();
+	return TRUE;
+}
+
+static gboolean accept_input(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+	client_t *cl;
+	int fd;
+
+	while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+		if (nclients == CTL_MAX_CLIENTS) {
+			close(fd);
+			continue;
+		}
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+		cl = g_new0(client_t, 1);
+		cl->fd = fd;
+		cl->serial = next_serial;
+		if (++next_serial > 0xffff)	/* shares a pointer with a tag, see client_request() */
+			next_serial = 1;
+		cl->out = g_malloc(CTL_OUTPUT_BUFFER);
+		cl->input = watch_fd(fd, WATCH_READ, client_input, cl);
+		clients[nclients++] = cl;
+	}
+	return TRUE;
+}
+
+/* 'index' of control 'c' changed: owe it to the clients subscribed to changes */
+void ctlserver_changed(control_t c, int index)
+{
+	int i;
+
+	for (i = 0; i < nclients; i++)
+		if (clients[i]->subscribed & CTL_SUBSCRIBE_CHANGES) {
+			client_owe(clients[i], c, index, OWE_VALUE);
+			flush_later();
+		}
+}
+
+/* Some client wants the meter frames */
+int ctlserver_metering(void)
+{
+	int i;
+
+	for (i = 0; i < nclients; i++)
+		if (clients[i]->subscribed & CTL_SUBSCRIBE_METERS)
+			return TRUE;
+	return FALSE;
+}
+
+/* The meters were read into 'peaks': send them to the clients subscribed */
+void ctlserver_meters(snd_ctl_elem_value_t *peaks)
+{
+	gint32 levels[MULTI_TRACK_PEAK_CHANNELS];
+	int i;
+
+	if (!ctlserver_metering())
+		return;
+	for (i = 0; i < MULTI_TRACK_PEAK_CHANNELS; i++)
+		levels[i] = snd_ctl_elem_value_get_integer(peaks, i);
+	for (i = nclients - 1; i >= 0; i--) {
+		if (!(clients[i]->subscribed & CTL_SUBSCRIBE_METERS) ||
+		    !client_put(clients[i], CTL_MSG_METERS, CTL_MULTI_TRACK_PEAK, 0, 0,
+				MULTI_TRACK_PEAK_CHANNELS, 0, levels))
+			continue;
+		client_write(clients[i]);
+	}
+}
+
+/*
+ * Serve the controls on the Unix socket 'path', readable by this user
+ * only; call after controls_init(). Returns 0, -EADDRINUSE if another
+ * instance serves it, or another negative errno.
+ */
+int ctlserver_init(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd, err;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -ENAMETOOLONG;
+	strcpy(addr.sun_path, path);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		return -errno;
+	/* a socket left behind by an instance that is gone is taken over */
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+		close(fd);
+		return -EADDRINUSE;
+	}
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    chmod(path, S_IRUSR | S_IWUSR) < 0 ||
+	    listen(fd, 8) < 0) {
+		err = -errno;
+		close(fd);
+		return err;
+	}
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	listen_fd = fd;
+	socket_path = g_strdup(path);
+	listen_input = watch_fd(fd, WATCH_READ, accept_input, NULL);
+	return 0;
+}
+
+/* The control socket of 'card' when not given --socket, for its clients to find */
+char *ctlserver_default_path(int card)
+{
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+
+	if (dir && *dir)
+		return g_strdup_printf("%s/mudita24-%i.sock", dir, card);
+	return g_strdup_printf("%s/mudita24-%u-%i.sock", g_get_tmp_dir(), (unsigned)getuid(), card);
+}
+
+void ctlserver_close(void)
+{
+	if (listen_fd < 0)
+		return;
+	if (flush_idle)
+		g_source_remove(flush_idle), flush_idle = 0;
+	while (nclients > 0)
+		client_close(clients[0]);
+	g_source_remove(listen_input);
+	close(listen_fd);
+	listen_fd = -1;
+	unlink(socket_path);
+	g_free(socket_path);
+	socket_path = NULL;
+}
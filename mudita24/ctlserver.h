@@ -0,0 +1,63 @@
+#ifndef CTLSERVER__H
+#define CTLSERVER__H
+
+#include <glib.h>
+
+/*
+ * The protocol of the control socket (--socket), see ctlserver.c. Every
+ * message, in either direction, is a ctl_message_t followed by 'count'
+ * gint32 values, in the byte order of the host: the socket is local.
+ * Controls are numbered as control_t in controls.h. The status bytes of
+ * an IEC958 control go four to a value, and strings as many bytes to a
+ * value, up to a NUL.
+ */
+enum {
+	CTL_MSG_READ = 1,	/* answered by a CTL_MSG_VALUE */
+	CTL_MSG_WRITE,		/* set channels 'first'... to the values */
+	CTL_MSG_SUBSCRIBE,	/* 'control': CTL_SUBSCRIBE_* flags, 0 for none */
+	CTL_MSG_RECALL,		/* recall the profile of the first value */
+	CTL_MSG_SYNC,		/* answered, with its 'tag', after all before it */
+	CTL_MSG_VALUE,		/* from the server: all channels of 'control', 'index' */
+	CTL_MSG_METERS,		/* from the server: the levels of the hardware peak meters */
+	CTL_MSG_INFO,		/* answered by a CTL_MSG_INFO: type, count, writable,
+				   notifies, min, max, then the dB scale's TLV words;
+				   only the type, _NONE, if the card hasn't it. The
+				   answer for an enumeration is followed by a
+				   CTL_MSG_ITEM for each item */
+	CTL_MSG_ITEM,		/* from the server: the name of item 'first' */
+	CTL_MSG_CARD,		/* answered by a CTL_MSG_CARD: number, CTL_CARD_*
+				   flags, the 32 bytes of the EEPROM, long name */
+	CTL_MSG_STEREO,		/* gang streams 'first'... (1-20) or not; with no
+				   values, answered by the gangs of all streams */
+	CTL_MSG_PROFILE,	/* 'control': PROFILE_JOB_*, of the profile of the
+				   first value, under the name that follows;
+				   answered, with its 'tag', by the result */
+	CTL_MSG_LEARN,		/* 'control' 1 starts MIDI learn, 0 cancels it; the
+				   server sends 'control' 0 once it has bound */
+	CTL_MSG_NAMES		/* answered by a CTL_MSG_NAMES for each profile up to
+				   the highest stored: its number, then its name;
+				   and by one without values after the last */
+};
+
+#define CTL_SUBSCRIBE_CHANGES	1	/* a CTL_MSG_VALUE whenever a control changed */
+#define CTL_SUBSCRIBE_METERS	2	/* a CTL_MSG_METERS whenever the meters are read */
+
+#define CTL_CARD_DMX6FIRE	1
+#define CTL_CARD_IEC958_STATUS	2	/* has "Delta IEC958 Input Status" */
+#define CTL_CARD_MIDI		4	/* the server has a MIDI port, for CTL_MSG_LEARN */
+
+#define CTL_MESSAGE_MAX_VALUES	32
+
+typedef struct {
+	guint8 type;		/* CTL_MSG_* */
+	guint8 control;
+	guint8 index;
+	guint8 first;		/* channel of the first value */
+	guint16 count;		/* of the values that follow */
+	guint16 tag;		/* for the client; copied into the answer to a CTL_MSG_SYNC */
+} ctl_message_t;
+
+int ctl_pack_string(const char *s, gint32 *values, int max);
+void ctl_unpack_string(char *s, int size, const gint32 *values, int count);
+
+#endif
@@ -0,0 +1,257 @@
+/*****************************************************************************
+   daemon.c - mudita24d, the card's controls without a window
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+******************************************************************************/
+
+/*
+ * mudita24d owns the card: its control handle and shadow, MIDI and the
+ * Mackie surface, OSC, the profiles and the control socket, on a GLib
+ * main loop and without GTK. Whatever works the mixer (the GUI, OSC
+ * clients, scripts on the socket) is one client among several. It runs
+ * until SIGINT or SIGTERM, reading the meters only while a surface or
+ * client is metering.
+ */
+
+#include "controls.h"
+#include "midi.h"
+#include "config.h"
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <glib-unix.h>
+
+static GMainLoop *daemon_loop;
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: mudita24d [-c card#] [-D control-name] [-f profiles-file] [-m channel-num] [-M] [-B] [-N] [-R midi-rate] [-U] [-O osc-port] [-P ping-count] [-S socket-path] [-r peak-sample-rate] [-k meter-mode] [-H peak-hold-ms] [-F peak-fallback-dB/s] [-q write-interval-ms]\n");
+	fprintf(stderr, "\t-c, --card\tAlsa card number to control\n");
+	fprintf(stderr, "\t-D, --device\tcontrol-name\n");
+	fprintf(stderr, "\t-f, --profiles_file\tuse file as profiles file\n");
+	fprintf(stderr, "\t-m, --midichannel\tmidi channel number for controller control\n");
+	fprintf(stderr, "\t-M, --midienhanced\tUse an enhanced mapping from midi controller to db slider\n");
+	fprintf(stderr, "\t-N, --midi_nrpn\tSet and send all attenuators by NRPN with 14 bit resolution\n");
+	fprintf(stderr, "\t-R, --midi_rate\tSend at most this many MIDI feedback messages per second, 0 for no limit (default %i)\n", DEFAULT_MIDI_RATE);
+	fprintf(stderr, "\t-U, --mackie\tWork the mixer from a Mackie Control surface on the MIDI port, 8 streams a page\n");
+	fprintf(stderr, "\t-O, --osc\tServe OSC on this UDP port of 127.0.0.1\n");
+	fprintf(stderr, "\t-P, --osc_ping\tPing the OSC server of -O this many times, print the round trip times and exit\n");
+	fprintf(stderr, "\t-S, --socket\tServe the controls on this Unix socket (default $XDG_RUNTIME_DIR/mudita24-<card#>.sock)\n");
+	fprintf(stderr, "\t-B, --midi_bank_select\tUse controllers 0 and 32 as bank select for program changes, which recall profiles\n");
+	fprintf(stderr, "\t-r, --peak_sample_rate\tRead hardware peak meters this many times per second (%i-%i, try 1000)\n\t\t from a separate thread, for accurate peak capture between 10Hz meter updates\n", MIN_PEAK_SAMPLE_RATE, MAX_PEAK_SAMPLE_RATE);
+	fprintf(stderr, "\t-k, --meter_mode\tMeter ballistics: peak (default), ppm1, ppm2, vu, k12, k14 or k20\n");
+	fprintf(stderr, "\t-H, --peak_hold\tHold peaks this many ms, then fall back; 0 (default) holds until reset\n");
+	fprintf(stderr, "\t-F, --peak_fallback\tFall back rate of held peaks in dB/s (default %.0f)\n", DEFAULT_PEAK_FALLBACK);
+	fprintf(stderr, "\t-q, --write_interval\tMinimum ms between writes of a dragged volume, 0 to write every change (default %i)\n", DEFAULT_WRITE_INTERVAL);
+}
+
+static gboolean daemon_quit(gpointer data)
+{
+	g_main_loop_quit(daemon_loop);
+	return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+	char *name = NULL, tmpname[16], *profiles_file_name = DEFAULT_PROFILERC;
+	char *socket_path = NULL;
+	int i, c, err;
+	int midi_fd = -1, midi_channel = -1, midi_enhanced = 0, mackie = 0;
+	int osc_port = 0, osc_ping_count = 0;
+	int peak_sample_rate = 0;
+	int meter_mode = METER_MODE_PEAK, peak_hold = 0;
+	double peak_fallback = DEFAULT_PEAK_FALLBACK;
+	int write_interval = DEFAULT_WRITE_INTERVAL;
+
+	static struct option long_options[] = {
+		{"device", 1, 0, 'D'},
+		{"card", 1, 0, 'c'},
+		{"profiles_file", 1, 0, 'f'},
+		{"midichannel", 1, 0, 'm'},
+		{"midienhanced", 0, 0, 'M'},
+		{"midi_nrpn", 0, 0, 'N'},
+		{"midi_rate", 1, 0, 'R'},
+		{"mackie", 0, 0, 'U'},
+		{"osc", 1, 0, 'O'},
+		{"osc_ping", 1, 0, 'P'},
+		{"socket", 1, 0, 'S'},
+		{"midi_bank_select", 0, 0, 'B'},
+		{"peak_sample_rate", 1, 0, 'r'},
+		{"meter_mode", 1, 0, 'k'},
+		{"peak_hold", 1, 0, 'H'},
+		{"peak_fallback", 1, 0, 'F'},
+		{"write_interval", 1, 0, 'q'},
+		{ NULL }
+	};
+
+	while ((c = getopt_long(argc, argv, "D:c:f:m:MBNUR:O:P:S:r:k:H:F:q:", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'D':
+			name = optarg;
+			if (index(optarg, ':')) {
+				card_number = snd_card_get_index(strchr(optarg, ':') + sizeof(char));
+				if (card_number < 0) {
+					fprintf(stderr, "mudita24d: invalid ALSA audio device, invalid index or name for card: %s\n", optarg);
+					exit(1);
+				}
+			}
+			break;
+		case 'c':
+			card_number = snd_card_get_index(optarg);
+			if (card_number < 0) {
+				fprintf(stderr, "mudita24d: invalid ALSA index or name for audio card: %s\n", optarg);
+				exit(1);
+			}
+			sprintf(tmpname, "hw:%d", card_number);
+			name = tmpname;
+			break;
+		case 'f':
+			profiles_file_name = optarg;
+			break;
+		case 'm':
+			midi_channel = atoi(optarg);
+			if (midi_channel < 1 || midi_channel > 16) {
+				fprintf(stderr, "mudita24d: invalid midi channel number %i\n", midi_channel);
+				exit(1);
+			}
+			--midi_channel;
+			break;
+		case 'M': midi_enhanced = 1; break;
+		case 'B': midi_bank_select(TRUE); break;
+		case 'N': midi_nrpn(TRUE); break;
+		case 'U': mackie_enable(TRUE); mackie = 1; break;
+		case 'O':
+			osc_port = atoi(optarg);
+			if (osc_port < 1 || osc_port > 65535) {
+				fprintf(stderr, "mudita24d: invalid OSC port %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'S': socket_path = optarg; break;
+		case 'P':
+			osc_ping_count = atoi(optarg);
+			if (osc_ping_count < 1)
+				osc_ping_count = DEFAULT_OSC_PING_COUNT;
+			break;
+		case 'R':
+			i = atoi(optarg);
+			if (i < 0 || i > MAX_MIDI_RATE) {
+				fprintf(stderr, "mudita24d: MIDI rate must be 0-%i messages/s\n", MAX_MIDI_RATE);
+				exit(1);
+			}
+			midi_rate(i);
+			break;
+		case 'r':
+			peak_sample_rate = atoi(optarg);
+			if (peak_sample_rate < MIN_PEAK_SAMPLE_RATE || peak_sample_rate > MAX_PEAK_SAMPLE_RATE) {
+				fprintf(stderr, "mudita24d: peak sample rate must be %i-%i Hz\n", MIN_PEAK_SAMPLE_RATE, MAX_PEAK_SAMPLE_RATE);
+				exit(1);
+			}
+			break;
+		case 'k':
+			if ((meter_mode = ballistics_parse_mode(optarg)) < 0) {
+				fprintf(stderr, "mudita24d: meter mode must be one of peak, ppm1, ppm2, vu, k12, k14, k20\n");
+				exit(1);
+			}
+			break;
+		case 'H':
+			peak_hold = atoi(optarg);
+			if (peak_hold < 0) {
+				fprintf(stderr, "mudita24d: invalid peak hold time %i ms\n", peak_hold);
+				exit(1);
+			}
+			break;
+		case 'F':
+			peak_fallback = atof(optarg);
+			if (peak_fallback <= 0.0) {
+				fprintf(stderr, "mudita24d: peak fallback must be greater than 0 dB/s\n");
+				exit(1);
+			}
+			break;
+		case 'q':
+			write_interval = atoi(optarg);
+			if (write_interval < 0 || write_interval > MAX_WRITE_INTERVAL) {
+				fprintf(stderr, "mudita24d: write interval must be 0-%i ms\n", MAX_WRITE_INTERVAL);
+				exit(1);
+			}
+			break;
+		default:
+			usage();
+			exit(1);
+			break;
+		}
+	}
+	if (optind < argc) {
+		usage();
+		exit(1);
+	}
+	if (osc_ping_count) {
+		if (!osc_port) {
+			fprintf(stderr, "mudita24d: --osc_ping needs the port of the server, -O\n");
+			exit(1);
+		}
+		exit(osc_ping(osc_port, osc_ping_count) < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+
+	if (card_open(name) < 0)
+		exit(EXIT_FAILURE);
+
+	controls_init(write_interval);
+	config_open();
+	ballistics_init(meter_mode, peak_hold, peak_fallback);
+	meters_init();
+	mixer_init();
+	if (midi_channel >= 0 || mackie)
+		midi_fd = midi_init(argv[0], midi_channel, midi_enhanced);
+	mackie_start();
+	if (osc_port && (err = osc_init(osc_port)) < 0)
+		fprintf(stderr, "Unable to serve OSC on port %i: %s\n", osc_port, strerror(-err));
+	if (peak_sample_rate > 0 && (err = peak_sampler_start(card_name(), peak_sample_rate)) < 0)
+		fprintf(stderr, "Unable to start peak sampler, metering at 10Hz: %s\n", snd_strerror(err));
+	if ((err = profile_jobs_start(card_name(), card_number, profiles_file_name)) < 0)
+		fprintf(stderr, "Unable to start profile worker, profiles are handled on the main loop: %s\n", snd_strerror(err));
+	/* recalls, from MIDI or any client, need no parsing once this is done */
+	profile_job_submit(PROFILE_JOB_PRELOAD, 0, NULL, NULL, NULL, NULL);
+	if (!socket_path)
+		socket_path = ctlserver_default_path(card_number);
+	if ((err = ctlserver_init(socket_path)) < 0) {
+		if (err == -EADDRINUSE)
+			fprintf(stderr, "Another mudita24d serves %s\n", socket_path);
+		else
+			fprintf(stderr, "Unable to serve %s: %s\n", socket_path, strerror(-err));
+		exit(EXIT_FAILURE);
+	}
+
+	daemon_loop = g_main_loop_new(NULL, FALSE);
+	controls_watch();
+	if (midi_fd >= 0)
+		watch_fd(midi_fd, WATCH_READ, midi_process, NULL);
+	/* the meters are only read while something is listening to them */
+	meters_suspend(TRUE);
+	metering_changed();	/* e.g. a Mackie surface, found already */
+	g_unix_signal_add(SIGINT, daemon_quit, NULL);
+	g_unix_signal_add(SIGTERM, daemon_quit, NULL);
+	g_main_loop_run(daemon_loop);
+
+	controls_close();
+	profile_jobs_stop();
+	peak_sampler_stop();
+	card_close();
+	midi_close();
+	osc_close();
+	ctlserver_close();
+	config_close();
+	g_main_loop_unref(daemon_loop);
+	return EXIT_SUCCESS;
+}
@@ -17,72 +17,197 @@
    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 ******************************************************************************/
 
-#include "envy24control.h"
+/*
+ * All events pending on the control handle are read in one go. Each is
+ * mapped from its numid to a control_t by control_event(), duplicates
+ * for the same element are dropped, and only then is each changed
+ * element dispatched once: to the clients of the control socket, to the
+ * MIDI and surface feedback, and to the handlers set by the GUI with
+ * control_handlers(). Handlers that refresh a whole group of controls
+ * (the clock, the patchbay) run once per batch however many of their
+ * controls changed, so a profile restore costs one GUI update per
+ * element rather than one per event.
+ *
+ * Changes made here from MIDI input are dispatched the same way, without
+ * the socket (which hears of them from the card), once they have rested
+ * for WIDGET_REFRESH_INTERVAL: see control_refresh_later().
+ */
 
-void control_input_callback(gpointer data, gint source, GdkInputCondition condition)
+#include "controls.h"
+#include "midi.h"
+
+#define MAX_UPDATE_ALL 8	/* distinct update_all handlers of the GUI */
+
+/* a set of changed elements, each listed once */
+typedef struct {
+	unsigned char queued[CTL_COUNT][MAX_CONTROL_INDEX];
+	struct {
+		control_t control;
+		int index;
+	} list[CTL_COUNT * MAX_CONTROL_INDEX];
+	int count;
+} change_set_t;
+
+static change_set_t changes;	/* from the card's events */
+static change_set_t refreshes;	/* made here, see control_refresh_later() */
+static guint refresh_timeout = 0;
+static const control_handler_t *widget_handlers = NULL;
+
+static void stream_volume_changed(control_t c, int index)
+{
+	int base = c == CTL_MULTI_PLAYBACK_VOLUME ? 1 : c == CTL_HW_MULTI_CAPTURE_VOLUME ? 11 : 19;
+
+	mixer_stream_changed(base + index, 1, 0);
+}
+
+static void stream_switch_changed(control_t c, int index)
+{
+	int base = c == CTL_MULTI_PLAYBACK_SWITCH ? 1 : c == CTL_HW_MULTI_CAPTURE_SWITCH ? 11 : 19;
+
+	mixer_stream_changed(base + index, 0, 1);
+}
+
+static void analog_volume_changed(control_t c, int index)
+{
+	int err;
+
+	if ((err = control_read(c, index)) < 0) {
+		g_print("Unable to read %s: %s\n", control_name(c), snd_strerror(err));
+		return;
+	}
+	midi_analog_volume(c, index, control_get(c, index, 0));
+}
+
+/* the MIDI and surface feedback, with or without the GUI */
+static void (* const feedback[CTL_COUNT])(control_t c, int index) = {
+	[CTL_MULTI_PLAYBACK_VOLUME]	  = stream_volume_changed,
+	[CTL_HW_MULTI_CAPTURE_VOLUME]	  = stream_volume_changed,
+	[CTL_IEC958_MULTI_CAPTURE_VOLUME] = stream_volume_changed,
+	[CTL_MULTI_PLAYBACK_SWITCH]	  = stream_switch_changed,
+	[CTL_HW_MULTI_CAPTURE_SWITCH]	  = stream_switch_changed,
+	[CTL_IEC958_MULTI_CAPTURE_SWITCH] = stream_switch_changed,
+	[CTL_DAC_VOLUME]		  = analog_volume_changed,
+	[CTL_ADC_VOLUME]		  = analog_volume_changed,
+	[CTL_IPGA_VOLUME]		  = analog_volume_changed,
+};
+
+static void change_add(change_set_t *set, control_t c, int index)
+{
+	if (set->queued[c][index])
+		return;
+	set->queued[c][index] = TRUE;
+	set->list[set->count].control = c;
+	set->list[set->count].index = index;
+	set->count++;
+}
+
+/* Dispatch and empty 'set'; to the socket's clients too if 'serve' */
+static void change_dispatch(change_set_t *set, int serve)
+{
+	void (*called[MAX_UPDATE_ALL])(void);
+	const control_handler_t *h;
+	control_t c;
+	int i, j, index, count = set->count, ncalled = 0;
+
+	set->count = 0;
+	for (i = 0; i < count; i++) {
+		c = set->list[i].control;
+		index = set->list[i].index;
+		set->queued[c][index] = FALSE;
+		if (serve)
+			ctlserver_changed(c, index);
+		if (feedback[c])
+			feedback[c](c, index);
+		if (widget_handlers == NULL)
+			continue;
+		h = &widget_handlers[c];
+		if (h->update) {
+			h->update(index);
+		} else if (h->update_all) {
+			for (j = 0; j < ncalled && called[j] != h->update_all; j++)
+				;
+			if (j < ncalled)
+				continue;
+			if (ncalled < MAX_UPDATE_ALL)
+				called[ncalled++] = h->update_all;
+			h->update_all();
+		}
+	}
+}
+
+/* Have the GUI's 'handlers', indexed by control_t, refresh its widgets */
+void control_handlers(const control_handler_t *handlers)
+{
+	widget_handlers = handlers;
+}
+
+/* Note that 'index' of control 'c' changed on the card */
+void control_changed(control_t c, int index)
+{
+	change_add(&changes, c, index);
+}
+
+/* Dispatch the changes noted by control_changed() */
+void control_changes_dispatch(void)
+{
+	change_dispatch(&changes, TRUE);
+}
+
+static gboolean control_refresh(gpointer data)
+{
+	refresh_timeout = 0;
+	change_dispatch(&refreshes, FALSE);
+	return FALSE;
+}
+
+/*
+ * 'index' of control 'c' was changed in the shadow for MIDI: send its
+ * feedback and refresh its widgets once per WIDGET_REFRESH_INTERVAL.
+ */
+void control_refresh_later(control_t c, int index)
+{
+	change_add(&refreshes, c, index);
+	if (!refresh_timeout)
+		refresh_timeout = g_timeout_add(WIDGET_REFRESH_INTERVAL, control_refresh, NULL);
+}
+
+static gboolean control_input_callback(GIOChannel *source, GIOCondition condition, gpointer data)
 {
 	snd_ctl_t *ctl = (snd_ctl_t *)data;
 	snd_ctl_event_t *ev;
-	const char *name;
+	control_t c;
 	int index;
-	unsigned int mask;
 
 	snd_ctl_event_alloca(&ev);
-	if (snd_ctl_read(ctl, ev) < 0)
-		return;
-	name = snd_ctl_event_elem_get_name(ev);
-	index = snd_ctl_event_elem_get_index(ev);
-	mask = snd_ctl_event_elem_get_mask(ev);
-	if (! (mask & (SND_CTL_EVENT_MASK_VALUE | SND_CTL_EVENT_MASK_INFO)))
-		return;
-
-	switch (snd_ctl_event_elem_get_interface(ev)) {
-	case SND_CTL_ELEM_IFACE_MIXER:
-		if (!strcmp(name, "Word Clock Sync"))
-			master_clock_update();
-		else if (!strcmp(name, "Multi Track Volume Rate"))
-			volume_change_rate_update();
-		else if (!strcmp(name, "IEC958 Input Optical"))
-			spdif_input_update();
-		else if (!strcmp(name, "Delta IEC958 Output Defaults"))
-			spdif_output_update();
-		else if (!strcmp(name, "Multi Track Internal Clock"))
-			master_clock_update();
-		else if (!strcmp(name, "Multi Track Internal Clock Default"))
-			master_clock_update();
-		else if (!strcmp(name, "Multi Track Rate Locking"))
-			rate_locking_update();
-		else if (!strcmp(name, "Multi Track Rate Reset"))
-			rate_reset_update();
-		else if (!strcmp(name, "Multi Playback Volume"))
-			mixer_update_stream(index + 1, 1, 0);
-		else if (!strcmp(name, "H/W Multi Capture Volume"))
-			mixer_update_stream(index + 11, 1, 0);
-		else if (!strcmp(name, "IEC958 Multi Capture Volume"))
-			mixer_update_stream(index + 19, 1, 0);
-		else if (!strcmp(name, "Multi Playback Switch"))
-			mixer_update_stream(index + 1, 0, 1);
-		else if (!strcmp(name, "H/W Multi Capture Switch"))
-			mixer_update_stream(index + 11, 0, 1);
-		else if (!strcmp(name, "IEC958 Multi Capture Switch"))
-			mixer_update_stream(index + 19, 0, 1);
-		else if (!strcmp(name, "H/W Playback Route"))
-			patchbay_update();
-		else if (!strcmp(name, "IEC958 Playback Route"))
-			patchbay_update();
-		else if (!strcmp(name, "DAC Volume"))
-			dac_volume_update(index);
-		else if (!strcmp(name, "ADC Volume"))
-			adc_volume_update(index);
-		else if (!strcmp(name, "IPGA Analog Capture Volume"))
-			ipga_volume_update(index);
-		else if (!strcmp(name, "Output Sensitivity Switch"))
-			dac_sense_update(index);
-		else if (!strcmp(name, "Input Sensitivity Switch"))
-			adc_sense_update(index);
-		break;
-	default:
-		break;
+	/* the handle is non-blocking: read until the queue is empty */
+	while (snd_ctl_read(ctl, ev) > 0) {
+		if (snd_ctl_event_get_type(ev) != SND_CTL_EVENT_ELEM)
+			continue;
+		if (! (snd_ctl_event_elem_get_mask(ev) & (SND_CTL_EVENT_MASK_VALUE | SND_CTL_EVENT_MASK_INFO)))
+			continue;
+		if (!control_event(snd_ctl_event_elem_get_numid(ev), &c, &index))
+			continue;
+		control_changed(c, index);
 	}
+	control_changes_dispatch();
+	return TRUE;
 }
 
+/* Watch the card's control events */
+void controls_watch(void)
+{
+	struct pollfd *pfds;
+	int i, npfds;
+
+	if (ctlclient_connected())
+		return;		/* the events come from mudita24d */
+	npfds = snd_ctl_poll_descriptors_count(ctl);
+	if (npfds <= 0)
+		return;
+	pfds = alloca(sizeof(*pfds) * npfds);
+	npfds = snd_ctl_poll_descriptors(ctl, pfds, npfds);
+	for (i = 0; i < npfds; i++)
+		watch_fd(pfds[i].fd, WATCH_READ, control_input_callback, ctl);
+	snd_ctl_nonblock(ctl, 1); /* control_input_callback() drains all pending events */
+	snd_ctl_subscribe_events(ctl, 1);
+}
@@ -58,16 +58,12 @@
 #define _GNU_SOURCE
 #include <getopt.h>
 
-int input_channels, output_channels, pcm_output_channels, spdif_channels, view_spdif_playback, card_number;
-int card_is_dmx6fire = FALSE, tall_equal_mixer_ht = FALSE;
+extern int input_channels, output_channels, pcm_output_channels, spdif_channels, view_spdif_playback;
+int tall_equal_mixer_ht = FALSE;
 int no_scale_marks = FALSE, channel_group_modulus = 2; /* NPM added options */
 GdkColor *meter_bg = NULL, *meter_fg = NULL; /* NPM added options */
-int card_has_delta_iec958_input_status = FALSE; /* NPM added to support "Delta IEC958 Input Status" */
 char *profiles_file_name, *default_profile;
 
-ice1712_eeprom_t card_eeprom;
-snd_ctl_t *ctl;
-
 GtkWidget *window;
 
 GtkWidget *mixer_mix_drawing;
@@ -168,7 +164,9 @@ SliderScale    ipga_volume_scales[10];
 struct profile_button {
 	GtkWidget *toggle_button;
 	GtkWidget *entry;
-} profiles_toggle_buttons[MAX_PROFILES];
+} *profiles_toggle_buttons = NULL;
+gint profiles_count = 0;
+GtkWidget *profiles_box;
 
 GtkWidget *active_button = NULL;
 GtkObject *card_number_adj;
@@ -308,6 +306,8 @@ static void create_mixer_frame(GtkWidget *box, int stream)
   //             ? TRUE
   //             : (stream%channel_group_modulus));
   gtk_widget_show(vscale);
+  g_signal_connect(G_OBJECT(vscale), "button-release-event",
+                   G_CALLBACK (scale_btrelease_handler), NULL);
 
   // TER: Create list of scale marking positions, connect handlers, then pack.
   scale_add_marks(GTK_SCALE(vscale), 
@@ -373,6 +373,8 @@ static void create_mixer_frame(GtkWidget *box, int stream)
   //             ? FALSE
   //             : ((stream-1)%channel_group_modulus));
   gtk_widget_show(vscale);
+  g_signal_connect(G_OBJECT(vscale), "button-release-event",
+                   G_CALLBACK (scale_btrelease_handler), NULL);
 
   // TER: Create list of scale marking positions, connect handlers.
   scale_add_marks(GTK_SCALE(vscale), 
@@ -436,7 +438,7 @@ static void create_mixer_frame(GtkWidget *box, int stream)
 	gtk_box_pack_end(GTK_BOX(vbox), toggle, FALSE, FALSE, 0);
 	/* gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(toggle), TRUE); */
 	g_signal_connect(GTK_OBJECT(toggle), "toggled",
-			   G_CALLBACK(config_set_stereo), (gpointer)(long)(stream - 1)); /* NPM: use (long) to fix "envy24control.c:251: warning: cast to pointer from integer of different size" */
+			   G_CALLBACK(mixer_toggled_stereo), (gpointer)(long)stream);
 
 	hbox = gtk_hbox_new(TRUE, 3);
 	gtk_widget_show(hbox);
@@ -1743,6 +1745,8 @@ static void create_analog_volume(GtkWidget *main, GtkWidget *notebook, int page)
     //draw_dac_scale_markings(GTK_SCALE(vscale), (i%channel_group_modulus) ? GTK_POS_RIGHT : GTK_POS_LEFT);
 		gtk_scale_set_draw_value(GTK_SCALE(vscale), FALSE); /* NPM: don't draw scale value since we're displaying in dB's */
 		gtk_widget_show(vscale);
+    g_signal_connect(G_OBJECT(vscale), "button-release-event",
+                       G_CALLBACK (scale_btrelease_handler), NULL);
     
     // TER: Create list of scale marking positions.
     scale_add_marks(GTK_SCALE(vscale), 
@@ -1857,6 +1861,8 @@ static void create_analog_volume(GtkWidget *main, GtkWidget *notebook, int page)
     //draw_adc_scale_markings(GTK_SCALE(vscale), (i%channel_group_modulus) ? GTK_POS_RIGHT : GTK_POS_LEFT);
 		gtk_scale_set_draw_value(GTK_SCALE(vscale), FALSE); /* NPM: don't draw scale value since we're displaying in dB's */
 		gtk_widget_show(vscale);
+    g_signal_connect(G_OBJECT(vscale), "button-release-event",
+                       G_CALLBACK (scale_btrelease_handler), NULL);
     
     // TER: Create list of scale marking positions.
     scale_add_marks(GTK_SCALE(vscale), 
@@ -1962,6 +1968,8 @@ static void create_analog_volume(GtkWidget *main, GtkWidget *notebook, int page)
 		vscale = gtk_vscale_new(GTK_ADJUSTMENT(adj));
 		gtk_scale_set_draw_value(GTK_SCALE(vscale), FALSE);
 		gtk_widget_show(vscale);
+    g_signal_connect(G_OBJECT(vscale), "button-release-event",
+                       G_CALLBACK (scale_btrelease_handler), NULL);
 
     // TER: Create list of scale marking positions.
     scale_add_marks(GTK_SCALE(vscale), 
@@ -2016,7 +2024,7 @@ int index_active_profile()
 	gboolean found;
 
 	found = FALSE;
-	for (index = 0; index < MAX_PROFILES; index++)
+	for (index = 0; index < profiles_count; index++)
 	{
 		if (active_button == profiles_toggle_buttons[index].toggle_button) {
 			found = TRUE;
@@ -2030,12 +2038,40 @@ int index_active_profile()
 	return NOTFOUND;
 }
 
-int delete_card_number(GtkWidget *delete_button)
+/* The name of 'profile_number', from mudita24d's profiles when its client */
+static const char *profile_name_of(const int profile_number)
+{
+	static char number[PROFILE_NAME_FIELD_LENGTH];
+	const char *name;
+
+	if (!ctlclient_connected())
+		return get_profile_name(profile_number, card_number, profiles_file_name);
+	if ((name = ctlclient_profile_name(profile_number)) == NULL)
+		snprintf(number, sizeof(number), "%d", profile_number);
+	return name != NULL ? name : number;
+}
+
+static void delete_card_done(profile_job_t *job, gpointer data)
 {
-	gint res;
+	GtkWidget *delete_button = data;
 	gint card_nr;
 	gint index;
 
+	card_nr = gtk_adjustment_get_value(GTK_ADJUSTMENT(card_number_adj));
+	if ((job->result >= 0) && (card_nr == card_number)) {
+		for (index = 0; index < profiles_count; index++)
+		{
+			gtk_entry_set_text(GTK_ENTRY (profiles_toggle_buttons[index].entry), profile_name_of(index + 1));
+		}
+	}
+
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON (delete_button), FALSE);
+}
+
+int delete_card_number(GtkWidget *delete_button)
+{
+	gint card_nr;
+
 	if (!gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON (delete_button)))
 		return EXIT_SUCCESS;
 
@@ -2049,51 +2085,64 @@ int delete_card_number(GtkWidget *delete_button)
 		return -EINVAL;
 	}
 
-	res = delete_card(card_number, profiles_file_name);
-	if (res < 0) {
-		gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON (delete_button), FALSE);
-		return res;
-	}
-	if (card_nr == card_number) {
-		for (index = 0; index < MAX_PROFILES; index++)
-		{
-			gtk_entry_set_text(GTK_ENTRY (profiles_toggle_buttons[index].entry), get_profile_name(index + 1, card_number, profiles_file_name));
-		}
-	}
-
-	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON (delete_button), FALSE);
+	/* the button stays down until the worker is done */
+	profile_job_submit(PROFILE_JOB_DELETE, 0, NULL, NULL, delete_card_done, delete_button);
 
 	return EXIT_SUCCESS;
 }
 
 int restore_active_profile(const gint profile_number)
 {
-	gint res;
+	profile_job_submit(PROFILE_JOB_RESTORE, profile_number, NULL, NULL, NULL, NULL);
+
+	return EXIT_SUCCESS;
+}
+
+static gint recalling = FALSE;
+
+/*
+ * profile_number is being recalled on behalf of MIDI or a client: show it
+ * as the active profile, also if it already was, without restoring it
+ * again from the toggle.
+ */
+static void profile_recalled(int profile_number)
+{
+	if ((profile_number > 0) && (profile_number <= profiles_count)) {
+		recalling = TRUE;
+		gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON (profiles_toggle_buttons[profile_number - 1].toggle_button), TRUE);
+		recalling = FALSE;
+	}
+}
 
-	res = save_restore(ALSACTL_OP_RESTORE, profile_number, card_number, profiles_file_name, NULL);
+static void add_profile_button(void);
 
-	return res;
+static void save_active_profile_done(profile_job_t *job, gpointer data)
+{
+	GtkWidget *save_button = data;
+
+	/* there is always an unused profile after the last one saved */
+	if ((job->result == EXIT_SUCCESS) && (job->profile_number == profiles_count))
+		add_profile_button();
+
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON (save_button), FALSE);
 }
 
 int save_active_profile(GtkWidget *save_button)
 {
-	gint res;
 	gint index;
 
 	if (!gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON (save_button)))
 		return EXIT_SUCCESS;
-	if ((index = index_active_profile()) >= 0) {
-		res = save_restore(ALSACTL_OP_STORE, index + 1, card_number, profiles_file_name, \
-			gtk_entry_get_text(GTK_ENTRY (profiles_toggle_buttons[index].entry)));
-	} else {
+	if ((index = index_active_profile()) < 0) {
 		fprintf(stderr, "No active profile found.\n");
 		gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON (save_button), FALSE);
 		return -EXIT_FAILURE;
 	}
+	/* the button stays down until the worker is done */
+	profile_job_submit(PROFILE_JOB_SAVE, index + 1, gtk_entry_get_text(GTK_ENTRY (profiles_toggle_buttons[index].entry)),
+			   NULL, save_active_profile_done, save_button);
 
-	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON (save_button), FALSE);
-
-	return res;
+	return EXIT_SUCCESS;
 }
 
 void entry_toggle_editable(GtkWidget *toggle_button, GtkWidget *entry)
@@ -2113,7 +2162,7 @@ void entry_toggle_editable(GtkWidget *toggle_button, GtkWidget *entry)
 	if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON (toggle_button))) {
 		gtk_widget_grab_focus(entry);
 		profile_number = NOTFOUND;
-		for (index = 0; index < MAX_PROFILES; index++)
+		for (index = 0; index < profiles_count; index++)
 		{
 			if (profiles_toggle_buttons[index].toggle_button != toggle_button) {
 				gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON (profiles_toggle_buttons[index].toggle_button), FALSE);
@@ -2121,7 +2170,7 @@ void entry_toggle_editable(GtkWidget *toggle_button, GtkWidget *entry)
 				profile_number = index + 1;
 			}
 		}
-		if (profile_number >= 0)
+		if ((profile_number >= 0) && !recalling)
 			restore_active_profile(profile_number);
 	}
 }
@@ -2164,6 +2213,18 @@ static GtkWidget *toggle_button_entry(const GtkWidget *parent, const gchar *prof
 	return (toggle_button);
 }
 
+/* append the button for profile number profiles_count + 1 */
+static void add_profile_button(void)
+{
+	const gchar *profile_name;
+
+	profiles_toggle_buttons = g_renew(struct profile_button, profiles_toggle_buttons, profiles_count + 1);
+	profile_name = profile_name_of(profiles_count + 1);
+	profiles_toggle_buttons[profiles_count].toggle_button = toggle_button_entry(window, profile_name, profiles_count);
+	gtk_box_pack_start(GTK_BOX (profiles_box), profiles_toggle_buttons[profiles_count].toggle_button, FALSE, FALSE, 0);
+	profiles_count++;
+}
+
 static void create_profiles(GtkWidget *main, GtkWidget *notebook, int page)
 {
 	GtkWidget *label;
@@ -2178,11 +2239,8 @@ static void create_profiles(GtkWidget *main, GtkWidget *notebook, int page)
 	GtkWidget *card_button;
 	GtkWidget *scrolledwindow;
 	GtkWidget *viewport;
-	gint index;
 	gint profile_number;
-	gchar *profile_name;
 	gint max_profiles;
-	gint max_digits;
 
 	hbox = gtk_hbox_new(FALSE, 0);
 	gtk_widget_show(hbox);
@@ -2213,14 +2271,21 @@ static void create_profiles(GtkWidget *main, GtkWidget *notebook, int page)
 
 
 	/* Create button boxes */
-	vbox1 = gtk_vbutton_box_new();
+	profiles_box = vbox1 = gtk_vbutton_box_new();
 
 	gtk_vbutton_box_set_spacing_default(0);
-	for (index = 0; index < MAX_PROFILES; index++)	{
-		profile_name = get_profile_name(index + 1, card_number, profiles_file_name);
-		profiles_toggle_buttons[index].toggle_button = toggle_button_entry(window, profile_name, index);
-		gtk_box_pack_start(GTK_BOX (vbox1), profiles_toggle_buttons[index].toggle_button, FALSE, FALSE, 0);
-	}
+	/* all stored profiles and at least one unused */
+	if (ctlclient_connected())
+		max_profiles = ctlclient_profiles() + 1;
+	else
+		max_profiles = get_max_profile_number(card_number, profiles_file_name) + 1;
+	if (max_profiles < DEFAULT_PROFILES)
+		max_profiles = DEFAULT_PROFILES;
+	while (profiles_count < max_profiles)
+		add_profile_button();
+	/* recalls, also of the default profile, need no parsing once this is done */
+	if (!ctlclient_connected())	/* else mudita24d preloaded its own */
+		profile_job_submit(PROFILE_JOB_PRELOAD, 0, NULL, NULL, NULL, NULL);
 	gtk_widget_show(vbox1);
 	gtk_container_set_border_width(GTK_CONTAINER(vbox1), 6);
 
@@ -2266,24 +2331,17 @@ static void create_profiles(GtkWidget *main, GtkWidget *notebook, int page)
 	if (default_profile != NULL)
 	{
 		/*
-		 * only if default_profile is numerical and lower or equal than MAX_PROFILES it will be a profile_number
+		 * only if default_profile is numerical and one of the profile buttons it will be a profile_number
 		 * otherwise it will be a profile name
 		 */
-		if (strcspn(default_profile, "0123456789") == 0) {
-			for (max_profiles = MAX_PROFILES, max_digits = 0; max_profiles > 9; max_digits++, max_profiles /= 10)
-				;
-			max_digits++;
-			if (strlen(default_profile) <= max_digits) {
-				profile_number = atoi(default_profile);
-				if (profile_number < 1 || profile_number > MAX_PROFILES)
-					profile_number = get_profile_number(default_profile, card_number, profiles_file_name);
-			} else {
-				profile_number = get_profile_number(default_profile, card_number, profiles_file_name);
-			}
-		} else {
+		profile_number = NOTFOUND;
+		if (strspn(default_profile, "0123456789") == strlen(default_profile))
+			profile_number = atoi(default_profile);
+		if ((profile_number < 1 || profile_number > profiles_count) && ctlclient_connected())
+			profile_number = ctlclient_profile_number(default_profile);
+		else if (profile_number < 1 || profile_number > profiles_count)
 			profile_number = get_profile_number(default_profile, card_number, profiles_file_name);
-		}
-		if ((profile_number > 0) && (profile_number <= MAX_PROFILES)) {
+		if ((profile_number > 0) && (profile_number <= profiles_count)) {
 			gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON (profiles_toggle_buttons[profile_number - 1].toggle_button), TRUE);
 		} else {
 			fprintf(stderr, "Cannot find profile '%s' for card '%d'.\n", default_profile, card_number);
@@ -2291,6 +2349,23 @@ static void create_profiles(GtkWidget *main, GtkWidget *notebook, int page)
 	}
 }
 
+/* MIDI learn bound a control and a message: release the toggle */
+static void midi_learn_done(gpointer data)
+{
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(data), FALSE);
+}
+
+static void midi_learn_toggled(GtkWidget *togglebutton, gpointer data)
+{
+	if (!gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(togglebutton))) {
+		midi_learn_cancel();
+		gtk_button_set_label(GTK_BUTTON(togglebutton), "MIDI Learn");
+		return;
+	}
+	midi_learn_start(midi_learn_done, togglebutton);
+	gtk_button_set_label(GTK_BUTTON(togglebutton), "Move a control and a MIDI controller");
+}
+
 static void create_outer(GtkWidget *main)
 {
         GtkWidget *hbox1;
@@ -2361,6 +2436,15 @@ static void create_outer(GtkWidget *main)
 	gtk_container_set_border_width(GTK_CONTAINER(mixer_clear_peaks_button), 4);
 	g_signal_connect(GTK_OBJECT(mixer_clear_peaks_button), "clicked",
 			   G_CALLBACK(level_meters_reset_peaks), NULL);
+
+	if (midi_active() || ctlclient_has_midi()) {
+		GtkWidget *toggle = gtk_toggle_button_new_with_label("MIDI Learn");
+		gtk_widget_show(toggle);
+		gtk_box_pack_start(GTK_BOX(vbox), toggle, TRUE, FALSE, 0);
+		gtk_container_set_border_width(GTK_CONTAINER(toggle), 4);
+		g_signal_connect(GTK_OBJECT(toggle), "toggled",
+				   G_CALLBACK(midi_learn_toggled), NULL);
+	}
 }/* End create_outer  */
 
 static void create_blank(GtkWidget *main, GtkWidget *notebook, int page)
@@ -2384,7 +2468,7 @@ static void create_blank(GtkWidget *main, GtkWidget *notebook, int page)
 
 static void usage(void)
 {
-	fprintf(stderr, "usage: mudita24 [-c card#] [-D control-name] [-o num-outputs] [-i num-inputs] [-p num-pcm-outputs] [-s num-spdif-in/outs] [-v] [-f profiles-file] [profile name|profile id] [-m channel-num] [-w initial-window-width] [-t height-num] [-n]\n");
+	fprintf(stderr, "usage: mudita24 [-c card#] [-D control-name] [-o num-outputs] [-i num-inputs] [-p num-pcm-outputs] [-s num-spdif-in/outs] [-v] [-f profiles-file] [profile name|profile id] [-m channel-num] [-B] [-N] [-R midi-rate] [-U] [-O osc-port] [-P ping-count] [-S socket-path] [-w initial-window-width] [-t height-num] [-n] [-r peak-sample-rate] [-k meter-mode] [-H peak-hold-ms] [-F peak-fallback-dB/s] [-q write-interval-ms]\n");
 	fprintf(stderr, "\t-c, --card\tAlsa card number to control\n");
 	fprintf(stderr, "\t-D, --device\tcontrol-name\n");
 	fprintf(stderr, "\t-o, --outputs\tLimit number of analog line outputs to display\n");
@@ -2395,24 +2479,218 @@ static void usage(void)
 	fprintf(stderr, "\t-f, --profiles_file\tuse file as profiles file\n");
 	fprintf(stderr, "\t-m, --midichannel\tmidi channel number for controller control\n");
 	fprintf(stderr, "\t-M, --midienhanced\tUse an enhanced mapping from midi controller to db slider\n");
+	fprintf(stderr, "\t-N, --midi_nrpn\tSet and send all attenuators by NRPN with 14 bit resolution\n");
+	fprintf(stderr, "\t-R, --midi_rate\tSend at most this many MIDI feedback messages per second, 0 for no limit (default %i)\n", DEFAULT_MIDI_RATE);
+	fprintf(stderr, "\t-U, --mackie\tWork the mixer from a Mackie Control surface on the MIDI port, 8 streams a page\n");
+	fprintf(stderr, "\t-O, --osc\tServe OSC on this UDP port of 127.0.0.1\n");
+	fprintf(stderr, "\t-P, --osc_ping\tPing the OSC server of -O this many times, print the round trip times and exit\n");
+	fprintf(stderr, "\t-S, --socket\tServe the controls on this Unix socket\n");
+	fprintf(stderr, "\t-B, --midi_bank_select\tUse controllers 0 and 32 as bank select for program changes, which recall profiles\n");
 	fprintf(stderr, "\t-w, --window_width\tSet initial window width (try 2,6 or 8; 280,626, or 968)\n");
 	fprintf(stderr, "\t-t, --tall_eq_mixer_heights\tSet taller height mixer displays (1-9)\n");
 	fprintf(stderr, "\t-n, --no_scale_mark\tDisable scale marks, which may be incorrect on certain cards (?),\n\t\t or whose Gtk-detent at the mark position may be annoying\n");
-	fprintf(stderr, "\n\tThe program 'alsactl' is automatically found and used.\n\tEnvironment variable ALSACTL_PROG overrides its location.\n");
+	fprintf(stderr, "\t-r, --peak_sample_rate\tRead hardware peak meters this many times per second (%i-%i, try 1000)\n\t\t from a separate thread, for accurate peak capture between 10Hz meter updates\n", MIN_PEAK_SAMPLE_RATE, MAX_PEAK_SAMPLE_RATE);
+	fprintf(stderr, "\t-k, --meter_mode\tMeter ballistics: peak (default), ppm1, ppm2, vu, k12, k14 or k20\n");
+	fprintf(stderr, "\t-H, --peak_hold\tHold peaks this many ms, then fall back; 0 (default) holds until reset\n");
+	fprintf(stderr, "\t-F, --peak_fallback\tFall back rate of held peaks in dB/s (default %.0f)\n", DEFAULT_PEAK_FALLBACK);
+	fprintf(stderr, "\t-q, --write_interval\tMinimum ms between writes of a dragged volume, 0 to write every change (default %i)\n", DEFAULT_WRITE_INTERVAL);
 }
 
 /* NPM for efficiency&power-savings, replaced multiple 40ms&100ms timeouts
    for each of the callbacks contained here, with a single 100ms one which
    calls gtk_timeout_add(100, (GtkFunction)envy24control_poll, ...) */
-gboolean envy24control_poll() {
-  level_meters_timeout_callback(NULL);
-  master_clock_status_timeout_callback(NULL);
-  internal_clock_status_timeout_callback(NULL);
-  rate_locking_status_timeout_callback(NULL);
-  rate_reset_status_timeout_callback(NULL);
-  if (card_has_delta_iec958_input_status)
-    iec958_input_status_timeout_callback(NULL); /* NPM */
-  return TRUE;
+/*
+ * Each poll task now has its own period, used while the widgets it updates
+ * are showing. While they are not (e.g. on another notebook page) the
+ * period doubles after each poll up to 'max_period', or the task is
+ * suspended if 'max_period' is 0. While the main window is unmapped or
+ * iconified every task that isn't suspended polls at POLL_HEARTBEAT.
+ * envy24control_poll() runs the tasks that are due and re-arms a single
+ * timeout for the next one; poll_scheduler_kick() runs it at once when
+ * what's showing changes. A task with an 'idle' function also backs off
+ * while visible, for as long as 'idle' reports that its last poll found
+ * nothing changed. Setting the environment variable MUDITA24_POLL_STATS
+ * reports each change of a task's period.
+ */
+#define POLL_HEARTBEAT 2000	/* ms */
+
+static int mapped(GtkWidget *widget)
+{
+  return (widget != NULL) && gtk_widget_get_mapped(widget);
+}
+
+static int hardware_status_visible(void)
+{
+  return mapped(hw_master_clock_status_label) || mapped(hw_master_clock_actual_rate_label)
+    || mapped(hw_rate_locking_check) || mapped(hw_rate_reset_check)
+    || mapped(hw_iec958_input_status_label);
+}
+
+typedef struct {
+  const char *name;
+  GSourceFunc poll;		/* returns FALSE to stop polling for good */
+  int (*visible)(void);
+  int period;			/* ms, while visible */
+  int max_period;		/* ms, backoff limit while not visible or idle; 0 suspends */
+  int (*idle)(void);		/* optional: TRUE if the last poll found no change */
+  void (*suspend)(int suspended); /* optional: told when the task is suspended or resumed */
+  int (*remote)(void);		/* optional: TRUE if polled for others than the window too */
+  int current;			/* ms, chosen period; 0 while suspended */
+  gint64 due;			/* ms */
+  int enabled;
+} poll_task_t;
+
+static poll_task_t poll_tasks[] = {
+  { "meters", level_meters_timeout_callback, level_meters_visible, 100, 0, NULL, meters_suspend, meters_remote },
+  { "hardware status", hardware_status_poll, hardware_status_visible, 100, 1000, hardware_status_idle },
+  { NULL }
+};
+static guint poll_source = 0;
+static int poll_stats = FALSE;
+
+static gint64 poll_now(void)
+{
+  return monotonic_usec() / 1000;
+}
+
+static int window_is_showing(void)
+{
+  return mapped(window)
+    && !(gdk_window_get_state(gtk_widget_get_window(window)) & GDK_WINDOW_STATE_ICONIFIED);
+}
+
+static void poll_set_period(poll_task_t *t, int period, gint64 now)
+{
+  if (period == t->current)
+    return;
+  if (t->current == 0 || period < t->current)
+    t->due = now;		/* speeding up: poll now rather than at the old period */
+  if (t->suspend && (period == 0 || t->current == 0))
+    t->suspend(period == 0);
+  t->current = period;
+  if (poll_stats) {
+    if (period)
+      g_print("poll: %s every %i ms\n", t->name, period);
+    else
+      g_print("poll: %s suspended\n", t->name);
+  }
+}
+
+gboolean envy24control_poll()
+{
+  poll_task_t *t;
+  gint64 now = poll_now(), next = now + POLL_HEARTBEAT;
+  int showing = window_is_showing();
+
+  for (t = poll_tasks; t->name != NULL; t++) {
+    if (!t->enabled)
+      continue;
+    if (t->remote && t->remote())
+      poll_set_period(t, t->period, now); /* whether or not the window is showing */
+    else if (!showing)
+      poll_set_period(t, t->max_period ? POLL_HEARTBEAT : 0, now);
+    else if (t->visible() && !(t->idle && t->idle()))
+      poll_set_period(t, t->period, now);
+    else if (t->max_period == 0)
+      poll_set_period(t, 0, now);
+    else if (t->current < t->period || t->current > t->max_period)
+      poll_set_period(t, t->period, now); /* start backing off from the base period */
+    if (t->current == 0)
+      continue;
+    if (now >= t->due) {
+      if (!t->poll(NULL)) {
+	t->enabled = FALSE;
+	continue;
+      }
+      if (showing && t->max_period && (!t->visible() || (t->idle && t->idle()))) /* back off while not visible or idle */
+	poll_set_period(t, MIN(t->current * 2, t->max_period), now);
+      t->due = now + t->current;
+    }
+    next = MIN(next, t->due);
+  }
+  poll_source = g_timeout_add(MAX(next - now, 1), (GSourceFunc)envy24control_poll, NULL);
+  return FALSE;
+}
+
+/* Re-evaluate poll periods now, e.g. after a page switch or window (un)map */
+static gboolean poll_scheduler_kick(void)
+{
+  if (poll_source)
+    g_source_remove(poll_source);
+  poll_source = g_idle_add((GSourceFunc)envy24control_poll, NULL);
+  return FALSE;
+}
+
+/* A surface or client started or stopped metering: re-evaluate the meters' period */
+static void metering_kick(void)
+{
+  poll_scheduler_kick();
+}
+
+static void poll_scheduler_init(void)
+{
+  poll_task_t *t;
+
+  poll_stats = (getenv("MUDITA24_POLL_STATS") != NULL);
+  for (t = poll_tasks; t->name != NULL; t++)
+    t->enabled = TRUE;
+  poll_source = g_timeout_add(100, (GSourceFunc)envy24control_poll, NULL);
+  meters_hook(metering_kick);
+}
+
+static void multi_playback_volume_changed(int index) { mixer_update_stream(index + 1, 1, 0); }
+static void hw_capture_volume_changed(int index) { mixer_update_stream(index + 11, 1, 0); }
+static void iec958_capture_volume_changed(int index) { mixer_update_stream(index + 19, 1, 0); }
+static void multi_playback_switch_changed(int index) { mixer_update_stream(index + 1, 0, 1); }
+static void hw_capture_switch_changed(int index) { mixer_update_stream(index + 11, 0, 1); }
+static void iec958_capture_switch_changed(int index) { mixer_update_stream(index + 19, 0, 1); }
+
+/* the widgets to refresh when a control changed, after its MIDI feedback */
+static const control_handler_t widget_handlers[CTL_COUNT] = {
+	[CTL_MULTI_PLAYBACK_VOLUME]	  = { multi_playback_volume_changed },
+	[CTL_HW_MULTI_CAPTURE_VOLUME]	  = { hw_capture_volume_changed },
+	[CTL_IEC958_MULTI_CAPTURE_VOLUME] = { iec958_capture_volume_changed },
+	[CTL_MULTI_PLAYBACK_SWITCH]	  = { multi_playback_switch_changed },
+	[CTL_HW_MULTI_CAPTURE_SWITCH]	  = { hw_capture_switch_changed },
+	[CTL_IEC958_MULTI_CAPTURE_SWITCH] = { iec958_capture_switch_changed },
+	[CTL_DAC_VOLUME]		  = { dac_volume_update },
+	[CTL_ADC_VOLUME]		  = { adc_volume_update },
+	[CTL_IPGA_VOLUME]		  = { ipga_volume_update },
+	[CTL_DAC_SENSE]			  = { dac_sense_update },
+	[CTL_ADC_SENSE]			  = { adc_sense_update },
+	[CTL_HW_PLAYBACK_ROUTE]		  = { NULL, patchbay_update },
+	[CTL_IEC958_PLAYBACK_ROUTE]	  = { NULL, patchbay_update },
+	[CTL_WORD_CLOCK_SYNC]		  = { NULL, master_clock_update },
+	[CTL_INTERNAL_CLOCK]		  = { NULL, master_clock_update },
+	[CTL_INTERNAL_CLOCK_DEFAULT]	  = { NULL, master_clock_update },
+	[CTL_RATE_LOCKING]		  = { NULL, rate_locking_update },
+	[CTL_RATE_RESET]		  = { NULL, rate_reset_update },
+	[CTL_VOLUME_RATE]		  = { NULL, volume_change_rate_update },
+	[CTL_IEC958_INPUT_OPTICAL]	  = { NULL, spdif_input_update },
+	[CTL_IEC958_PLAYBACK_DEFAULT]	  = { NULL, spdif_output_update },
+};
+
+static void close_all(void)
+{
+	if (ctlclient_connected()) {
+		controls_close();
+		ctlclient_close();
+		return;
+	}
+	controls_close();
+	profile_jobs_stop();
+	peak_sampler_stop();
+	card_close();
+	midi_close();
+	osc_close();
+	ctlserver_close();
+	config_close();
+}
+
+/* mudita24d went away: there is nothing left to drive the widgets */
+static void client_lost_quit(void)
+{
+	gtk_main_quit();
 }
 
 int main(int argc, char **argv)
@@ -2421,11 +2699,10 @@ int main(int argc, char **argv)
   GtkWidget *outerbox;
   char *name, tmpname[8], title[128];
   int i, c, err;
-	snd_ctl_card_info_t *hw_info;
-	snd_ctl_elem_value_t *val;
-	int npfds;
-	struct pollfd *pfds;
-	int midi_fd = -1, midi_channel = -1, midi_enhanced = 0;
+	int midi_fd = -1, midi_channel = -1, midi_enhanced = 0, mackie = 0;
+	int osc_port = 0, osc_ping_count = 0;
+	char *socket_path = NULL;
+	gboolean have_display, serve, client;
 	int page;
 	int input_channels_set = 0;
 	int output_channels_set = 0;
@@ -2433,6 +2710,10 @@ int main(int argc, char **argv)
 	int width_val;
 	int wwidth_set =FALSE;
 	int wwidth = 796;
+	int peak_sample_rate = 0;
+	int meter_mode = METER_MODE_PEAK, peak_hold = 0;
+	double peak_fallback = DEFAULT_PEAK_FALLBACK;
+	int write_interval = DEFAULT_WRITE_INTERVAL;
 	const int chanwidth = 86;
 	const int fixwidth = 108;
 
@@ -2443,6 +2724,13 @@ int main(int argc, char **argv)
 		{"inputs", 1, 0, 'i'},
 		{"midichannel", 1, 0, 'm'},
 		{"midienhanced", 0, 0, 'M'},
+		{"midi_nrpn", 0, 0, 'N'}, /* 14 bit NRPN for all attenuators */
+		{"midi_rate", 1, 0, 'R'}, /* ceiling of MIDI feedback messages per second */
+		{"mackie", 0, 0, 'U'}, /* Mackie Control surface on the MIDI port */
+		{"osc", 1, 0, 'O'}, /* OSC server on this UDP port of the loopback interface */
+		{"osc_ping", 1, 0, 'P'}, /* loopback client: ping the OSC server, print round trip times */
+		{"socket", 1, 0, 'S'}, /* serve the controls on this Unix socket */
+		{"midi_bank_select", 0, 0, 'B'}, /* controllers 0 and 32 select the bank of profiles for program changes */
 		{"outputs", 1, 0, 'o'},
 		{"pcm_outputs", 1, 0, 'p'},
 		{"spdif", 1, 0, 's'},
@@ -2453,28 +2741,24 @@ int main(int argc, char **argv)
 		{"channel_group_modulus", 1, 0, 'g'}, /* NPM: add optional count to control grouping behavior of labels */
 		{"bg_color", 1, 0, 'b'}, /* NPM: add optional 'bg_color' for peak level metering */
 		{"lights_color", 1, 0, 'l'}, /* NPM: add optional 'lights_color' for peak level metering */
+		{"peak_sample_rate", 1, 0, 'r'}, /* sample hardware peak meters from a separate thread at this rate */
+		{"meter_mode", 1, 0, 'k'}, /* meter ballistics: peak, ppm1, ppm2, vu, k12, k14, k20 */
+		{"peak_hold", 1, 0, 'H'}, /* ms to hold peaks before falling back, 0 holds until "Reset Peaks" */
+		{"peak_fallback", 1, 0, 'F'}, /* dB/s fall back of held peaks after --peak_hold */
+		{"write_interval", 1, 0, 'q'}, /* ms between writes of queued volume changes */
 		{ NULL }
 	};
 
-	snd_ctl_card_info_alloca(&hw_info);
-	snd_ctl_elem_value_alloca(&val);
-
-	/* Go through gtk initialization */
-        gtk_init(&argc, &argv);
+	/* Go through gtk initialization; mudita24d runs without a display */
+        have_display = gtk_init_check(&argc, &argv);
 
 	name = NULL; /* probe */
-	card_number = 0;
-	input_channels = MAX_INPUT_CHANNELS;
-	output_channels = MAX_OUTPUT_CHANNELS;
-	pcm_output_channels = MAX_PCM_OUTPUT_CHANNELS;
-	spdif_channels = MAX_SPDIF_CHANNELS;
-	view_spdif_playback = 0;
 	profiles_file_name = DEFAULT_PROFILERC;
 	default_profile = NULL;
 
   clear_all_scale_marks(TRUE); // TER
   
-	while ((c = getopt_long(argc, argv, "D:c:f:i:m:Mo:p:s:w:vt:ng:b:l:", long_options, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "D:c:f:i:m:MBNUR:O:P:S:o:p:s:w:vt:ng:b:l:r:k:H:F:q:", long_options, NULL)) != -1) {
 		switch (c) {
 		case 'D':
 		/*
@@ -2538,6 +2822,30 @@ int main(int argc, char **argv)
 			--midi_channel;
 			break;
 		case 'M': midi_enhanced = 1; break;
+		case 'B': midi_bank_select(TRUE); break;
+		case 'N': midi_nrpn(TRUE); break;
+		case 'U': mackie_enable(TRUE); mackie = 1; break;
+		case 'O':
+			osc_port = atoi(optarg);
+			if (osc_port < 1 || osc_port > 65535) {
+				fprintf(stderr, "mudita24: invalid OSC port %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'S': socket_path = optarg; break;
+		case 'P':
+			osc_ping_count = atoi(optarg);
+			if (osc_ping_count < 1)
+				osc_ping_count = DEFAULT_OSC_PING_COUNT;
+			break;
+		case 'R':
+			i = atoi(optarg);
+			if (i < 0 || i > MAX_MIDI_RATE) {
+				fprintf(stderr, "mudita24: MIDI rate must be 0-%i messages/s\n", MAX_MIDI_RATE);
+				exit(1);
+			}
+			midi_rate(i);
+			break;
 		case 'o':
 			output_channels = atoi(optarg);
 			if (output_channels < 0 || output_channels > MAX_OUTPUT_CHANNELS) {
@@ -2602,6 +2910,40 @@ int main(int argc, char **argv)
 		    exit(1);
 		  }
 		  break;
+		case 'r':
+			peak_sample_rate = atoi(optarg);
+			if (peak_sample_rate < MIN_PEAK_SAMPLE_RATE || peak_sample_rate > MAX_PEAK_SAMPLE_RATE) {
+				fprintf(stderr, "mudita24: peak sample rate must be %i-%i Hz\n", MIN_PEAK_SAMPLE_RATE, MAX_PEAK_SAMPLE_RATE);
+				exit(1);
+			}
+			break;
+		case 'k':
+			if ((meter_mode = ballistics_parse_mode(optarg)) < 0) {
+				fprintf(stderr, "mudita24: meter mode must be one of peak, ppm1, ppm2, vu, k12, k14, k20\n");
+				exit(1);
+			}
+			break;
+		case 'H':
+			peak_hold = atoi(optarg);
+			if (peak_hold < 0) {
+				fprintf(stderr, "mudita24: invalid peak hold time %i ms\n", peak_hold);
+				exit(1);
+			}
+			break;
+		case 'F':
+			peak_fallback = atof(optarg);
+			if (peak_fallback <= 0.0) {
+				fprintf(stderr, "mudita24: peak fallback must be greater than 0 dB/s\n");
+				exit(1);
+			}
+			break;
+		case 'q':
+			write_interval = atoi(optarg);
+			if (write_interval < 0 || write_interval > MAX_WRITE_INTERVAL) {
+				fprintf(stderr, "mudita24: write interval must be 0-%i ms\n", MAX_WRITE_INTERVAL);
+				exit(1);
+			}
+			break;
 		default:
 			usage();
 			exit(1);
@@ -2611,63 +2953,33 @@ int main(int argc, char **argv)
 	if (optind < argc) {
 		default_profile = argv[optind];
 	}
-
-	if (! name) {
-		/* probe cards */
-		static char cardname[8];
-		/* FIXME: hardcoded max number of cards */
-		for (card_number = 0; card_number < 8; card_number++) {
-			sprintf(cardname, "hw:%d", card_number);
-			if (snd_ctl_open(&ctl, cardname, 0) < 0)
-				continue;
-			if (snd_ctl_card_info(ctl, hw_info) < 0 ||
-			    strcmp(snd_ctl_card_info_get_driver(hw_info), "ICE1712")) {
-				snd_ctl_close(ctl);
-				continue;
-			}
-			/* found */
-			name = cardname;
-			break;
-		}
-		if (! name) {
-			fprintf(stderr, "No ICE1712 cards found\n");
-			exit(EXIT_FAILURE);
-		}
-	} else {
-		if ((err = snd_ctl_open(&ctl, name, 0)) < 0) {
-			fprintf(stderr, "snd_ctl_open: %s\n", snd_strerror(err));
-			exit(EXIT_FAILURE);
-		}
-		if ((err = snd_ctl_card_info(ctl, hw_info)) < 0) {
-			fprintf(stderr, "snd_ctl_card_info: %s\n", snd_strerror(err));
-			exit(EXIT_FAILURE);
-		}
-		if (strcmp(snd_ctl_card_info_get_driver(hw_info), "ICE1712")) {
-			fprintf(stderr, "invalid card type (driver is %s)\n", snd_ctl_card_info_get_driver(hw_info));
-			exit(EXIT_FAILURE);
+	if (osc_ping_count) {
+		if (!osc_port) {
+			fprintf(stderr, "mudita24: --osc_ping needs the port of the server, -O\n");
+			exit(1);
 		}
+		exit(osc_ping(osc_port, osc_ping_count) < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
 	}
-
-	snd_ctl_elem_value_set_interface(val, SND_CTL_ELEM_IFACE_CARD);
-	snd_ctl_elem_value_set_name(val, "ICE1712 EEPROM");
-	if ((err = snd_ctl_elem_read(ctl, val)) < 0) {
-		fprintf(stderr, "Unable to read EEPROM contents: %s\n", snd_strerror(err));
-		exit(EXIT_FAILURE);
+	if (!have_display) {
+		fprintf(stderr, "mudita24: cannot open display, run mudita24d to serve the card without one\n");
+		exit(1);
 	}
-	memcpy(&card_eeprom, snd_ctl_elem_value_get_bytes(val), 32);
 
-	if(card_eeprom.subvendor == ICE1712_SUBDEVICE_DMX6FIRE)
-		card_is_dmx6fire = TRUE;
-
-	/* NPM: determine if "Delta IEC958 Input Status" available
-	   excluding ICE1712_SUBDEVICE_DELTA44 since it has no IEC958 in */
-	if ((card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTA1010
-	     || card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTA1010LT
-	     || card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTA66
-	     || card_eeprom.subvendor == ICE1712_SUBDEVICE_AUDIOPHILE
-	     || card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTADIO2496
-	     || card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTA410))
-	  card_has_delta_iec958_input_status = TRUE;
+	/* a card already served by mudita24d is worked over its socket */
+	serve = socket_path != NULL;
+	if (!socket_path) {
+		if (!name && (i = card_find()) >= 0)
+			card_number = i;
+		socket_path = ctlserver_default_path(card_number);
+	}
+	client = ctlclient_open(socket_path, client_lost_quit) >= 0;
+	if (client) {
+		fprintf(stderr, "using the card served on %s\n", socket_path);
+		if (midi_channel >= 0 || mackie || osc_port || peak_sample_rate > 0)
+			fprintf(stderr, "MIDI, OSC and the peak sampler are mudita24d's: ignoring their options\n");
+		serve = FALSE;
+	} else if (card_open(name) < 0)
+		exit(EXIT_FAILURE);
 
 	/* Set a better default for input_channels and output_channels */
 	if(!input_channels_set)
@@ -2688,28 +3000,54 @@ int main(int argc, char **argv)
 
 
 	/* Initialize code */
-	config_open();
+	controls_init(write_interval);
+	if (!client)
+		config_open();
+	ballistics_init(meter_mode, peak_hold, peak_fallback);
+	meters_init();
 	level_meters_init();
 	mixer_init();
 	patchbay_init();
 	hardware_init();
 	analog_volume_init();
-	if (midi_channel >= 0)
-		midi_fd = midi_init(argv[0], midi_channel, midi_enhanced);
+	if (!client) {		/* else MIDI, OSC, the sampler and the profiles are mudita24d's */
+		if (midi_channel >= 0 || mackie)
+			midi_fd = midi_init(argv[0], midi_channel, midi_enhanced);
+		mackie_start();
+		if (osc_port && (err = osc_init(osc_port)) < 0)
+			fprintf(stderr, "Unable to serve OSC on port %i: %s\n", osc_port, strerror(-err));
+		if (peak_sample_rate > 0 && (err = peak_sampler_start(card_name(), peak_sample_rate)) < 0)
+			fprintf(stderr, "Unable to start peak sampler, metering at 10Hz: %s\n", snd_strerror(err));
+		if ((err = profile_jobs_start(card_name(), card_number, profiles_file_name)) < 0)
+			fprintf(stderr, "Unable to start profile worker, profiles are handled in the GUI: %s\n", snd_strerror(err));
+	}
+	if (serve && (err = ctlserver_init(socket_path)) < 0) {
+		if (err == -EADDRINUSE)
+			fprintf(stderr, "Another mudita24 serves %s\n", socket_path);
+		else
+			fprintf(stderr, "Unable to serve %s: %s\n", socket_path, strerror(-err));
+	}
+	recall_profile_hook(profile_recalled);
 
-	g_timeout_add(100, (GSourceFunc)envy24control_poll, NULL); /* NPM for efficiency&power-savings, replaced multiple 40ms&100ms timeouts with this single one */
+	poll_scheduler_init(); /* NPM for efficiency&power-savings, replaced multiple 40ms&100ms timeouts with this single one */
 
 	fprintf(stderr, "using\t --- input_channels: %i\n\t --- output_channels: %i\n\t --- pcm_output_channels: %i\n\t --- spdif in/out channels: %i\n", \
 		input_channels, output_channels, pcm_output_channels, spdif_channels);
 
         /* Make the title */
-        sprintf(title, "Envy24 Control Utility %s (%s)", VERSION, snd_ctl_card_info_get_longname(hw_info));
+        g_snprintf(title, sizeof(title), "Envy24 Control Utility %s (%s)", VERSION, card_longname());
 
         /* Create the main window */
         window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
         gtk_window_set_title(GTK_WINDOW(window), title);
         g_signal_connect(GTK_OBJECT (window), "delete_event", 
                            G_CALLBACK( gtk_main_quit), NULL);
+        g_signal_connect_swapped(G_OBJECT(window), "map_event",
+                           G_CALLBACK(poll_scheduler_kick), NULL);
+        g_signal_connect_swapped(G_OBJECT(window), "unmap_event",
+                           G_CALLBACK(poll_scheduler_kick), NULL);
+        g_signal_connect_swapped(G_OBJECT(window), "window_state_event",
+                           G_CALLBACK(poll_scheduler_kick), NULL);
         signal(SIGINT, (void *)gtk_main_quit);
 
 	gtk_window_set_default_size(GTK_WINDOW(window), wwidth, 300);
@@ -2724,6 +3062,8 @@ int main(int argc, char **argv)
         notebook = gtk_notebook_new();
 	gtk_notebook_set_scrollable(GTK_NOTEBOOK(notebook), TRUE);
 	gtk_notebook_popup_enable(GTK_NOTEBOOK(notebook));
+	g_signal_connect_swapped(G_OBJECT(notebook), "switch_page",
+				 G_CALLBACK(poll_scheduler_kick), NULL);
         gtk_widget_show(notebook);
 	gtk_container_add(GTK_CONTAINER(outerbox), notebook);
 
@@ -2739,21 +3079,10 @@ int main(int argc, char **argv)
 	create_about(outerbox, notebook, page++);
 	create_blank(outerbox, notebook, page++);
 
-	npfds = snd_ctl_poll_descriptors_count(ctl);
-	if (npfds > 0) {
-		pfds = alloca(sizeof(*pfds) * npfds);
-		npfds = snd_ctl_poll_descriptors(ctl, pfds, npfds);
-		for (i = 0; i < npfds; i++)
-			gdk_input_add(pfds[i].fd,
-				      GDK_INPUT_READ,
-				      control_input_callback,
-				      ctl);
-		snd_ctl_subscribe_events(ctl, 1);
-	}
-	if (midi_fd >= 0) {
-		gdk_input_add(midi_fd, GDK_INPUT_READ, midi_process, NULL);
-	}
-
+	control_handlers(widget_handlers);
+	controls_watch();
+	if (midi_fd >= 0)
+		watch_fd(midi_fd, WATCH_READ, midi_process, NULL);
 
 	gtk_widget_show(window);
 
@@ -2765,9 +3094,7 @@ int main(int argc, char **argv)
 
 	gtk_main();
 
-	snd_ctl_close(ctl);
-	midi_close();
-	config_close();
+	close_all();
 
   clear_all_scale_marks(FALSE); // TER
 
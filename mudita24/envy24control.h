@@ -1,139 +1,5 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <signal.h>
-#include <errno.h>
-#include <assert.h>
 #include <gtk/gtk.h>
-#include <alsa/asoundlib.h>
-
-#include "globaldefs.h"
-
-/* Profiles */
-#ifdef PACKAGE
-#define PROGRAM_NAME PACKAGE
-#else
-#define PROGRAM_NAME "envy24control"
-#endif
-#define MAX_PROFILES 8
-#define MAX_PROFILE_NAME_LENGTH 20
-#define DEFAULT_PROFILERC "~/.envy24control/profiles.conf" /* NPM: use hidden directory for profiles */
-#define SYS_PROFILERC "/etc/envy24control/profiles.conf"
-#ifndef MKDIR
-#define MKDIR "/bin/mkdir"
-#endif
-#ifndef ALSACTL
-#define ALSACTL "/usr/sbin/alsactl"
-#endif
-
-#include "profiles.h"
-
-/* MidiMan */
-#define ICE1712_SUBDEVICE_DELTA1010	0x121430d6
-#define ICE1712_SUBDEVICE_DELTADIO2496	0x121431d6
-#define ICE1712_SUBDEVICE_DELTA66	0x121432d6
-#define ICE1712_SUBDEVICE_DELTA44	0x121433d6
-#define ICE1712_SUBDEVICE_AUDIOPHILE    0x121434d6
-#define ICE1712_SUBDEVICE_DELTA410      0x121438d6
-#define ICE1712_SUBDEVICE_DELTA1010LT   0x12143bd6
-
-/* Terratec */
-#define ICE1712_SUBDEVICE_EWX2496       0x3b153011
-#define ICE1712_SUBDEVICE_EWS88MT       0x3b151511
-#define ICE1712_SUBDEVICE_EWS88D        0x3b152b11
-#define ICE1712_SUBDEVICE_DMX6FIRE      0x3b153811
-
-/* Hoontech */
-#define ICE1712_SUBDEVICE_STDSP24       0x12141217      /* Hoontech SoundTrack Audio DSP 24 */
-
-/* max number of cards for alsa */
-#define MAX_CARD_NUMBERS	8
-/* max number of HW input/output channels (analog lines)
- * the number of available HW input/output channels is defined
- * at 'adcs/dacs' in the driver
- */
-/* max number of HW input channels (analog lines) */
-#define MAX_INPUT_CHANNELS	8
-/* max number of HW output channels (analog lines) */
-#define MAX_OUTPUT_CHANNELS	8
-/* max number of spdif input/output channels */
-#define MAX_SPDIF_CHANNELS	2
-/* max number of PCM output channels */
-#define MAX_PCM_OUTPUT_CHANNELS	8
-/* NPM: the digital mixer max-attenuation in dB, per snd ice1712 architecture diagram
-   http://nielsmayer.com/npm/envy24mixer-architecture.png
-   taken from http://alsa.cybermirror.org/manuals/icensemble/envy24.pdf */
-/* NPM: the control values for the digital mixer are 0-96 and not the
-   dB attenuation values of MAX_MIXER_ATTENUATION_DB...
-   The following values comprise all the signals mixed in the ice1712's digital
-   mixer: MULTI_PLAYBACK_VOLUME, HW_MULTI_CAPTURE_VOLUME, IEC958_MULTI_CAPTURE_VOLUME:
-    > amixer -c M66 cget iface=MIXER,name='Multi Playback Volume'
-    numid=11,iface=MIXER,name='Multi Playback Volume'
-      ; type=INTEGER,access=rw---R--,values=2,min=0,max=96,step=0
-      : values=78,67
-      | dBscale-min=-144.00dB,step=1.50dB,mute=0
-    > amixer -c M66 cget iface=MIXER,name="H/W Multi Capture Volume"
-    numid=27,iface=MIXER,name='H/W Multi Capture Volume'
-      ; type=INTEGER,access=rw---R--,values=2,min=0,max=96,step=0
-      : values=0,0
-      | dBscale-min=-144.00dB,step=1.50dB,mute=0
-    > amixer -c M66 cget iface=MIXER,name="IEC958 Multi Capture Volume"
-    numid=31,iface=MIXER,name='IEC958 Multi Capture Volume'
-      ; type=INTEGER,access=rw------,values=2,min=0,max=96,step=0
-      : values=16,0
-*/
-#define MAX_MIXER_ATTENUATION_VALUE 96 /* for -144dB */
-#define LOW_MIXER_ATTENUATION_VALUE 33 /* for -49.5dB nb: 64-->-48dB where 96-64=32 */
-#define MIN_MIXER_ATTENUATION_VALUE 0  /* for 0dB */
-
-/*
- * NPM: DAC and ADC constants
- */
-#define MIN_ADC_GAIN -63
-#define MAX_ADC_GAIN 18
-#define MIN_DAC_GAIN -63
-#define MAX_DAC_GAIN 0
-#define ANALOG_GAIN_STEP_SIZE 12  /* this value gives a known -18dB step size for 24 bit attenuators, -6dB step for 16 bit attenuators */
-// TER: Changed.
-//#define MIXER_ATTENUATOR_STEP_SIZE 8  /* this value gives a known -12dB step size for 24 bit attenuators, -6dB step for 16 bit attenuators */
-#define MIXER_ATTENUATOR_STEP_SIZE 4  /* this value gives a known -6dB step size for 24 bit attenuators, -6dB step for 16 bit attenuators */
-
-/*
- * NPM: For peak meters
- */
-#define MULTI_TRACK_PEAK_CHANNELS 22
-#define IDX_LMIX 20
-#define IDX_RMIX 21
-#define MAX_METERING_LEVEL 255 	/* level corresponding to 0dB output for ice1712 hardware peak meters */
-// #define MIN_METERING_LEVEL_DB -48.164799306 /* == 20*log10(1/(MAX_METERING_LEVEL+1)) */
-// #define MIN_METERING_LEVEL_DB −48.130803609 /* == 20*log10(1/MAX_METERING_LEVEL)     */
-
-/*
- * NPM: 
- */
-
-typedef struct {
-	unsigned int subvendor;	/* PCI[2c-2f] */
-	unsigned char size;	/* size of EEPROM image in bytes */
-	unsigned char version;	/* must be 1 */
-	unsigned char codec;	/* codec configuration PCI[60] */
-	unsigned char aclink;	/* ACLink configuration PCI[61] */
-	unsigned char i2sID;	/* PCI[62] */
-	unsigned char spdif;	/* S/PDIF configuration PCI[63] */
-	unsigned char gpiomask;	/* GPIO initial mask, 0 = write, 1 = don't */
-	unsigned char gpiostate; /* GPIO initial state */
-	unsigned char gpiodir;	/* GPIO direction state */
-	unsigned short ac97main;
-	unsigned short ac97pcm;
-	unsigned short ac97rec;
-	unsigned char ac97recsrc;
-	unsigned char dacID[4];	/* I2S IDs for DACs */
-	unsigned char adcID[4];	/* I2S IDs for ADCs */
-	unsigned char extra[4];
-} ice1712_eeprom_t;
-
-extern snd_ctl_t *ctl;
-extern ice1712_eeprom_t card_eeprom;
+#include "controls.h"
 
 extern GtkWidget *mixer_mix_drawing;
 extern GtkWidget *mixer_clear_peaks_button;
@@ -221,10 +87,8 @@ extern GtkWidget *av_dac_sense_radio[][4];
 extern GtkWidget *av_adc_sense_radio[][4];
 
 /* flags */
-extern int card_is_dmx6fire;
 extern int no_scale_marks;	/* NPM: --no_scale_marks option */
 extern GdkColor *meter_bg, *meter_fg; /* NPM: --bg_color --lights_color options */
-extern int card_has_delta_iec958_input_status; /* NPM added to support "Delta IEC958 Input Status" */
 
 gint level_meters_configure_event(GtkWidget *widget, GdkEventConfigure *event);
 gint level_meters_expose_event(GtkWidget *widget, GdkEventExpose *event);
@@ -232,13 +96,13 @@ gint level_meters_timeout_callback(gpointer data);
 void level_meters_reset_peaks(GtkButton *button, gpointer data);
 void level_meters_init(void);
 void level_meters_postinit(void);
+int level_meters_visible(void);
 
-int mixer_stream_is_active(int stream);
 void mixer_update_stream(int stream, int vol_flag, int sw_flag);
 void mixer_toggled_solo(GtkWidget *togglebutton, gpointer data);
 void mixer_toggled_mute(GtkWidget *togglebutton, gpointer data);
 void mixer_adjust(GtkAdjustment *adj, gpointer data);
-void mixer_init(void);
+void mixer_toggled_stereo(GtkWidget *togglebutton, gpointer data);
 void mixer_postinit(void);
 
 int patchbay_stream_is_active(int stream);
@@ -248,11 +112,8 @@ void patchbay_init(void);
 void patchbay_postinit(void);
 
 void master_clock_update(void);
-gint master_clock_status_timeout_callback(gpointer data);
-gint internal_clock_status_timeout_callback(gpointer data);
-gint rate_locking_status_timeout_callback(gpointer data);
-gint rate_reset_status_timeout_callback(gpointer data);
-gint iec958_input_status_timeout_callback(gpointer data);
+gint hardware_status_poll(gpointer data);
+int hardware_status_idle(void);
 void internal_clock_toggled(GtkWidget *togglebutton, gpointer data);
 void rate_locking_update(void);
 void rate_locking_toggled(GtkWidget *togglebutton, gpointer data);
@@ -335,6 +196,7 @@ void scale_add_marks(GtkScale        *scale,
                      gboolean         draw_legend_p);
 void clear_all_scale_marks(gboolean init);
 gboolean scale_btpress_handler(GtkWidget *widget, GdkEventButton *event, gpointer data);
+gboolean scale_btrelease_handler(GtkWidget *widget, GdkEventButton *event, gpointer data);
 gboolean scale_expose_handler(GtkWidget *widget, GdkEventExpose *event, gpointer data);
 void scale_size_req_handler(GtkWidget *widget, GtkRequisition *requisition, gpointer data);
 gboolean slider_change_value_handler(GtkRange     *range,
@@ -353,11 +215,9 @@ void ipga_volume_adjust(GtkAdjustment *adj, gpointer data);
 void dac_sense_toggled(GtkWidget *togglebutton, gpointer data);
 void adc_sense_toggled(GtkWidget *togglebutton, gpointer data);
 
-void control_input_callback(gpointer data, gint source, GdkInputCondition condition);
-void mixer_input_callback(gpointer data, gint source, GdkInputCondition condition);
-
 /* NPM: volume/db-related stuff added to volume.c */
 char* peak_level_to_db(int ival);
+void peak_level_db_init(void);
 // TER: Replaced with custom drawing.
 //void draw_24bit_attenuator_scale_markings(GtkScale *scale, GtkPositionType position, int draw_legend_p);
 //void draw_dac_scale_markings(GtkScale *scale, GtkPositionType position);
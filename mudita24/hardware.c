@@ -22,10 +22,12 @@
 static snd_ctl_elem_value_t *internal_clock;
 static snd_ctl_elem_value_t *internal_clock_default;
 static snd_ctl_elem_value_t *word_clock_sync;
+static snd_ctl_elem_value_t *word_clock_status;
 static snd_ctl_elem_value_t *rate_locking;
 static snd_ctl_elem_value_t *rate_reset;
 static snd_ctl_elem_value_t *volume_rate;
 static snd_ctl_elem_value_t *spdif_input;
+static control_t spdif_input_control;
 static snd_ctl_elem_value_t *spdif_output;
 static snd_ctl_elem_value_t *analog_input_select;
 static snd_ctl_elem_value_t *breakbox_led;
@@ -33,7 +35,10 @@ static snd_ctl_elem_value_t *spdif_on_off;
 static snd_ctl_elem_value_t *phono_input;
 static snd_ctl_elem_value_t *iec958_in_status; /* NPM: add feature to display "Delta IEC958 Input Status" */
 
+static void clock_state_read(void);
 static inline int is_update_needed(void);
+static void internal_clock_status_show(void);
+static void master_clock_status_show(void);
 
 #define toggle_set(widget, state) \
 	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(widget), state);
@@ -45,17 +50,9 @@ static int is_active(GtkWidget *widget)
 
 void master_clock_update(void)
 {
-	int err, rate, need_default_update;
+	int rate, need_default_update;
 	
-	if ((err = snd_ctl_elem_read(ctl, internal_clock)) < 0)
-		g_print("Unable to read Internal Clock state: %s\n", snd_strerror(err));
-	if ((err = snd_ctl_elem_read(ctl, internal_clock_default)) < 0)
-		g_print("Unable to read Internal Clock Default state: %s\n", snd_strerror(err));
-	if (card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTA1010 ||
-	    card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTA1010LT) {
-		if ((err = snd_ctl_elem_read(ctl, word_clock_sync)) < 0)
-			g_print("Unable to read word clock sync selection: %s\n", snd_strerror(err));
-	}
+	clock_state_read();
 	if (snd_ctl_elem_value_get_enumerated(internal_clock, 0) == 13) {
 		if (snd_ctl_elem_value_get_boolean(word_clock_sync, 0)) {
 			toggle_set(hw_master_clock_word_radio, TRUE);
@@ -82,8 +79,11 @@ void master_clock_update(void)
 			    break;
 		}
 	}
-	internal_clock_status_timeout_callback(NULL);
-	master_clock_status_timeout_callback(NULL);
+	internal_clock_status_show();
+	if ((card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTA1010 ||
+	     card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTA1010LT) &&
+	    control_read(CTL_WORD_CLOCK_STATUS, 0) >= 0)
+		master_clock_status_show();
 }
 
 static void master_clock_word_select(int on)
@@ -94,7 +94,7 @@ static void master_clock_word_select(int on)
 	    card_eeprom.subvendor != ICE1712_SUBDEVICE_DELTA1010LT)
 		return;
 	snd_ctl_elem_value_set_boolean(word_clock_sync, 0, on ? 1 : 0);
-	if ((err = snd_ctl_elem_write(ctl, word_clock_sync)) < 0)
+	if ((err = control_write(CTL_WORD_CLOCK_SYNC, 0)) < 0)
 		g_print("Unable to write word clock sync selection: %s\n", snd_strerror(err));
 }
 
@@ -104,7 +104,7 @@ static void internal_clock_set(int xrate)
 
 	master_clock_word_select(0);
 	snd_ctl_elem_value_set_enumerated(internal_clock, 0, xrate);
-	if ((err = snd_ctl_elem_write(ctl, internal_clock)) < 0)
+	if ((err = control_write(CTL_INTERNAL_CLOCK, 0)) < 0)
 		g_print("Unable to write internal clock rate: %s\n", snd_strerror(err));
 }
 
@@ -136,60 +136,51 @@ void internal_clock_toggled(GtkWidget *togglebutton, gpointer data)
 	}
 }
 
-static int is_rate_locked(void)
+/*
+ * Reads everything the master clock display depends on. Controls the
+ * driver notifies changes of come from their shadows; only the "Multi
+ * Track Internal Clock", which follows the rate chosen by PCM
+ * applications, and any volatile controls actually go to the card.
+ */
+static void clock_state_read(void)
 {
 	int err;
-	
-	if ((err = snd_ctl_elem_read(ctl, rate_locking)) < 0)
-		g_print("Unable to read rate locking state: %s\n", snd_strerror(err));
-	return snd_ctl_elem_value_get_boolean(rate_locking, 0) ? 1 : 0;
-}
 
-static int is_rate_reset(void)
-{
-	int err;
-	
-	if ((err = snd_ctl_elem_read(ctl, rate_reset)) < 0)
+	if ((err = control_read(CTL_INTERNAL_CLOCK, 0)) < 0)
+		g_print("Unable to read Internal Clock state: %s\n", snd_strerror(err));
+	if ((err = control_read(CTL_INTERNAL_CLOCK_DEFAULT, 0)) < 0)
+		g_print("Unable to read Internal Clock Default state: %s\n", snd_strerror(err));
+	if (card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTA1010 ||
+	    card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTA1010LT) {
+		if ((err = control_read(CTL_WORD_CLOCK_SYNC, 0)) < 0)
+			g_print("Unable to read word clock sync selection: %s\n", snd_strerror(err));
+	}
+	if ((err = control_read(CTL_RATE_LOCKING, 0)) < 0)
+		g_print("Unable to read rate locking state: %s\n", snd_strerror(err));
+	if ((err = control_read(CTL_RATE_RESET, 0)) < 0)
 		g_print("Unable to read rate reset state: %s\n", snd_strerror(err));
-	return snd_ctl_elem_value_get_boolean(rate_reset, 0) ? 1 : 0;
 }
 
+/* From the values last read; see clock_state_read() */
 static inline int is_update_needed(void)
 {
-	return (is_rate_locked() || !is_rate_reset());
+	return (snd_ctl_elem_value_get_boolean(rate_locking, 0) ||
+		!snd_ctl_elem_value_get_boolean(rate_reset, 0));
 }
 
-gint master_clock_status_timeout_callback(gpointer data)
+static void master_clock_status_show(void)
 {
-	snd_ctl_elem_value_t *sw;
-	int err;
-	
 	if (card_eeprom.subvendor != ICE1712_SUBDEVICE_DELTA1010 && card_eeprom.subvendor != ICE1712_SUBDEVICE_DELTA1010LT)
-		return FALSE;
-	snd_ctl_elem_value_alloca(&sw);
-	snd_ctl_elem_value_set_interface(sw, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(sw, "Word Clock Status");
-	if ((err = snd_ctl_elem_read(ctl, sw)) < 0)
-		g_print("Unable to determine word clock status: %s\n", snd_strerror(err));
+		return;
 	gtk_label_set_text(GTK_LABEL(hw_master_clock_status_label),
-			   snd_ctl_elem_value_get_boolean(sw, 0) ? "No signal" : "Locked");
-	return TRUE;
+			   snd_ctl_elem_value_get_boolean(word_clock_status, 0) ? "No signal" : "Locked");
 }
 
-gint internal_clock_status_timeout_callback(gpointer data)
+static void internal_clock_status_show(void)
 {
-	int err, rate, need_update;
+	int rate, need_update;
 	char *label;
 	
-	if ((err = snd_ctl_elem_read(ctl, internal_clock)) < 0)
-		g_print("Unable to read Internal Clock state: %s\n", snd_strerror(err));
-	if ((err = snd_ctl_elem_read(ctl, internal_clock_default)) < 0)
-		g_print("Unable to read Internal Clock Default state: %s\n", snd_strerror(err));
-	if (card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTA1010 ||
-	    card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTA1010LT) {
-		if ((err = snd_ctl_elem_read(ctl, word_clock_sync)) < 0)
-			g_print("Unable to read word clock sync selection: %s\n", snd_strerror(err));
-	}
 	need_update = is_update_needed() ? 1 : 0;
 	if (snd_ctl_elem_value_get_enumerated(internal_clock, 0) == 13) {
 		if (snd_ctl_elem_value_get_boolean(word_clock_sync, 0)) {
@@ -248,72 +239,221 @@ gint internal_clock_status_timeout_callback(gpointer data)
 		}
 	}
 	gtk_label_set_text(GTK_LABEL(hw_master_clock_actual_rate_label), label);
-	return TRUE;
 }
 
-gint rate_locking_status_timeout_callback(gpointer data)
+static void internal_clock_status_refresh(void)
+{
+	clock_state_read();
+	internal_clock_status_show();
+}
+
+static void rate_locking_status_show(void)
 {
-    int state;
+	int state = snd_ctl_elem_value_get_boolean(rate_locking, 0) ? 1 : 0;
 
-    if (is_active(hw_rate_locking_check) != (state = is_rate_locked())) {
-	toggle_set(hw_rate_locking_check, state ? TRUE : FALSE);
-    }
-    return TRUE;
+	if (is_active(hw_rate_locking_check) != state)
+		toggle_set(hw_rate_locking_check, state ? TRUE : FALSE);
 }
 
-gint rate_reset_status_timeout_callback(gpointer data)
+static void rate_reset_status_show(void)
 {
-    int state;
+	int state = snd_ctl_elem_value_get_boolean(rate_reset, 0) ? 1 : 0;
 
-    if (is_active(hw_rate_reset_check) != (state = is_rate_reset())) {
-	toggle_set(hw_rate_reset_check, state ? TRUE : FALSE);
-    }
-    return TRUE;
+	if (is_active(hw_rate_reset_check) != state)
+		toggle_set(hw_rate_reset_check, state ? TRUE : FALSE);
+}
+
+/* the displayed rate depends on the locking and reset states */
+static void rate_locking_status_changed(void)
+{
+	rate_locking_status_show();
+	internal_clock_status_show();
+}
+
+static void rate_reset_status_changed(void)
+{
+	rate_reset_status_show();
+	internal_clock_status_show();
 }
 
 /* NPM: add feature to display "Delta IEC958 Input Status" */
-static int iec958_input_status_enabled = TRUE;
-gint iec958_input_status_timeout_callback(gpointer data)
-{
-  if (gtk_widget_get_visible(hw_iec958_input_status_label) && iec958_input_status_enabled) {
-    int err;
-    if ((err = snd_ctl_elem_read(ctl, iec958_in_status)) < 0) {
-      char temp_text[1024];
-      sprintf(temp_text,
-	      "<span size=\"small\">Unable to read IEC958 Input Status:\n     %s</span>",
-	      snd_strerror(err));
-      gtk_label_set_markup(GTK_LABEL(hw_iec958_input_status_label),
-			   temp_text);
-      iec958_input_status_enabled = FALSE; /* NPM: to prevent constant retries on HW that doesn't support this feature, if it fails the first time it tries, assume it won't succeed later */
-    }
-    else if (snd_ctl_elem_value_get_boolean(iec958_in_status, 0))
-      gtk_label_set_markup(GTK_LABEL(hw_iec958_input_status_label),
-			   "<span size=\"medium\">Input Active</span>");
-    else
-      gtk_label_set_markup(GTK_LABEL(hw_iec958_input_status_label),
-			   "<span size=\"medium\">No Signal Detected</span>");
-  }
-  return TRUE;
+static void iec958_input_status_show(void)
+{
+  if (snd_ctl_elem_value_get_boolean(iec958_in_status, 0))
+    gtk_label_set_markup(GTK_LABEL(hw_iec958_input_status_label),
+			 "<span size=\"medium\">Input Active</span>");
+  else
+    gtk_label_set_markup(GTK_LABEL(hw_iec958_input_status_label),
+			 "<span size=\"medium\">No Signal Detected</span>");
+}
+
+static void iec958_input_status_error(int err)
+{
+  char temp_text[1024];
+
+  sprintf(temp_text,
+	  "<span size=\"small\">Unable to read IEC958 Input Status:\n     %s</span>",
+	  snd_strerror(err));
+  gtk_label_set_markup(GTK_LABEL(hw_iec958_input_status_label),
+		       temp_text);
+}
+
+/*
+ * The status controls shown on the Hardware Settings page. Each one is
+ * classified by hardware_status_init(): those the driver sends change
+ * events for are push-only, updated from the events of driverevents.c
+ * through master_clock_update(), rate_locking_update() and
+ * rate_reset_update().
+ * The others (word clock and S/PDIF input status, the actual rate, and
+ * any control a driver marks volatile) are read together by
+ * hardware_status_poll(), which redraws only what changed, and which the
+ * poll scheduler calls less and less often while nothing does.
+ *
+ * 'reads' counts the reads made; 'avoided' the reads that polling every
+ * HW_STATUS_TICK ms, as every status used to, would have made on top.
+ * MUDITA24_POLL_STATS prints both every HW_STATUS_STATS_PERIOD ms.
+ */
+#define HW_STATUS_TICK 100		/* ms */
+#define HW_STATUS_STATS_PERIOD 10000	/* ms */
+
+typedef struct {
+	control_t control;
+	int enumerated;
+	void (*show)(void);	/* redraw after a change */
+	int present;
+	int polled;		/* no change events; read by hardware_status_poll() */
+	long last;
+	unsigned long reads, avoided;
+} hw_status_t;
+
+static hw_status_t hw_status[] = {
+	{ CTL_INTERNAL_CLOCK, TRUE, internal_clock_status_show },
+	{ CTL_INTERNAL_CLOCK_DEFAULT, TRUE, internal_clock_status_show },
+	{ CTL_WORD_CLOCK_SYNC, FALSE, internal_clock_status_show },
+	{ CTL_WORD_CLOCK_STATUS, FALSE, master_clock_status_show },
+	{ CTL_RATE_LOCKING, FALSE, rate_locking_status_changed },
+	{ CTL_RATE_RESET, FALSE, rate_reset_status_changed },
+	{ CTL_IEC958_INPUT_STATUS, FALSE, iec958_input_status_show },
+};
+#define HW_STATUS_COUNT (sizeof(hw_status) / sizeof(hw_status[0]))
+
+static int hw_status_idle = FALSE;
+static int hw_status_stats = FALSE;
+static gint64 hw_status_last_poll = 0, hw_status_last_stats = 0; /* ms */
+
+static gint64 hardware_status_now(void)
+{
+	return monotonic_usec() / 1000;
+}
+
+static void hardware_status_init(void)
+{
+	hw_status_t *st;
+	int delta1010 = (card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTA1010 ||
+			 card_eeprom.subvendor == ICE1712_SUBDEVICE_DELTA1010LT);
+
+	hw_status_stats = (getenv("MUDITA24_POLL_STATS") != NULL);
+	for (st = hw_status; st < hw_status + HW_STATUS_COUNT; st++) {
+		switch (st->control) {
+		case CTL_WORD_CLOCK_SYNC:
+		case CTL_WORD_CLOCK_STATUS:
+			st->present = delta1010;
+			break;
+		case CTL_IEC958_INPUT_STATUS:
+			st->present = card_has_delta_iec958_input_status;
+			break;
+		default:
+			st->present = TRUE;
+			break;
+		}
+		st->polled = !control_notifies(st->control, 0);
+		st->last = -1;
+		if (hw_status_stats && st->present)
+			g_print("status: %s is %s\n", control_name(st->control),
+				st->polled ? "polled" : "updated by events");
+	}
+}
+
+/*
+ * The poll task for all the hardware status controls. Reads the polled
+ * ones in one pass and calls each 'show' needed once.
+ */
+gint hardware_status_poll(gpointer data)
+{
+	void (*shown[HW_STATUS_COUNT])(void);
+	hw_status_t *st;
+	gint64 now = hardware_status_now();
+	long ticks, value;
+	int i, err, nshown = 0;
+
+	ticks = hw_status_last_poll ? (now - hw_status_last_poll + HW_STATUS_TICK / 2) / HW_STATUS_TICK : 1;
+	if (ticks < 1)
+		ticks = 1;
+	hw_status_last_poll = now;
+	for (st = hw_status; st < hw_status + HW_STATUS_COUNT; st++) {
+		if (!st->present)
+			continue;
+		if (!st->polled) {
+			st->avoided += ticks;
+			continue;
+		}
+		st->reads++;
+		st->avoided += ticks - 1;
+		if ((err = control_read(st->control, 0)) < 0) {
+			if (st->control == CTL_IEC958_INPUT_STATUS) {
+				iec958_input_status_error(err);
+				st->present = FALSE; /* NPM: to prevent constant retries on HW that doesn't support this feature, if it fails the first time it tries, assume it won't succeed later */
+			} else
+				g_print("Unable to read %s: %s\n", control_name(st->control), snd_strerror(err));
+			continue;
+		}
+		value = st->enumerated
+			? (long)snd_ctl_elem_value_get_enumerated(control_value(st->control, 0), 0)
+			: snd_ctl_elem_value_get_boolean(control_value(st->control, 0), 0);
+		if (value == st->last)
+			continue;
+		st->last = value;
+		for (i = 0; i < nshown && shown[i] != st->show; i++)
+			;
+		if (i == nshown)
+			shown[nshown++] = st->show;
+	}
+	for (i = 0; i < nshown; i++)
+		shown[i]();
+	hw_status_idle = (nshown == 0);
+
+	if (hw_status_stats && now - hw_status_last_stats >= HW_STATUS_STATS_PERIOD) {
+		for (st = hw_status; st < hw_status + HW_STATUS_COUNT; st++)
+			if (st->present)
+				g_print("status: %s: %lu reads, %lu avoided\n",
+					control_name(st->control), st->reads, st->avoided);
+		hw_status_last_stats = now;
+	}
+	return TRUE;
+}
+
+/* TRUE when the last hardware_status_poll() found nothing changed */
+int hardware_status_idle(void)
+{
+	return hw_status_idle;
 }
 
 void rate_locking_update(void)
 {
 	int err;
 	
-	if ((err = snd_ctl_elem_read(ctl, rate_locking)) < 0)
+	if ((err = control_read(CTL_RATE_LOCKING, 0)) < 0)
 		g_print("Unable to read rate locking state: %s\n", snd_strerror(err));
-	if (snd_ctl_elem_value_get_boolean(rate_locking, 0))
-			toggle_set(hw_rate_locking_check, TRUE);
+	rate_locking_status_changed();
 }
 
 void rate_reset_update(void)
 {
 	int err;
 	
-	if ((err = snd_ctl_elem_read(ctl, rate_reset)) < 0)
+	if ((err = control_read(CTL_RATE_RESET, 0)) < 0)
 		g_print("Unable to read rate reset state: %s\n", snd_strerror(err));
-	if (snd_ctl_elem_value_get_boolean(rate_reset, 0))
-			toggle_set(hw_rate_reset_check, TRUE);
+	rate_reset_status_changed();
 }
 
 static void rate_locking_set(int on)
@@ -321,7 +461,7 @@ static void rate_locking_set(int on)
 	int err;
 
 	snd_ctl_elem_value_set_boolean(rate_locking, 0, on ? 1 : 0);
-	if ((err = snd_ctl_elem_write(ctl, rate_locking)) < 0)
+	if ((err = control_write(CTL_RATE_LOCKING, 0)) < 0)
 		g_print("Unable to write rate locking state: %s\n", snd_strerror(err));
 }
 
@@ -330,7 +470,7 @@ static void rate_reset_set(int on)
 	int err;
 
 	snd_ctl_elem_value_set_boolean(rate_reset, 0, on ? 1 : 0);
-	if ((err = snd_ctl_elem_write(ctl, rate_reset)) < 0)
+	if ((err = control_write(CTL_RATE_RESET, 0)) < 0)
 		g_print("Unable to write rate reset state: %s\n", snd_strerror(err));
 }
 
@@ -344,7 +484,7 @@ void rate_locking_toggled(GtkWidget *togglebutton, gpointer data)
 	}
 	if (!strcmp(what, "locked")) {
 		rate_locking_set(1);
-		internal_clock_status_timeout_callback(NULL);
+		internal_clock_status_refresh();
 	} else {
 		g_print("rate_locking_toggled: %s ???\n", what);
 	}
@@ -356,7 +496,7 @@ void rate_reset_toggled(GtkWidget *togglebutton, gpointer data)
 
 	if (!is_active(togglebutton)) {
 		rate_reset_set(0);
-		internal_clock_status_timeout_callback(NULL);
+		internal_clock_status_refresh();
 		return;
 	}
 	if (!strcmp(what, "reset")) {
@@ -370,7 +510,7 @@ void volume_change_rate_update(void)
 {
 	int err;
 	
-	if ((err = snd_ctl_elem_read(ctl, volume_rate)) < 0)
+	if ((err = control_read(CTL_VOLUME_RATE, 0)) < 0)
 		g_print("Unable to read volume change rate: %s\n", snd_strerror(err));
 	gtk_adjustment_set_value(GTK_ADJUSTMENT(hw_volume_change_adj),
 				 snd_ctl_elem_value_get_integer(volume_rate, 0));
@@ -381,7 +521,7 @@ void volume_change_rate_adj(GtkAdjustment *adj, gpointer data)
 	int err;
 	
 	snd_ctl_elem_value_set_integer(volume_rate, 0, gtk_adjustment_get_value(adj));
-	if ((err = snd_ctl_elem_write(ctl, volume_rate)) < 0)
+	if ((err = control_write(CTL_VOLUME_RATE, 0)) < 0)
 		g_print("Unable to write volume change rate: %s\n", snd_strerror(err));
 }
 
@@ -390,7 +530,7 @@ void spdif_output_update(void)
 	int err;
 	snd_aes_iec958_t iec958;
 	
-	if ((err = snd_ctl_elem_read(ctl, spdif_output)) < 0) {
+	if ((err = control_read(CTL_IEC958_PLAYBACK_DEFAULT, 0)) < 0) {
 		if (err == -ENOENT)
 			return;
 		g_print("Unable to read Delta S/PDIF output state: %s\n", snd_strerror(err));
@@ -446,7 +586,7 @@ static void spdif_output_write(void)
 {
 	int err;
 
-	if ((err = snd_ctl_elem_write(ctl, spdif_output)) < 0)
+	if ((err = control_write(CTL_IEC958_PLAYBACK_DEFAULT, 0)) < 0)
 		g_print("Unable to write Delta S/PDIF Output Defaults: %s\n", snd_strerror(err));
 }
 
@@ -638,12 +778,12 @@ void spdif_input_update(void)
 	if ((card_eeprom.subvendor != ICE1712_SUBDEVICE_DELTADIO2496) &&
 	    ! card_is_dmx6fire)
 		return;
-	if ((err = snd_ctl_elem_read(ctl, spdif_input)) < 0)
+	if ((err = control_read(spdif_input_control, 0)) < 0)
 		g_print("Unable to read S/PDIF input switch: %s\n", snd_strerror(err));
 	if (snd_ctl_elem_value_get_boolean(spdif_input, 0))
 		digoptical = TRUE;
 	if (card_is_dmx6fire) {
-        	if ((err = snd_ctl_elem_read(ctl, spdif_on_off)) < 0)
+        	if ((err = control_read(CTL_FRONT_DIGITAL_INPUT, 0)) < 0)
 			g_print("Unable to read S/PDIF on/off switch: %s\n", snd_strerror(err));
 	      	if (!(snd_ctl_elem_value_get_boolean(spdif_on_off, 0)))
 			diginternal = TRUE;
@@ -674,9 +814,9 @@ void spdif_input_toggled(GtkWidget *togglebutton, gpointer data)
 			if (!strcmp(str, "Coaxial"))
 				snd_ctl_elem_value_set_boolean(spdif_input, 0, 0);
 	}
-	if ((err = snd_ctl_elem_write(ctl, spdif_on_off)) < 0)
+	if ((err = control_write(CTL_FRONT_DIGITAL_INPUT, 0)) < 0)
                g_print("Unable to write S/PDIF on/off switch: %s\n", snd_strerror(err));
-	if ((err = snd_ctl_elem_write(ctl, spdif_input)) < 0)
+	if ((err = control_write(spdif_input_control, 0)) < 0)
 		g_print("Unable to write S/PDIF input switch: %s\n", snd_strerror(err));
 }
 
@@ -686,7 +826,7 @@ void analog_input_select_update(void)
 
 	if (! card_is_dmx6fire)
 		return;
-	if ((err = snd_ctl_elem_read(ctl, analog_input_select)) < 0)
+	if ((err = control_read(CTL_ANALOG_INPUT_SELECT, 0)) < 0)
 		g_print("Unable to read analog input switch: %s\n", snd_strerror(err));
 	input_interface = snd_ctl_elem_value_get_enumerated(analog_input_select, 0);
 	switch (input_interface) {
@@ -705,7 +845,7 @@ void analog_input_select_set(int value)
 	int err;
 
         snd_ctl_elem_value_set_enumerated(analog_input_select, 0, value);
-        if ((err = snd_ctl_elem_write(ctl, analog_input_select)) < 0)
+        if ((err = control_write(CTL_ANALOG_INPUT_SELECT, 0)) < 0)
                 g_print("Unable to write analog input selection: %s\n", snd_strerror(err));
 }
 
@@ -731,7 +871,7 @@ void analog_input_select_toggled(GtkWidget *togglebutton, gpointer data)
         } else {
                 g_print("analog_input_select_toggled: %s ???\n", what);
         }
-       if ((err = snd_ctl_elem_write(ctl, breakbox_led)) < 0)
+       if ((err = control_write(CTL_BREAKBOX_LED, 0)) < 0)
                g_print("Unable to write breakbox LED switch: %s\n", snd_strerror(err));
 }
 
@@ -741,7 +881,7 @@ void phono_input_update(void)
 
         if (! card_is_dmx6fire)
                 return;
-        if ((err = snd_ctl_elem_read(ctl, phono_input)) < 0)
+        if ((err = control_read(CTL_PHONO_INPUT, 0)) < 0)
                 g_print("Unable to read phono input switch: %s\n", snd_strerror(err));
         if (snd_ctl_elem_value_get_boolean(phono_input, 0)) {
                 toggle_set(hw_phono_input_on_radio, TRUE);
@@ -761,72 +901,30 @@ void phono_input_toggled(GtkWidget *togglebutton, gpointer data)
                 snd_ctl_elem_value_set_boolean(phono_input, 0, 1);
         else
                 snd_ctl_elem_value_set_boolean(phono_input, 0, 0);
-        if ((err = snd_ctl_elem_write(ctl, phono_input)) < 0)
+        if ((err = control_write(CTL_PHONO_INPUT, 0)) < 0)
                 g_print("Unable to write phono input switch: %s\n", snd_strerror(err));
 }
 
 void hardware_init(void)
 {
-	if (snd_ctl_elem_value_malloc(&internal_clock) < 0 ||
-	    snd_ctl_elem_value_malloc(&internal_clock_default) < 0 ||
-	    snd_ctl_elem_value_malloc(&word_clock_sync) < 0 ||
-	    snd_ctl_elem_value_malloc(&rate_locking) < 0 ||
-	    snd_ctl_elem_value_malloc(&rate_reset) < 0 ||
-	    snd_ctl_elem_value_malloc(&volume_rate) < 0 ||
-	    snd_ctl_elem_value_malloc(&spdif_input) < 0 ||
-	    snd_ctl_elem_value_malloc(&spdif_output) < 0 ||
-	    snd_ctl_elem_value_malloc(&analog_input_select) < 0 ||
-	    snd_ctl_elem_value_malloc(&breakbox_led) < 0 ||
-	    snd_ctl_elem_value_malloc(&spdif_on_off) < 0 ||
-	    snd_ctl_elem_value_malloc(&phono_input) < 0  ||
-	    snd_ctl_elem_value_malloc(&iec958_in_status) < 0) { /* NPM: add feature to display "Delta IEC958 Input Status" */
-		g_print("Cannot allocate memory\n");
-		exit(1);
-	}
-
-	snd_ctl_elem_value_set_interface(internal_clock, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(internal_clock, "Multi Track Internal Clock");
-
-	snd_ctl_elem_value_set_interface(internal_clock_default, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(internal_clock_default, "Multi Track Internal Clock Default");
-
-	snd_ctl_elem_value_set_interface(word_clock_sync, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(word_clock_sync, "Word Clock Sync");
-
-	snd_ctl_elem_value_set_interface(rate_locking, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(rate_locking, "Multi Track Rate Locking");
-
-	snd_ctl_elem_value_set_interface(rate_reset, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(rate_reset, "Multi Track Rate Reset");
-
-	snd_ctl_elem_value_set_interface(volume_rate, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(volume_rate, "Multi Track Volume Rate");
-
-	if (card_is_dmx6fire) {
-		snd_ctl_elem_value_set_interface(spdif_input, SND_CTL_ELEM_IFACE_MIXER);
-		snd_ctl_elem_value_set_name(spdif_input, "Optical Digital Input Switch");
-	} else {
-		snd_ctl_elem_value_set_interface(spdif_input, SND_CTL_ELEM_IFACE_MIXER);
-		snd_ctl_elem_value_set_name(spdif_input, "IEC958 Input Optical");
-	}
-
-	snd_ctl_elem_value_set_interface(spdif_output, SND_CTL_ELEM_IFACE_PCM);
-	snd_ctl_elem_value_set_name(spdif_output, "IEC958 Playback Default");
-
-	snd_ctl_elem_value_set_interface(analog_input_select, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(analog_input_select, "Analog Input Select");
-
-	snd_ctl_elem_value_set_interface(breakbox_led, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(breakbox_led, "Breakbox LED");
-
-	snd_ctl_elem_value_set_interface(spdif_on_off, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(spdif_on_off, "Front Digital Input Switch");
-
-	snd_ctl_elem_value_set_interface(phono_input, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(phono_input, "Phono Analog Input Switch");
-
-	snd_ctl_elem_value_set_interface(iec958_in_status, SND_CTL_ELEM_IFACE_MIXER); /* NPM: add feature to display "Delta IEC958 Input Status" */
-	snd_ctl_elem_value_set_name(iec958_in_status, "Delta IEC958 Input Status"); /* NPM: add feature to display "Delta IEC958 Input Status" */
+	internal_clock = control_value(CTL_INTERNAL_CLOCK, 0);
+	internal_clock_default = control_value(CTL_INTERNAL_CLOCK_DEFAULT, 0);
+	word_clock_sync = control_value(CTL_WORD_CLOCK_SYNC, 0);
+	word_clock_status = control_value(CTL_WORD_CLOCK_STATUS, 0);
+	rate_locking = control_value(CTL_RATE_LOCKING, 0);
+	rate_reset = control_value(CTL_RATE_RESET, 0);
+	volume_rate = control_value(CTL_VOLUME_RATE, 0);
+	if (card_is_dmx6fire)
+		spdif_input_control = CTL_OPTICAL_DIGITAL_INPUT;
+	else
+		spdif_input_control = CTL_IEC958_INPUT_OPTICAL;
+	spdif_input = control_value(spdif_input_control, 0);
+	spdif_output = control_value(CTL_IEC958_PLAYBACK_DEFAULT, 0);
+	analog_input_select = control_value(CTL_ANALOG_INPUT_SELECT, 0);
+	breakbox_led = control_value(CTL_BREAKBOX_LED, 0);
+	spdif_on_off = control_value(CTL_FRONT_DIGITAL_INPUT, 0);
+	phono_input = control_value(CTL_PHONO_INPUT, 0);
+	iec958_in_status = control_value(CTL_IEC958_INPUT_STATUS, 0); /* NPM: add feature to display "Delta IEC958 Input Status" */
 }
 
 void hardware_postinit(void)
@@ -839,6 +937,6 @@ void hardware_postinit(void)
 	spdif_output_update();
 	analog_input_select_update();
 	phono_input_update();
-	if (card_has_delta_iec958_input_status)
-	  iec958_input_status_timeout_callback(NULL); /* NPM */
+	hardware_status_init();
+	hardware_status_poll(NULL);
 }
@@ -25,25 +25,57 @@
 #include <math.h>
 #include "envy24control.h"
 
-static GdkGC *penWhiteLight[21] = { NULL, };
-static GdkGC *penGreenLight[21] = { NULL, };
-static GdkGC *penForeground[21] = { NULL, };
-static GdkGC *penBackground[21] = { NULL, };
-static GdkGC *penOrangeLight[21] = { NULL, };
-static GdkGC *penRedLight[21] = { NULL, };
-static GdkColor *peak_label_color = NULL; /* NPM set in level_meters_configure_event() */
+#define METERS 21		/* "DigitalMixer" + "Mixer1" .. "Mixer20" */
 
-static GdkPixmap *pixmap[21] = { NULL, };
-static snd_ctl_elem_value_t *peaks;
+/*
+ * All meters share one set of pens, as every meter uses the same colors,
+ * and are rendered into a single offscreen "atlas" pixmap, meter 'idx'
+ * occupying the slot_width-wide column starting at idx * slot_width.
+ * Each drawing operation adds to that meter's damage rectangle; once per
+ * tick meter_flush() copies only the damaged area to the meter's window,
+ * rather than blitting every visible meter in full.
+ */
+static GdkGC *penWhiteLight = NULL;
+static GdkGC *penGreenLight = NULL;
+static GdkGC *penForeground = NULL;
+static GdkGC *penBackground = NULL;
+static GdkGC *penOrangeLight = NULL;
+static GdkGC *penRedLight = NULL;
 
-extern int input_channels, output_channels, pcm_output_channels, spdif_channels, view_spdif_playback;
+/*
+ * Lookup tables indexed by hardware peak value 0..MAX_METERING_LEVEL, so
+ * that drawing the meters does no floating point math: the bar height in
+ * pixels for each meter, rebuilt by level_meters_configure_event() when
+ * the meter's height changes, and the color class of each peak value.
+ */
+enum { PEAK_GREEN, PEAK_WHITE, PEAK_ORANGE, PEAK_RED };
+static short meter_levels[METERS][MAX_METERING_LEVEL + 1];
+static int meter_levels_height[METERS] = { 0, }; /* height meter_levels[idx] was built for */
+static unsigned char peak_color_class[MAX_METERING_LEVEL + 1];
+static int peak_white_level, peak_orange_level, peak_red_level; /* from ballistics_color_thresholds() */
+static GdkColor *peak_label_color = NULL; /* NPM set in level_meters_configure_event() */
 
-static void update_peak_switch(void) {
-	int err;
+static GdkPixmap *atlas = NULL;
+static int slot_width = 0, atlas_height = 0;
+static int meter_width[METERS] = { 0, };  /* 0 until level_meters_configure_event() */
+static int meter_height[METERS] = { 0, };
+static GdkRectangle damage[METERS];	  /* in meter window coordinates; empty if width == 0 */
 
-	if ((err = snd_ctl_elem_read(ctl, peaks)) < 0)
-		g_print("Unable to read peaks: %s\n", snd_strerror(err));
-}
+/*
+ * Frame cost counters, reported every FRAME_COST_REPORT_TICKS ticks when
+ * the environment variable MUDITA24_METER_STATS is set.
+ */
+#define FRAME_COST_REPORT_TICKS 100 /* 10 seconds at 10Hz */
+static struct {
+	unsigned long ticks;
+	unsigned long draw_ops;
+	unsigned long blits;
+	unsigned long blit_pixels;
+	unsigned long usec;
+} frame_cost;
+static int frame_cost_report = FALSE;
+
+extern int input_channels, output_channels, pcm_output_channels, spdif_channels, view_spdif_playback;
 
 /*
  * Niels Mayer (NPM) Jul-11-10: Fixing https://bugzilla.redhat.com/show_bug.cgi?id=602903
@@ -61,45 +93,105 @@ static void update_peak_switch(void) {
 static int peak_levels[MULTI_TRACK_PEAK_CHANNELS] = {0,};
 static int peak_changed[MULTI_TRACK_PEAK_CHANNELS] = {0,};
 static int previous_levels[MULTI_TRACK_PEAK_CHANNELS] = {0,};
+/*
+ * Returns level of peak channel 'i', updating its held peak: the max level
+ * seen since "Reset Peaks" or, with ballistics, the engine's held peak.
+ */
+static int get_level(int i) {
+  int level = meters_level(i);
+
+  if (ballistics_active()) {
+    if (meters_held(i) != peak_levels[i]) {
+      peak_levels[i] = meters_held(i);
+      peak_changed[i] = TRUE;
+    }
+  }
+  else if (level > peak_levels[i]) {
+    peak_levels[i] = level;
+    peak_changed[i] = TRUE;
+  }
+  return level;
+}
+
 /* NPM: changed for https://bugzilla.redhat.com/show_bug.cgi?id=602903 */
 static void get_levels(int idx, int *l1, int *l2) {
   *l1 = *l2 = 0;
   if (idx == 0) { /* "if (stereo)" -- special case idx=0 as digital mix pair */
     if ((peak_changed[IDX_LMIX] != RESET) && (peak_changed[IDX_RMIX] != RESET)) { /* don't change values if doing "Reset Peaks" */
-      if ((*l1 = snd_ctl_elem_value_get_integer(peaks, IDX_LMIX)) > peak_levels[IDX_LMIX]) {
-	peak_levels[IDX_LMIX] = (*l1);
-	peak_changed[IDX_LMIX] = TRUE;
-      }
-      if ((*l2 = snd_ctl_elem_value_get_integer(peaks, IDX_RMIX)) > peak_levels[IDX_RMIX]) {
-	peak_levels[IDX_RMIX] = (*l2);
-	peak_changed[IDX_RMIX] = TRUE;
-      }
+      *l1 = get_level(IDX_LMIX);
+      *l2 = get_level(IDX_RMIX);
     }
   }
   else {
-    if (peak_changed[idx-1] != RESET) {
-      if ((*l1 = snd_ctl_elem_value_get_integer(peaks, idx - 1)) > peak_levels[idx - 1]) {
-	peak_levels[idx - 1] = (*l1);
-	peak_changed[idx - 1] = TRUE;
-      }
-    }
+    if (peak_changed[idx-1] != RESET)
+      *l1 = get_level(idx - 1);
   }
 }
 
-static GdkGC *get_pen(int idx, int nRed, int nGreen, int nBlue) {
+static GdkGC *get_pen(int nRed, int nGreen, int nBlue) {
 	GdkColor *c;
 	GdkGC *gc;
-	
+
 	c = (GdkColor *)g_malloc(sizeof(GdkColor));
 	c->red = nRed;
 	c->green = nGreen;
 	c->blue = nBlue;
 	gdk_color_alloc(gdk_colormap_get_system(), c);
-	gc = gdk_gc_new(pixmap[idx]);
+	gc = gdk_gc_new(atlas);
 	gdk_gc_set_foreground(gc, c);
 	return gc;
 }
 
+/* Add a rectangle, clipped to the meter's window, to meter 'idx' damage */
+static void meter_damage(int idx, int x, int y, int width, int height) {
+	GdkRectangle r, bounds;
+
+	bounds.x = bounds.y = 0;
+	bounds.width = meter_width[idx];
+	bounds.height = meter_height[idx];
+	r.x = x;
+	r.y = y;
+	r.width = width;
+	r.height = height;
+	if (!gdk_rectangle_intersect(&r, &bounds, &r))
+		return;
+	if (damage[idx].width == 0)
+		damage[idx] = r;
+	else
+		gdk_rectangle_union(&damage[idx], &r, &damage[idx]);
+}
+
+static void meter_draw_rectangle(int idx, GdkGC *gc, int x, int y, int width, int height) {
+	if (width <= 0 || height <= 0)
+		return;
+	gdk_draw_rectangle(atlas, gc, TRUE, idx * slot_width + x, y, width, height);
+	meter_damage(idx, x, y, width, height);
+	frame_cost.draw_ops++;
+}
+
+static void meter_draw_hline(int idx, GdkGC *gc, int x1, int x2, int y) {
+	gdk_draw_line(atlas, gc, idx * slot_width + x1, y, idx * slot_width + x2, y);
+	meter_damage(idx, x1, y, x2 - x1 + 1, 1);
+	frame_cost.draw_ops++;
+}
+
+/* Copy meter 'idx' damaged area from the atlas to its window */
+static void meter_flush(int idx, GtkWidget *widget) {
+	GdkRectangle *d = &damage[idx];
+
+	if (d->width == 0)
+		return;
+	gdk_draw_drawable(gtk_widget_get_window(widget),
+			  gtk_widget_get_style(widget)->black_gc,
+			  atlas,
+			  idx * slot_width + d->x, d->y,
+			  d->x, d->y,
+			  d->width, d->height);
+	frame_cost.blits++;
+	frame_cost.blit_pixels += d->width * d->height;
+	d->width = d->height = 0;
+}
+
 static int get_index(const gchar *name) {
 	int result;
 
@@ -120,15 +212,24 @@ static int get_index(const gchar *name) {
  * min - FFh max volume. Reading the register resets the meter to 00h."
  */
 
-//NPM difft colors for -1dB, -3dB, and -6dB peak levels
-#define GET_COLOR_FOR_PEAKLEVEL(level) \
-  (level > 228)                        \
-      ? (penRedLight[idx])             \
-      : ((level > 181)                 \
-	 ? (penOrangeLight[idx])       \
-	 : ((level > 128)              \
-	    ? (penWhiteLight[idx])     \
-	    : (penGreenLight[idx])))   
+//NPM difft colors for -1dB, -3dB, and -6dB peak levels (by default, see ballistics_color_thresholds())
+#define PEAK_COLOR_CLASS(level)        \
+  (level > peak_red_level)             \
+      ? (PEAK_RED)                     \
+      : ((level > peak_orange_level)   \
+	 ? (PEAK_ORANGE)               \
+	 : ((level > peak_white_level) \
+	    ? (PEAK_WHITE)             \
+	    : (PEAK_GREEN)))
+
+static GdkGC *get_color_for_peaklevel(int level) {
+  switch (peak_color_class[level]) {
+  case PEAK_RED:    return penRedLight;
+  case PEAK_ORANGE: return penOrangeLight;
+  case PEAK_WHITE:  return penWhiteLight;
+  default:          return penGreenLight;
+  }
+}
 
 /*
  * NPM: Called by redraw_meters(), this is a special case for when "Reset
@@ -144,18 +245,17 @@ static void draw_meters_reset(int idx, int width, int height,
 //  if (!gdk_color_parse("bg", &color))
 //    g_print("gdk_color_parse('bg') fail\n");
 
-  gdk_draw_rectangle(pixmap[idx],
-		     penBackground[idx], 
-		     TRUE,
-		     //X
-		     6,
-		     //Y
-		     0,
-		     //WIDTH
-		     segment_width,
-		     //HEIGHT
-		     height
-		     );
+  meter_draw_rectangle(idx,
+		       penBackground,
+		       //X
+		       6,
+		       //Y
+		       0,
+		       //WIDTH
+		       segment_width,
+		       //HEIGHT
+		       height
+		       );
   /* NPM: Reset peak labels for "Monitor Inputs" and "Monitor PCMs" panels */
   gtk_label_set_text(GTK_LABEL((stereo) ? peak_label[IDX_LMIX] : peak_label[idx-1]),
 		     peak_level_to_db((stereo) ? peak_levels[IDX_LMIX] : peak_levels[idx-1])); /* put new value in label */
@@ -183,18 +283,17 @@ static void draw_meters_reset(int idx, int width, int height,
     }
   }
   if (stereo) {
-    gdk_draw_rectangle(pixmap[idx],
-		       penBackground[idx], 
-		       TRUE,
-		       //X
-		       2 + (width / 2),
-		       //Y
-		       0,
-		       //WIDTH
-		       segment_width,
-		       //HEIGHT
-		       height
-		       );
+    meter_draw_rectangle(idx,
+			 penBackground,
+			 //X
+			 2 + (width / 2),
+			 //Y
+			 0,
+			 //WIDTH
+			 segment_width,
+			 //HEIGHT
+			 height
+			 );
     /* put new value in label */
     gtk_label_set_text(GTK_LABEL(peak_label[IDX_RMIX]), peak_level_to_db(peak_levels[IDX_RMIX])); 
     gtk_widget_modify_fg(peak_label[IDX_RMIX], GTK_STATE_NORMAL, NULL);
@@ -268,6 +367,23 @@ static void draw_peak_labels(int index, int stereo, int peak1_level, int peak2_l
 		/  51.0) ))-1                           \
    )
 
+/* Build meter 'idx' table of METER_LEVEL() for its current 'height' */
+static void build_meter_levels(int idx, int height) {
+  int level;
+
+  for (level = 0; level <= MAX_METERING_LEVEL; level++)
+    meter_levels[idx][level] = METER_LEVEL(level, height);
+  meter_levels_height[idx] = height;
+}
+
+static int meter_level(int idx, int level, int height) {
+  if (meter_levels_height[idx] != height) /* only if drawn before configured */
+    build_meter_levels(idx, height);
+  if (level > MAX_METERING_LEVEL)
+    level = MAX_METERING_LEVEL;
+  return meter_levels[idx][level];
+}
+
 /* 
  * NPM: Called by redraw_meters(), this is the normal case 
  * where we draw the meter and peaks, if changed.
@@ -275,10 +391,10 @@ static void draw_peak_labels(int index, int stereo, int peak1_level, int peak2_l
 static void draw_meters_and_peaks(int idx, int width, int height, int level1, int level2, 
 				  int stereo, int segment_width) {
   int meter1 = (stereo)
-    ? METER_LEVEL(peak_levels[IDX_LMIX], height)
-    : METER_LEVEL(peak_levels[idx - 1],  height);
+    ? meter_level(idx, peak_levels[IDX_LMIX], height)
+    : meter_level(idx, peak_levels[idx - 1],  height);
   int meter2 = (stereo)
-    ? METER_LEVEL(peak_levels[IDX_RMIX], height)
+    ? meter_level(idx, peak_levels[IDX_RMIX], height)
     : 0;
   int peak1 = height - meter1;
   int peak2 = (stereo) ? height - meter2: 0;
@@ -291,32 +407,41 @@ static void draw_meters_and_peaks(int idx, int width, int height, int level1, in
     int peak2_level, peak1_level
       = (stereo) ? peak_levels[IDX_LMIX] : peak_levels[idx-1];
 
+    /* With ballistics the held peak falls back: clear the old peak line
+       above the new one, and have the bar repaint whatever it covered */
+    if (ballistics_active()) {
+      meter_draw_rectangle(idx, penBackground, 6, 0, segment_width, peak1 - 1);
+      if (stereo) {
+	if (peak_changed[IDX_RMIX]) /* RMIX peak line is only redrawn below if changed */
+	  meter_draw_rectangle(idx, penBackground, 2 + (width / 2), 0, segment_width, peak2 - 1);
+	previous_levels[IDX_LMIX] = previous_levels[IDX_RMIX] = -1;
+      }
+      else
+	previous_levels[idx-1] = -1;
+    }
+
     /* Draw the peak as a single line */
-    gdk_draw_line(pixmap[idx],
-		  GET_COLOR_FOR_PEAKLEVEL(peak1_level),
-		  //X1
-		  6,
-		  //Y1
-		  peak1 - 1,
-		  //X2
-		  5 + segment_width,
-		  //Y2
-		  peak1 - 1
-		  );
+    meter_draw_hline(idx,
+		     get_color_for_peaklevel(peak1_level),
+		     //X1
+		     6,
+		     //X2
+		     5 + segment_width,
+		     //Y
+		     peak1 - 1
+		     );
     /* Handle special "stereo" case for right-channel of digital mixer */
     if (stereo && peak_changed[IDX_RMIX]) { //for stereo, draw RMIX, but skip redraw if same
       peak2_level = peak_levels[IDX_RMIX];
-      gdk_draw_line(pixmap[idx],
-		    GET_COLOR_FOR_PEAKLEVEL(peak2_level),
-		    //X1
-		    2 + (width / 2),
-		    //Y1
-		    peak2 - 1,
-		    //X2
-		    1 + (width / 2) + segment_width,
-		    //Y2
-		    peak2 - 1
-		    );
+      meter_draw_hline(idx,
+		       get_color_for_peaklevel(peak2_level),
+		       //X1
+		       2 + (width / 2),
+		       //X2
+		       1 + (width / 2) + segment_width,
+		       //Y
+		       peak2 - 1
+		       );
     }
     else
       peak2_level = -1;	/* not used unless above case, which is also in draw_peak_labels()... but initialize anyways */
@@ -340,76 +465,78 @@ static void draw_meters_and_peaks(int idx, int width, int height, int level1, in
    * level1 at 0 --> no dspl
    * level1 at 1 --> draw rectange at (1/255)*height
    * level1 at 255 --> draw rectangle (255/255)*height
+   * previous_levels[] holds the bar height last drawn, in pixels, so that
+   * level changes too small to move the bar cause no drawing at all.
    */
-  meter1 = METER_LEVEL(level1, height);
+  meter1 = meter_level(idx, level1, height);
   if (stereo)
-    meter2 = METER_LEVEL(level2, height);
-  if (level1 != (stereo ? previous_levels[IDX_LMIX] : previous_levels[idx-1]) ) { //skip redraw if same
-    gdk_draw_rectangle(pixmap[idx],
-		       penBackground[idx],
-		       TRUE,
-		       //X
-		       6,                               // draw black downward from peak
-		       //Y
-		       peak1,
-		       //WIDTH
-		       segment_width,
-		       //HEIGHT
-		       height - meter1 - peak1
-		       );
-    gdk_draw_rectangle(pixmap[idx],
-		       penForeground[idx],
-		       TRUE,
-		       //X
-		       6,
-		       //Y
-		       height - meter1,
-		       //WIDTH
-		       segment_width,
-		       //HEIGHT
-		       meter1
-		       );                             
-    /* save current level value, skip redraw next time if no change */
+    meter2 = meter_level(idx, level2, height);
+  if (meter1 != (stereo ? previous_levels[IDX_LMIX] : previous_levels[idx-1]) ) { //skip redraw if same
+    meter_draw_rectangle(idx,
+			 penBackground,
+			 //X
+			 6,                               // draw black downward from peak
+			 //Y
+			 peak1,
+			 //WIDTH
+			 segment_width,
+			 //HEIGHT
+			 height - meter1 - peak1
+			 );
+    meter_draw_rectangle(idx,
+			 penForeground,
+			 //X
+			 6,
+			 //Y
+			 height - meter1,
+			 //WIDTH
+			 segment_width,
+			 //HEIGHT
+			 meter1
+			 );
+    /* save current bar height, skip redraw next time if no change */
     if (stereo)
-      previous_levels[IDX_LMIX] = level1;
+      previous_levels[IDX_LMIX] = meter1;
     else
-      previous_levels[idx-1] = level1;
+      previous_levels[idx-1] = meter1;
   }
-  if (stereo && (level2 != previous_levels[IDX_RMIX])) { //for stereo, draw RMIX, but skip redraw if same
-    gdk_draw_rectangle(pixmap[idx],
-		       penBackground[idx],
-		       TRUE,
-		       //X
-		       2 + (width / 2),
-		       //Y
-		       peak2,
-		       //WIDTH
-		       segment_width,
-		       //HEIGHT
-		       height - meter2 - peak2
-		       );
-    gdk_draw_rectangle(pixmap[idx],
-		       penForeground[idx],
-		       TRUE,
-		       //X
-		       2 + (width / 2),
-		       //Y
-		       height - meter2,
-		       //WIDTH
-		       segment_width,
-		       //HEIGHT
-		       meter2
-		       );
-    /* save current level value, skip redraw next time if no change */
-    previous_levels[IDX_RMIX] = level2; 
+  if (stereo && (meter2 != previous_levels[IDX_RMIX])) { //for stereo, draw RMIX, but skip redraw if same
+    meter_draw_rectangle(idx,
+			 penBackground,
+			 //X
+			 2 + (width / 2),
+			 //Y
+			 peak2,
+			 //WIDTH
+			 segment_width,
+			 //HEIGHT
+			 height - meter2 - peak2
+			 );
+    meter_draw_rectangle(idx,
+			 penForeground,
+			 //X
+			 2 + (width / 2),
+			 //Y
+			 height - meter2,
+			 //WIDTH
+			 segment_width,
+			 //HEIGHT
+			 meter2
+			 );
+    /* save current bar height, skip redraw next time if no change */
+    previous_levels[IDX_RMIX] = meter2;
   }
 }
 
-static void redraw_meters(int idx, int width, int height, int level1, int level2) {
-  int stereo = (idx == 0);
-  int segment_width = (stereo)
+static int get_segment_width(int idx, int width) {
+  return (idx == 0)		/* "if stereo" */
     ? (width / 2) - 8
     : width - 12;
+}
+
+static void redraw_meters(int idx, int width, int height, int level1, int level2) {
+  int stereo = (idx == 0);
+  int segment_width = get_segment_width(idx, width);
 
   if ( (stereo && ((peak_changed[IDX_LMIX] == RESET) || (peak_changed[IDX_RMIX] == RESET)))
        || peak_changed[idx-1] == RESET)	//needs full refresh, reset peaks button was clicked
@@ -450,38 +577,96 @@ static void levelmeters_init_bg(GtkWidget* widget, GdkGC *gc) {
   gdk_gc_set_foreground(gc, meter_bg); 
 }
 
+/*
+ * The atlas content of every meter other than the one being configured is
+ * lost when the atlas is reallocated: repaint its background now and force
+ * its bars and held peaks to be redrawn on the next tick.
+ */
+static void meter_repaint(int idx) {
+  int width = meter_width[idx];
+  int segment_width = get_segment_width(idx, width);
+
+  meter_draw_rectangle(idx, penBackground, 6, 0, segment_width, meter_height[idx]);
+  if (idx == 0) {		/* "if stereo" */
+    meter_draw_rectangle(idx, penBackground, 2 + (width / 2), 0, segment_width, meter_height[idx]);
+    previous_levels[IDX_LMIX] = previous_levels[IDX_RMIX] = -1;
+    if (peak_changed[IDX_LMIX] != RESET)
+      peak_changed[IDX_LMIX] = TRUE;
+    if (peak_changed[IDX_RMIX] != RESET)
+      peak_changed[IDX_RMIX] = TRUE;
+  }
+  else {
+    previous_levels[idx-1] = -1;
+    if (peak_changed[idx-1] != RESET)
+      peak_changed[idx-1] = TRUE;
+  }
+}
+
+/* Grow the atlas so every slot holds a 'width' x 'height' meter */
+static void atlas_resize(GtkWidget *widget, int width, int height) {
+	int i;
+
+	if (atlas != NULL)
+		gdk_pixmap_unref(atlas);
+	slot_width = width;
+	atlas_height = height;
+	atlas = gdk_pixmap_new(gtk_widget_get_window(widget),
+			       METERS * slot_width,
+			       atlas_height,
+			       -1);
+	gdk_draw_rectangle(atlas,
+			   gtk_widget_get_style(widget)->black_gc,
+			   TRUE,
+			   0, 0,
+			   METERS * slot_width,
+			   atlas_height);
+	if (penBackground == NULL)
+		return;		/* first meter configured, nothing to repaint */
+	for (i = 0; i < METERS; i++)
+		if (meter_width[i] != 0)
+			meter_repaint(i);
+}
+
 gint level_meters_configure_event(GtkWidget *widget, GdkEventConfigure *event) {
 	int idx = get_index(gtk_widget_get_name(widget));
 	GtkAllocation allocation;
 	gtk_widget_get_allocation(widget, &allocation);
-	if (pixmap[idx] != NULL)
-		gdk_pixmap_unref(pixmap[idx]);
-	pixmap[idx] = gdk_pixmap_new(gtk_widget_get_window(widget),
-				     allocation.width,
-				     allocation.height,
-				     -1);
-	penWhiteLight[idx] = get_pen(idx, 0xffff, 0xffff, 0xffff);
-	penGreenLight[idx] = get_pen(idx, 0, 0xffff, 0);
-
-	/* NPM: Setup penForeground[idx] color for meters */
-	levelmeters_init_fg(widget, (penForeground[idx] = gdk_gc_new(pixmap[idx])));
-	/* NPM: Setup penBackground[idx] color for meters */
-	levelmeters_init_bg(widget, (penBackground[idx] = gdk_gc_new(pixmap[idx])));
-
-	penOrangeLight[idx] = get_pen(idx, 0xff11, 0x9911, 0);
-
-	peak_label_color = (GdkColor *)g_malloc(sizeof(GdkColor)); /* free()'d on exit() */
-        gdk_color_parse("red", peak_label_color);
-	gdk_color_alloc(gdk_colormap_get_system(), peak_label_color);
-
-	penRedLight[idx] = get_pen(idx, 0xffff, 0, 0);
+	meter_width[idx] = 0;	/* exclude from meter_repaint() */
+	if (atlas == NULL
+	    || allocation.width > slot_width
+	    || allocation.height > atlas_height)
+		atlas_resize(widget,
+			     MAX(slot_width, allocation.width),
+			     MAX(atlas_height, allocation.height));
+	meter_width[idx] = allocation.width;
+	meter_height[idx] = allocation.height;
+	if (meter_levels_height[idx] != allocation.height)
+		build_meter_levels(idx, allocation.height);
+
+	if (penBackground == NULL) { /* pens are shared by all meters, create once */
+		penWhiteLight = get_pen(0xffff, 0xffff, 0xffff);
+		penGreenLight = get_pen(0, 0xffff, 0);
+
+		/* NPM: Setup penForeground color for meters */
+		levelmeters_init_fg(widget, (penForeground = gdk_gc_new(atlas)));
+		/* NPM: Setup penBackground color for meters */
+		levelmeters_init_bg(widget, (penBackground = gdk_gc_new(atlas)));
+
+		penOrangeLight = get_pen(0xff11, 0x9911, 0);
+
+		peak_label_color = (GdkColor *)g_malloc(sizeof(GdkColor)); /* free()'d on exit() */
+		gdk_color_parse("red", peak_label_color);
+		gdk_color_alloc(gdk_colormap_get_system(), peak_label_color);
+
+		penRedLight = get_pen(0xffff, 0, 0);
+	}
 
-	gdk_draw_rectangle(pixmap[idx],
+	gdk_draw_rectangle(atlas,
 			   gtk_widget_get_style(widget)->black_gc,
 			   TRUE,
-			   0, 0,
-			   allocation.width,
-			   allocation.height);
+			   idx * slot_width, 0,
+			   slot_width,
+			   atlas_height);
 
 	/* NPM: ensure redraw_meters() below does a full refresh, per meter  */
 	if (idx == 0) {		/* "if stereo" -- special case for L/R output pair of digital mixer */
@@ -499,9 +684,10 @@ gint level_meters_configure_event(GtkWidget *widget, GdkEventConfigure *event) {
 	  previous_levels[idx-1]    = 0;
 	  peak_changed[idx-1]       = RESET;
 	}
-	
+
 	// g_print("configure: %i:%i\n", allocation.width, allocation.height);
 	redraw_meters(idx, allocation.width, allocation.height, 0, 0);
+	damage[idx].width = damage[idx].height = 0; /* the expose event that follows copies it all */
 	return TRUE;
 }
 
@@ -510,42 +696,69 @@ gint level_meters_expose_event(GtkWidget *widget, GdkEventExpose *event) {
 	int l1, l2;
 	GtkAllocation allocation;
 	gtk_widget_get_allocation(widget, &allocation);
-	
+
+	if (meter_width[idx] == 0)
+		return FALSE;
 	get_levels(idx, &l1, &l2);
 	redraw_meters(idx, allocation.width, allocation.height, l1, l2);
-	gdk_draw_pixmap(gtk_widget_get_window(widget),
-			gtk_widget_get_style(widget)->black_gc,
-			pixmap[idx],
-			event->area.x, event->area.y,
-			event->area.x, event->area.y,
-			event->area.width, event->area.height);
+	gdk_draw_drawable(gtk_widget_get_window(widget),
+			  gtk_widget_get_style(widget)->black_gc,
+			  atlas,
+			  idx * slot_width + event->area.x, event->area.y,
+			  event->area.x, event->area.y,
+			  event->area.width, event->area.height);
+	damage[idx].width = damage[idx].height = 0;
 	return FALSE;
 }
 
+/*
+ * Fetch meter 'idx' levels and, if its window is showing, draw what changed
+ * and copy the damaged area. Returns FALSE if the meter is not showing.
+ */
+static int update_meter(int idx, int *l1, int *l2) {
+	GtkWidget *widget = idx == 0 ? mixer_mix_drawing : mixer_drawing[idx-1];
+	GtkAllocation allocation;
+
+	get_levels(idx, l1, l2);
+	if (!gtk_widget_get_visible(widget) || (meter_width[idx] == 0))
+		return FALSE;
+	gtk_widget_get_allocation(widget, &allocation);
+	redraw_meters(idx, allocation.width, allocation.height, *l1, *l2);
+	meter_flush(idx, widget);
+	return TRUE;
+}
+
+static void frame_cost_update(gint64 start) {
+	frame_cost.usec += monotonic_usec() - start;
+	if (++frame_cost.ticks < FRAME_COST_REPORT_TICKS)
+		return;
+	g_print("meters per tick: %.1f draw ops, %.1f blits, %.0f pixels blitted, %.1f usec\n",
+		(double)frame_cost.draw_ops / frame_cost.ticks,
+		(double)frame_cost.blits / frame_cost.ticks,
+		(double)frame_cost.blit_pixels / frame_cost.ticks,
+		(double)frame_cost.usec / frame_cost.ticks);
+	memset(&frame_cost, 0, sizeof(frame_cost));
+}
+
+static int level_meters_shown(void);
+
 gint level_meters_timeout_callback(gpointer data) {
-	GtkWidget *widget;
 	int idx, l1, l2;
-	GtkAllocation allocation;
+	gint64 start = 0;
 
-	update_peak_switch();
+	if (frame_cost_report)
+		start = monotonic_usec();
+	meters_read();
+	if (!level_meters_shown())	/* polled only for the surfaces and clients */
+		return TRUE;
 	for (idx = 0; idx <= pcm_output_channels; idx++) {
-		get_levels(idx, &l1, &l2);
-		widget = idx == 0 ? mixer_mix_drawing : mixer_drawing[idx-1];
-		if (gtk_widget_get_visible(widget) && (pixmap[idx] != NULL)) {
-			gtk_widget_get_allocation(widget, &allocation);
-			redraw_meters(idx, allocation.width, allocation.height, l1, l2);
-			gdk_draw_pixmap(gtk_widget_get_window(widget),
-					gtk_widget_get_style(widget)->black_gc,
-					pixmap[idx],
-					0, 0,
-					0, 0,
-					allocation.width, allocation.height);
-		}
+		if (update_meter(idx, &l1, &l2))
+			continue;
 		/* NPM: both cases below are special-case hack to get
 		   "Analog Volume" PCM peak levels updating correctly,
 		   should "Analog Volume" panel be selected before "Monitor
 		   PCM outs" panel. In that situation,
-		   "(gtk_widget_get_visible(widget) && (pixmap[idx] != NULL))"
+		   "(gtk_widget_get_visible(widget) && (meter_width[idx] != 0))"
 		   fails as level_meters_configure_event() hasn't been
 		   called yet (it gets called when user selects "Monitor
 		   PCM outs" panel).
@@ -584,50 +797,16 @@ gint level_meters_timeout_callback(gpointer data) {
 		}
 	}
 	if (view_spdif_playback) {
-		for (idx = MAX_PCM_OUTPUT_CHANNELS + 1; idx <= MAX_OUTPUT_CHANNELS + spdif_channels; idx++) {
-			get_levels(idx, &l1, &l2);
-			widget = idx == 0 ? mixer_mix_drawing : mixer_drawing[idx-1];
-			if (gtk_widget_get_visible(widget) && (pixmap[idx] != NULL)) {
-				gtk_widget_get_allocation(widget, &allocation);
-				redraw_meters(idx, allocation.width, allocation.height, l1, l2);
-				gdk_draw_pixmap(gtk_widget_get_window(widget),
-						gtk_widget_get_style(widget)->black_gc,
-						pixmap[idx],
-						0, 0,
-						0, 0,
-						allocation.width, allocation.height);
-			}
-		}
-	}
-	for (idx = MAX_PCM_OUTPUT_CHANNELS + MAX_SPDIF_CHANNELS + 1; idx <= input_channels + MAX_PCM_OUTPUT_CHANNELS + MAX_SPDIF_CHANNELS; idx++) {
-		get_levels(idx, &l1, &l2);
-		widget = idx == 0 ? mixer_mix_drawing : mixer_drawing[idx-1];
-		if (gtk_widget_get_visible(widget) && (pixmap[idx] != NULL)) {
-			gtk_widget_get_allocation(widget, &allocation);
-			redraw_meters(idx, allocation.width, allocation.height, l1, l2);
-			gdk_draw_pixmap(gtk_widget_get_window(widget),
-					gtk_widget_get_style(widget)->black_gc,
-					pixmap[idx],
-					0, 0,
-					0, 0,
-					allocation.width, allocation.height);
-		}
+		for (idx = MAX_PCM_OUTPUT_CHANNELS + 1; idx <= MAX_OUTPUT_CHANNELS + spdif_channels; idx++)
+			update_meter(idx, &l1, &l2);
 	}
+	for (idx = MAX_PCM_OUTPUT_CHANNELS + MAX_SPDIF_CHANNELS + 1; idx <= input_channels + MAX_PCM_OUTPUT_CHANNELS + MAX_SPDIF_CHANNELS; idx++)
+		update_meter(idx, &l1, &l2);
 	for (idx = MAX_PCM_OUTPUT_CHANNELS + MAX_SPDIF_CHANNELS + MAX_INPUT_CHANNELS + 1; \
-		    idx <= spdif_channels + MAX_PCM_OUTPUT_CHANNELS + MAX_SPDIF_CHANNELS + MAX_INPUT_CHANNELS; idx++) {
-		get_levels(idx, &l1, &l2);
-		widget = idx == 0 ? mixer_mix_drawing : mixer_drawing[idx-1];
-		if (gtk_widget_get_visible(widget) && (pixmap[idx] != NULL)) {
-			gtk_widget_get_allocation(widget, &allocation);
-			redraw_meters(idx, allocation.width, allocation.height, l1, l2);
-			gdk_draw_pixmap(gtk_widget_get_window(widget),
-					gtk_widget_get_style(widget)->black_gc,
-					pixmap[idx],
-					0, 0,
-					0, 0,
-					allocation.width, allocation.height);
-		}
-	}
+		    idx <= spdif_channels + MAX_PCM_OUTPUT_CHANNELS + MAX_SPDIF_CHANNELS + MAX_INPUT_CHANNELS; idx++)
+		update_meter(idx, &l1, &l2);
+	if (frame_cost_report)
+		frame_cost_update(start);
 	return TRUE;
 }
 
@@ -635,6 +814,8 @@ gint level_meters_timeout_callback(gpointer data) {
 /* NPM fixed lack of implementation ( https://bugzilla.redhat.com/show_bug.cgi?id=602903 )*/
 void level_meters_reset_peaks(GtkButton *button, gpointer data) {
   int i;
+
+  ballistics_reset();
   for (i = 0; i < MULTI_TRACK_PEAK_CHANNELS ; i++) {
     peak_levels[i]     = 0;
     previous_levels[i] = 0;
@@ -644,16 +825,36 @@ void level_meters_reset_peaks(GtkButton *button, gpointer data) {
   level_meters_timeout_callback((gpointer) data);
 }
 
+/* Is any meter, or peak label of the "Analog Volume" panel, showing? */
+static int level_meters_shown(void) {
+  int i;
+
+  if (gtk_widget_get_mapped(mixer_mix_drawing))
+    return TRUE;
+  for (i = 0; i < 20; i++)
+    if (mixer_drawing[i] != NULL && gtk_widget_get_mapped(mixer_drawing[i]))
+      return TRUE;
+  for (i = 0; i < MAX_OUTPUT_CHANNELS; i++)
+    if (dac_peak_label[i] != NULL && gtk_widget_get_mapped(dac_peak_label[i]))
+      return TRUE;
+  for (i = 0; i < MAX_INPUT_CHANNELS; i++)
+    if (adc_peak_label[i] != NULL && gtk_widget_get_mapped(adc_peak_label[i]))
+      return TRUE;
+  return FALSE;
+}
+
+int level_meters_visible(void) {
+  return meters_remote() || level_meters_shown();
+}
+
 void level_meters_init(void) {
-	int err;
-
-	snd_ctl_elem_value_malloc(&peaks);
-	snd_ctl_elem_value_set_interface(peaks, SND_CTL_ELEM_IFACE_PCM);
-	snd_ctl_elem_value_set_name(peaks, "Multi Track Peak");
-	if ((err = snd_ctl_elem_read(ctl, peaks)) < 0)
-		/* older ALSA driver, using MIXER type */
-		snd_ctl_elem_value_set_interface(peaks,
-			SND_CTL_ELEM_IFACE_MIXER);
+	int level;
+
+	ballistics_color_thresholds(&peak_white_level, &peak_orange_level, &peak_red_level);
+	for (level = 0; level <= MAX_METERING_LEVEL; level++)
+		peak_color_class[level] = PEAK_COLOR_CLASS(level);
+	peak_level_db_init();
+	frame_cost_report = (getenv("MUDITA24_METER_STATS") != NULL);
 }
 
 void level_meters_postinit(void) {
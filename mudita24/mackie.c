@@ -0,0 +1,249 @@
+/*****************************************************************************
+   mackie.c - Mackie Control surfaces on the MIDI port
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+******************************************************************************/
+
+/*
+ * With --mackie, a surface speaking the Mackie Control (MCU) protocol on
+ * the sequencer port of midi.c works the mixer a page of 8 streams at a
+ * time. The pages go over the active streams in the mixer's order: the
+ * bank buttons move by 8 streams, the channel buttons by one.
+ *
+ * Each strip's fader sets both channels of its stream by pitch bend, with
+ * its 14 bits turned into the attenuation by the same dB-spaced table as
+ * --midi_nrpn; its mute button toggles the stream's mute. While a fader is
+ * touched, its motor is left alone: changes of the stream are not sent
+ * back to it, and when it is let go it moves to where the stream really
+ * is. Each strip's meter shows the hardware peak of its stream, every time
+ * the meters are read.
+ *
+ * Feedback goes through the queue of midi.c like the rest, so a bank
+ * switch is one short burst of its faders and LEDs within --midi_rate.
+ * The surface talks on MIDI channel 1 (and pitch bends on 1-9); the
+ * messages of it used here do not reach the --midichannel mapping or MIDI
+ * learn.
+ */
+
+#include <math.h>
+#include "controls.h"
+#include "midi.h"
+
+#define MCU_MUTE		16	/* notes of the strips' mute buttons and LEDs */
+#define MCU_BANK_LEFT		46
+#define MCU_BANK_RIGHT		47
+#define MCU_CHANNEL_LEFT	48
+#define MCU_CHANNEL_RIGHT	49
+#define MCU_TOUCH		104	/* notes of the faders' touch sensors, master last */
+#define MCU_VPOT		16	/* controllers of the strips' V-pots */
+#define MCU_JOG			60
+#define MCU_METER_LEVELS	12
+
+/* dB lighting each segment of a strip's meter */
+static const int meter_db[MCU_METER_LEVELS] = {
+	-60, -50, -40, -30, -20, -14, -10, -8, -6, -4, -2, 0
+};
+
+static int enabled = FALSE;
+static int started = FALSE;
+static int streams[20];			/* the active streams */
+static int nstreams = 0;
+static int first = 0;			/* index in streams[] of strip 1 */
+static int touched[MCU_STRIPS];
+static int fader_in[MCU_STRIPS];	/* position last sent by the surface, or -1 */
+static guint8 meter_level[MAX_METERING_LEVEL + 1];
+
+void mackie_enable(int enable)
+{
+	enabled = enable;
+}
+
+/* TRUE once mackie_start() has found the MIDI port */
+int mackie_active(void)
+{
+	return started;
+}
+
+/* The stream on 'strip', or 0 if none */
+static int strip_stream(int strip)
+{
+	return first + strip < nstreams ? streams[first + strip] : 0;
+}
+
+/* The 14 bit position of the fader of 'strip' for its 'stream' */
+static int fader_position(int strip, int stream)
+{
+	long value;
+	int v = mixer_get_volume(stream, 0);
+
+	/* don't pull the fader to the middle of the step it is on */
+	if (fader_in[strip] >= 0 &&
+	    midi_scale_value(CTL_MULTI_PLAYBACK_VOLUME, fader_in[strip], &value) && value == v)
+		return fader_in[strip];
+	return MAX(midi_scale_feedback(CTL_MULTI_PLAYBACK_VOLUME, v), 0);
+}
+
+static void strip_refresh(int strip)
+{
+	int stream = strip_stream(strip);
+
+	if (!stream) {
+		midi_mcu_fader(strip, 0, FALSE);
+		midi_mcu_led(MCU_MUTE + strip, FALSE);
+		return;
+	}
+	if (!touched[strip])
+		midi_mcu_fader(strip, fader_position(strip, stream), FALSE);
+	midi_mcu_led(MCU_MUTE + strip, mixer_get_switch(stream, 0) == 0);
+}
+
+/* Show the page starting at the 'f'th stream */
+static void bank_to(int f)
+{
+	int strip;
+
+	first = CLAMP(f, 0, MAX(nstreams - MCU_STRIPS, 0));
+	for (strip = 0; strip < MCU_STRIPS; strip++) {
+		fader_in[strip] = -1;
+		strip_refresh(strip);
+	}
+}
+
+/* Call after mixer_init() and midi_init(); shows the first page */
+void mackie_start(void)
+{
+	int stream, level, i;
+	double db;
+
+	if (!enabled || !midi_active())
+		return;
+	for (nstreams = 0, stream = 1; stream <= 20; stream++)
+		if (mixer_stream_is_active(stream))
+			streams[nstreams++] = stream;
+	for (level = 0; level <= MAX_METERING_LEVEL; level++) {
+		db = level ? 20 * log10((double)level / MAX_METERING_LEVEL) : -1000;
+		for (i = 0; i < MCU_METER_LEVELS && db >= meter_db[i]; i++)
+			;
+		meter_level[level] = i;
+	}
+	started = TRUE;
+	bank_to(0);
+	metering_changed();
+}
+
+/* 'stream' changed: update its strip, if it is on the page */
+void mackie_stream_changed(int stream)
+{
+	int strip;
+
+	if (!started)
+		return;
+	for (strip = 0; strip < MCU_STRIPS; strip++)
+		if (strip_stream(strip) == stream)
+			strip_refresh(strip);
+}
+
+/* The meters were read into 'peaks' (0 - MAX_METERING_LEVEL, stream - 1) */
+void mackie_meters(snd_ctl_elem_value_t *peaks)
+{
+	int strip, stream, level;
+
+	if (!started)
+		return;
+	for (strip = 0; strip < MCU_STRIPS; strip++) {
+		if (!(stream = strip_stream(strip)))
+			continue;
+		level = snd_ctl_elem_value_get_integer(peaks, stream - 1);
+		level = meter_level[CLAMP(level, 0, MAX_METERING_LEVEL)];
+		/* the surface lets the meter fall by itself */
+		if (level)
+			midi_mcu_meter(strip, level);
+	}
+}
+
+static void fader_moved(int strip, int v)
+{
+	long value;
+	int stream;
+
+	fader_in[strip] = v;
+	midi_mcu_fader(strip, v, TRUE);
+	if (!(stream = strip_stream(strip)) ||
+	    !midi_scale_value(CTL_MULTI_PLAYBACK_VOLUME, v, &value))
+		return;
+	mixer_set_volume(stream, 0, value);
+	mixer_set_volume(stream, 1, value);
+}
+
+static void button(int note, int velocity)
+{
+	int strip, stream, on;
+
+	if (note >= MCU_TOUCH && note < MCU_TOUCH + MCU_STRIPS) {
+		strip = note - MCU_TOUCH;
+		touched[strip] = velocity != 0;
+		if (!touched[strip])
+			strip_refresh(strip);
+		return;
+	}
+	if (!velocity)
+		return;
+	if (note >= MCU_MUTE && note < MCU_MUTE + MCU_STRIPS) {
+		if ((stream = strip_stream(note - MCU_MUTE)) &&
+		    (on = mixer_get_switch(stream, 0)) >= 0)
+			mixer_set_switch(stream, !on, !on);
+		return;
+	}
+	switch (note) {
+	case MCU_BANK_LEFT: bank_to(first - MCU_STRIPS); break;
+	case MCU_BANK_RIGHT: bank_to(first + MCU_STRIPS); break;
+	case MCU_CHANNEL_LEFT: bank_to(first - 1); break;
+	case MCU_CHANNEL_RIGHT: bank_to(first + 1); break;
+	}
+}
+
+/* Handle 'ev' if it is from the surface; FALSE if it is not */
+int mackie_event(const snd_seq_event_t *ev)
+{
+	int channel;
+
+	if (!started)
+		return FALSE;
+	switch (ev->type) {
+	case SND_SEQ_EVENT_PITCHBEND:
+		channel = ev->data.control.channel & 0x0f;
+		if (channel >= MCU_FADERS)
+			return FALSE;
+		/* the master fader has nothing to move */
+		if (channel < MCU_STRIPS)
+			fader_moved(channel, CLAMP(ev->data.control.value + 8192, 0, MIDI_VALUE_MAX));
+		return TRUE;
+	case SND_SEQ_EVENT_NOTEON:
+	case SND_SEQ_EVENT_NOTEOFF:
+		if ((ev->data.note.channel & 0x0f) != 0 ||
+		    (ev->data.note.note > MCU_CHANNEL_RIGHT && ev->data.note.note < MCU_TOUCH) ||
+		    ev->data.note.note > MCU_TOUCH + MCU_STRIPS)
+			return FALSE;
+		/* rec, solo, select and the rest have nothing to do */
+		button(ev->data.note.note, ev->type == SND_SEQ_EVENT_NOTEON ? ev->data.note.velocity & 0x7f : 0);
+		return TRUE;
+	case SND_SEQ_EVENT_CONTROLLER:
+		/* V-pots and jog wheel, which have nothing to turn */
+		return (ev->data.control.channel & 0x0f) == 0 &&
+			((ev->data.control.param >= MCU_VPOT && ev->data.control.param < MCU_VPOT + MCU_STRIPS) ||
+			 ev->data.control.param == MCU_JOG);
+	}
+	return FALSE;
+}
@@ -0,0 +1,168 @@
+/*****************************************************************************
+   meters.c - Read the card's peak meters
+   Copyright (C) 2010 by Niels Mayer ( http://nielsmayer.com ).
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+******************************************************************************/
+
+/*
+ * The "Multi Track Peak" values, read directly or from the peak sampler
+ * and passed through the ballistics, for the level meters of the GUI and
+ * for the surfaces and clients metering. The GUI polls meters_read() from
+ * its scheduler and sets a hook to hear of metering_changed(); without
+ * the GUI, as in mudita24d, the meters are read on a timer of their own,
+ * only while a surface or client is metering. A GUI that is a client of
+ * mudita24d takes the frames it is sent instead, subscribing to them
+ * while it isn't suspended.
+ */
+
+#include "controls.h"
+#include "midi.h"
+
+#define METERS_FEED_INTERVAL 100	/* ms, as the GUI's meters */
+
+static snd_ctl_elem_value_t *peaks;
+
+/*
+ * With --meter_mode or --peak_hold, 'peaks' holds the ballistics output
+ * rather than raw peak values, and hold_levels[] the held peaks.
+ */
+static unsigned char hold_levels[MULTI_TRACK_PEAK_CHANNELS];
+static unsigned char meter_levels_in[MULTI_TRACK_PEAK_CHANNELS];
+static gint32 received_levels[MULTI_TRACK_PEAK_CHANNELS];	/* the last frame from mudita24d */
+static gint64 peaks_read_usec = 0;	/* monotonic time of the last direct read */
+
+static void (*metering_hook)(void) = NULL;
+static guint meters_feed_source = 0;
+
+/*
+ * Seconds since the previous direct read, which is what the self-resetting
+ * register covers: the poll period normally, but shorter for the read of
+ * "Reset Peaks" and longer after the meters were suspended. Rounded to the
+ * millisecond so that poll jitter doesn't recompute the coefficients.
+ */
+static double peaks_read_interval(void) {
+	gint64 now = monotonic_usec();
+	double dt = peaks_read_usec ? (double)((now - peaks_read_usec + 500) / 1000) / 1000.0 : 0.1;
+
+	peaks_read_usec = now;
+	return dt;
+}
+
+static void update_peak_switch(void) {
+	int err, i;
+	double dt;
+	peak_aggregate_t agg;
+
+	/* with --peak_sample_rate, use the max of all frames sampled since last poll */
+	if (peak_sampler_running()) {
+		peak_sampler_consume(&agg);
+		if (!ballistics_active()) {
+			for (i = 0; i < MULTI_TRACK_PEAK_CHANNELS; i++)
+				snd_ctl_elem_value_set_integer(peaks, i, agg.level[i]);
+		}
+		else if (agg.frames) {
+			memcpy(hold_levels, agg.hold, sizeof(hold_levels));
+			for (i = 0; i < MULTI_TRACK_PEAK_CHANNELS; i++)
+				snd_ctl_elem_value_set_integer(peaks, i, agg.meter[i]);
+		}
+		return;
+	}
+	dt = peaks_read_interval();
+	if (ctlclient_connected()) {
+		for (i = 0; i < MULTI_TRACK_PEAK_CHANNELS; i++)
+			snd_ctl_elem_value_set_integer(peaks, i, received_levels[i]);
+		err = 0;
+	} else if ((err = snd_ctl_elem_read(ctl, peaks)) < 0)
+		g_print("Unable to read peaks: %s\n", snd_strerror(err));
+	if (err >= 0 && ballistics_active()) {
+		for (i = 0; i < MULTI_TRACK_PEAK_CHANNELS; i++)
+			meter_levels_in[i] = snd_ctl_elem_value_get_integer(peaks, i);
+		ballistics_process(meter_levels_in, dt);
+		ballistics_get(meter_levels_in, hold_levels);
+		for (i = 0; i < MULTI_TRACK_PEAK_CHANNELS; i++)
+			snd_ctl_elem_value_set_integer(peaks, i, meter_levels_in[i]);
+	}
+}
+
+/* Read the meters, and send them to the surfaces and clients metering */
+void meters_read(void) {
+	update_peak_switch();
+	mackie_meters(peaks);
+	osc_meters(peaks);
+	ctlserver_meters(peaks);
+}
+
+/* Level of peak channel 'channel' as last read */
+int meters_level(int channel) {
+	return snd_ctl_elem_value_get_integer(peaks, channel);
+}
+
+/* The ballistics' held peak of 'channel'; meaningful while ballistics_active() */
+int meters_held(int channel) {
+	return hold_levels[channel];
+}
+
+/* Is a surface, OSC or socket client metering? */
+int meters_remote(void) {
+	return mackie_active() || osc_metering() || ctlserver_metering();
+}
+
+/* The meters are no longer read, or again: pause or resume the sampler */
+void meters_suspend(int suspended) {
+	if (ctlclient_connected())
+		ctlclient_meters(!suspended);
+	if (!peak_sampler_running())
+		return;
+	if (suspended)
+		peak_sampler_pause();
+	else
+		peak_sampler_resume();
+}
+
+/* A frame of the meters, as read by mudita24d */
+void meters_received(const gint32 *levels, int count) {
+	memcpy(received_levels, levels, MIN(count, MULTI_TRACK_PEAK_CHANNELS) * sizeof(gint32));
+}
+
+static gboolean meters_feed(gpointer data) {
+	meters_read();
+	return TRUE;
+}
+
+/* Have 'changed' called by metering_changed() rather than feeding on a timer */
+void meters_hook(void (*changed)(void)) {
+	metering_hook = changed;
+}
+
+/* A surface or client started or stopped metering: start or stop the meters */
+void metering_changed(void) {
+	if (metering_hook != NULL) {
+		metering_hook();
+		return;
+	}
+	if (meters_remote() == (meters_feed_source != 0))
+		return;
+	if (meters_feed_source) {
+		g_source_remove(meters_feed_source);
+		meters_feed_source = 0;
+	} else
+		meters_feed_source = g_timeout_add(METERS_FEED_INTERVAL, meters_feed, NULL);
+	meters_suspend(!meters_feed_source);
+}
+
+void meters_init(void) {
+	peaks = control_value(CTL_MULTI_TRACK_PEAK, 0); /* PCM, or MIXER on older ALSA drivers */
+}
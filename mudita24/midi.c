@@ -20,8 +20,8 @@
 
 #include <string.h>
 #include <alsa/asoundlib.h>
+#include "controls.h"
 #include "midi.h"
-#include <gtk/gtk.h>
 #include <stdint.h>
 
 static const int midi2slider_lin[128] = {
@@ -97,20 +97,309 @@ static snd_seq_t *seq=0;
 static int client, clientId, port, ch;
 static char *portname=0, *appname=0;
 static int maxstreams=0;
-static int currentvalue[128];
+
+/*
+ * With --midi_nrpn every attenuator can also be set with 14 bit resolution
+ * by NRPN: controllers 99 and 98 select the parameter, then data entry
+ * 6 (MSB) and 38 (LSB) set it. The parameters are
+ *   0-39     the volumes of the mixer's streams, as controllers 0-39
+ *   128-137  DAC volumes, 144-153 ADC volumes, 160-169 IPGA volumes
+ * and their feedback is sent the same way. A value is turned into the
+ * control's by one lookup in a table built for the control at startup,
+ * spaced evenly in dB over its dB range, so that every step of the
+ * control is reachable; a control without a dB range is spaced evenly
+ * over its values. Controllers 6 and 38 then no longer move streams 4 and
+ * 20 (left); those are reached by NRPN like the rest.
+ */
+#define NRPN_STREAMS	0
+#define NRPN_DAC	128
+#define NRPN_ADC	144
+#define NRPN_IPGA	160
+#define NRPN_COUNT	176
+#define NRPN_NULL	0x3fff
+#define HIRES_MAX	MIDI_VALUE_MAX
+#define HIRES_DB_FLOOR	-14400	/* dB * 100; lower counts as off */
+
+typedef struct {
+  int built;			/* hires_scale_init() was called */
+  long min, max;		/* range of the control's values */
+  gint16 *to_value;		/* HIRES_MAX+1 entries */
+  guint16 *to_midi;		/* max-min+1 entries */
+} hires_scale_t;
+
+static hires_scale_t hires_scales[CTL_COUNT];
+static int nrpn=0;
+static int nrpn_param[16], nrpn_msb[16];	/* per MIDI channel */
+static int nrpn_sent=-1;		/* parameter selected by our last output */
+
+static void hires_scale_init(control_t c, snd_ctl_elem_id_t *id);
+
+/* The table of control 'c', built on first use; NULL if it has no integer range */
+static hires_scale_t *hires_scale(control_t c)
+{
+  /* the same digital mixer, and the IEC958 volumes have no dB range */
+  if(c==CTL_HW_MULTI_CAPTURE_VOLUME || c==CTL_IEC958_MULTI_CAPTURE_VOLUME)
+    c=CTL_MULTI_PLAYBACK_VOLUME;
+  if(!hires_scales[c].built)
+    {
+      hires_scales[c].built=1;
+      hires_scale_init(c, control_id(c, 0));
+    }
+  return hires_scales[c].to_value ? &hires_scales[c] : NULL;
+}
+
+/*
+ * Set 'value' to the value of control 'c' for the 14 bit 'v', by the same
+ * table as NRPN uses; FALSE if 'c' has none.
+ */
+int midi_scale_value(control_t c, int v, long *value)
+{
+  hires_scale_t *s=hires_scale(c);
+
+  if(!s)
+    return FALSE;
+  *value=s->to_value[CLAMP(v, 0, HIRES_MAX)];
+  return TRUE;
+}
+
+/*
+ * Controllers 0-127, then NRPN parameters 0-NRPN_COUNT-1, on our channel;
+ * then for a Mackie Control surface (see mackie.c) the pitch bend of MIDI
+ * channels 1-9, notes (LEDs) on channel 1 and the meters of its 8 strips.
+ */
+#define SLOT_NRPN	128
+#define SLOT_MCU_FADER	(SLOT_NRPN+NRPN_COUNT)
+#define SLOT_MCU_LED	(SLOT_MCU_FADER+MCU_FADERS)
+#define SLOT_MCU_METER	(SLOT_MCU_LED+128)
+#define FEEDBACK_SLOTS	(SLOT_MCU_METER+MCU_STRIPS)
+static int currentvalue[FEEDBACK_SLOTS];
+
+/*
+ * Feedback to the controllers is not sent as it is made: a profile recall
+ * changes up to 80 of them at once, and a slow surface would lag or drop
+ * messages. do_controller() only records the latest value per controller;
+ * feedback_tick() sends what is pending every MIDI_FEEDBACK_TICK ms, in
+ * one drain, and no more than --midi_rate messages per second on our
+ * port. The rest wait for the next tick, still with their latest value.
+ * An idle port saves up to MIDI_FEEDBACK_BURST messages, so that a page
+ * of a surface (a bank switch) goes out whole in one drain.
+ * With MUDITA24_MIDI_STATS set, the number of changes and of messages sent
+ * is printed every ten seconds and on exit.
+ */
+#define MIDI_FEEDBACK_TICK 10 /* ms */
+#define MIDI_FEEDBACK_BURST 32 /* messages */
+#define MIDI_STATS_PERIOD 10000 /* ms */
+static int pendingvalue[FEEDBACK_SLOTS];	/* -1: nothing to send */
+static guint16 pending[FEEDBACK_SLOTS];		/* slots listed for the next tick, in order */
+static char listed[FEEDBACK_SLOTS];		/* slot is in pending[] */
+static int npending=0;
+static int feedback_rate=DEFAULT_MIDI_RATE; /* messages/s, 0 unlimited */
+static double feedback_budget=0;	/* messages that may be sent now */
+static gint64 feedback_last=0, stats_last=0; /* ms */
+static guint feedback_timeout=0;
+static unsigned long feedback_changes=0, feedback_sent=0, feedback_ticks=0;
+
+/*
+ * Program changes on the channel recall profile <program> + 1, or with
+ * bank select (controllers 0 and 32, then not used for the streams)
+ * profile <bank> * 128 + <program> + 1. The profiles are compiled ahead,
+ * see profiles.c, so the recall is only the writes that change the mix.
+ * With MUDITA24_MIDI_STATS set, each recall prints the time from the
+ * program change to the last write returning.
+ */
+static int bank_select=0, bank_msb=0, bank_lsb=0;
+static int midi_stats=0;
+static unsigned long recalls=0;
+static guint64 recall_min=0, recall_max=0, recall_sum=0; /* usec */
 
 void midi_maxstreams(int m)
 {
   maxstreams=m*2;
 }
 
+void midi_bank_select(int enable)
+{
+  bank_select=enable;
+}
+
+void midi_rate(int rate)
+{
+  feedback_rate=rate;
+}
+
+void midi_nrpn(int enable)
+{
+  nrpn=enable;
+}
+
+static gint64 midi_now(void)
+{
+  return monotonic_usec()/1000;
+}
+
+static void feedback_stats_report(void)
+{
+  g_print("MIDI feedback: %lu changes, %lu messages sent in %lu drains\n",
+	  feedback_changes, feedback_sent, feedback_ticks);
+}
+
+static void send_controller(int c, int v)
+{
+  snd_seq_event_t ev;
+
+  snd_seq_ev_clear(&ev);
+  snd_seq_ev_set_source(&ev, port);
+  snd_seq_ev_set_subs(&ev);
+  snd_seq_ev_set_direct(&ev);
+  snd_seq_ev_set_controller(&ev,ch,c,v);
+  snd_seq_event_output(seq, &ev);
+  feedback_sent++;
+}
+
+static void send_mcu(int slot, int v)
+{
+  snd_seq_event_t ev;
+
+  snd_seq_ev_clear(&ev);
+  snd_seq_ev_set_source(&ev, port);
+  snd_seq_ev_set_subs(&ev);
+  snd_seq_ev_set_direct(&ev);
+  if(slot>=SLOT_MCU_METER)
+    snd_seq_ev_set_chanpress(&ev, 0, ((slot-SLOT_MCU_METER)<<4)|v);
+  else if(slot>=SLOT_MCU_LED)
+    snd_seq_ev_set_noteon(&ev, 0, slot-SLOT_MCU_LED, v);
+  else
+    snd_seq_ev_set_pitchbend(&ev, slot-SLOT_MCU_FADER, v-8192);
+  snd_seq_event_output(seq, &ev);
+  feedback_sent++;
+}
+
+/* Send feedback 'slot' as 'v'; returns the number of messages it took */
+static int send_slot(int slot, int v)
+{
+  int n=0;
+
+  if(slot<SLOT_NRPN)
+    {
+      send_controller(slot, v);
+      return 1;
+    }
+  if(slot>=SLOT_MCU_FADER)
+    {
+      send_mcu(slot, v);
+      return 1;
+    }
+  slot-=SLOT_NRPN;
+  if(slot!=nrpn_sent)
+    {
+      send_controller(99, slot>>7);
+      send_controller(98, slot&0x7f);
+      nrpn_sent=slot;
+      n=2;
+    }
+  send_controller(6, v>>7);
+  send_controller(38, v&0x7f);
+  return n+2;
+}
+
+static gboolean feedback_tick(gpointer data)
+{
+  gint64 now=midi_now();
+  double burst;
+  int i, n, c;
+
+  feedback_timeout=0;
+  if(!seq)
+    return FALSE;
+  if(feedback_rate)
+    {
+      /* allow a tick's worth of messages, or a surface's page */
+      burst=MAX(feedback_rate*MIDI_FEEDBACK_TICK/1000.0, MIDI_FEEDBACK_BURST);
+      feedback_budget+=feedback_rate*(now-feedback_last)/1000.0;
+      if(feedback_budget>burst || now<feedback_last)
+	feedback_budget=burst;
+    }
+  feedback_last=now;
+
+  for(i=0; i<npending && (!feedback_rate || feedback_budget>=1.0); i++)
+    {
+      c=pending[i];
+      if(pendingvalue[c]<0)
+	continue;
+      n=send_slot(c, pendingvalue[c]);
+      pendingvalue[c]=-1;
+      if(feedback_rate)
+	feedback_budget-=n;
+    }
+  if(i)
+    {
+      snd_seq_drain_output(seq);
+      feedback_ticks++;
+    }
+
+  /* keep what is still pending, in order */
+  for(n=0, i=0; i<npending; i++)
+    {
+      if(pendingvalue[pending[i]]>=0)
+	pending[n++]=pending[i];
+      else
+	listed[pending[i]]=0;
+    }
+  npending=n;
+  if(npending)
+    feedback_timeout=g_timeout_add(MIDI_FEEDBACK_TICK, feedback_tick, NULL);
+
+  if(midi_stats && now-stats_last>=MIDI_STATS_PERIOD)
+    {
+      feedback_stats_report();
+      stats_last=now;
+    }
+  return FALSE;
+}
+
+static void recall_done(profile_job_t *job, gpointer data)
+{
+  guint64 latency;
+
+  if(job->state!=PROFILE_JOB_DONE || job->result<0)
+    return;
+  latency=job->finished-job->submitted;
+  if(!recalls || latency<recall_min)
+    recall_min=latency;
+  if(latency>recall_max)
+    recall_max=latency;
+  recall_sum+=latency;
+  recalls++;
+  if(midi_stats)
+    g_print("MIDI recall of profile %d: %.2f ms (min %.2f, avg %.2f, max %.2f ms over %lu recalls)\n",
+	    job->profile_number, latency/1000.0, recall_min/1000.0,
+	    recall_sum/1000.0/recalls, recall_max/1000.0, recalls);
+}
+
+static void do_program_change(int program)
+{
+  int profile=program+1;
+
+  if(bank_select)
+    profile+=((bank_msb<<7)|bank_lsb)*128;
+  recall_profile(profile, recall_done, NULL);
+}
+
 int midi_close()
 {
   int i=0;
+  if(feedback_timeout)
+    g_source_remove(feedback_timeout), feedback_timeout=0;
   if(seq)
-    i=snd_seq_close(seq);
+    {
+      if(midi_stats)
+	feedback_stats_report();
+      i=snd_seq_close(seq);
+    }
 
   seq=0;
+  npending=0;
+  memset(listed, 0, sizeof(listed));
   client=port=0;
   if(portname)
     free(portname), portname=0;
@@ -120,23 +409,25 @@ int midi_close()
   return i;
 }
 
+/* Send feedback 'c' (a controller, or SLOT_NRPN + an NRPN, ...) as 'v' on the next tick, if it changed */
 static void do_controller(int c, int v)
 {
-  snd_seq_event_t ev;
   if(!seq) return;
   if(currentvalue[c]==v) return;
+  if(c<SLOT_MCU_FADER && ch<0) return; /* only a Mackie Control surface */
 #if 0
   fprintf(stderr, "do_controller(%i,%i)\n",c,v);
 #endif
-  snd_seq_ev_clear(&ev);
-  snd_seq_ev_set_source(&ev, port);
-  snd_seq_ev_set_subs(&ev);
-  snd_seq_ev_set_direct(&ev);
-  snd_seq_ev_set_controller(&ev,ch,c,v);
-  snd_seq_event_output(seq, &ev);
-  snd_seq_drain_output(seq);
-
+  feedback_changes++;
+  if(!listed[c])
+    {
+      listed[c]=1;
+      pending[npending++]=c;
+    }
+  pendingvalue[c]=v;
   currentvalue[c]=v;
+  if(!feedback_timeout)
+    feedback_timeout=g_timeout_add(MIDI_FEEDBACK_TICK, feedback_tick, NULL);
 }
 
 int midi_controller(int c, int v)
@@ -150,6 +441,13 @@ int midi_controller(int c, int v)
 
   if(v<0) v=0;
   else if(v>96) v=96;
+  if(nrpn && c<maxstreams)
+    {
+      hires_scale_t *s=hires_scale(CTL_MULTI_PLAYBACK_VOLUME);
+      if(s && v>=s->min && v<=s->max)
+	do_controller(SLOT_NRPN+NRPN_STREAMS+c, s->to_midi[v-s->min]);
+      return 0;
+    }
   v2=slider2midi[v];
 #if 0
   fprintf(stderr, "midi_controller(%i,%i)->%i\n",c,v,v2);
@@ -158,6 +456,27 @@ int midi_controller(int c, int v)
   return 0;
 }
 
+/* Feedback of 'index' of the analog volume 'c' having become 'v' */
+int midi_analog_volume(control_t c, int index, int v)
+{
+  hires_scale_t *s;
+  int base;
+
+  if(!seq || !nrpn || index<0 || index>=10)
+    return 0;
+  switch(c)
+    {
+    case CTL_DAC_VOLUME: base=NRPN_DAC; break;
+    case CTL_ADC_VOLUME: base=NRPN_ADC; break;
+    case CTL_IPGA_VOLUME: base=NRPN_IPGA; break;
+    default: return 0;
+    }
+  if((s=hires_scale(c))==NULL || v<s->min || v>s->max)
+    return 0;
+  do_controller(SLOT_NRPN+base+index, s->to_midi[v-s->min]);
+  return 0;
+}
+
 int midi_button(int b, int v)
 {
   if(b<0) return 0;
@@ -167,6 +486,183 @@ int midi_button(int b, int v)
   return 0;
 }
 
+/*
+ * Move fader 'f' of a Mackie Control surface to the 14 bit 'v'. With
+ * 'received', the surface sent 'v' itself and is already there.
+ */
+void midi_mcu_fader(int f, int v, int received)
+{
+  if(f<0 || f>=MCU_FADERS)
+    return;
+  if(received)
+    {
+      currentvalue[SLOT_MCU_FADER+f]=v;
+      pendingvalue[SLOT_MCU_FADER+f]=-1;
+      return;
+    }
+  do_controller(SLOT_MCU_FADER+f, CLAMP(v, 0, MIDI_VALUE_MAX));
+}
+
+/* Light the LED of 'note' of a Mackie Control surface, or not */
+void midi_mcu_led(int note, int on)
+{
+  if(note<0 || note>127)
+    return;
+  do_controller(SLOT_MCU_LED+note, on?127:0);
+}
+
+/*
+ * Show 'level' (0-12) on the meter of 'strip'. The surface lets its
+ * meters fall by itself, so 'level' is sent even if it is the last one.
+ */
+void midi_mcu_meter(int strip, int level)
+{
+  if(strip<0 || strip>=MCU_STRIPS)
+    return;
+  currentvalue[SLOT_MCU_METER+strip]=-1;
+  do_controller(SLOT_MCU_METER+strip, CLAMP(level, 0, 12));
+}
+
+/* The 14 bit value of 'value' of control 'c', as NRPN feedback sends it; -1 if none */
+int midi_scale_feedback(control_t c, long value)
+{
+  hires_scale_t *s=hires_scale(c);
+
+  if(!s || value<s->min || value>s->max)
+    return -1;
+  return s->to_midi[value-s->min];
+}
+
+/*
+ * Build the NRPN table of control 'c' from the range and dB range of
+ * 'id'. Values below HIRES_DB_FLOOR share the 14 bit value 0 with the
+ * minimum.
+ */
+static void hires_scale_init(control_t c, snd_ctl_elem_id_t *id)
+{
+  hires_scale_t *s=&hires_scales[c];
+  snd_ctl_elem_info_t *info;
+  unsigned int tlv[64];
+  long dbmin=0, dbmax=0, value;
+  int has_db, v, w, r, last;
+
+  snd_ctl_elem_info_alloca(&info);
+  snd_ctl_elem_info_set_id(info, id);
+  if(snd_ctl_elem_info(ctl, info) < 0 ||
+     snd_ctl_elem_info_get_type(info) != SND_CTL_ELEM_TYPE_INTEGER)
+    return;
+  s->min=snd_ctl_elem_info_get_min(info);
+  s->max=snd_ctl_elem_info_get_max(info);
+  if(s->max<=s->min || s->max-s->min>HIRES_MAX)
+    return;
+  has_db=snd_ctl_elem_info_is_tlv_readable(info) &&
+    snd_ctl_elem_tlv_read(ctl, id, tlv, sizeof(tlv)) >= 0 &&
+    snd_tlv_get_dB_range(tlv, s->min, s->max, &dbmin, &dbmax) >= 0;
+  if(dbmin<HIRES_DB_FLOOR)
+    dbmin=HIRES_DB_FLOOR;
+  if(dbmax<=dbmin)
+    has_db=0;
+
+  s->to_value=g_new(gint16, HIRES_MAX+1);
+  s->to_midi=g_new(guint16, s->max-s->min+1);
+  for(v=0; v<=HIRES_MAX; v++)
+    {
+      if(v==0)
+	value=s->min;
+      else if(v==HIRES_MAX)
+	value=s->max;
+      else if(!has_db ||
+	      snd_tlv_convert_from_dB(tlv, s->min, s->max, dbmin+(dbmax-dbmin)*v/HIRES_MAX, &value, 1) < 0)
+	value=s->min+((s->max-s->min)*v+HIRES_MAX/2)/HIRES_MAX;
+      s->to_value[v]=CLAMP(value, s->min, s->max);
+    }
+
+  /* feedback: the middle of the values that map to each step */
+  for(r=0; r<=s->max-s->min; r++)
+    s->to_midi[r]=G_MAXUINT16;
+  for(v=0; v<=HIRES_MAX; v=w)
+    {
+      for(w=v+1; w<=HIRES_MAX && s->to_value[w]==s->to_value[v]; w++)
+	;
+      s->to_midi[s->to_value[v]-s->min]= v==0 ? 0 : w>HIRES_MAX ? HIRES_MAX : (v+w-1)/2;
+    }
+  for(r=0, last=0; r<=s->max-s->min; r++)
+    {
+      if(s->to_midi[r]==G_MAXUINT16)
+	s->to_midi[r]=last;	/* below the floor */
+      last=s->to_midi[r];
+    }
+}
+
+/* Set NRPN 'param' to the 14 bit 'v' */
+static void do_nrpn(int param, int v)
+{
+  hires_scale_t *s;
+  control_t c;
+  int index;
+
+  if(param<0 || param>=NRPN_COUNT)
+    return;
+  currentvalue[SLOT_NRPN+param]=v;
+  pendingvalue[SLOT_NRPN+param]=-1;
+  if(param<NRPN_STREAMS+maxstreams)
+    {
+      if((s=hires_scale(CTL_MULTI_PLAYBACK_VOLUME)))
+	mixer_set_volume((param-NRPN_STREAMS)/2+1, (param-NRPN_STREAMS)&1, s->to_value[v]);
+      return;
+    }
+  if(param>=NRPN_IPGA)
+    c=CTL_IPGA_VOLUME, index=param-NRPN_IPGA;
+  else if(param>=NRPN_ADC)
+    c=CTL_ADC_VOLUME, index=param-NRPN_ADC;
+  else if(param>=NRPN_DAC)
+    c=CTL_DAC_VOLUME, index=param-NRPN_DAC;
+  else
+    return;
+  if((s=hires_scale(c)))
+    analog_volume_set(c, index, s->to_value[v]);
+}
+
+/* NRPN 'param' of MIDI channel 'c' was set to the 14 bit 'v' */
+static void nrpn_value(int c, int param, int v)
+{
+  if(param==NRPN_NULL || midi_learn_event(MIDI_BIND_NRPN, c, param, v))
+    return;
+  if(c==ch)
+    do_nrpn(param, v);
+}
+
+/* Decode the NRPN controllers of MIDI channel 'c'; FALSE if 'param' is not one of them */
+static int nrpn_controller(int c, int param, int value)
+{
+  switch(param)
+    {
+    case 99:			/* NRPN MSB */
+      nrpn_param[c]=(value<<7)|(nrpn_param[c]&0x7f);
+      return TRUE;
+    case 98:			/* NRPN LSB */
+      nrpn_param[c]=(nrpn_param[c]&~0x7f)|value;
+      return TRUE;
+    case 101: case 100:	/* RPN, none of ours */
+      nrpn_param[c]=NRPN_NULL;
+      return TRUE;
+    case 6:			/* data entry MSB, refined by a following LSB */
+      nrpn_msb[c]=value;
+      nrpn_value(c, nrpn_param[c], value<<7);
+      return TRUE;
+    case 38:			/* data entry LSB */
+      nrpn_value(c, nrpn_param[c], (nrpn_msb[c]<<7)|value);
+      return TRUE;
+    }
+  return FALSE;
+}
+
+/* TRUE once midi_init() has succeeded */
+int midi_active(void)
+{
+  return seq!=0;
+}
+
 int midi_init(char *appname, int channel, int midi_enhanced)
 {
   snd_seq_client_info_t *clientinfo;
@@ -176,10 +672,28 @@ int midi_init(char *appname, int channel, int midi_enhanced)
   if(seq)
     return 0;
 
-  for(npfd=0; npfd!=128; ++npfd)
-    currentvalue[npfd]=-1;
+  for(npfd=0; npfd!=FEEDBACK_SLOTS; ++npfd)
+    currentvalue[npfd]=pendingvalue[npfd]=-1;
+  memset(listed, 0, sizeof(listed));
+  npending=0;
+  nrpn_sent=-1;
+  for(npfd=0; npfd!=16; ++npfd)
+    {
+      nrpn_param[npfd]=NRPN_NULL;
+      nrpn_msb[npfd]=0;
+    }
+  if(nrpn)
+    {
+      /* rather than on the first message */
+      hires_scale(CTL_MULTI_PLAYBACK_VOLUME);
+      hires_scale(CTL_DAC_VOLUME);
+      hires_scale(CTL_ADC_VOLUME);
+      hires_scale(CTL_IPGA_VOLUME);
+    }
+  feedback_last=stats_last=midi_now();
 
   ch=channel;
+  midi_stats=(getenv("MUDITA24_MIDI_STATS") != NULL);
   if(midi_enhanced)
     {
       midi2slider=midi2slider_enh;
@@ -240,16 +754,18 @@ int midi_init(char *appname, int channel, int midi_enhanced)
   return pfd[0].fd;
 }
 
-void mixer_adjust(GtkAdjustment *adj, gpointer data);
-void mixer_set_mute(int stream, int left, int right);
-
-void midi_process(gpointer data, gint source, GdkInputCondition condition)
+/*
+ * Controllers go straight to the shadow values of the mixer's controls
+ * (mixer_set_volume(), mixer_set_switch()), not through its scales and
+ * toggles. All events read in one go are queued as one batch of writes,
+ * coalesced per control, and the mixer redraws the streams they changed
+ * once per frame.
+ */
+gboolean midi_process(GIOChannel *source, GIOCondition condition, gpointer data)
 {
   snd_seq_event_t *ev;
-  static GtkAdjustment *adj=0;
-  if(!adj)
-    adj=(GtkAdjustment*) gtk_adjustment_new(0, 0, 96, 1, 1, 10);
 
+  controls_batch_begin();
   do
     {
       snd_seq_event_input(seq, &ev);
@@ -257,19 +773,41 @@ void midi_process(gpointer data, gint source, GdkInputCondition condition)
       switch(ev->type)
 	{
 	case SND_SEQ_EVENT_CONTROLLER:
+	  if(mackie_event(ev))
+	    break;
 #if 0
 	  fprintf(stderr, "Channel %02d: Controller %03d: Value:%d\n",
 		  ev->data.control.channel, ev->data.control.param, ev->data.control.value);
 #endif
+	  if(nrpn && nrpn_controller(ev->data.control.channel & 0x0f, ev->data.control.param & 0x7f,
+				     ev->data.control.value & 0x7f))
+	    break;
+	  if(midi_learn_event(MIDI_BIND_CC, ev->data.control.channel & 0x0f, ev->data.control.param & 0x7f,
+			      ((ev->data.control.value & 0x7f)<<7)|(ev->data.control.value & 0x7f)))
+	    break;
 	  if(ev->data.control.channel == ch)
 	    {
+	      if(bank_select && ev->data.control.param == 0)
+		{
+		  bank_msb=ev->data.control.value & 0x7f;
+		  break;
+		}
+	      if(bank_select && ev->data.control.param == 32)
+		{
+		  bank_lsb=ev->data.control.value & 0x7f;
+		  break;
+		}
+	      /* the surface is already where it was moved to */
 	      currentvalue[ev->data.control.param]=ev->data.control.value;
+	      pendingvalue[ev->data.control.param]=-1;
 	      if(ev->data.control.param < maxstreams)
 		{
 		  int stream=ev->data.control.param;
-		  long data=((stream/2+1)<<16)|(stream&1);
-		  gtk_adjustment_set_value(adj, midi2slider[ev->data.control.value]);
-		  mixer_adjust(adj, (gpointer)data);
+		  int value=MAX_MIXER_ATTENUATION_VALUE - midi2slider[ev->data.control.value & 0x7f];
+		  /* the bottom of the shortened scale is off, as on the slider */
+		  if(value <= (MAX_MIXER_ATTENUATION_VALUE - LOW_MIXER_ATTENUATION_VALUE))
+		    value=MIN_MIXER_ATTENUATION_VALUE;
+		  mixer_set_volume(stream/2+1, stream&1, value);
 		}
 	      else if(ev->data.control.param < maxstreams*2)
 		{
@@ -279,11 +817,29 @@ void midi_process(gpointer data, gint source, GdkInputCondition condition)
 		    right=ev->data.control.value;
 		  else
 		    left=ev->data.control.value;
-		  mixer_set_mute(b/2+1, left, right);
+		  mixer_set_switch(b/2+1, left, right);
 		}
 	    }
 	  break;
 
+	case SND_SEQ_EVENT_PITCHBEND:
+	case SND_SEQ_EVENT_NOTEOFF:
+	  mackie_event(ev);
+	  break;
+
+	case SND_SEQ_EVENT_NOTEON:
+	  if(mackie_event(ev))
+	    break;
+	  if(ev->data.note.velocity)	/* else a note off */
+	    midi_learn_event(MIDI_BIND_NOTE, ev->data.note.channel & 0x0f, ev->data.note.note & 0x7f,
+			     ((ev->data.note.velocity & 0x7f)<<7)|(ev->data.note.velocity & 0x7f));
+	  break;
+
+	case SND_SEQ_EVENT_PGMCHANGE:
+	  if(ev->data.control.channel == ch)
+	    do_program_change(ev->data.control.value & 0x7f);
+	  break;
+
 	case SND_SEQ_EVENT_PORT_SUBSCRIBED:
 #if 0
 	  fprintf(stderr, "event subscribed send.client:%i dest.client:%i clientId:%i\n",
@@ -292,7 +848,8 @@ void midi_process(gpointer data, gint source, GdkInputCondition condition)
 	  if(ev->data.connect.dest.client!=clientId)
 	    {
 	      int i;
-	      for(i=0; i!=128; ++i)
+	      nrpn_sent=-1;
+	      for(i=0; i!=SLOT_MCU_METER; ++i)
 		if(currentvalue[i] >= 0)
 		  {
 		    /* set currentvalue[i] to a fake value, so the check in do_controller does not trigger */
@@ -306,6 +863,8 @@ void midi_process(gpointer data, gint source, GdkInputCondition condition)
       snd_seq_free_event(ev);
     }
   while (snd_seq_event_input_pending(seq, 0) > 0);
+  controls_batch_end();
+  return TRUE;
 }
 
 /* ************************************************* */
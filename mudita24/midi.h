@@ -1,13 +1,54 @@
 #ifndef MIDI__H
 #define MIDI__H
 
-#include <gdk/gdk.h>
+#include <glib.h>
+
+#define DEFAULT_MIDI_RATE 1000	/* feedback messages/s, about what a MIDI cable carries */
+#define MAX_MIDI_RATE 100000
+#define MIDI_VALUE_MAX 16383	/* 14 bit values, as by NRPN */
+#define MCU_STRIPS 8		/* channel strips of a Mackie Control surface */
+#define MCU_FADERS 9		/* its faders, the strips' and the master */
+
+/* kinds of MIDI input that can be bound to a control, see midilearn.c */
+enum {
+	MIDI_BIND_CC,
+	MIDI_BIND_NOTE,
+	MIDI_BIND_NRPN,
+	MIDI_BIND_KINDS
+};
 
 int midi_init(char *appname, int channel, int midi_enhanced);
 int midi_close();
+int midi_active(void);
 void midi_maxstreams(int);
+void midi_bank_select(int enable);
+void midi_rate(int rate);
+void midi_nrpn(int enable);
 int midi_controller(int c, int v);
-void midi_process(gpointer data, gint source, GdkInputCondition condition);
+gboolean midi_process(GIOChannel *source, GIOCondition condition, gpointer data);
 int midi_button(int b, int v);
+/* these need controls.h */
+int midi_analog_volume(control_t c, int index, int v);
+int midi_scale_value(control_t c, int v, long *value);
+int midi_scale_feedback(control_t c, long value);
+void midi_mcu_fader(int f, int v, int received);
+void midi_mcu_led(int note, int on);
+void midi_mcu_meter(int strip, int level);
+
+/* midilearn.c */
+int midi_learn_event(int kind, int channel, int number, int value);
+void midi_learn_control(control_t c, int index);
+void midi_learn_start(void (*done)(gpointer data), gpointer data);
+void midi_learn_cancel(void);
+void midi_learn_load(GKeyFile *file);
+void midi_learn_save(GKeyFile *file);
+
+/* mackie.c */
+void mackie_enable(int enable);
+int mackie_active(void);
+void mackie_start(void);
+int mackie_event(const snd_seq_event_t *ev);
+void mackie_stream_changed(int stream);
+void mackie_meters(snd_ctl_elem_value_t *peaks);
 
 #endif
@@ -0,0 +1,352 @@
+/*****************************************************************************
+   midilearn.c - Bind MIDI controllers, notes and NRPNs to any control
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+******************************************************************************/
+
+/*
+ * The fixed MIDI mapping in midi.c only reaches the mixer's faders and
+ * mutes. With "MIDI Learn" pressed, the next control changed in the GUI
+ * and the next controller, note or NRPN received (on any channel, in
+ * either order) are bound to each other, replacing any earlier binding of
+ * that message. A binding then takes precedence over the fixed mapping.
+ *
+ * Bindings are looked up in dense 16 x 128 tables, by channel and number,
+ * so decoding costs the same however many there are; NRPNs add a level
+ * indexed by their MSB, allocated for the MSBs in use. Each binding keeps
+ * the type and range of its control, read when it was made, so applying
+ * one is a write to the shadow and control_queue(): the writes of one
+ * batch of MIDI input are coalesced like those of the fixed mapping.
+ *
+ * Controllers and NRPNs set integer controls over their range (by the
+ * same dB-spaced tables as --midi_nrpn for the attenuators), switch
+ * booleans on from half way and spread the items of an enumeration over
+ * the range. A note on toggles a boolean, steps through an enumeration
+ * or sets an integer by its velocity. A binding sets one channel of its
+ * control, or all of them if all changed together when it was learned
+ * (e.g. a ganged fader).
+ *
+ * The bindings are kept in the [midi learn] group of the config file, one
+ * key per message: "cc.<channel>.<number>", "note.<channel>.<number>" or
+ * "nrpn.<channel>.<number>" (channels 1-16), with the value
+ * "<index>,<channel or -1>,<control name>".
+ */
+
+#include "controls.h"
+#include "midi.h"
+
+#define MIDI_LEARN_GROUP "midi learn"
+
+typedef struct {
+	guint8 control;		/* control_t + 1; 0: not bound */
+	guint8 index;
+	gint8 channel;		/* of the control's values; -1 all */
+	guint8 type;		/* SND_CTL_ELEM_TYPE_* */
+	guint16 count;		/* values in the control */
+	gint32 min, max;	/* integer range; 0 and items - 1 for an enumeration */
+} binding_t;
+
+static binding_t cc_bindings[16][128];
+static binding_t note_bindings[16][128];
+static binding_t *nrpn_bindings[16][128];	/* by NRPN MSB, then LSB */
+
+static const char *const kind_names[MIDI_BIND_KINDS] = { "cc", "note", "nrpn" };
+
+/* learning: the control and the message to bind, each found yet or not */
+static int learning = FALSE;
+static void (*learn_done)(gpointer data) = NULL;
+static gpointer learn_done_data;
+static binding_t learn_target;
+static int learn_kind, learn_channel, learn_number;
+static int learn_source = FALSE;
+
+/* The binding of a message, allocating NRPN tables if 'create'; NULL if none */
+static binding_t *binding(int kind, int channel, int number, int create)
+{
+	binding_t **page;
+
+	switch (kind) {
+	case MIDI_BIND_CC:
+		return &cc_bindings[channel][number & 0x7f];
+	case MIDI_BIND_NOTE:
+		return &note_bindings[channel][number & 0x7f];
+	case MIDI_BIND_NRPN:
+		page = &nrpn_bindings[channel][(number >> 7) & 0x7f];
+		if (*page == NULL) {
+			if (!create)
+				return NULL;
+			*page = g_new0(binding_t, 128);
+		}
+		return &(*page)[number & 0x7f];
+	}
+	return NULL;
+}
+
+/* Fill in the type and range of 'b' from its control; FALSE if it can't be bound */
+static int binding_describe(binding_t *b, control_t c, int index)
+{
+	const control_range_t *r = control_range(c, index);
+
+	if (!r->writable)
+		return FALSE;
+	switch (r->type) {
+	case SND_CTL_ELEM_TYPE_BOOLEAN:
+	case SND_CTL_ELEM_TYPE_INTEGER:
+	case SND_CTL_ELEM_TYPE_ENUMERATED:
+		break;
+	default:
+		return FALSE;
+	}
+	b->control = c + 1;
+	b->index = index;
+	b->type = r->type;
+	b->count = r->count;
+	b->min = r->min;
+	b->max = r->max;
+	if (b->channel >= b->count)
+		b->channel = -1;
+	return b->count > 0 && b->max >= b->min;
+}
+
+/* Set the control of 'b' by the 14 bit 'value', or step it for a note */
+static void binding_apply(const binding_t *b, int value, int note)
+{
+	control_t c = b->control - 1;
+	snd_ctl_elem_value_t *val = control_value(c, b->index);
+	long v;
+	int i, changed = FALSE;
+
+	control_read(c, b->index);
+	for (i = 0; i < b->count; i++) {
+		if (b->channel >= 0 && i != b->channel)
+			continue;
+		switch (b->type) {
+		case SND_CTL_ELEM_TYPE_BOOLEAN:
+			v = note ? !snd_ctl_elem_value_get_boolean(val, i) : value > MIDI_VALUE_MAX / 2;
+			if (v == snd_ctl_elem_value_get_boolean(val, i))
+				continue;
+			snd_ctl_elem_value_set_boolean(val, i, v);
+			break;
+		case SND_CTL_ELEM_TYPE_INTEGER:
+			if (!midi_scale_value(c, value, &v) || v < b->min || v > b->max)
+				v = b->min + ((gint64)(b->max - b->min) * value + MIDI_VALUE_MAX / 2) / MIDI_VALUE_MAX;
+			if (v == snd_ctl_elem_value_get_integer(val, i))
+				continue;
+			snd_ctl_elem_value_set_integer(val, i, v);
+			break;
+		case SND_CTL_ELEM_TYPE_ENUMERATED:
+			if (note)
+				v = (snd_ctl_elem_value_get_enumerated(val, i) + 1) % (b->max + 1);
+			else
+				v = (gint64)value * (b->max + 1) / (MIDI_VALUE_MAX + 1);
+			if (v == snd_ctl_elem_value_get_enumerated(val, i))
+				continue;
+			snd_ctl_elem_value_set_enumerated(val, i, v);
+			break;
+		}
+		changed = TRUE;
+	}
+	if (changed)
+		control_queue(c, b->index);
+}
+
+static void learn_stop(void)
+{
+	learning = FALSE;
+	if (learn_done != NULL)
+		learn_done(learn_done_data);
+}
+
+/* Bind once both the control and the message are known */
+static void learn_try_bind(void)
+{
+	binding_t *b;
+
+	if (!learn_target.control || !learn_source)
+		return;
+	b = binding(learn_kind, learn_channel, learn_number, TRUE);
+	*b = learn_target;
+	if (getenv("MUDITA24_MIDI_STATS") != NULL)
+		g_print("MIDI learn: %s %i/%i bound to %s %i, channel %i\n",
+			kind_names[learn_kind], learn_channel + 1, learn_number,
+			control_name(b->control - 1), b->index, b->channel);
+	learn_stop();
+}
+
+/*
+ * Bind the next control changed and the next message received to each
+ * other; 'done' is called with 'data' once they are.
+ */
+void midi_learn_start(void (*done)(gpointer data), gpointer data)
+{
+	if (ctlclient_connected()) {
+		ctlclient_learn(done, data);	/* in mudita24d, which has the port */
+		return;
+	}
+	memset(&learn_target, 0, sizeof(learn_target));
+	learn_source = FALSE;
+	learn_done = done;
+	learn_done_data = data;
+	learning = TRUE;
+}
+
+/* Stop learning without binding, and without calling 'done' */
+void midi_learn_cancel(void)
+{
+	if (ctlclient_connected())
+		ctlclient_learn(NULL, NULL);
+	learning = FALSE;
+}
+
+/*
+ * Called by control_write() and control_queue() before the card is
+ * written: while learning, 'index' of control 'c' becomes the control to
+ * bind. The channels whose value differs from the card's tell which one
+ * it is, or that it is all of them.
+ */
+void midi_learn_control(control_t c, int index)
+{
+	snd_ctl_elem_value_t *card, *val;
+	binding_t target;
+	int i, changed = 0, channel = -1;
+
+	if (!learning)
+		return;
+	memset(&target, 0, sizeof(target));
+	target.channel = -1;
+	if (!binding_describe(&target, c, index))
+		return;
+	val = control_value(c, index);
+	snd_ctl_elem_value_alloca(&card);
+	snd_ctl_elem_value_set_id(card, control_id(c, index));
+	if (snd_ctl_elem_read(ctl, card) >= 0) {
+		for (i = 0; i < target.count; i++) {
+			switch (target.type) {
+			case SND_CTL_ELEM_TYPE_BOOLEAN:
+				if (snd_ctl_elem_value_get_boolean(card, i) == snd_ctl_elem_value_get_boolean(val, i))
+					continue;
+				break;
+			case SND_CTL_ELEM_TYPE_INTEGER:
+				if (snd_ctl_elem_value_get_integer(card, i) == snd_ctl_elem_value_get_integer(val, i))
+					continue;
+				break;
+			default:
+				if (snd_ctl_elem_value_get_enumerated(card, i) == snd_ctl_elem_value_get_enumerated(val, i))
+					continue;
+				break;
+			}
+			changed++;
+			channel = i;
+		}
+	}
+	if (changed == 0 && learn_target.control == c + 1 && learn_target.index == index)
+		return;		/* written again, e.g. by the flush of a drag */
+	target.channel = changed == 1 ? channel : -1;
+	learn_target = target;
+	learn_try_bind();
+}
+
+/*
+ * Called for each controller, note on and NRPN received, with 'value'
+ * scaled to 14 bits: apply its binding, or take it as the message to bind
+ * while learning. FALSE if neither, for the fixed mapping to handle.
+ */
+int midi_learn_event(int kind, int channel, int number, int value)
+{
+	binding_t *b;
+
+	if (learning) {
+		learn_kind = kind;
+		learn_channel = channel;
+		learn_number = number;
+		learn_source = TRUE;
+		learn_try_bind();
+		return TRUE;
+	}
+	if ((b = binding(kind, channel, number, FALSE)) == NULL || !b->control)
+		return FALSE;
+	binding_apply(b, value, kind == MIDI_BIND_NOTE);
+	return TRUE;
+}
+
+/* Read the bindings from the config 'file'; call after controls_init() */
+void midi_learn_load(GKeyFile *file)
+{
+	gchar **keys, *value, kind_name[8];
+	binding_t target, *b;
+	int i, kind, channel, number, index, element, n;
+	int c;
+
+	if ((keys = g_key_file_get_keys(file, MIDI_LEARN_GROUP, NULL, NULL)) == NULL)
+		return;
+	for (i = 0; keys[i] != NULL; i++) {
+		if (sscanf(keys[i], "%7[a-z].%d.%d", kind_name, &channel, &number) != 3 ||
+		    channel < 1 || channel > 16 || number < 0 || number > MIDI_VALUE_MAX)
+			continue;
+		for (kind = 0; kind < MIDI_BIND_KINDS; kind++)
+			if (!strcmp(kind_name, kind_names[kind]))
+				break;
+		if (kind == MIDI_BIND_KINDS || (kind != MIDI_BIND_NRPN && number > 127))
+			continue;
+		if ((value = g_key_file_get_string(file, MIDI_LEARN_GROUP, keys[i], NULL)) == NULL)
+			continue;
+		n = 0;
+		memset(&target, 0, sizeof(target));
+		if (sscanf(value, "%d,%d,%n", &index, &element, &n) >= 2 && n > 0 &&
+		    (c = control_lookup(value + n)) >= 0 &&
+		    index >= 0 && index < MAX_CONTROL_INDEX) {
+			target.channel = element;
+			if (binding_describe(&target, c, index)) {
+				b = binding(kind, channel - 1, number, TRUE);
+				*b = target;
+			} else
+				g_print("MIDI learn: cannot bind %s to %s %i\n", keys[i], value + n, index);
+		}
+		g_free(value);
+	}
+	g_strfreev(keys);
+}
+
+static void save_binding(GKeyFile *file, int kind, int channel, int number, const binding_t *b)
+{
+	gchar *key, *value;
+
+	if (!b->control)
+		return;
+	key = g_strdup_printf("%s.%i.%i", kind_names[kind], channel + 1, number);
+	value = g_strdup_printf("%i,%i,%s", b->index, b->channel, control_name(b->control - 1));
+	g_key_file_set_string(file, MIDI_LEARN_GROUP, key, value);
+	g_free(key);
+	g_free(value);
+}
+
+/* Replace the bindings in the config 'file' with the current ones */
+void midi_learn_save(GKeyFile *file)
+{
+	int channel, number, lsb;
+
+	g_key_file_remove_group(file, MIDI_LEARN_GROUP, NULL);
+	for (channel = 0; channel < 16; channel++) {
+		for (number = 0; number < 128; number++) {
+			save_binding(file, MIDI_BIND_CC, channel, number, &cc_bindings[channel][number]);
+			save_binding(file, MIDI_BIND_NOTE, channel, number, &note_bindings[channel][number]);
+			if (nrpn_bindings[channel][number] == NULL)
+				continue;
+			for (lsb = 0; lsb < 128; lsb++)
+				save_binding(file, MIDI_BIND_NRPN, channel, (number << 7) | lsb,
+					     &nrpn_bindings[channel][number][lsb]);
+		}
+	}
+}
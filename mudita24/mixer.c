@@ -19,22 +19,10 @@
 
 #include "envy24control.h"
 #include "midi.h"
-#include "config.h"
-
-#define	MULTI_PLAYBACK_SWITCH		"Multi Playback Switch"
-#define MULTI_PLAYBACK_VOLUME		"Multi Playback Volume"
-
-#define HW_MULTI_CAPTURE_SWITCH		"H/W Multi Capture Switch"
-#define IEC958_MULTI_CAPTURE_SWITCH	"IEC958 Multi Capture Switch"
-
-#define HW_MULTI_CAPTURE_VOLUME		"H/W Multi Capture Volume"
-#define IEC958_MULTI_CAPTURE_VOLUME	"IEC958 Multi Capture Volume"
 
 #define toggle_set(widget, state) \
 	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(widget), state);
 
-static int stream_is_active[MAX_PCM_OUTPUT_CHANNELS + MAX_SPDIF_CHANNELS + \
-				MAX_INPUT_CHANNELS + MAX_SPDIF_CHANNELS];
 extern int input_channels, output_channels, pcm_output_channels, spdif_channels, view_spdif_playback;
 
 static int is_active(GtkWidget *widget)
@@ -42,69 +30,57 @@ static int is_active(GtkWidget *widget)
 	return gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget)) ? 1 : 0;
 }
 
+/*
+ * Bring the widgets of 'stream' up to date with its volume (vol_flag) or
+ * switch (sw_flag) in the shadow, after mixer_stream_changed() has sent
+ * the feedback.
+ */
 void mixer_update_stream(int stream, int vol_flag, int sw_flag)
 {
-	int err;
+	int index;
+	control_t c;
 	
   //printf("mixer_update_stream stream:%d vol_flag:%d sw_flag:%d\n", stream, vol_flag, sw_flag);
   
-  if (! stream_is_active[stream - 1])
+  if (! mixer_stream_is_active(stream))
 		return;
 
 	if (vol_flag) {
 		snd_ctl_elem_value_t *vol;
 		int v[2];
-		snd_ctl_elem_value_alloca(&vol);
-		snd_ctl_elem_value_set_interface(vol, SND_CTL_ELEM_IFACE_MIXER);
-		snd_ctl_elem_value_set_name(vol, stream <= 10 ? MULTI_PLAYBACK_VOLUME : (stream <= 18 ? HW_MULTI_CAPTURE_VOLUME : IEC958_MULTI_CAPTURE_VOLUME));
-		snd_ctl_elem_value_set_index(vol, stream <= 18 ? (stream - 1) % 10 : (stream - 1) % 18 );
-		if ((err = snd_ctl_elem_read(ctl, vol)) < 0)
-			g_print("Unable to read multi playback volume: %s\n", snd_strerror(err));
+		c = mixer_stream_control(stream, 1, &index);
+		vol = control_value(c, index);
 		v[0] = snd_ctl_elem_value_get_integer(vol, 0);
 		v[1] = snd_ctl_elem_value_get_integer(vol, 1);
 		if (v[0] != v[1])
 			toggle_set(mixer_stereo_toggle[stream-1], FALSE);
-    
 		// TER: Stop jitter when adjusting sliders.
-    //printf("mixer_update_stream cur val:%f new val:%d\n", GTK_ADJUSTMENT(mixer_adj[stream-1][0])->value, MAX_MIXER_ATTENUATION_VALUE - v[0]);
-    if((gint)gtk_adjustment_get_value(GTK_ADJUSTMENT(mixer_adj[stream-1][0])) != MAX_MIXER_ATTENUATION_VALUE - v[0])
-      gtk_adjustment_set_value(GTK_ADJUSTMENT(mixer_adj[stream-1][0]), MAX_MIXER_ATTENUATION_VALUE - v[0]);
-    if((gint)gtk_adjustment_get_value(GTK_ADJUSTMENT(mixer_adj[stream-1][1])) != MAX_MIXER_ATTENUATION_VALUE - v[1])
-		  gtk_adjustment_set_value(GTK_ADJUSTMENT(mixer_adj[stream-1][1]), MAX_MIXER_ATTENUATION_VALUE - v[1]);
-      
-		midi_controller((stream-1)*2,   v[0]);
-		midi_controller((stream-1)*2+1, v[1]);
+		if((gint)gtk_adjustment_get_value(GTK_ADJUSTMENT(mixer_adj[stream-1][0])) != MAX_MIXER_ATTENUATION_VALUE - v[0])
+			gtk_adjustment_set_value(GTK_ADJUSTMENT(mixer_adj[stream-1][0]), MAX_MIXER_ATTENUATION_VALUE - v[0]);
+		if((gint)gtk_adjustment_get_value(GTK_ADJUSTMENT(mixer_adj[stream-1][1])) != MAX_MIXER_ATTENUATION_VALUE - v[1])
+			gtk_adjustment_set_value(GTK_ADJUSTMENT(mixer_adj[stream-1][1]), MAX_MIXER_ATTENUATION_VALUE - v[1]);
 	}
 	if (sw_flag) {
 		snd_ctl_elem_value_t *sw;
 		int v[2];
-		snd_ctl_elem_value_alloca(&sw);
-		snd_ctl_elem_value_set_interface(sw, SND_CTL_ELEM_IFACE_MIXER);
-		snd_ctl_elem_value_set_name(sw, stream <= 10 ? MULTI_PLAYBACK_SWITCH : (stream <= 18 ? HW_MULTI_CAPTURE_SWITCH : IEC958_MULTI_CAPTURE_SWITCH));
-		snd_ctl_elem_value_set_index(sw, stream <= 18 ? (stream - 1) % 10 : (stream - 1) % 18 );
-		if ((err = snd_ctl_elem_read(ctl, sw)) < 0)
-			g_print("Unable to read multi playback switch: %s\n", snd_strerror(err));
+		c = mixer_stream_control(stream, 0, &index);
+		sw = control_value(c, index);
 		v[0] = snd_ctl_elem_value_get_boolean(sw, 0);
 		v[1] = snd_ctl_elem_value_get_boolean(sw, 1);
 		if (v[0] != v[1])
 			toggle_set(mixer_stereo_toggle[stream-1], FALSE);
 		toggle_set(mixer_mute_toggle[stream-1][0], !v[0] ? TRUE : FALSE);
 		toggle_set(mixer_mute_toggle[stream-1][1], !v[1] ? TRUE : FALSE);
-		midi_button((stream-1)*2, v[0]);
-		midi_button((stream-1)*2+1, v[1]);
 	}
 }
 
 static void set_switch1(int stream, int left, int right)
 {
-	snd_ctl_elem_value_t *sw;
-	int err, changed = 0;
+	int err, changed = 0, index;
+	control_t c = mixer_stream_control(stream, 0, &index);
+	snd_ctl_elem_value_t *sw = control_value(c, index);
 	
-	snd_ctl_elem_value_alloca(&sw);
-	snd_ctl_elem_value_set_interface(sw, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(sw, stream <= 10 ? MULTI_PLAYBACK_SWITCH : (stream <= 18 ? HW_MULTI_CAPTURE_SWITCH : IEC958_MULTI_CAPTURE_SWITCH));
-	snd_ctl_elem_value_set_index(sw, stream <= 18 ? (stream - 1) % 10 : (stream - 1) % 18 );
-	if ((err = snd_ctl_elem_read(ctl, sw)) < 0)
+	if ((err = control_read(c, index)) < 0)
 		g_print("Unable to read multi switch: %s\n", snd_strerror(err));
 	if (left >= 0 && left != snd_ctl_elem_value_get_boolean(sw, 0)) {
 		snd_ctl_elem_value_set_boolean(sw, 0, left);
@@ -117,7 +93,7 @@ static void set_switch1(int stream, int left, int right)
 		midi_button((stream-1)*2+1, right);
 	}
 	if (changed) {
-		err = snd_ctl_elem_write(ctl, sw);
+		err = control_write(c, index);
 		if (err < 0)
 			g_print("Unable to write multi switch: %s\n", snd_strerror(err));
 	}
@@ -140,31 +116,21 @@ void mixer_toggled_mute(GtkWidget *togglebutton, gpointer data)
 	set_switch1(stream, vol[0], vol[1]);
 }
 
-void mixer_set_mute(int stream, int left, int right)
+void mixer_toggled_stereo(GtkWidget *togglebutton, gpointer data)
 {
-	int stereo = is_active(mixer_stereo_toggle[stream-1]) ? 1 : 0;
-	if (left >= 0 || stereo) {
-		toggle_set(mixer_mute_toggle[stream-1][0], left ? TRUE : FALSE);
-		if(stereo && left<0) left=right;
-	}
-	if (right >= 0 || stereo) {
-		toggle_set(mixer_mute_toggle[stream-1][1], right ? TRUE : FALSE);
-		if(stereo && right<0) right=left;
-	}
-	set_switch1(stream, left, right);
+	int stream = (long)data;
+
+	mixer_set_stereo(stream, is_active(togglebutton));
 }
 
 static void set_volume1(int stream, int left, int right)
 {
-	snd_ctl_elem_value_t *vol;
 	int change = 0;
-	int err;
+	int err, index;
+	control_t c = mixer_stream_control(stream, 1, &index);
+	snd_ctl_elem_value_t *vol = control_value(c, index);
 	
-	snd_ctl_elem_value_alloca(&vol);
-	snd_ctl_elem_value_set_interface(vol, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(vol, stream <= 10 ? MULTI_PLAYBACK_VOLUME : (stream <= 18 ? HW_MULTI_CAPTURE_VOLUME : IEC958_MULTI_CAPTURE_VOLUME));
-	snd_ctl_elem_value_set_index(vol, stream <= 18 ? (stream - 1) % 10 : (stream - 1) % 18 );
-	if ((err = snd_ctl_elem_read(ctl, vol)) < 0)
+	if ((err = control_read(c, index)) < 0)
 		g_print("Unable to read multi volume: %s\n", snd_strerror(err));
 	if (left >= 0) {
 		change |= (snd_ctl_elem_value_get_integer(vol, 0) != left);
@@ -176,36 +142,30 @@ static void set_volume1(int stream, int left, int right)
 		snd_ctl_elem_value_set_integer(vol, 1, right);
 		midi_controller((stream-1)*2+1, right);
 	}
-	if (change) {
-    if ((err = snd_ctl_elem_write(ctl, vol)) < 0 && err != -EBUSY)
-			g_print("Unable to write multi volume: %s\n", snd_strerror(err));
-	}
+	if (change)
+		control_queue(c, index);
 }
 
 /* 
  * NPM: mixer_volume_to_db() -- called out of mixer_adjust(). Use of proper
  * ALSA API snd_ctl_convert_to_dB() to return dB values suggested by
- * Tim E. Real on linux-audio-devel list.
+ * Tim E. Real on linux-audio-devel list. Now control_db(), by the same
+ * dB scale whether read from the card or from mudita24d.
  */
 static char temp_label[16];
 static char* mixer_volume_to_db(int stream, int ival) {
   if (ival != 0) {
 //  g_print("mixer_volume_to_db(%i, %i)\n", stream, ival);
-    snd_ctl_elem_id_t *elem_id;
-    snd_ctl_elem_id_alloca(&elem_id);
-    snd_ctl_elem_id_set_interface(elem_id, SND_CTL_ELEM_IFACE_MIXER);
     /* NPM: IEC958_MULTI_CAPTURE_VOLUME, for stream=19 or 20 gives incorrect
      * results, use HW_MULTI_CAPTURE_VOLUME for all.
      * Verified by TER. Those two controls have no dB values, but they
-     * should, they're just part of the same mixer ! */
-    //snd_ctl_elem_id_set_name(elem_id, (stream <= 10) ? MULTI_PLAYBACK_VOLUME : (stream <= 18 ? HW_MULTI_CAPTURE_VOLUME : IEC958_MULTI_CAPTURE_VOLUME));
-    snd_ctl_elem_id_set_name(elem_id, (stream <= 10) ? MULTI_PLAYBACK_VOLUME : HW_MULTI_CAPTURE_VOLUME);
-    /* TER: First line is 'proper' way, but second line is corrected
+     * should, they're just part of the same mixer !
+     * TER: Index 0 of HW_MULTI_CAPTURE_VOLUME is the corrected
      *  workaround for lack of dB values for IEC958 controls. */
-    //snd_ctl_elem_id_set_index(elem_id, stream <= 18 ? (stream - 1) % 10 : (stream - 1) % 18 );
-    snd_ctl_elem_id_set_index(elem_id, stream <= 18 ? (stream - 1) % 10 : 0 );
     long db_gain = 0;
-    snd_ctl_convert_to_dB(ctl, elem_id, ival, &db_gain); /* convert 'ival' attenuation to mixer from integer to dB for display */
+    control_db((stream <= 10) ? CTL_MULTI_PLAYBACK_VOLUME : CTL_HW_MULTI_CAPTURE_VOLUME,
+               stream <= 18 ? (stream - 1) % 10 : 0,
+               ival, &db_gain); /* convert 'ival' attenuation to mixer from integer to dB for display */
     float fval = ((float)db_gain / 100.0);
     if (fval > -10)
       sprintf(temp_label, "%+2.1f  ", fval);
@@ -258,61 +218,11 @@ void mixer_adjust(GtkAdjustment *adj, gpointer data)
 	set_volume1(stream, vol[0], vol[1]);
 }
 
-int mixer_stream_is_active(int stream)
+static void mixer_postinit_stream(int stream)
 {
-	return stream_is_active[stream - 1];
-}
-
-void mixer_init(void)
-{
-	int i;
-	int nb_active_channels;
-	snd_ctl_elem_value_t *val;
-
-	midi_maxstreams(sizeof(stream_is_active)/sizeof(stream_is_active[0]));
-
-	snd_ctl_elem_value_alloca(&val);
-	snd_ctl_elem_value_set_interface(val, SND_CTL_ELEM_IFACE_MIXER);
-	memset (stream_is_active, 0, (MAX_PCM_OUTPUT_CHANNELS + MAX_SPDIF_CHANNELS + MAX_INPUT_CHANNELS + MAX_SPDIF_CHANNELS) * sizeof(int));
-	snd_ctl_elem_value_set_name(val, MULTI_PLAYBACK_SWITCH);
-	nb_active_channels = 0;
-	for (i = 0; i < pcm_output_channels; i++) {
-		snd_ctl_elem_value_set_numid(val, 0);
-		snd_ctl_elem_value_set_index(val, i);
-		if (snd_ctl_elem_read(ctl, val) < 0)
-			continue;
-
-		stream_is_active[i] = 1;
-		nb_active_channels++;
-	}
-	pcm_output_channels = nb_active_channels;
-	for (i = MAX_PCM_OUTPUT_CHANNELS; i < MAX_PCM_OUTPUT_CHANNELS + spdif_channels; i++) {
-		snd_ctl_elem_value_set_numid(val, 0);
-		snd_ctl_elem_value_set_index(val, i);
- 		if (snd_ctl_elem_read(ctl, val) < 0)
-			continue;
-		stream_is_active[i] = 1;
-	}
-	snd_ctl_elem_value_set_name(val, HW_MULTI_CAPTURE_SWITCH);
-	nb_active_channels = 0;
-	for (i = 0; i < input_channels; i++) {
-		snd_ctl_elem_value_set_numid(val, 0);
-		snd_ctl_elem_value_set_index(val, i);
-		if (snd_ctl_elem_read(ctl, val) < 0)
-			continue;
-
-		stream_is_active[i + MAX_PCM_OUTPUT_CHANNELS + MAX_SPDIF_CHANNELS] = 1;
-		nb_active_channels++;
-	}
-	input_channels = nb_active_channels;
-	snd_ctl_elem_value_set_name(val, IEC958_MULTI_CAPTURE_SWITCH);
-	for (i = 0; i < spdif_channels; i++) {
-		snd_ctl_elem_value_set_numid(val, 0);
-		snd_ctl_elem_value_set_index(val, i);
- 		if (snd_ctl_elem_read(ctl, val) < 0)
-			continue;
-		stream_is_active[i + MAX_PCM_OUTPUT_CHANNELS + MAX_SPDIF_CHANNELS + MAX_INPUT_CHANNELS] = 1;
-	}
+	mixer_stream_changed(stream, 1, 1);
+	mixer_update_stream(stream, 1, 1);
+	toggle_set(mixer_stereo_toggle[stream-1], mixer_stream_is_stereo(stream));
 }
 
 void mixer_postinit(void)
@@ -320,25 +230,23 @@ void mixer_postinit(void)
 	int stream;
 
 	for (stream = 1; stream <= pcm_output_channels; stream++) {
-		if (stream_is_active[stream - 1])
-			mixer_update_stream(stream, 1, 1);
+		if (mixer_stream_is_active(stream))
+			mixer_postinit_stream(stream);
 	}
 	for (stream = MAX_PCM_OUTPUT_CHANNELS + 1; \
 		stream <= MAX_PCM_OUTPUT_CHANNELS + spdif_channels; stream++) {
-		if (stream_is_active[stream - 1] && view_spdif_playback)
-			mixer_update_stream(stream, 1, 1);
+		if (mixer_stream_is_active(stream) && view_spdif_playback)
+			mixer_postinit_stream(stream);
 	}
 	for (stream = MAX_PCM_OUTPUT_CHANNELS + MAX_SPDIF_CHANNELS + 1; \
 		stream <= MAX_PCM_OUTPUT_CHANNELS + MAX_SPDIF_CHANNELS + input_channels; stream++) {
-		if (stream_is_active[stream - 1])
-			mixer_update_stream(stream, 1, 1);
+		if (mixer_stream_is_active(stream))
+			mixer_postinit_stream(stream);
 	}
 	for (stream = MAX_PCM_OUTPUT_CHANNELS + MAX_SPDIF_CHANNELS + MAX_INPUT_CHANNELS + 1; \
 		stream <= MAX_PCM_OUTPUT_CHANNELS + MAX_SPDIF_CHANNELS + MAX_INPUT_CHANNELS + spdif_channels; stream++) {
-		if (stream_is_active[stream - 1])
-			mixer_update_stream(stream, 1, 1);
+		if (mixer_stream_is_active(stream))
+			mixer_postinit_stream(stream);
 	}
-
-	config_restore_stereo();
 }
 
@@ -0,0 +1,265 @@
+/*****************************************************************************
+   mixerstate.c - The digital mixer's streams, with or without the GUI
+   Copyright (C) 2000 by Jaroslav Kysela <perex@perex.cz>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+******************************************************************************/
+
+/*
+ * Which of the 20 streams the card has, which are ganged ("L/R Gang"),
+ * and setting and reading their volumes and switches from the shadow for
+ * MIDI, the surfaces and OSC. The widgets of the GUI are in mixer.c.
+ *
+ * MIDI input changes the streams through mixer_set_volume() and
+ * mixer_set_switch(), which only update the shadow values and queue the
+ * writes. Their feedback and widgets are brought up to date from the
+ * shadow once per WIDGET_REFRESH_INTERVAL, however many messages a
+ * motorized fader sends meanwhile; analog_volume_set() does the same for
+ * the analog volumes.
+ */
+
+#include "controls.h"
+#include "midi.h"
+#include "config.h"
+
+#define STREAMS (MAX_PCM_OUTPUT_CHANNELS + MAX_SPDIF_CHANNELS + \
+		 MAX_INPUT_CHANNELS + MAX_SPDIF_CHANNELS)
+
+static int stream_is_active[STREAMS];
+/* the "L/R Gang" of each stream, with or without its toggle */
+static int stream_is_stereo[STREAMS];
+extern int input_channels, output_channels, pcm_output_channels, spdif_channels, view_spdif_playback;
+
+/* The volume or switch control of 'stream', and its index */
+control_t mixer_stream_control(int stream, int volume, int *index)
+{
+	*index = stream <= 18 ? (stream - 1) % 10 : (stream - 1) % 18;
+	if (stream <= 10)
+		return volume ? CTL_MULTI_PLAYBACK_VOLUME : CTL_MULTI_PLAYBACK_SWITCH;
+	else if (stream <= 18)
+		return volume ? CTL_HW_MULTI_CAPTURE_VOLUME : CTL_HW_MULTI_CAPTURE_SWITCH;
+	else
+		return volume ? CTL_IEC958_MULTI_CAPTURE_VOLUME : CTL_IEC958_MULTI_CAPTURE_SWITCH;
+}
+
+int mixer_stream_is_active(int stream)
+{
+	return stream_is_active[stream - 1];
+}
+
+int mixer_stream_is_stereo(int stream)
+{
+	return stream_is_stereo[stream - 1];
+}
+
+/* Gang, or ungang, the channels of 'stream', as saved on exit */
+void mixer_set_stereo(int stream, int on)
+{
+	stream_is_stereo[stream - 1] = on;
+	if (ctlclient_connected())
+		ctlclient_stereo(stream, on);	/* saved by mudita24d */
+	else
+		config_set_stereo(stream, on);
+}
+
+/* The gangs of streams 'first'... as mudita24d has them */
+void mixer_stereo_received(int first, const gint32 *on, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		if (first + i >= 1 && first + i <= STREAMS)
+			stream_is_stereo[first + i - 1] = on[i] != 0;
+}
+
+/* The volume (vol_flag) or switch (sw_flag) of 'stream' changed: send the feedback */
+void mixer_stream_changed(int stream, int vol_flag, int sw_flag)
+{
+	int err, index;
+	control_t c;
+
+	if (! stream_is_active[stream - 1])
+		return;
+	if (vol_flag) {
+		c = mixer_stream_control(stream, 1, &index);
+		if ((err = control_read(c, index)) < 0)
+			g_print("Unable to read multi playback volume: %s\n", snd_strerror(err));
+		midi_controller((stream-1)*2,   control_get(c, index, 0));
+		midi_controller((stream-1)*2+1, control_get(c, index, 1));
+	}
+	if (sw_flag) {
+		c = mixer_stream_control(stream, 0, &index);
+		if ((err = control_read(c, index)) < 0)
+			g_print("Unable to read multi playback switch: %s\n", snd_strerror(err));
+		midi_button((stream-1)*2, control_get(c, index, 0));
+		midi_button((stream-1)*2+1, control_get(c, index, 1));
+	}
+	mackie_stream_changed(stream);
+}
+
+/*
+ * Set the attenuation of 'channel' (0 left, 1 right, both if ganged) of
+ * 'stream' to 'value', 0 to MAX_MIXER_ATTENUATION_VALUE, without going
+ * through its scale.
+ */
+void mixer_set_volume(int stream, int channel, int value)
+{
+	int index, ch, change = 0;
+	control_t c;
+	snd_ctl_elem_value_t *vol;
+
+	if (stream < 1 || stream > 20 || !stream_is_active[stream - 1])
+		return;
+	c = mixer_stream_control(stream, 1, &index);
+	vol = control_value(c, index);
+	control_read(c, index);
+	for (ch = 0; ch < 2; ch++) {
+		if (ch != channel && !stream_is_stereo[stream - 1])
+			continue;
+		if (snd_ctl_elem_value_get_integer(vol, ch) == value)
+			continue;
+		snd_ctl_elem_value_set_integer(vol, ch, value);
+		change = 1;
+	}
+	if (!change)
+		return;
+	control_queue(c, index);
+	control_refresh_later(c, index);
+}
+
+/*
+ * Switch the left and right channels of 'stream' on (1, not muted) or off
+ * (0), leaving one with -1 as it is unless ganged to the other, without
+ * going through the mute toggles.
+ */
+void mixer_set_switch(int stream, int left, int right)
+{
+	int index, ch, v[2], change = 0;
+	control_t c;
+	snd_ctl_elem_value_t *sw;
+
+	if (stream < 1 || stream > 20 || !stream_is_active[stream - 1])
+		return;
+	if (stream_is_stereo[stream - 1]) {
+		if (left < 0)
+			left = right;
+		if (right < 0)
+			right = left;
+	}
+	v[0] = left;
+	v[1] = right;
+	c = mixer_stream_control(stream, 0, &index);
+	sw = control_value(c, index);
+	control_read(c, index);
+	for (ch = 0; ch < 2; ch++) {
+		if (v[ch] < 0 || snd_ctl_elem_value_get_boolean(sw, ch) == !!v[ch])
+			continue;
+		snd_ctl_elem_value_set_boolean(sw, ch, !!v[ch]);
+		change = 1;
+	}
+	if (!change)
+		return;
+	control_queue(c, index);
+	control_refresh_later(c, index);
+}
+
+/* The attenuation of 'channel' of 'stream', from the shadow; -1 if inactive */
+int mixer_get_volume(int stream, int channel)
+{
+	int index;
+	control_t c;
+
+	if (stream < 1 || stream > 20 || !stream_is_active[stream - 1])
+		return -1;
+	c = mixer_stream_control(stream, 1, &index);
+	control_read(c, index);
+	return snd_ctl_elem_value_get_integer(control_value(c, index), channel);
+}
+
+/* Whether 'channel' of 'stream' is on (not muted); -1 if inactive */
+int mixer_get_switch(int stream, int channel)
+{
+	int index;
+	control_t c;
+
+	if (stream < 1 || stream > 20 || !stream_is_active[stream - 1])
+		return -1;
+	c = mixer_stream_control(stream, 0, &index);
+	control_read(c, index);
+	return snd_ctl_elem_value_get_boolean(control_value(c, index), channel);
+}
+
+/*
+ * Set 'idx' of the analog volume 'c' (CTL_DAC_VOLUME, CTL_ADC_VOLUME or
+ * CTL_IPGA_VOLUME) to 'value' for MIDI, without going through its scale.
+ */
+void analog_volume_set(control_t c, int idx, int value)
+{
+	snd_ctl_elem_value_t *val;
+
+	if (c != CTL_DAC_VOLUME && c != CTL_ADC_VOLUME && c != CTL_IPGA_VOLUME)
+		return;
+	if (idx < 0 || idx >= MAX_CONTROL_INDEX || control_range(c, idx)->type == SND_CTL_ELEM_TYPE_NONE)
+		return;
+	val = control_value(c, idx);
+	control_read(c, idx);
+	if (snd_ctl_elem_value_get_integer(val, 0) == value)
+		return;
+	snd_ctl_elem_value_set_integer(val, 0, value);
+	control_queue(c, idx);
+	control_refresh_later(c, idx);
+}
+
+void mixer_init(void)
+{
+	int i;
+	int nb_active_channels;
+
+	midi_maxstreams(STREAMS);
+
+	memset (stream_is_active, 0, STREAMS * sizeof(int));
+	nb_active_channels = 0;
+	for (i = 0; i < pcm_output_channels; i++) {
+		if (control_read(CTL_MULTI_PLAYBACK_SWITCH, i) < 0)
+			continue;
+
+		stream_is_active[i] = 1;
+		nb_active_channels++;
+	}
+	pcm_output_channels = nb_active_channels;
+	for (i = MAX_PCM_OUTPUT_CHANNELS; i < MAX_PCM_OUTPUT_CHANNELS + spdif_channels; i++) {
+ 		if (control_read(CTL_MULTI_PLAYBACK_SWITCH, i) < 0)
+			continue;
+		stream_is_active[i] = 1;
+	}
+	nb_active_channels = 0;
+	for (i = 0; i < input_channels; i++) {
+		if (control_read(CTL_HW_MULTI_CAPTURE_SWITCH, i) < 0)
+			continue;
+
+		stream_is_active[i + MAX_PCM_OUTPUT_CHANNELS + MAX_SPDIF_CHANNELS] = 1;
+		nb_active_channels++;
+	}
+	input_channels = nb_active_channels;
+	for (i = 0; i < spdif_channels; i++) {
+ 		if (control_read(CTL_IEC958_MULTI_CAPTURE_SWITCH, i) < 0)
+			continue;
+		stream_is_active[i + MAX_PCM_OUTPUT_CHANNELS + MAX_SPDIF_CHANNELS + MAX_INPUT_CHANNELS] = 1;
+	}
+	if (ctlclient_connected())
+		return;		/* as mixer_stereo_received() */
+	for (i = 0; i < STREAMS; i++)
+		stream_is_stereo[i] = config_get_stereo(i + 1);
+}
@@ -0,0 +1,518 @@
+/*****************************************************************************
+   osc.c - Open Sound Control server on the loopback interface
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+******************************************************************************/
+
+/*
+ * With --osc, OSC messages on UDP port <port> of 127.0.0.1 (only) set and
+ * read every control of controls.c by the path
+ *   /mudita24/<control>[/<index>[/<channel>]]
+ * where <control> is its name in lower case with '_' for the rest, e.g.
+ * /mudita24/multi_playback_volume/3 or /mudita24/h_w_playback_route/0.
+ * Arguments set the channels from the first, or from <channel>: an int
+ * is the control's own value (the attenuation, the item of an enumeration,
+ * 0 or 1), a float or T/F goes from 0 to 1 over its range, spaced in dB
+ * for the attenuators as by --midi_nrpn. Without arguments, the control's
+ * values are sent back as ints on the same path.
+ *
+ * /mudita24/list answers with a /mudita24/list message per control on the
+ * card (its path and number of channels), /mudita24/ping with /mudita24/pong
+ * and the same int arguments, and /mudita24/meters [1|0] (un)subscribes
+ * the sender to the meter frames: /mudita24/meters with a blob of the
+ * MULTI_TRACK_PEAK_CHANNELS hardware peaks (0-255) each time they are read.
+ *
+ * The datagrams read in one go, bundles and all, are applied as one batch
+ * of writes like the MIDI input, coalesced per control. Bundles are
+ * applied as they arrive, whatever their time tag. A control's type and
+ * range are looked up once (control_range()), so a write costs no ioctl
+ * of its own until the queued writes are flushed.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "controls.h"
+#include "midi.h"
+
+#define OSC_PREFIX		"/mudita24/"
+#define OSC_MAX_PACKET		8192
+#define OSC_MAX_ARGS		32
+#define OSC_MAX_DEPTH		8	/* of nested bundles */
+#define OSC_MAX_SUBSCRIBERS	8
+#define OSC_PING_TIMEOUT	1000	/* ms */
+
+typedef struct {
+	char type;		/* 'i' or 'f' */
+	gint32 i;
+	float f;
+} osc_arg_t;
+
+typedef struct {
+	char data[OSC_MAX_PACKET];
+	int len;		/* > OSC_MAX_PACKET: overflowed */
+} osc_packet_t;
+
+static int sock = -1;
+static guint sock_input = 0;
+static char *slugs[CTL_COUNT];
+static struct sockaddr_in subscribers[OSC_MAX_SUBSCRIBERS];
+static int nsubscribers = 0;
+
+/* The string at 'pos', padded to 4 bytes; NULL if there is none */
+static const char *read_string(const char *buf, int len, int *pos)
+{
+	const char *s = buf + *pos, *end;
+
+	if (*pos >= len || (end = memchr(s, 0, len - *pos)) == NULL)
+		return NULL;
+	*pos += ((end - s) + 4) & ~3;
+	return *pos <= len ? s : NULL;
+}
+
+static int read_int32(const char *buf, int len, int *pos, guint32 *v)
+{
+	if (len - *pos < 4)
+		return FALSE;
+	memcpy(v, buf + *pos, 4);
+	*v = ntohl(*v);
+	*pos += 4;
+	return TRUE;
+}
+
+static void put_bytes(osc_packet_t *p, const void *data, int size)
+{
+	int padded = (size + 3) & ~3;
+
+	if (p->len + padded > OSC_MAX_PACKET) {
+		p->len = OSC_MAX_PACKET + 1;
+		return;
+	}
+	memcpy(p->data + p->len, data, size);
+	memset(p->data + p->len + size, 0, padded - size);
+	p->len += padded;
+}
+
+static void put_string(osc_packet_t *p, const char *s)
+{
+	put_bytes(p, s, strlen(s) + 1);
+}
+
+static void put_int32(osc_packet_t *p, guint32 v)
+{
+	v = htonl(v);
+	put_bytes(p, &v, 4);
+}
+
+static void send_packet(const osc_packet_t *p, const struct sockaddr_in *to)
+{
+	if (p->len <= OSC_MAX_PACKET)
+		sendto(sock, p->data, p->len, 0, (const struct sockaddr *)to, sizeof(*to));
+}
+
+/* "H/W Playback Route" -> "h_w_playback_route" */
+static char *control_slug(const char *name)
+{
+	char *slug = g_malloc(strlen(name) + 1), *s = slug;
+
+	for (; *name; name++) {
+		if (g_ascii_isalnum(*name))
+			*s++ = g_ascii_tolower(*name);
+		else if (s > slug && s[-1] != '_')
+			*s++ = '_';
+	}
+	while (s > slug && s[-1] == '_')
+		s--;
+	*s = '\0';
+	return slug;
+}
+
+/* Parse "<control>[/<index>[/<channel>]]"; FALSE if it is none */
+static int parse_control(const char *path, control_t *c, int *index, int *channel)
+{
+	const char *slash = strchr(path, '/');
+	char *end;
+	size_t n = slash ? (size_t)(slash - path) : strlen(path);
+	int i;
+
+	for (i = 0; i < CTL_COUNT; i++)
+		if (strlen(slugs[i]) == n && !strncmp(slugs[i], path, n))
+			break;
+	if (i == CTL_COUNT)
+		return FALSE;
+	*c = i;
+	*index = 0;
+	*channel = -1;
+	if (slash) {
+		*index = strtol(slash + 1, &end, 10);
+		if (end == slash + 1)
+			return FALSE;
+		if (*end == '/') {
+			slash = end;
+			*channel = strtol(slash + 1, &end, 10);
+			if (end == slash + 1 || *channel < 0)
+				return FALSE;
+		}
+		if (*end)
+			return FALSE;
+	}
+	return *index >= 0 && *index < MAX_CONTROL_INDEX;
+}
+
+/* Set 'channel' of 'index' of control 'c' by 'arg'; TRUE if it changed */
+static int set_value(control_t c, int index, int channel, const osc_arg_t *arg)
+{
+	const control_range_t *r = control_range(c, index);
+	double f = CLAMP(arg->f, 0.0, 1.0);
+	long v;
+
+	if (arg->type == 'i')
+		v = arg->i;
+	else if (r->type != SND_CTL_ELEM_TYPE_INTEGER ||
+		 !midi_scale_value(c, (int)(f * MIDI_VALUE_MAX + 0.5), &v) || v < r->min || v > r->max)
+		v = r->min + (long)((r->max - r->min) * f + 0.5);
+	return control_set(c, index, channel, v);
+}
+
+static void reply_values(const char *path, control_t c, int index, const struct sockaddr_in *from)
+{
+	osc_packet_t *p = g_new(osc_packet_t, 1);
+	char tags[OSC_MAX_ARGS + 2];
+	int i, n = MIN(control_range(c, index)->count, OSC_MAX_ARGS);
+
+	control_read(c, index);
+	tags[0] = ',';
+	memset(tags + 1, 'i', n);
+	tags[n + 1] = '\0';
+	p->len = 0;
+	put_string(p, path);
+	put_string(p, tags);
+	for (i = 0; i < n; i++)
+		put_int32(p, control_get(c, index, i));
+	send_packet(p, from);
+	g_free(p);
+}
+
+static void control_message(const char *path, const osc_arg_t *args, int nargs,
+			    const struct sockaddr_in *from)
+{
+	const control_range_t *r;
+	control_t c;
+	int index, channel, i, changed = FALSE;
+
+	if (!parse_control(path + strlen(OSC_PREFIX), &c, &index, &channel))
+		return;
+	r = control_range(c, index);
+	if (r->type != SND_CTL_ELEM_TYPE_BOOLEAN && r->type != SND_CTL_ELEM_TYPE_INTEGER &&
+	    r->type != SND_CTL_ELEM_TYPE_ENUMERATED)
+		return;
+	if (!nargs) {
+		reply_values(path, c, index, from);
+		return;
+	}
+	if (!r->writable)
+		return;
+	control_read(c, index);
+	if (channel >= 0) {
+		changed = set_value(c, index, channel, &args[0]);
+	} else {
+		for (i = 0; i < nargs; i++)
+			changed |= set_value(c, index, i, &args[i]);
+	}
+	if (changed)
+		control_queue(c, index);
+}
+
+static void list_controls(const struct sockaddr_in *from)
+{
+	osc_packet_t *p = g_new(osc_packet_t, 1);
+	char path[64];
+	int c, index;
+
+	for (c = 0; c < CTL_COUNT; c++) {
+		for (index = 0; index < MAX_CONTROL_INDEX; index++) {
+			if (control_range(c, index)->type == SND_CTL_ELEM_TYPE_NONE)
+				continue;
+			snprintf(path, sizeof(path), OSC_PREFIX "%s/%d", slugs[c], index);
+			p->len = 0;
+			put_string(p, OSC_PREFIX "list");
+			put_string(p, ",si");
+			put_string(p, path);
+			put_int32(p, control_range(c, index)->count);
+			send_packet(p, from);
+		}
+	}
+	g_free(p);
+}
+
+static void subscribe_meters(int subscribe, const struct sockaddr_in *from)
+{
+	int i;
+
+	for (i = 0; i < nsubscribers; i++)
+		if (subscribers[i].sin_port == from->sin_port &&
+		    subscribers[i].sin_addr.s_addr == from->sin_addr.s_addr)
+			break;
+	if (subscribe && i == nsubscribers && nsubscribers < OSC_MAX_SUBSCRIBERS)
+		subscribers[nsubscribers++] = *from;
+	else if (!subscribe && i < nsubscribers)
+		subscribers[i] = subscribers[--nsubscribers];
+	else
+		return;
+	if (nsubscribers <= 1)	/* the first came or the last left */
+		metering_changed();
+}
+
+static void ping(const osc_arg_t *args, int nargs, const struct sockaddr_in *from)
+{
+	osc_packet_t p;
+	char tags[OSC_MAX_ARGS + 2];
+	int i, n = 0;
+
+	tags[0] = ',';
+	for (i = 0; i < nargs; i++)
+		if (args[i].type == 'i')
+			tags[++n] = 'i';
+	tags[n + 1] = '\0';
+	p.len = 0;
+	put_string(&p, OSC_PREFIX "pong");
+	put_string(&p, tags);
+	for (i = 0; i < nargs; i++)
+		if (args[i].type == 'i')
+			put_int32(&p, args[i].i);
+	send_packet(&p, from);
+}
+
+static void handle_message(const char *buf, int len, const struct sockaddr_in *from)
+{
+	osc_arg_t args[OSC_MAX_ARGS];
+	const char *path, *tags;
+	guint32 v;
+	int pos = 0, nargs = 0;
+
+	if ((path = read_string(buf, len, &pos)) == NULL ||
+	    strncmp(path, OSC_PREFIX, strlen(OSC_PREFIX)))
+		return;
+	if ((tags = read_string(buf, len, &pos)) == NULL || tags[0] != ',')
+		tags = ",";
+	for (tags++; *tags && nargs < OSC_MAX_ARGS; tags++) {
+		switch (*tags) {
+		case 'i':
+			if (!read_int32(buf, len, &pos, &v))
+				return;
+			args[nargs].type = 'i';
+			args[nargs].i = (gint32)v;
+			args[nargs++].f = 0;
+			break;
+		case 'f':
+			if (!read_int32(buf, len, &pos, &v))
+				return;
+			args[nargs].type = 'f';
+			memcpy(&args[nargs++].f, &v, 4);
+			break;
+		case 'T':
+		case 'F':
+			args[nargs].type = 'f';
+			args[nargs++].f = *tags == 'T';
+			break;
+		default:
+			/* strings, blobs and the rest mean nothing to a control */
+			return;
+		}
+	}
+
+	path += strlen(OSC_PREFIX);
+	if (!strcmp(path, "ping"))
+		ping(args, nargs, from);
+	else if (!strcmp(path, "list"))
+		list_controls(from);
+	else if (!strcmp(path, "meters"))
+		subscribe_meters(!nargs || (args[0].type == 'i' ? args[0].i != 0 : args[0].f >= 0.5), from);
+	else
+		control_message(path - strlen(OSC_PREFIX), args, nargs, from);
+}
+
+static void handle_packet(const char *buf, int len, const struct sockaddr_in *from, int depth)
+{
+	guint32 size;
+	int pos = 16;		/* "#bundle", time tag */
+
+	if (len < 8 || memcmp(buf, "#bundle", 8)) {
+		handle_message(buf, len, from);
+		return;
+	}
+	if (depth >= OSC_MAX_DEPTH)
+		return;
+	while (read_int32(buf, len, &pos, &size) && size <= (guint32)(len - pos)) {
+		handle_packet(buf + pos, size, from, depth + 1);
+		pos += size;
+	}
+}
+
+/* Apply all the datagrams waiting as one batch of writes */
+static gboolean osc_input(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+	static char buf[OSC_MAX_PACKET];
+	struct sockaddr_in from;
+	socklen_t fromlen;
+	int len;
+
+	controls_batch_begin();
+	for (;;) {
+		fromlen = sizeof(from);
+		if ((len = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr *)&from, &fromlen)) < 0)
+			break;
+		if (len % 4 == 0)
+			handle_packet(buf, len, &from, 0);
+	}
+	controls_batch_end();
+	return TRUE;
+}
+
+/* Some client wants the meter frames */
+int osc_metering(void)
+{
+	return nsubscribers > 0;
+}
+
+/* The meters were read into 'peaks': send them to the subscribers */
+void osc_meters(snd_ctl_elem_value_t *peaks)
+{
+	osc_packet_t p;
+	guint8 levels[MULTI_TRACK_PEAK_CHANNELS];
+	int i;
+
+	if (!nsubscribers)
+		return;
+	for (i = 0; i < MULTI_TRACK_PEAK_CHANNELS; i++)
+		levels[i] = CLAMP(snd_ctl_elem_value_get_integer(peaks, i), 0, MAX_METERING_LEVEL);
+	p.len = 0;
+	put_string(&p, OSC_PREFIX "meters");
+	put_string(&p, ",b");
+	put_int32(&p, sizeof(levels));
+	put_bytes(&p, levels, sizeof(levels));
+	for (i = 0; i < nsubscribers; i++)
+		send_packet(&p, &subscribers[i]);
+}
+
+static void loopback_address(struct sockaddr_in *addr, int port)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_port = htons(port);
+	addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+}
+
+/*
+ * Serve OSC on UDP 'port' of the loopback interface; call after
+ * controls_init(). Returns 0 or a negative errno.
+ */
+int osc_init(int port)
+{
+	struct sockaddr_in addr;
+	int c, err;
+
+	if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+		return -errno;
+	loopback_address(&addr, port);
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		err = -errno;
+		close(sock);
+		sock = -1;
+		return err;
+	}
+	fcntl(sock, F_SETFL, O_NONBLOCK);
+	for (c = 0; c < CTL_COUNT; c++)
+		slugs[c] = control_slug(control_name(c));
+	sock_input = watch_fd(sock, WATCH_READ, osc_input, NULL);
+	return 0;
+}
+
+void osc_close(void)
+{
+	int c;
+
+	if (sock < 0)
+		return;
+	g_source_remove(sock_input);
+	close(sock);
+	sock = -1;
+	nsubscribers = 0;
+	for (c = 0; c < CTL_COUNT; c++)
+		g_free(slugs[c]), slugs[c] = NULL;
+}
+
+/*
+ * Ping the server on 'port' of this host 'count' times, one at a time,
+ * and print the round trip times. Returns 0 if all were answered.
+ */
+int osc_ping(int port, int count)
+{
+	struct sockaddr_in addr;
+	struct pollfd pfd;
+	osc_packet_t p;
+	char buf[OSC_MAX_PACKET];
+	const char *path;
+	guint32 seq;
+	gint64 sent, rtt, rtt_min = 0, rtt_max = 0, rtt_sum = 0;
+	int fd, i, len, pos, answered = 0;
+
+	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+		return -errno;
+	loopback_address(&addr, port);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -errno;
+	}
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	for (i = 0; i < count; i++) {
+		p.len = 0;
+		put_string(&p, OSC_PREFIX "ping");
+		put_string(&p, ",i");
+		put_int32(&p, i);
+		sent = monotonic_usec();
+		if (send(fd, p.data, p.len, 0) < 0)
+			break;
+		for (;;) {
+			if (poll(&pfd, 1, OSC_PING_TIMEOUT) <= 0 || (len = recv(fd, buf, sizeof(buf), 0)) < 0)
+				break;
+			pos = 0;
+			if ((path = read_string(buf, len, &pos)) == NULL || strcmp(path, OSC_PREFIX "pong") ||
+			    read_string(buf, len, &pos) == NULL || !read_int32(buf, len, &pos, &seq) ||
+			    seq != (guint32)i)
+				continue;	/* a late pong */
+			rtt = monotonic_usec() - sent;
+			if (!answered || rtt < rtt_min)
+				rtt_min = rtt;
+			if (rtt > rtt_max)
+				rtt_max = rtt;
+			rtt_sum += rtt;
+			answered++;
+			break;
+		}
+	}
+	close(fd);
+	printf("OSC ping of port %i: %i of %i answered", port, answered, count);
+	if (answered)
+		printf(", round trip min %.3f avg %.3f max %.3f ms",
+		       rtt_min / 1000.0, rtt_sum / 1000.0 / answered, rtt_max / 1000.0);
+	printf("\n");
+	return answered == count ? 0 : -ETIMEDOUT;
+}
@@ -19,9 +19,6 @@
 
 #include "envy24control.h"
 
-#define SPDIF_PLAYBACK_ROUTE_NAME	"IEC958 Playback Route"
-#define ANALOG_PLAYBACK_ROUTE_NAME	"H/W Playback Route"
-
 #define toggle_set(widget, state) \
 	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(widget), state);
 
@@ -33,28 +30,31 @@ static int is_active(GtkWidget *widget)
 	return gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget)) ? 1 : 0;
 }
 
+/* The route control of 0-based 'stream', and its index */
+static control_t route_control(int stream, int *index)
+{
+	if (stream >= MAX_OUTPUT_CHANNELS) {
+		*index = stream - MAX_OUTPUT_CHANNELS;
+		return CTL_IEC958_PLAYBACK_ROUTE;
+	}
+	*index = stream;
+	return CTL_HW_PLAYBACK_ROUTE;
+}
+
 static int get_toggle_index(int stream)
 {
-	int err, out;
-	snd_ctl_elem_value_t *val;
+	int err, out, index;
+	control_t c;
 
 	stream--;
 	if (stream < 0 || stream > 9) {
 		g_print("get_toggle_index (1)\n");
 		return 0;
 	}
-	snd_ctl_elem_value_alloca(&val);
-	snd_ctl_elem_value_set_interface(val, SND_CTL_ELEM_IFACE_MIXER);
-	if (stream >= MAX_OUTPUT_CHANNELS) {
-		snd_ctl_elem_value_set_name(val, SPDIF_PLAYBACK_ROUTE_NAME);
-		snd_ctl_elem_value_set_index(val, stream - MAX_OUTPUT_CHANNELS);
-	} else {
-		snd_ctl_elem_value_set_name(val, ANALOG_PLAYBACK_ROUTE_NAME);
-		snd_ctl_elem_value_set_index(val, stream);
-	}
-	if ((err = snd_ctl_elem_read(ctl, val)) < 0)
+	c = route_control(stream, &index);
+	if ((err = control_read(c, index)) < 0)
 		return 0;
-	out = snd_ctl_elem_value_get_enumerated(val, 0);
+	out = snd_ctl_elem_value_get_enumerated(control_value(c, index), 0);
 	if (out >= MAX_INPUT_CHANNELS + MAX_SPDIF_CHANNELS + 1) {
 		if (stream >= MAX_PCM_OUTPUT_CHANNELS || stream < MAX_SPDIF_CHANNELS)
 			return 1; /* digital mixer */
@@ -80,9 +80,9 @@ void patchbay_update(void)
 
 static void set_routes(int stream, int idx)
 {
-	int err;
+	int err, index;
 	unsigned int out;
-	snd_ctl_elem_value_t *val;
+	control_t c;
 
 	stream--;
 	if (stream < 0 || stream > 9) {
@@ -99,18 +99,9 @@ static void set_routes(int stream, int idx)
 	else if (idx >= 4) /* analog */
 		out = idx - 3; /* 1-8 */
 
-	snd_ctl_elem_value_alloca(&val);
-	snd_ctl_elem_value_set_interface(val, SND_CTL_ELEM_IFACE_MIXER);
-	if (stream >= MAX_OUTPUT_CHANNELS) {
-		snd_ctl_elem_value_set_name(val, SPDIF_PLAYBACK_ROUTE_NAME);
-		snd_ctl_elem_value_set_index(val, stream - MAX_OUTPUT_CHANNELS);
-	} else {
-		snd_ctl_elem_value_set_name(val, ANALOG_PLAYBACK_ROUTE_NAME);
-		snd_ctl_elem_value_set_index(val, stream);
-	}
-
-	snd_ctl_elem_value_set_enumerated(val, 0, out);
-	if ((err = snd_ctl_elem_write(ctl, val)) < 0)
+	c = route_control(stream, &index);
+	snd_ctl_elem_value_set_enumerated(control_value(c, index), 0, out);
+	if ((err = control_write(c, index)) < 0)
 		g_print("Multi track route write error: %s\n", snd_strerror(err));
 }
 
@@ -132,29 +123,20 @@ void patchbay_init(void)
 {
 	int i;
 	int nb_active_channels;
-	snd_ctl_elem_value_t *val;
 
-	snd_ctl_elem_value_alloca(&val);
-	snd_ctl_elem_value_set_interface(val, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(val, ANALOG_PLAYBACK_ROUTE_NAME);
 	memset (stream_active, 0, (MAX_OUTPUT_CHANNELS + MAX_SPDIF_CHANNELS) * sizeof(int));
 	nb_active_channels = 0;
 	for (i = 0; i < output_channels; i++) {
-		snd_ctl_elem_value_set_numid(val, 0);
-		snd_ctl_elem_value_set_index(val, i);
-		if (snd_ctl_elem_read(ctl, val) < 0)
+		if (control_read(CTL_HW_PLAYBACK_ROUTE, i) < 0)
 			continue;
 
 		stream_active[i] = 1;
 		nb_active_channels++;
 	}
 	output_channels = nb_active_channels;
-	snd_ctl_elem_value_set_name(val, SPDIF_PLAYBACK_ROUTE_NAME);
 	nb_active_channels = 0;
 	for (i = 0; i < spdif_channels; i++) {
-		snd_ctl_elem_value_set_numid(val, 0);
-		snd_ctl_elem_value_set_index(val, i);
- 		if (snd_ctl_elem_read(ctl, val) < 0)
+ 		if (control_read(CTL_IEC958_PLAYBACK_ROUTE, i) < 0)
 			continue;
 		stream_active[i + MAX_OUTPUT_CHANNELS] = 1;
 		nb_active_channels++;
@@ -0,0 +1,243 @@
+/*****************************************************************************
+   peaksampler.c - High-rate sampling of the hardware peak meters
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+******************************************************************************/
+
+/*
+ * The "Multi Track Peak" register resets itself each time it is read
+ * ("Reading the register resets the meter to 00h"), so reading it only from
+ * envy24control_poll() collapses each 100ms window into a single value.
+ * When --peak_sample_rate is given, a dedicated thread reads the 22 peak
+ * values at that rate, on its own snd_ctl handle, and pushes timestamped
+ * frames into a single-producer/single-consumer ring. The GUI side drains
+ * the ring once per envy24control_poll() into a peak_aggregate_t: the max
+ * of each channel over all frames since the last poll. A full-scale frame
+ * anywhere in the window thus reaches the max and shows as a clip in the
+ * held peak, however briefly the signal clipped.
+ *
+ * The ring is lock-free: only the sampler thread writes 'ring_head', only
+ * the GUI thread writes 'ring_tail'. Should the GUI stall long enough to
+ * fill the ring, new frames are dropped and counted in 'overruns'.
+ *
+ * While nothing shows or feeds the meters the poll scheduler suspends
+ * them, and peak_sampler_pause() parks the thread on a condition variable
+ * until peak_sampler_resume(), so that it stops reading the card.
+ */
+
+#include <time.h>
+#include <pthread.h>
+#include "controls.h"
+
+#define PEAK_RING_SIZE 1024	/* must be a power of 2; >1s of frames at 1kHz */
+#define PEAK_RING_MASK (PEAK_RING_SIZE - 1)
+
+typedef struct {
+	guint64 timestamp;	/* usec, CLOCK_MONOTONIC */
+	unsigned char level[MULTI_TRACK_PEAK_CHANNELS];
+	unsigned char meter[MULTI_TRACK_PEAK_CHANNELS]; /* ballistics output, if ballistics_active() */
+	unsigned char hold[MULTI_TRACK_PEAK_CHANNELS];
+} peak_frame_t;
+
+static peak_frame_t ring[PEAK_RING_SIZE];
+static volatile unsigned int ring_head = 0; /* written only by sampler thread */
+static volatile unsigned int ring_tail = 0; /* written only by GUI thread */
+static volatile unsigned int overruns = 0;
+
+static pthread_t sampler_thread;
+static pthread_mutex_t sampler_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sampler_wakeup = PTHREAD_COND_INITIALIZER;
+static volatile int sampler_running = FALSE;
+static int sampler_paused = FALSE;	/* under sampler_lock */
+static snd_ctl_t *sampler_ctl = NULL;
+static snd_ctl_elem_value_t *sampler_peaks = NULL;
+static long sampler_period_ns = 0;
+
+/* Microseconds on a clock that neither jumps nor stops with the wall clock */
+gint64 monotonic_usec(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (gint64)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void *peak_sampler_main(void *arg)
+{
+	struct timespec next;
+	peak_frame_t *frame;
+	unsigned int head;
+	int i, err;
+	int ballistics = ballistics_active();
+	double dt = sampler_period_ns / 1e9;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (sampler_running) {
+		pthread_mutex_lock(&sampler_lock);
+		if (sampler_paused) {
+			while (sampler_paused && sampler_running)
+				pthread_cond_wait(&sampler_wakeup, &sampler_lock);
+			clock_gettime(CLOCK_MONOTONIC, &next); /* don't catch up on the pause */
+			if (ballistics)
+				ballistics_reset();
+		}
+		pthread_mutex_unlock(&sampler_lock);
+		next.tv_nsec += sampler_period_ns;
+		while (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+		if ((err = snd_ctl_elem_read(sampler_ctl, sampler_peaks)) < 0)
+			continue; /* e.g. -EBUSY while the card is reconfigured; try next period */
+
+		head = ring_head;
+		if (head - ring_tail >= PEAK_RING_SIZE) { /* GUI fell behind, drop frame */
+			overruns++;
+			continue;
+		}
+		frame = &ring[head & PEAK_RING_MASK];
+		frame->timestamp = monotonic_usec();
+		for (i = 0; i < MULTI_TRACK_PEAK_CHANNELS; i++)
+			frame->level[i] = snd_ctl_elem_value_get_integer(sampler_peaks, i);
+		if (ballistics) {
+			ballistics_process(frame->level, dt);
+			ballistics_get(frame->meter, frame->hold);
+		}
+		__sync_synchronize(); /* publish frame contents before advancing head */
+		ring_head = head + 1;
+	}
+	return NULL;
+}
+
+/*
+ * Drain all frames queued since the previous call into 'agg'. Returns the
+ * number of frames consumed; when zero, 'agg->level[]' is all zero just as
+ * a direct read of the self-resetting hardware register would be.
+ */
+int peak_sampler_consume(peak_aggregate_t *agg)
+{
+	unsigned int head, tail;
+	peak_frame_t *frame;
+	int i;
+
+	memset(agg, 0, sizeof(*agg));
+	head = ring_head;
+	__sync_synchronize(); /* read head before reading the frames it covers */
+	for (tail = ring_tail; tail != head; tail++) {
+		frame = &ring[tail & PEAK_RING_MASK];
+		for (i = 0; i < MULTI_TRACK_PEAK_CHANNELS; i++)
+			if (frame->level[i] > agg->level[i])
+				agg->level[i] = frame->level[i];
+		agg->timestamp = frame->timestamp;
+		agg->frames++;
+	}
+	if (agg->frames) {	/* ballistics state is that of the newest frame */
+		frame = &ring[(tail - 1) & PEAK_RING_MASK];
+		memcpy(agg->meter, frame->meter, sizeof(agg->meter));
+		memcpy(agg->hold, frame->hold, sizeof(agg->hold));
+	}
+	__sync_synchronize(); /* finish reading frames before releasing the slots */
+	ring_tail = tail;
+	agg->overruns = overruns;
+	return agg->frames;
+}
+
+int peak_sampler_running(void)
+{
+	return sampler_running;
+}
+
+/* Stop reading the card until peak_sampler_resume() */
+void peak_sampler_pause(void)
+{
+	pthread_mutex_lock(&sampler_lock);
+	sampler_paused = TRUE;
+	pthread_mutex_unlock(&sampler_lock);
+}
+
+/*
+ * Sample again. The frames left over from before the pause are stale, so
+ * they are dropped rather than aggregated into the next poll.
+ */
+void peak_sampler_resume(void)
+{
+	pthread_mutex_lock(&sampler_lock);
+	if (sampler_paused) {
+		sampler_paused = FALSE;
+		ring_tail = ring_head;
+		pthread_cond_signal(&sampler_wakeup);
+	}
+	pthread_mutex_unlock(&sampler_lock);
+}
+
+/*
+ * Open a private control handle on 'ctl_name' and start sampling "Multi
+ * Track Peak" 'rate' times per second. Returns 0 or a negative errno.
+ */
+int peak_sampler_start(const char *ctl_name, int rate)
+{
+	int err;
+
+	if (sampler_running)
+		return -EBUSY;
+	if (rate < MIN_PEAK_SAMPLE_RATE || rate > MAX_PEAK_SAMPLE_RATE)
+		return -EINVAL;
+	if ((err = snd_ctl_open(&sampler_ctl, ctl_name, 0)) < 0)
+		return err;
+	snd_ctl_elem_value_malloc(&sampler_peaks);
+	snd_ctl_elem_value_set_interface(sampler_peaks, SND_CTL_ELEM_IFACE_PCM);
+	snd_ctl_elem_value_set_name(sampler_peaks, "Multi Track Peak");
+	if (snd_ctl_elem_read(sampler_ctl, sampler_peaks) < 0) {
+		/* older ALSA driver, using MIXER type */
+		snd_ctl_elem_value_set_interface(sampler_peaks, SND_CTL_ELEM_IFACE_MIXER);
+		if ((err = snd_ctl_elem_read(sampler_ctl, sampler_peaks)) < 0)
+			goto __error;
+	}
+
+	sampler_period_ns = 1000000000L / rate;
+	ring_head = ring_tail = overruns = 0;
+	sampler_paused = FALSE;
+	sampler_running = TRUE;
+	if ((err = pthread_create(&sampler_thread, NULL, peak_sampler_main, NULL)) != 0) {
+		sampler_running = FALSE;
+		err = -err;
+		goto __error;
+	}
+	return 0;
+
+ __error:
+	snd_ctl_elem_value_free(sampler_peaks);
+	sampler_peaks = NULL;
+	snd_ctl_close(sampler_ctl);
+	sampler_ctl = NULL;
+	return err;
+}
+
+void peak_sampler_stop(void)
+{
+	if (!sampler_running)
+		return;
+	pthread_mutex_lock(&sampler_lock);
+	sampler_running = FALSE;
+	pthread_cond_signal(&sampler_wakeup); /* wake it if paused */
+	pthread_mutex_unlock(&sampler_lock);
+	pthread_join(sampler_thread, NULL);
+	snd_ctl_elem_value_free(sampler_peaks);
+	sampler_peaks = NULL;
+	snd_ctl_close(sampler_ctl);
+	sampler_ctl = NULL;
+}
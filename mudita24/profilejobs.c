@@ -0,0 +1,367 @@
+/*****************************************************************************
+   profilejobs.c - Save, restore and delete profiles on a worker thread
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+******************************************************************************/
+
+/*
+ * Saving, restoring and deleting profiles read and write the profiles file
+ * and the card for as long as that takes; run in the GTK signal handlers
+ * they froze the meters and MIDI input meanwhile. Instead they are queued
+ * as jobs for a worker thread, which has its own snd_ctl handle like the
+ * peak sampler. The worker reports the start of each job (progress) and
+ * its end (completion) through a pipe, watched on the main loop like the
+ * card's events, so the callbacks run there.
+ *
+ * A job still queued can be cancelled, and a restore supersedes the
+ * restores still waiting: clicking through profiles only recalls the last
+ * one. A job that is running always completes, so that neither the file
+ * nor the card is left half changed.
+ *
+ * A GUI that is a client of mudita24d has the daemon run its jobs, which
+ * are finished when it answers.
+ */
+
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include "controls.h"
+
+typedef struct {
+	profile_job_t *job;
+	int state;		/* PROFILE_JOB_RUNNING, _DONE or _CANCELLED */
+} job_note_t;
+
+static pthread_t worker_thread;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static profile_job_t *queue_head = NULL;
+static profile_job_t *queue_tail = NULL;
+static volatile int worker_running = FALSE;
+static snd_ctl_t *worker_ctl = NULL;
+static int worker_card_number;
+static char *worker_cfgfile;
+static int note_pipe[2] = { -1, -1 };
+static guint note_input = 0;
+
+static void post_note(profile_job_t *job, int state)
+{
+	job_note_t note;
+
+	note.job = job;
+	note.state = state;
+	/* smaller than PIPE_BUF, so written whole */
+	while (write(note_pipe[1], &note, sizeof(note)) < 0 && errno == EINTR)
+		;
+}
+
+static void free_job(profile_job_t *job)
+{
+	g_free(job->profile_name);
+	g_free(job);
+}
+
+static void run_job(profile_job_t *job)
+{
+	switch (job->operation) {
+	case PROFILE_JOB_RESTORE:
+		job->result = save_restore(ALSACTL_OP_RESTORE, job->profile_number, worker_card_number, worker_cfgfile, NULL);
+		break;
+	case PROFILE_JOB_SAVE:
+		job->result = save_restore(ALSACTL_OP_STORE, job->profile_number, worker_card_number, worker_cfgfile, job->profile_name);
+		break;
+	case PROFILE_JOB_DELETE:
+		job->result = delete_card(worker_card_number, worker_cfgfile);
+		break;
+	case PROFILE_JOB_PRELOAD:
+		job->result = preload_profiles(worker_card_number, worker_cfgfile);
+		break;
+	default:
+		job->result = -EINVAL;
+		break;
+	}
+	job->finished = monotonic_usec();
+}
+
+static void *profile_worker_main(void *arg)
+{
+	profile_job_t *job;
+
+	pthread_mutex_lock(&queue_mutex);
+	while (worker_running) {
+		if ((job = queue_head) == NULL) {
+			pthread_cond_wait(&queue_cond, &queue_mutex);
+			continue;
+		}
+		if ((queue_head = job->next) == NULL)
+			queue_tail = NULL;
+		job->state = PROFILE_JOB_RUNNING;
+		pthread_mutex_unlock(&queue_mutex);
+
+		post_note(job, PROFILE_JOB_RUNNING);
+		run_job(job);
+		post_note(job, PROFILE_JOB_DONE);
+
+		pthread_mutex_lock(&queue_mutex);
+	}
+	pthread_mutex_unlock(&queue_mutex);
+	return NULL;
+}
+
+/* Run the callbacks of the notes posted by the worker, on the main loop */
+static gboolean profile_jobs_input(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+	job_note_t note;
+	profile_job_t *job;
+
+	while (read(note_pipe[0], &note, sizeof(note)) == sizeof(note)) {
+		job = note.job;
+		job->state = note.state;
+		if (note.state == PROFILE_JOB_RUNNING) {
+			if (job->progress != NULL)
+				job->progress(job, job->data);
+			continue;
+		}
+		if (job->done != NULL)
+			job->done(job, job->data);
+		free_job(job);
+	}
+	return TRUE;
+}
+
+/* Take 'job' out of the queue; queue_mutex must be held */
+static int unqueue_job(profile_job_t *job)
+{
+	profile_job_t **link;
+
+	for (link = &queue_head; *link != NULL; link = &(*link)->next) {
+		if (*link != job)
+			continue;
+		*link = job->next;
+		if (queue_tail == job) {
+			for (queue_tail = queue_head; queue_tail != NULL && queue_tail->next != NULL; queue_tail = queue_tail->next)
+				;
+		}
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/*
+ * Cancel 'job' if it is still queued: its completion callback then runs
+ * with the state PROFILE_JOB_CANCELLED and the result -ECANCELED. Returns
+ * 0, or -EBUSY if the job is already running.
+ */
+int profile_job_cancel(profile_job_t *job)
+{
+	int cancelled;
+
+	pthread_mutex_lock(&queue_mutex);
+	if ((cancelled = (job->state == PROFILE_JOB_QUEUED) && unqueue_job(job))) {
+		job->state = PROFILE_JOB_CANCELLED;
+		job->result = -ECANCELED;
+	}
+	pthread_mutex_unlock(&queue_mutex);
+	if (!cancelled)
+		return -EBUSY;
+	post_note(job, PROFILE_JOB_CANCELLED);
+	return 0;
+}
+
+/*
+ * Queue a profile operation: PROFILE_JOB_RESTORE, _SAVE (under
+ * 'profile_name'), _DELETE of the card's profiles, or _PRELOAD of its
+ * compiled profiles. 'progress' (when the job starts) and 'done' run on
+ * the main loop and may be NULL. Without a worker the job runs here and
+ * then, and NULL is returned; otherwise the job, valid until 'done' has
+ * returned. A client of mudita24d gets NULL too if the job could not be
+ * sent, 'done' having been called.
+ */
+profile_job_t *profile_job_submit(int operation, int profile_number, const char *profile_name,
+				  profile_job_callback_t progress, profile_job_callback_t done, gpointer data)
+{
+	profile_job_t *job, *queued, *next;
+
+	job = g_new0(profile_job_t, 1);
+	job->submitted = monotonic_usec();
+	job->operation = operation;
+	job->profile_number = profile_number;
+	job->profile_name = g_strdup(profile_name);
+	job->state = PROFILE_JOB_QUEUED;
+	job->progress = progress;
+	job->done = done;
+	job->data = data;
+
+	/* let pending volume writes land before they are stored or overwritten */
+	if (operation == PROFILE_JOB_SAVE || operation == PROFILE_JOB_RESTORE)
+		controls_flush();
+
+	if (ctlclient_connected()) {
+		job->state = PROFILE_JOB_RUNNING;	/* not to be cancelled from here */
+		if (progress != NULL)
+			progress(job, data);
+		return ctlclient_profile(job) ? job : NULL;
+	}
+
+	if (!worker_running) {
+		job->state = PROFILE_JOB_RUNNING;
+		if (progress != NULL)
+			progress(job, data);
+		run_job(job);
+		job->state = PROFILE_JOB_DONE;
+		if (done != NULL)
+			done(job, data);
+		free_job(job);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&queue_mutex);
+	if (operation == PROFILE_JOB_RESTORE) {
+		for (queued = queue_head; queued != NULL; queued = next) {
+			next = queued->next;
+			if (queued->operation != PROFILE_JOB_RESTORE)
+				continue;
+			unqueue_job(queued);
+			queued->state = PROFILE_JOB_CANCELLED;
+			queued->result = -ECANCELED;
+			post_note(queued, PROFILE_JOB_CANCELLED);
+		}
+	}
+	if (queue_tail != NULL)
+		queue_tail->next = job;
+	else
+		queue_head = job;
+	queue_tail = job;
+	pthread_cond_signal(&queue_cond);
+	pthread_mutex_unlock(&queue_mutex);
+	return job;
+}
+
+/* The name of 'profile_number' in the profiles the jobs work on */
+const char *profile_jobs_name(int profile_number)
+{
+	return get_profile_name(profile_number, worker_card_number, worker_cfgfile);
+}
+
+/* The highest profile number stored for the card, 0 if none */
+int profile_jobs_max_number(void)
+{
+	return get_max_profile_number(worker_card_number, worker_cfgfile);
+}
+
+/* 'job' was run elsewhere, with 'result': complete it as the worker does */
+void profile_job_finish(profile_job_t *job, int result)
+{
+	job->result = result;
+	job->state = result == -ECANCELED ? PROFILE_JOB_CANCELLED : PROFILE_JOB_DONE;
+	job->finished = monotonic_usec();
+	if (job->done != NULL)
+		job->done(job, job->data);
+	free_job(job);
+}
+
+/*
+ * Start the worker for the profiles of 'card_number' in 'cfgfile', with a
+ * control handle of its own on 'ctl_name'. Returns 0 or a negative errno.
+ */
+int profile_jobs_start(const char *ctl_name, int card_number, char *cfgfile)
+{
+	int err;
+
+	if (worker_running)
+		return -EBUSY;
+	/* also the profiles of the jobs run here, should the worker not start */
+	worker_card_number = card_number;
+	worker_cfgfile = cfgfile;
+	if ((err = snd_ctl_open(&worker_ctl, ctl_name, 0)) < 0)
+		return err;
+	if (pipe(note_pipe) < 0) {
+		err = -errno;
+		goto __ctl;
+	}
+	fcntl(note_pipe[0], F_SETFL, O_NONBLOCK);
+	set_profiles_ctl(worker_ctl);
+
+	worker_running = TRUE;
+	if ((err = pthread_create(&worker_thread, NULL, profile_worker_main, NULL)) != 0) {
+		worker_running = FALSE;
+		err = -err;
+		goto __pipe;
+	}
+	note_input = watch_fd(note_pipe[0], WATCH_READ, profile_jobs_input, NULL);
+	return 0;
+
+ __pipe:
+	set_profiles_ctl(NULL);
+	close(note_pipe[0]);
+	close(note_pipe[1]);
+	note_pipe[0] = note_pipe[1] = -1;
+ __ctl:
+	snd_ctl_close(worker_ctl);
+	worker_ctl = NULL;
+	return err;
+}
+
+/* Drop the jobs still queued, let the running one finish and stop the worker */
+void profile_jobs_stop(void)
+{
+	profile_job_t *job;
+	job_note_t note;
+
+	if (!worker_running)
+		return;
+	pthread_mutex_lock(&queue_mutex);
+	while ((job = queue_head) != NULL) {
+		queue_head = job->next;
+		free_job(job);
+	}
+	queue_tail = NULL;
+	worker_running = FALSE;
+	pthread_cond_signal(&queue_cond);
+	pthread_mutex_unlock(&queue_mutex);
+	pthread_join(worker_thread, NULL);
+
+	/* the main loop is gone, free what it didn't see finish */
+	g_source_remove(note_input);
+	while (read(note_pipe[0], &note, sizeof(note)) == sizeof(note)) {
+		if (note.state != PROFILE_JOB_RUNNING)
+			free_job(note.job);
+	}
+	close(note_pipe[0]);
+	close(note_pipe[1]);
+	note_pipe[0] = note_pipe[1] = -1;
+	set_profiles_ctl(NULL);
+	snd_ctl_close(worker_ctl);
+	worker_ctl = NULL;
+}
+
+static void (*recall_hook)(int profile_number) = NULL;
+
+/* Have 'recalled' show each profile recalled, e.g. on its toggle */
+void recall_profile_hook(void (*recalled)(int profile_number))
+{
+	recall_hook = recalled;
+}
+
+/*
+ * Restore profile_number on behalf of MIDI or a client, showing it as the
+ * active profile, also if it already was: the mix may have changed since.
+ */
+void recall_profile(int profile_number, profile_job_callback_t done, gpointer data)
+{
+	if (recall_hook != NULL)
+		recall_hook(profile_number);
+	profile_job_submit(PROFILE_JOB_RESTORE, profile_number, NULL, NULL, done, data);
+}
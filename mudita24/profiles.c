@@ -1,6 +1,6 @@
 /*
  *  Advanced Linux Sound Architecture part of envy24control
- *  handle profiles for envy24control using alsactl
+ *  handle profiles for envy24control in alsactl's file format
  * 
  *  Copyright (c) by Dirk Kalis <dirk.kalis@t-online.de>
  *
@@ -22,20 +22,76 @@
  */
 
 #define __PROFILES_C__
-#include "envy24control.h"
+#include "controls.h"
 #undef __PROFILES_C__
 
+#include <pthread.h>
+
 /* include string search function */
 #include "strstr_icase_blank.c"
 
-/* include forking process function */
-#include "new_process.c"
-
 /* replace tilde with home directory */
 static char filename_without_tilde[MAX_FILE_NAME_LENGTH];
 
 static char profile_name[PROFILE_NAME_FIELD_LENGTH];
 
+/*
+ * Profiles are saved and restored on the worker of profilejobs.c while the
+ * GUI looks up profile names: the exported functions at the end of this
+ * file hold this lock, as the index, the scene cache and the buffers above
+ * are shared. They use the worker's own control handle once it is set.
+ */
+static pthread_mutex_t profiles_mutex = PTHREAD_MUTEX_INITIALIZER;
+static snd_ctl_t *profiles_ctl = NULL;
+
+static snd_ctl_t *get_profiles_ctl(void)
+{
+	return profiles_ctl != NULL ? profiles_ctl : ctl;
+}
+
+/*
+ * Offsets of all sections of a profiles buffer. Rescanning the buffer with
+ * strstr_icase_blank() for every section looked up made reorganize_profiles()
+ * and get_profile_number() quadratic in the size of the file. Instead
+ * index_profiles() tokenizes the buffer once, line by line, and the get_*()
+ * functions only look up the offsets here, profiles by number and card
+ * sections by profile name through hash tables, so neither the number of
+ * profiles nor the size of the file is limited.
+ * The index belongs to the buffer it was built from and must be invalidated
+ * whenever that buffer is changed or refilled.
+ */
+typedef struct {
+	int begin;		/* card header */
+	int end;		/* next profile or card header, or own card footer */
+	int next;		/* line after own card footer, else end */
+	int name_header;	/* profile name header, or NOTFOUND */
+	int alsa_begin;		/* first line of the alsa settings, or NOTFOUND */
+} card_section_t;
+
+typedef struct {
+	int number;
+	int begin;		/* profile header */
+	int end;		/* next profile header or end of buffer */
+	int card_number_max;	/* highest card header number in the profile */
+	card_section_t card[MAX_CARD_NUMBERS];
+} profile_section_t;
+
+static struct {
+	const char *buffer;	/* buffer indexed, NULL if none */
+	profile_section_t *profile;	/* sorted by profile number */
+	int profiles;
+	int allocated;
+	GHashTable *numbers;	/* profile number -> position in profile[] + 1 */
+	GHashTable *names;	/* "<card number> <profile name>" -> profile number */
+	int first_begin;	/* first profile header in the buffer */
+	int irregular;		/* sections that reorganize_profiles() would change */
+} profiles_index;
+
+static void invalidate_profiles_index(void)
+{
+	profiles_index.buffer = NULL;
+}
+
 /*
  * check the environment and use the set variables
  */
@@ -90,59 +146,106 @@ int which_cfgfile(char ** const cfgfile)
 	return res;
 }
 
-int get_file_size(const char * const filename)
+/*
+ * Map the profiles file for reading. The string functions need a '\0' after
+ * the last character: the rest of the last page of a mapping is zero filled,
+ * so the file is mapped unless it ends exactly on a page boundary, in which
+ * case it is read into an allocated buffer instead. The mapping is private,
+ * the buffer can be changed up to and including buffer[*length] without
+ * changing the file. Returns the buffer, or NULL with errno set.
+ */
+static char *open_profiles(const char * const cfgfile, size_t * const length)
 {
 	struct stat file_status;
+	char *buffer;
+	int inputFile, res;
 
-	strncpy(filename_without_tilde, filename, MAX_FILE_NAME_LENGTH);
-	filename_without_tilde[MAX_FILE_NAME_LENGTH - 1] = '\0';
-	subst_tilde_in_filename(filename_without_tilde);
-	if (stat(filename_without_tilde, &file_status) < 0) {
-		fprintf(stderr, "Cannot find file '%s'.\n", filename);
-		return -errno;
+	invalidate_profiles_index();
+	if ((inputFile = open(cfgfile, O_RDONLY)) < 0) {
+		fprintf(stderr, "warning: can't open profiles file '%s' for reading.\n", cfgfile);
+		return NULL;
+	}
+	if (fstat(inputFile, &file_status) < 0) {
+		close(inputFile);
+		return NULL;
+	}
+	*length = file_status.st_size;
+	if (*length % sysconf(_SC_PAGESIZE)) {
+		if ((buffer = mmap(NULL, *length, PROT_READ | PROT_WRITE, MAP_PRIVATE, inputFile, 0)) == MAP_FAILED)
+			buffer = NULL;
+	} else if ((buffer = malloc(*length + 1)) != NULL) {
+		if ((res = read(inputFile, buffer, *length)) < 0) {
+			free(buffer);
+			buffer = NULL;
+		} else {
+			buffer[res] = '\0';
+		}
 	}
+	close(inputFile);
+	return buffer;
+}
 
-	return (int)file_status.st_size;
+static void close_profiles(char * const buffer, const size_t length)
+{
+	if (buffer == NULL)
+		return;
+	if (length % sysconf(_SC_PAGESIZE))
+		munmap(buffer, length);
+	else
+		free(buffer);
 }
 
-int read_profiles_in_buffer(const char * const cfgfile, void * const buffer, const size_t max_length)
+static int write_all(const int outputFile, const char *text, size_t length)
 {
-	int res;
-	int inputFile;
+	ssize_t res;
 
-	if ((inputFile = open(cfgfile, O_RDONLY)) < 0) {
-		fprintf(stderr, "warning: can't open profiles file '%s' for reading.\n", cfgfile);
-		return -errno;
-	}
-	res = read(inputFile, buffer, max_length);
-	close(inputFile);
-	*(char *)(buffer + max_length - 1) = '\0';
-	if (res == max_length) {
-		fprintf(stderr, "warning: profiles file '%s' has maximum size reached.\n", cfgfile);
-		fprintf(stderr, "\tThe defined value for MAX_PROFILE_SIZE must be increased in 'profiles.h'.\n");
-		fprintf(stderr, "\tThen you must recompile the '%s' tool.\n", PROGRAM_NAME);
-		fprintf(stderr, "\tThe current value is %d.\n", MAX_PROFILE_SIZE);
+	while (length > 0)
+	{
+		if ((res = write(outputFile, text, length)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		text += res;
+		length -= res;
 	}
-
-	return res;
+	return EXIT_SUCCESS;
 }
 
 /*
- * write buffer with max_length to cfgfile
- * with introduction if with_intro != 0
+ * Write the introduction and the 'count' pieces of text to cfgfile without
+ * ever leaving a partly written profiles file behind: the text goes to a
+ * temporary file in the same directory, which is synced and then renamed
+ * over cfgfile, so after a crash there is either the old or the new file.
+ * A mapping of the old file stays valid.
+ * Returns the number of bytes written or a negative errno.
  */
-int write_profiles_from_buffer(const char * const cfgfile, const void * const buffer, const size_t max_length, const int with_intro)
+static int write_profiles(const char * const cfgfile, const struct iovec * const pieces, const int count)
 {
-	int res, length;
+	int res, length, piece;
 	time_t date_time[MAX_NUM_STR_LENGTH];
 	char introduction_part[MAX_SEARCH_FIELD_LENGTH];
-	int outputFile;
-
-	if ((outputFile = open(cfgfile, O_WRONLY | O_CREAT | O_TRUNC | 0400000 /* O_NOFOLLOW */, FILE_CREA_MODE)) < 0) {
-		fprintf(stderr, "warning: can't open profiles file '%s' for writing.\n", cfgfile);
+	char tmpfile[MAX_FILE_NAME_LENGTH + 8];
+	char dirname[MAX_FILE_NAME_LENGTH];
+	struct stat file_status;
+	mode_t mode;
+	int outputFile, dir;
+
+	/* like O_NOFOLLOW, don't replace a symbolic link */
+	mode = FILE_CREA_MODE;
+	if (lstat(cfgfile, &file_status) == 0) {
+		if (S_ISLNK(file_status.st_mode)) {
+			fprintf(stderr, "warning: can't write profiles file '%s', it is a symbolic link.\n", cfgfile);
+			return -ELOOP;
+		}
+		mode = file_status.st_mode & 07777;
+	}
+	snprintf(tmpfile, sizeof(tmpfile), "%s.XXXXXX", cfgfile);
+	if ((outputFile = mkstemp(tmpfile)) < 0) {
+		fprintf(stderr, "warning: can't open profiles file '%s' for writing.\n", tmpfile);
 		return -errno;
 	}
-	length = max_length > strlen(buffer) ? strlen(buffer) : max_length;
+	fchmod(outputFile, mode);
 	time(date_time);
 	snprintf(introduction_part, MAX_SEARCH_FIELD_LENGTH, "%s'%s'%s%s%s'%s'%s%s%s%s%s%s%s%s%s\n", \
 							"#\n" \
@@ -162,42 +265,85 @@ int write_profiles_from_buffer(const char * const cfgfile, const void * const bu
 							"#\n");
 
 	introduction_part[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-	if (with_intro)
-		res = write(outputFile, introduction_part, strlen(introduction_part));
-	res = write(outputFile, buffer, length);
-	close(outputFile);
+	length = strlen(introduction_part);
+	res = write_all(outputFile, introduction_part, length);
+	for (piece = 0; (piece < count) && (res >= 0); piece++)
+	{
+		res = write_all(outputFile, pieces[piece].iov_base, pieces[piece].iov_len);
+		length += pieces[piece].iov_len;
+	}
+	if ((res >= 0) && (fsync(outputFile) < 0))
+		res = -errno;
+	if ((close(outputFile) < 0) && (res >= 0))
+		res = -errno;
+	if ((res >= 0) && (rename(tmpfile, cfgfile) < 0))
+		res = -errno;
 	if (res < 0) {
-		fprintf(stderr, "warning: can't write profiles file '%s'.\n", cfgfile);
+		unlink(tmpfile);
+		fprintf(stderr, "warning: can't write profiles file '%s': %s\n", cfgfile, strerror(-res));
+		return res;
+	}
+	/* the rename is only durable once the directory is synced */
+	strncpy(dirname, cfgfile, MAX_FILE_NAME_LENGTH);
+	dirname[MAX_FILE_NAME_LENGTH - 1] = '\0';
+	if (strrchr(dirname, '/') != NULL)
+		*strrchr(dirname, '/') = '\0';
+	else
+		strcpy(dirname, ".");
+	if ((dir = open(dirname[0] != '\0' ? dirname : "/", O_RDONLY)) >= 0) {
+		fsync(dir);
+		close(dir);
 	}
 
-	return res;
+	return length;
+}
+
+/*
+ * Serialize the writers of cfgfile, also those in other processes: the
+ * read-modify-write of save_profile() and delete_card() holds an exclusive
+ * lock on '<cfgfile>.lock' until the new file is in place.
+ * Returns the lock to pass to unlock_profiles() or a negative errno.
+ */
+static int lock_profiles(const char * const cfgfile)
+{
+	char lockfile[MAX_FILE_NAME_LENGTH + 8];
+	int lock;
+
+	snprintf(lockfile, sizeof(lockfile), "%s.lock", cfgfile);
+	if ((lock = open(lockfile, O_RDWR | O_CREAT | O_NOFOLLOW, FILE_CREA_MODE)) < 0) {
+		fprintf(stderr, "warning: can't open lock file '%s'.\n", lockfile);
+		return -errno;
+	}
+	while (flock(lock, LOCK_EX) < 0)
+	{
+		if (errno != EINTR) {
+			close(lock);
+			return -errno;
+		}
+	}
+	return lock;
+}
+
+static void unlock_profiles(const int lock)
+{
+	if (lock >= 0)
+		close(lock);
 }
 
 int create_dir_from_filename(const char * const filename)
 {
-	int res;
 	char pathname[MAX_FILE_NAME_LENGTH];
-	char * parameter[MAX_PARAM];
-	char *mkdir;
-
-	mkdir = check_environment("MKDIR_PROG", MKDIR);
 
 	strncpy(pathname, filename, MAX_FILE_NAME_LENGTH);
 	pathname[MAX_FILE_NAME_LENGTH - 1] = '\0';
 
 	*strrchr(pathname, '/') = '\0';
 	subst_tilde_in_filename(pathname);
-	
-	parameter[0] = mkdir;
-	parameter[1] = "-p";
-	parameter[2] = "-m";
-	parameter[3] = DIR_CREA_MODE;
-	parameter[4] = pathname;
-	parameter[5] = NULL;
-	
-	res = new_process(parameter);
-	
-	return res;
+
+	/* like 'mkdir -p', without running it */
+	if (g_mkdir_with_parents(pathname, DIR_CREA_MODE) < 0)
+		return -errno;
+	return EXIT_SUCCESS;
 }
 
 int compose_search_string(char * const search_string, const char * const templ, const char * const value, const char place_holder, const int max_length)
@@ -239,165 +385,52 @@ int get_start_of_line(const char * const buffer, const int offset)
 }
 
 /*
- * search tokens sequential for the furthest token backwards from section_end
- * tokens should be specified from nearest token to the furthest
+ * Copy the line 'src' of 'length' characters to 'dst' the way
+ * strstr_icase_blank() compares it: upper case, runs of blanks replaced by
+ * a single SEP_CHAR, no leading or trailing blanks.
+ * Returns the offset of the first non blank character in 'src', or NOTFOUND
+ * for an empty line.
  */
-int get_begin_of_section(const char * const buffer, char * const section_tokens, const char * const token_sep, const int section_end)
+static int normalize_line(char * const dst, const char * const src, const int length)
 {
-	char *search_token;
-	int pos_start_of_section, pos_end_of_section, pos_end_of_search;
+	int i, j, first;
 
-	search_token = strtok(section_tokens, token_sep);
-
-	pos_end_of_search = section_end;
-	do
+	first = NOTFOUND;
+	for (i = 0, j = 0; (i < length) && (j < MAX_SEARCH_FIELD_LENGTH - 1); i++)
 	{
-		pos_start_of_section = 0;
-		pos_end_of_section = 0;
-		while ((pos_start_of_section = strstr_icase_blank(buffer + pos_end_of_section, search_token)) < pos_end_of_search - pos_end_of_section)
-		{
-			if (pos_start_of_section < 0)
-				break;
-			pos_end_of_section += pos_start_of_section;
-			pos_end_of_section++;
-		}
-		pos_end_of_section--;
-		pos_start_of_section = pos_end_of_section;
-		pos_end_of_search = pos_end_of_section;
-		if (pos_start_of_section < 0) {
-			pos_start_of_section = NOTFOUND;
-			// fprintf(stderr, "Begin of section for '%s' can't be found\n", search_token);
-			return pos_start_of_section;
+		if (isblank(src[i]) || (src[i] == '\n')) {
+			if ((j > 0) && (dst[j - 1] != SEP_CHAR))
+				dst[j++] = SEP_CHAR;
+			continue;
 		}
-	} while ((search_token = strtok(NULL, token_sep)) != NULL);
+		if (first < 0)
+			first = i;
+		dst[j++] = (char)toupper(src[i]);
+	}
+	if ((j > 0) && (dst[j - 1] == SEP_CHAR))
+		j--;
+	dst[j] = '\0';
 
-	return pos_start_of_section;
+	return first;
 }
 
 /*
- * search tokens sequential for the nearest token from section_begin
- * tokens should be specified from furthest token to the nearest
+ * normalized form of the template 'templ' up to its place holder,
+ * or of the whole template with 'value' in place of the place holder
  */
-int get_end_of_section(const char * const buffer, char * const section_tokens, const char * const token_sep, const int section_begin)
-{
-	char *search_token;
-	int pos_end_of_section, pos_end_of_search;
-
-	search_token = strtok(section_tokens, token_sep);
-
-	pos_end_of_section = strlen(buffer);
-	do
-	{
-		pos_end_of_search = strstr_icase_blank(buffer + section_begin, search_token);
-		if (!((pos_end_of_search < 0) || (pos_end_of_search > pos_end_of_section))) {
-			pos_end_of_section = pos_end_of_search;
-		}
-	} while ((search_token = strtok(NULL, token_sep)) != NULL);
-
-	return pos_end_of_section == strlen(buffer) ? pos_end_of_section : pos_end_of_section + section_begin;
-}
-
-int get_profile_begin(const char * const buffer, const int profile_number)
-{
-	char header[MAX_SEARCH_FIELD_LENGTH], profile_or_card_number_as_str[MAX_NUM_STR_LENGTH];
-	char place_holder;
-
-	/* compose profile header */
-	place_holder = PLACE_HOLDER_NUM;
-	snprintf(profile_or_card_number_as_str, MAX_NUM_STR_LENGTH, "%d", profile_number);
-	profile_or_card_number_as_str[MAX_NUM_STR_LENGTH - 1] = '\0';
-	compose_search_string(header, PROFILE_HEADER_TEMPL, profile_or_card_number_as_str, place_holder, MAX_SEARCH_FIELD_LENGTH);
-	header[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-	return strstr_icase_blank(buffer, header);
-}
-
-int get_profile_end(const char * const buffer, const int profile_number)
+static void normalize_template(char * const dst, const char * const templ, const char * const value, const char place_holder)
 {
 	char header[MAX_SEARCH_FIELD_LENGTH];
-	char place_holder;
-	int pos_profile_begin;
-
-	if ((pos_profile_begin = get_profile_begin(buffer, profile_number)) < 0)
-		return pos_profile_begin;
-	place_holder = PLACE_HOLDER_NUM;
-	strncpy(header, PROFILE_HEADER_TEMPL, MAX_SEARCH_FIELD_LENGTH);
-	header[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-	*strchr(header, place_holder) = '\0';
-	return get_end_of_section(buffer, header, TOKEN_SEP, pos_profile_begin + sizeof(char));
-}
-
-int get_card_begin(const char * const buffer, const int profile_number, const int card_number)
-{
-	char header[MAX_SEARCH_FIELD_LENGTH], profile_or_card_number_as_str[MAX_NUM_STR_LENGTH];
-	char place_holder;
-	int pos_profile_begin, pos_profile_end, pos_card_begin;
-
-	if ((pos_profile_begin = get_profile_begin(buffer, profile_number)) < 0)
-		return pos_profile_begin;
-	pos_profile_end = get_profile_end(buffer, profile_number);
-
-	/* compose card header */
-	place_holder = PLACE_HOLDER_NUM;
-	snprintf(profile_or_card_number_as_str, MAX_NUM_STR_LENGTH, "%d", card_number);
-	profile_or_card_number_as_str[MAX_NUM_STR_LENGTH - 1] = '\0';
-	compose_search_string(header, CARD_HEADER_TEMPL, profile_or_card_number_as_str, place_holder, MAX_SEARCH_FIELD_LENGTH);
-	header[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-	if ((pos_card_begin = strstr_icase_blank(buffer + pos_profile_begin, header)) < 0)
-		return pos_card_begin;
-	if ((pos_card_begin += pos_profile_begin) > pos_profile_end)
-		return NOTFOUND;
-	return pos_card_begin;
-}
-
-int get_card_end(const char * const buffer, const int profile_number, const int card_number)
-{
-	char header[MAX_SEARCH_FIELD_LENGTH], profile_or_card_number_as_str[MAX_NUM_STR_LENGTH];
-	char place_holder;
-	int pos_card_begin;
-
-	if ((pos_card_begin = get_card_begin(buffer, profile_number, card_number)) < 0)
-		return pos_card_begin;
-	/* searching "[ profile | < card | < /card # >" */
-	/* add "[ profile |" to search_field */
-	place_holder = PLACE_HOLDER_NUM;
-	snprintf(profile_or_card_number_as_str, MAX_NUM_STR_LENGTH, "%d", card_number);
-	profile_or_card_number_as_str[MAX_NUM_STR_LENGTH - 1] = '\0';
-	strncpy(header, PROFILE_HEADER_TEMPL, MAX_SEARCH_FIELD_LENGTH);
-	*strchr(header, place_holder) = '\0';
-	strncpy(header + strlen(header), TOKEN_SEP, MAX_SEARCH_FIELD_LENGTH - strlen(header));
-	header[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-	/* add "< card |" to header */
-	strncpy(header + strlen(header), CARD_HEADER_TEMPL, MAX_SEARCH_FIELD_LENGTH - strlen(header));
-	*strchr(header, place_holder) = '\0';
-	strncpy(header + strlen(header), TOKEN_SEP, MAX_SEARCH_FIELD_LENGTH - strlen(header));
-	header[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-	/* add "< /card # >" to header */
-	compose_search_string(header + strlen(header), CARD_FOOTER_TEMPL, profile_or_card_number_as_str, place_holder, MAX_SEARCH_FIELD_LENGTH - strlen(header));
-	header[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-	return get_end_of_section(buffer, header, TOKEN_SEP, pos_card_begin + sizeof(char));
-}
-
-int get_pos_for_next_card(const char * const buffer, const int profile_number, const int card_number)
-{
-	char header[MAX_SEARCH_FIELD_LENGTH], profile_or_card_number_as_str[MAX_NUM_STR_LENGTH];
-	char place_holder;
-	int pos_next_card;
 
-	if ((pos_next_card = get_card_end(buffer, profile_number, card_number)) < 0)
-		return pos_next_card;
-	/* add "< /card # >" to header */
-	place_holder = PLACE_HOLDER_NUM;
-	snprintf(profile_or_card_number_as_str, MAX_NUM_STR_LENGTH, "%d", card_number);
-	profile_or_card_number_as_str[MAX_NUM_STR_LENGTH - 1] = '\0';
-	compose_search_string(header, CARD_FOOTER_TEMPL, profile_or_card_number_as_str, place_holder, MAX_SEARCH_FIELD_LENGTH);
-	header[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-	if (strstr_icase_blank(buffer + pos_next_card, header) == 0) {
-		while((buffer[pos_next_card] != '\n') && (buffer[pos_next_card] != '\0'))
-			pos_next_card++;
-		if (buffer[pos_next_card] == '\n')
-			pos_next_card++;
+	if (value != NULL) {
+		compose_search_string(header, templ, value, place_holder, MAX_SEARCH_FIELD_LENGTH);
+	} else {
+		strncpy(header, templ, MAX_SEARCH_FIELD_LENGTH);
+		header[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
+		*strchr(header, place_holder) = '\0';
 	}
-	return pos_next_card;
+	header[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
+	normalize_line(dst, header, strlen(header));
 }
 
 int get_number_from_header(const char * const header_string)
@@ -438,116 +471,379 @@ char *get_profile_name_from_header(const char * const header_string)
 	return profile_name;
 }
 
-/* search max card number in profile */
-int get_max_card_number_in_profile(const char * const buffer, const int profile_number)
+static void close_card_section(card_section_t * const card, const int end, const int next)
 {
-	char header[MAX_SEARCH_FIELD_LENGTH];
-	char place_holder;
-	int pos_card_next, pos_profile_end, pos_card_begin, card_number, card_number_max;
+	if (card == NULL)
+		return;
+	card->end = end;
+	card->next = next;
+	if (end == next)	/* no card footer */
+		profiles_index.irregular++;
+}
 
-	place_holder = PLACE_HOLDER_NUM;
-	card_number_max = NOTFOUND;
-	strncpy(header, CARD_HEADER_TEMPL, MAX_SEARCH_FIELD_LENGTH);
-	header[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-	*strchr(header, place_holder) = '\0';
-	pos_card_next = get_profile_begin(buffer, profile_number);
-	pos_profile_end = get_profile_end(buffer, profile_number);
-	while ((pos_card_begin = strstr_icase_blank(buffer + pos_card_next, header)) >= 0)
-	{
-		if ((pos_card_begin += pos_card_next) > pos_profile_end)
-			break;
-		pos_card_next = pos_card_begin + sizeof(char);
-		card_number = get_number_from_header(buffer + pos_card_begin);
-		if (card_number > card_number_max)
-			card_number_max = card_number;
+static profile_section_t *add_profile_section(const int number, const int begin)
+{
+	profile_section_t *profile;
+	int card_number;
+
+	if (profiles_index.profiles == profiles_index.allocated) {
+		profiles_index.allocated = profiles_index.allocated ? 2 * profiles_index.allocated : 16;
+		profiles_index.profile = g_renew(profile_section_t, profiles_index.profile, profiles_index.allocated);
 	}
-	return card_number_max;
+	profile = &profiles_index.profile[profiles_index.profiles++];
+	profile->number = number;
+	profile->begin = begin;
+	profile->end = NOTFOUND;
+	profile->card_number_max = NOTFOUND;
+	for (card_number = 0; card_number < MAX_CARD_NUMBERS; card_number++)
+		profile->card[card_number].begin = NOTFOUND;
+	g_hash_table_insert(profiles_index.numbers, GINT_TO_POINTER(number), GINT_TO_POINTER(profiles_index.profiles));
+	return profile;
 }
 
-int get_pos_name_header_from_card(const char * const buffer, const int profile_number, const int card_number)
+static int compare_profile_sections(const void *a, const void *b)
 {
-	char header[MAX_SEARCH_FIELD_LENGTH];
-	char place_holder;
-	int pos_card_begin, pos_card_end, pos_name_header;
+	return ((const profile_section_t *)a)->number - ((const profile_section_t *)b)->number;
+}
 
-	pos_card_begin = get_card_begin(buffer, profile_number, card_number);
-	pos_card_end = get_card_end(buffer, profile_number, card_number);
-	place_holder = PLACE_HOLDER_STR;
-	strncpy(header, PROFILE_NAME_TEMPL, MAX_SEARCH_FIELD_LENGTH);
-	*strchr(header, place_holder) = '\0';
-	header[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-	if ((pos_name_header = strstr_icase_blank(buffer + pos_card_begin, header)) >= 0) {
-		if ((pos_name_header += pos_card_begin) < pos_card_end) {
-			return pos_name_header;
+static void index_profiles(const char * const buffer)
+{
+	static char profile_token[MAX_SEARCH_FIELD_LENGTH] = "";
+	static char card_token[MAX_SEARCH_FIELD_LENGTH];
+	static char footer_token[MAX_SEARCH_FIELD_LENGTH];
+	static char name_token[MAX_SEARCH_FIELD_LENGTH];
+	static char name_end_token[MAX_SEARCH_FIELD_LENGTH];
+	char line[MAX_SEARCH_FIELD_LENGTH], header[MAX_SEARCH_FIELD_LENGTH];
+	char number_as_str[MAX_NUM_STR_LENGTH];
+	int length, pos, line_end, next_line, first, number, nr, pos_after_alsa_section;
+	char *token, *name, *name_end, *key;
+	profile_section_t *profile = NULL;	/* profile section the line is in */
+	card_section_t *card = NULL;		/* card section the line is in */
+	int card_number = NOTFOUND;
+
+	if (profile_token[0] == '\0') {
+		normalize_template(card_token, CARD_HEADER_TEMPL, NULL, PLACE_HOLDER_NUM);
+		normalize_template(footer_token, CARD_FOOTER_TEMPL, NULL, PLACE_HOLDER_NUM);
+		normalize_template(name_token, PROFILE_NAME_TEMPL, NULL, PLACE_HOLDER_STR);
+		strncpy(header, strchr(PROFILE_NAME_TEMPL, PLACE_HOLDER_STR) + sizeof(char), MAX_SEARCH_FIELD_LENGTH);
+		header[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
+		normalize_line(name_end_token, header, strlen(header));
+		normalize_template(profile_token, PROFILE_HEADER_TEMPL, NULL, PLACE_HOLDER_NUM);
+		profiles_index.numbers = g_hash_table_new(g_direct_hash, g_direct_equal);
+		profiles_index.names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	}
+	profiles_index.profiles = 0;
+	profiles_index.irregular = 0;
+	g_hash_table_remove_all(profiles_index.numbers);
+	g_hash_table_remove_all(profiles_index.names);
+
+	length = strlen(buffer);
+	for (pos = 0; pos < length; pos = next_line)
+	{
+		line_end = pos + strcspn(buffer + pos, "\n");
+		next_line = buffer[line_end] == '\n' ? line_end + 1 : line_end;
+		/* no compare with comment lines or empty lines */
+		if ((first = normalize_line(line, buffer + pos, line_end - pos)) < 0)
+			continue;
+		if (buffer[pos + first] == '#')
+			continue;
+		if ((token = strstr(line, profile_token)) != NULL) {
+			number = pos + first + (token - line);
+			close_card_section(card, number, number);
+			card = NULL;
+			if (profile != NULL)
+				profile->end = number;
+			profile = NULL;
+			nr = get_number_from_header(buffer + number);
+			snprintf(number_as_str, MAX_NUM_STR_LENGTH, "%d", nr);
+			number_as_str[MAX_NUM_STR_LENGTH - 1] = '\0';
+			normalize_template(header, PROFILE_HEADER_TEMPL, number_as_str, PLACE_HOLDER_NUM);
+			if (strstr(line, header) == NULL) {
+				profiles_index.irregular++;
+				fprintf(stderr, "profile header '%.*s' has incorrect syntax.\n", line_end - pos, buffer + pos);
+				fprintf(stderr, "profile header syntax is '%s'\n" \
+						"by replacing place holder '%c' with profile number.\n", \
+						PROFILE_HEADER_TEMPL, PLACE_HOLDER_NUM);
+			} else if ((nr >= 1) && !g_hash_table_lookup(profiles_index.numbers, GINT_TO_POINTER(nr))) {
+				/* only the first header of a profile counts */
+				profile = add_profile_section(nr, number);
+			} else {
+				profiles_index.irregular++;
+			}
+		} else if ((token = strstr(line, card_token)) != NULL) {
+			number = pos + first + (token - line);
+			close_card_section(card, number, number);
+			card = NULL;
+			if (profile == NULL) {
+				profiles_index.irregular++;
+				continue;
+			}
+			nr = get_number_from_header(buffer + number);
+			if (nr > profile->card_number_max)
+				profile->card_number_max = nr;
+			snprintf(number_as_str, MAX_NUM_STR_LENGTH, "%d", nr);
+			number_as_str[MAX_NUM_STR_LENGTH - 1] = '\0';
+			normalize_template(header, CARD_HEADER_TEMPL, number_as_str, PLACE_HOLDER_NUM);
+			if ((strstr(line, header) != NULL) && (nr >= 0) && (nr < MAX_CARD_NUMBERS) && (profile->card[nr].begin < 0)) {
+				card = &profile->card[nr];
+				card_number = nr;
+				card->begin = number;
+				card->name_header = NOTFOUND;
+			} else {
+				profiles_index.irregular++;
+			}
+		} else if (card == NULL) {
+			continue;
+		} else if ((token = strstr(line, footer_token)) != NULL) {
+			snprintf(number_as_str, MAX_NUM_STR_LENGTH, "%d", card_number);
+			number_as_str[MAX_NUM_STR_LENGTH - 1] = '\0';
+			normalize_template(header, CARD_FOOTER_TEMPL, number_as_str, PLACE_HOLDER_NUM);
+			if ((token = strstr(line, header)) != NULL) {
+				close_card_section(card, pos + first + (token - line), next_line);
+				card = NULL;
+			}
+		} else if ((card->name_header < 0) && ((token = strstr(line, name_token)) != NULL)) {
+			card->name_header = pos + first + (token - line);
+			/* the first profile in the file with this name for the card wins */
+			name = token + strlen(name_token);
+			for (name_end = NULL; (token = strstr(token + 1, name_end_token)) != NULL; )
+				name_end = token;
+			if ((name_end == NULL) || (name_end < name))
+				continue;
+			*name_end = '\0';
+			key = g_strdup_printf("%d %s", card_number, name);
+			if (g_hash_table_lookup(profiles_index.names, key) == NULL)
+				g_hash_table_insert(profiles_index.names, key, GINT_TO_POINTER(profile->number));
+			else
+				g_free(key);
 		}
 	}
-	return NOTFOUND;
+	close_card_section(card, length, length);
+	if (profile != NULL)
+		profile->end = length;
+
+	profiles_index.first_begin = profiles_index.profiles > 0 ? profiles_index.profile[0].begin : length;
+	qsort(profiles_index.profile, profiles_index.profiles, sizeof(profile_section_t), compare_profile_sections);
+	for (nr = 0; nr < profiles_index.profiles; nr++)
+	{
+		profile = &profiles_index.profile[nr];
+		if ((nr > 0) && (profile->begin < profiles_index.profile[nr - 1].begin))
+			profiles_index.irregular++;	/* not sorted by number */
+		g_hash_table_insert(profiles_index.numbers, GINT_TO_POINTER(profile->number), GINT_TO_POINTER(nr + 1));
+		/* the alsa settings start on the line after the card or name header */
+		for (number = 0; number < MAX_CARD_NUMBERS; number++)
+		{
+			card = &profile->card[number];
+			if (card->begin < 0)
+				continue;
+			pos_after_alsa_section = get_start_of_line(buffer, card->end);
+			pos = card->name_header < 0 ? card->begin : card->name_header;
+			pos += strcspn(buffer + pos, "\n") + 1;
+			card->alsa_begin = pos < pos_after_alsa_section ? pos : NOTFOUND;
+		}
+	}
+	profiles_index.buffer = buffer;
+}
+
+static const profile_section_t *get_profile_section(const char * const buffer, const int profile_number)
+{
+	int position;
+
+	if (profiles_index.buffer != buffer)
+		index_profiles(buffer);
+	if ((position = GPOINTER_TO_INT(g_hash_table_lookup(profiles_index.numbers, GINT_TO_POINTER(profile_number)))) == 0)
+		return NULL;
+	return &profiles_index.profile[position - 1];
+}
+
+static const card_section_t *get_card_section(const char * const buffer, const int profile_number, const int card_number)
+{
+	const profile_section_t *profile;
+
+	if ((profile = get_profile_section(buffer, profile_number)) == NULL)
+		return NULL;
+	if ((card_number < 0) || (card_number >= MAX_CARD_NUMBERS))
+		return NULL;
+	if (profile->card[card_number].begin < 0)
+		return NULL;
+	return &profile->card[card_number];
+}
+
+/* number of the first profile in the file with a card section named profile_name */
+static int get_profile_number_by_name(const char * const buffer, const char * const profile_name, const int card_number)
+{
+	char name[MAX_SEARCH_FIELD_LENGTH];
+	char *key;
+	int profile_number;
+
+	if (profiles_index.buffer != buffer)
+		index_profiles(buffer);
+	normalize_line(name, profile_name, strlen(profile_name));
+	key = g_strdup_printf("%d %s", card_number, name);
+	profile_number = GPOINTER_TO_INT(g_hash_table_lookup(profiles_index.names, key));
+	g_free(key);
+	return profile_number > 0 ? profile_number : NOTFOUND;
+}
+
+/* highest profile number with a section for the card, 0 if none */
+static int get_max_profile_number_in_buffer(const char * const buffer, const int card_number)
+{
+	int position;
+
+	if (profiles_index.buffer != buffer)
+		index_profiles(buffer);
+	for (position = profiles_index.profiles - 1; position >= 0; position--)
+	{
+		if (get_card_section(buffer, profiles_index.profile[position].number, card_number) != NULL)
+			return profiles_index.profile[position].number;
+	}
+	return 0;
+}
+
+int get_profile_begin(const char * const buffer, const int profile_number)
+{
+	const profile_section_t *profile;
+
+	if ((profile = get_profile_section(buffer, profile_number)) == NULL)
+		return NOTFOUND;
+	return profile->begin;
+}
+
+int get_profile_end(const char * const buffer, const int profile_number)
+{
+	const profile_section_t *profile;
+
+	if ((profile = get_profile_section(buffer, profile_number)) == NULL)
+		return NOTFOUND;
+	return profile->end;
+}
+
+int get_card_begin(const char * const buffer, const int profile_number, const int card_number)
+{
+	const card_section_t *card;
+
+	if ((card = get_card_section(buffer, profile_number, card_number)) == NULL)
+		return NOTFOUND;
+	return card->begin;
+}
+
+int get_card_end(const char * const buffer, const int profile_number, const int card_number)
+{
+	const card_section_t *card;
+
+	if ((card = get_card_section(buffer, profile_number, card_number)) == NULL)
+		return NOTFOUND;
+	return card->end;
+}
+
+int get_pos_for_next_card(const char * const buffer, const int profile_number, const int card_number)
+{
+	const card_section_t *card;
+
+	if ((card = get_card_section(buffer, profile_number, card_number)) == NULL)
+		return NOTFOUND;
+	return card->next;
+}
+
+/* search max card number in profile */
+int get_max_card_number_in_profile(const char * const buffer, const int profile_number)
+{
+	const profile_section_t *profile;
+
+	if ((profile = get_profile_section(buffer, profile_number)) == NULL)
+		return NOTFOUND;
+	return profile->card_number_max;
+}
+
+int get_pos_name_header_from_card(const char * const buffer, const int profile_number, const int card_number)
+{
+	const card_section_t *card;
+
+	if ((card = get_card_section(buffer, profile_number, card_number)) == NULL)
+		return NOTFOUND;
+	return card->name_header;
 }
 
 int get_begin_of_alsa_section(const char * const buffer, const int profile_number, const int card_number)
 {
-	char search_string[MAX_SEARCH_FIELD_LENGTH];
-	int card_section_begin, card_section_end;
-	int begin_of_alsa_section, pos_after_alsa_section;
+	const card_section_t *card;
 
-	if ((card_section_begin = get_card_begin(buffer, profile_number, card_number)) < 0)
-		return card_section_begin;
-	card_section_end = get_card_end(buffer, profile_number, card_number);
-	strncpy(search_string, PROFILE_NAME_TEMPL, MAX_SEARCH_FIELD_LENGTH);
-	search_string[MAX_SEARCH_FIELD_LENGTH -1] = '\0';
-	*strchr(search_string, PLACE_HOLDER_STR) = '\0';
+	if ((card = get_card_section(buffer, profile_number, card_number)) == NULL)
+		return NOTFOUND;
+	return card->alsa_begin;
+}
 
-	pos_after_alsa_section = get_start_of_line(buffer, card_section_end);
+/* number of profile and card headers in the buffer */
+static int get_sections_in_buffer(const char * const buffer)
+{
+	int position, card_number, sections;
 
-	begin_of_alsa_section = strstr_icase_blank(buffer + card_section_begin, search_string);
-	begin_of_alsa_section = begin_of_alsa_section < 0 ? card_section_begin : begin_of_alsa_section + card_section_begin;
-	if (begin_of_alsa_section > pos_after_alsa_section)
-		begin_of_alsa_section = card_section_begin;
-	while (begin_of_alsa_section < pos_after_alsa_section)
+	if (profiles_index.buffer != buffer)
+		index_profiles(buffer);
+	sections = profiles_index.profiles;
+	for (position = 0; position < profiles_index.profiles; position++)
 	{
-		if (buffer[begin_of_alsa_section] == '\n') {
-			begin_of_alsa_section++;
-			break;
+		for (card_number = 0; card_number < MAX_CARD_NUMBERS; card_number++)
+		{
+			if (profiles_index.profile[position].card[card_number].begin >= 0)
+				sections++;
 		}
-		begin_of_alsa_section++;
 	}
+	return sections;
+}
+
+/* number of damaged or unsorted sections, that reorganize_profiles() would change */
+static int get_irregular_sections_in_buffer(const char * const buffer)
+{
+	if (profiles_index.buffer != buffer)
+		index_profiles(buffer);
+	return profiles_index.irregular;
+}
 
-	if (begin_of_alsa_section >= pos_after_alsa_section)
-		begin_of_alsa_section = NOTFOUND;
+/* begin of the first profile with a number higher than profile_number */
+static int get_begin_of_next_profile(const char * const buffer, const int profile_number)
+{
+	int position;
 
-	return begin_of_alsa_section;
+	if (profiles_index.buffer != buffer)
+		index_profiles(buffer);
+	for (position = 0; position < profiles_index.profiles; position++)
+	{
+		if (profiles_index.profile[position].number > profile_number)
+			return profiles_index.profile[position].begin;
+	}
+	return NOTFOUND;
 }
 
-int reorganize_profiles(char * const buffer, const int max_length)
+/*
+ * copy the profiles in buffer to reorganized, sorted by profile and card number
+ * and with all headers and footers in the syntax of the templates
+ * max_length must leave room for SECTION_HEADERS_LENGTH per section
+ */
+int reorganize_profiles(const char * const buffer, char * const reorganized, const int max_length)
 {
-	int profile_number, card_number, card_number_max;
-	int res;
-	int pos_profile_begin, pos_profile_end, pos_card_begin, pos_card_end, pos_name_header;
+	int position, profile_number, card_number, card_number_max;
+	int pos_card_begin, pos_card_end, pos_name_header;
 	int pos_alsa_section_begin, pos_after_alsa_section;
 	char header[MAX_SEARCH_FIELD_LENGTH];
-	void *buffer_copy = NULL;
 	char profile_or_card_number_as_str[MAX_NUM_STR_LENGTH];
 	char place_holder;
+	int length = 0;	/* appending at strlen(reorganized) is quadratic */
 
-	if ((buffer_copy = malloc(max_length)) == NULL) {
-		res = -ENOBUFS;
-		profile_number = res;
-		fprintf(stderr, "Cannot allocate memory for reorganize profiles.\n");
-		return res;
-	}
-	memset(buffer_copy, '\0', max_length);
-	for (profile_number = 1; profile_number <= MAX_PROFILES; profile_number++)
+	memset(reorganized, '\0', max_length);
+	if (profiles_index.buffer != buffer)
+		index_profiles(buffer);
+	for (position = 0; position < profiles_index.profiles; position++)
 	{
-		if ((pos_profile_begin = get_profile_begin(buffer, profile_number)) < 0)
-			continue;
+		profile_number = profiles_index.profile[position].number;
 		/* write profile header */
 		place_holder = PLACE_HOLDER_NUM;
 		snprintf(profile_or_card_number_as_str, MAX_NUM_STR_LENGTH, "%d", profile_number);
 		profile_or_card_number_as_str[MAX_NUM_STR_LENGTH - 1] = '\0';
 		compose_search_string(header, PROFILE_HEADER_TEMPL, profile_or_card_number_as_str, place_holder, MAX_SEARCH_FIELD_LENGTH);
 		header[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-		snprintf(buffer_copy + strlen(buffer_copy), max_length - strlen(buffer_copy), "%s\n", header);
-		pos_profile_end = get_profile_end(buffer, profile_number);
+		snprintf(reorganized + length, max_length - length, "%s\n", header);
+		length += strlen(reorganized + length);
 		/* search max card number in profile */
 		card_number_max = get_max_card_number_in_profile(buffer, profile_number);
 		for (card_number = 0; card_number <= card_number_max; card_number++)
@@ -560,19 +856,24 @@ int reorganize_profiles(char * const buffer, const int max_length)
 			profile_or_card_number_as_str[MAX_NUM_STR_LENGTH - 1] = '\0';
 			compose_search_string(header, CARD_HEADER_TEMPL, profile_or_card_number_as_str, place_holder, MAX_SEARCH_FIELD_LENGTH);
 			header[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-			snprintf(buffer_copy + strlen(buffer_copy), max_length - strlen(buffer_copy), "%s\n", header);
+			snprintf(reorganized + length, max_length - length, "%s\n", header);
+			length += strlen(reorganized + length);
 			pos_card_end = get_card_end(buffer, profile_number, card_number);
 			/* write profile name */
 			place_holder = PLACE_HOLDER_STR;
 			if ((pos_name_header = get_pos_name_header_from_card(buffer, profile_number, card_number)) >= 0) {
 				compose_search_string(header, PROFILE_NAME_TEMPL, get_profile_name_from_header(buffer + pos_name_header), place_holder, \
 						MAX_SEARCH_FIELD_LENGTH);
-				snprintf(buffer_copy + strlen(buffer_copy), max_length - strlen(buffer_copy), "%s\n", header);
+				snprintf(reorganized + length, max_length - length, "%s\n", header);
+				length += strlen(reorganized + length);
 			}
 			/* copy alsa section if exists */
 			if ((pos_alsa_section_begin = get_begin_of_alsa_section(buffer, profile_number, card_number)) >= 0) {
 				pos_after_alsa_section = get_start_of_line(buffer, pos_card_end);
-				strncpy(buffer_copy + strlen(buffer_copy), buffer + pos_alsa_section_begin, pos_after_alsa_section - pos_alsa_section_begin);
+				if (pos_after_alsa_section - pos_alsa_section_begin < max_length - length) {
+					memcpy(reorganized + length, buffer + pos_alsa_section_begin, pos_after_alsa_section - pos_alsa_section_begin);
+					length += pos_after_alsa_section - pos_alsa_section_begin;
+				}
 			}
 			/* write card footer */
 			place_holder = PLACE_HOLDER_NUM;
@@ -580,71 +881,304 @@ int reorganize_profiles(char * const buffer, const int max_length)
 			profile_or_card_number_as_str[MAX_NUM_STR_LENGTH - 1] = '\0';
 			compose_search_string(header, CARD_FOOTER_TEMPL, profile_or_card_number_as_str, place_holder, MAX_SEARCH_FIELD_LENGTH);
 			header[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-			snprintf(buffer_copy + strlen(buffer_copy), max_length - strlen(buffer_copy), "%s\n", header);
+			snprintf(reorganized + length, max_length - length, "%s\n", header);
+			length += strlen(reorganized + length);
 		}
 	}
-	memset(buffer, '\0', max_length);
-	strncpy(buffer, buffer_copy, max_length);
-	buffer[max_length - 1] = '\0';
-	free(buffer_copy);
-	buffer_copy = NULL;
+	reorganized[max_length - 1] = '\0';
 	return EXIT_SUCCESS;
 }
 
-int delete_card_from_profile(char * const buffer, const int profile_number, const int card_number, const int max_length)
+static int compare_card_sections(const void *a, const void *b)
 {
-	int pos_card_begin, pos_next_card;
-	char *buffer_copy = NULL;
+	return (*(const card_section_t * const *)a)->begin - (*(const card_section_t * const *)b)->begin;
+}
 
-	if ((pos_card_begin = get_card_begin(buffer, profile_number, card_number)) < 0)
-		return pos_card_begin;
-	if ((buffer_copy = malloc(max_length)) == NULL) {
-		fprintf(stderr, "Cannot allocate memory for reading profiles.\n");
-		fprintf(stderr, "Cannot delete card '%d' from profile '%d'.\n", card_number, profile_number);
-		return -ENOBUFS;
+/*
+ * the pieces of the buffer from the first profile on without the sections of
+ * the card in any profile, for write_profiles()
+ * returns the number of pieces in *pieces, to be freed with g_free()
+ */
+static int get_pieces_without_card(const char * const buffer, const int card_number, struct iovec ** const pieces)
+{
+	const card_section_t **cards;
+	int position, count, pos_from;
+
+	if (profiles_index.buffer != buffer)
+		index_profiles(buffer);
+	cards = g_new(const card_section_t *, profiles_index.profiles + 1);
+	for (position = 0, count = 0; position < profiles_index.profiles; position++)
+	{
+		if ((card_number >= 0) && (card_number < MAX_CARD_NUMBERS) && \
+		    (profiles_index.profile[position].card[card_number].begin >= 0))
+			cards[count++] = &profiles_index.profile[position].card[card_number];
+	}
+	qsort(cards, count, sizeof(cards[0]), compare_card_sections);
+	*pieces = g_new(struct iovec, count + 1);
+	pos_from = profiles_index.first_begin;
+	for (position = 0; position < count; position++)
+	{
+		(*pieces)[position].iov_base = (char *)buffer + pos_from;
+		(*pieces)[position].iov_len = cards[position]->begin - pos_from;
+		pos_from = cards[position]->next;
+	}
+	(*pieces)[count].iov_base = (char *)buffer + pos_from;
+	(*pieces)[count].iov_len = strlen(buffer + pos_from);
+	g_free(cards);
+	return count + 1;
+}
+
+/*
+ * Compiled profiles ("scenes") of one card, so that a recall is a write
+ * loop without parsing. Each profile's ALSA section is compiled by
+ * alsa_state_compile() the first time it is needed, and again only when
+ * the text of that section changes. The scenes are kept in memory and in
+ * '<cfgfile>.<card number>.scenes', keyed by the modification time, size
+ * and hash of cfgfile and by the card's element signature: at startup a
+ * cache whose key still matches is taken as is, else only the sections
+ * whose hash changed are compiled again.
+ */
+#define SCENE_CACHE_MAGIC "MU24SC01"
+
+typedef struct {
+	char magic[8];		/* SCENE_CACHE_MAGIC */
+	guint64 mtime;		/* of cfgfile, in ns */
+	guint64 size;		/* of cfgfile */
+	guint64 hash;		/* of cfgfile's contents */
+	guint64 signature;	/* of the card's elements */
+	guint32 scenes;
+	guint32 reserved;
+} scene_cache_header_t;
+
+typedef struct {
+	gint32 profile_number;
+	guint32 length;		/* of the records following */
+	guint64 section_hash;
+} scene_cache_entry_t;
+
+typedef struct {
+	guint64 section_hash;	/* of the ALSA section compiled */
+	alsa_scene_t scene;
+} scene_t;
+
+static struct {
+	char cfgfile[MAX_FILE_NAME_LENGTH];	/* empty if nothing cached */
+	int card_number;
+	guint64 mtime;
+	guint64 size;
+	guint64 hash;
+	guint64 signature;
+	GHashTable *scenes;	/* profile number -> scene_t */
+} scene_cache;
+
+static guint64 get_mtime(const struct stat * const file_status)
+{
+	return (guint64)file_status->st_mtim.tv_sec * 1000000000 + file_status->st_mtim.tv_nsec;
+}
+
+static void free_scene(gpointer data)
+{
+	scene_t *scene = data;
+
+	g_free(scene->scene.records);
+	g_free(scene);
+}
+
+static void get_scene_cache_name(char * const name, const size_t size)
+{
+	snprintf(name, size, "%s.%d.scenes", scene_cache.cfgfile, scene_cache.card_number);
+}
+
+/* take the scenes of a cache file written for the same card */
+static void load_scene_cache(void)
+{
+	char name[MAX_FILE_NAME_LENGTH + 16];
+	const scene_cache_header_t *header;
+	const scene_cache_entry_t *entry;
+	scene_t *scene;
+	gchar *contents;
+	gsize length, pos;
+	guint32 count;
+
+	get_scene_cache_name(name, sizeof(name));
+	if (!g_file_get_contents(name, &contents, &length, NULL))
+		return;
+	header = (const scene_cache_header_t *)contents;
+	if ((length < sizeof(*header)) || memcmp(header->magic, SCENE_CACHE_MAGIC, sizeof(header->magic)) ||
+	    (header->signature != scene_cache.signature)) {
+		g_free(contents);
+		return;
+	}
+	pos = sizeof(*header);
+	for (count = 0; count < header->scenes; count++)
+	{
+		entry = (const scene_cache_entry_t *)(contents + pos);
+		if ((pos + sizeof(*entry) > length) || (entry->length % 8) || (pos + sizeof(*entry) + entry->length > length))
+			break;
+		scene = g_new(scene_t, 1);
+		scene->section_hash = entry->section_hash;
+		scene->scene.length = entry->length;
+		scene->scene.records = g_malloc(entry->length);
+		memcpy(scene->scene.records, entry + 1, entry->length);
+		g_hash_table_replace(scene_cache.scenes, GINT_TO_POINTER(entry->profile_number), scene);
+		pos += sizeof(*entry) + entry->length;
+	}
+	if (count == header->scenes) {
+		scene_cache.mtime = header->mtime;
+		scene_cache.size = header->size;
+		scene_cache.hash = header->hash;
+	} else {
+		g_hash_table_remove_all(scene_cache.scenes);
+	}
+	g_free(contents);
+}
+
+/* the cache is only an optimization, failing to write it is not an error */
+static void save_scene_cache(void)
+{
+	char name[MAX_FILE_NAME_LENGTH + 16];
+	char tmpfile[MAX_FILE_NAME_LENGTH + 24];
+	scene_cache_header_t header;
+	scene_cache_entry_t entry;
+	GHashTableIter iter;
+	gpointer key, value;
+	scene_t *scene;
+	int outputFile, res;
+
+	get_scene_cache_name(name, sizeof(name));
+	snprintf(tmpfile, sizeof(tmpfile), "%s.XXXXXX", name);
+	if ((outputFile = mkstemp(tmpfile)) < 0)
+		return;
+	fchmod(outputFile, FILE_CREA_MODE);
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic));
+	header.mtime = scene_cache.mtime;
+	header.size = scene_cache.size;
+	header.hash = scene_cache.hash;
+	header.signature = scene_cache.signature;
+	header.scenes = g_hash_table_size(scene_cache.scenes);
+	res = write_all(outputFile, (const char *)&header, sizeof(header));
+	g_hash_table_iter_init(&iter, scene_cache.scenes);
+	while ((res >= 0) && g_hash_table_iter_next(&iter, &key, &value))
+	{
+		scene = value;
+		memset(&entry, 0, sizeof(entry));
+		entry.profile_number = GPOINTER_TO_INT(key);
+		entry.length = scene->scene.length;
+		entry.section_hash = scene->section_hash;
+		if ((res = write_all(outputFile, (const char *)&entry, sizeof(entry))) >= 0)
+			res = write_all(outputFile, (const char *)scene->scene.records, scene->scene.length);
+	}
+	if ((close(outputFile) < 0) || (res < 0) || (rename(tmpfile, name) < 0))
+		unlink(tmpfile);
+}
+
+/*
+ * Bring the scenes up to date with cfgfile, whose status is 'file_status':
+ * keep those whose section is unchanged, compile the others, drop those of
+ * profiles gone. Returns EXIT_SUCCESS or a negative errno.
+ */
+static int update_scene_cache(const struct stat * const file_status)
+{
+	const profile_section_t *profile;
+	const card_section_t *card;
+	GHashTable *scenes;
+	scene_t *scene;
+	char *buffer;
+	size_t length;
+	guint64 file_hash, hash;
+	int position, end;
+
+	if ((buffer = open_profiles(scene_cache.cfgfile, &length)) == NULL)
+		return -errno;
+	file_hash = alsa_state_hash(buffer, length, ALSA_STATE_HASH_INIT);
+	if (file_hash != scene_cache.hash) {
+		scenes = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free_scene);
+		index_profiles(buffer);
+		for (position = 0; position < profiles_index.profiles; position++)
+		{
+			profile = &profiles_index.profile[position];
+			if (((card = get_card_section(buffer, profile->number, scene_cache.card_number)) == NULL) ||
+			    (card->alsa_begin < 0))
+				continue;
+			end = get_start_of_line(buffer, card->end);
+			hash = alsa_state_hash(buffer + card->alsa_begin, end - card->alsa_begin, ALSA_STATE_HASH_INIT);
+			scene = g_hash_table_lookup(scene_cache.scenes, GINT_TO_POINTER(profile->number));
+			if ((scene != NULL) && (scene->section_hash == hash)) {
+				g_hash_table_steal(scene_cache.scenes, GINT_TO_POINTER(profile->number));
+			} else {
+				scene = g_new(scene_t, 1);
+				scene->section_hash = hash;
+				if (alsa_state_compile(get_profiles_ctl(), buffer + card->alsa_begin, end - card->alsa_begin, &scene->scene) < 0) {
+					free_scene(scene);
+					continue;	/* restore_profile() will tell what is wrong */
+				}
+			}
+			g_hash_table_replace(scenes, GINT_TO_POINTER(profile->number), scene);
+		}
+		g_hash_table_destroy(scene_cache.scenes);
+		scene_cache.scenes = scenes;
+		scene_cache.hash = file_hash;
 	}
-	memset(buffer_copy, '\0', max_length);
-	pos_next_card = get_pos_for_next_card(buffer, profile_number, card_number);
-	strncpy(buffer_copy, buffer, pos_card_begin);
-	strncpy(buffer_copy + pos_card_begin, buffer + pos_next_card, max_length - pos_card_begin);
-	buffer_copy[max_length - 1] = '\0';
-	memset(buffer, '\0', max_length);
-	strncpy(buffer, buffer_copy, max_length);
-	buffer[max_length - 1] = '\0';
-	free(buffer_copy);
-	buffer_copy = NULL;
+	close_profiles(buffer, length);
+	/*
+	 * Changes within one tick of the file system clock leave the mtime as
+	 * it was: until it is safely in the past, check the hash every time.
+	 */
+	scene_cache.mtime = get_mtime(file_status);
+	if (file_status->st_mtime + 1 >= time(NULL))
+		scene_cache.mtime = 0;
+	scene_cache.size = file_status->st_size;
+	save_scene_cache();
 	return EXIT_SUCCESS;
 }
 
-int save_restore_alsactl_settings(char * const tmpfile, const int card_number, char * const operation)
+/*
+ * Make the scene cache that of card_number and cfgfile and bring it up to
+ * date. Returns EXIT_SUCCESS or a negative errno.
+ */
+static int validate_scene_cache(const int card_number, const char * const cfgfile)
 {
+	struct stat file_status;
 	int res;
-	char * parameter[MAX_PARAM];
-	char *alsactl;
-	char profile_number_or_card_number_as_str[MAX_NUM_STR_LENGTH];
 
-	alsactl = check_environment("ALSACTL_PROG", ALSACTL);
-	snprintf(profile_number_or_card_number_as_str, MAX_NUM_STR_LENGTH, "%d", card_number);
-	profile_number_or_card_number_as_str[MAX_NUM_STR_LENGTH - 1] = '\0';
+	if (stat(cfgfile, &file_status) < 0)
+		return -errno;
+	if ((scene_cache.card_number != card_number) || strcmp(scene_cache.cfgfile, cfgfile)) {
+		if (scene_cache.scenes == NULL)
+			scene_cache.scenes = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free_scene);
+		g_hash_table_remove_all(scene_cache.scenes);
+		scene_cache.cfgfile[0] = '\0';
+		scene_cache.mtime = scene_cache.size = scene_cache.hash = 0;
+		if ((res = alsa_state_signature(get_profiles_ctl(), &scene_cache.signature)) < 0)
+			return res;
+		strncpy(scene_cache.cfgfile, cfgfile, MAX_FILE_NAME_LENGTH);
+		scene_cache.cfgfile[MAX_FILE_NAME_LENGTH - 1] = '\0';
+		scene_cache.card_number = card_number;
+		load_scene_cache();
+	}
+	if ((get_mtime(&file_status) == scene_cache.mtime) && ((guint64)file_status.st_size == scene_cache.size))
+		return EXIT_SUCCESS;
+	return update_scene_cache(&file_status);
+}
 
-	parameter[0] = alsactl;
-	parameter[1] = "-f";
-	parameter[2] = tmpfile;
-	parameter[3] = operation;
-	parameter[4] = profile_number_or_card_number_as_str;
-	parameter[5] = NULL;
-	
-	res = new_process(parameter);
-	
-	return res;
+/* the compiled profile, or NULL if there is none */
+static const alsa_scene_t *get_scene(const int profile_number, const int card_number, const char * const cfgfile)
+{
+	scene_t *scene;
+
+	if (validate_scene_cache(card_number, cfgfile) < 0)
+		return NULL;
+	if ((scene = g_hash_table_lookup(scene_cache.scenes, GINT_TO_POINTER(profile_number))) == NULL)
+		return NULL;
+	return &scene->scene;
 }
 
-void compose_tmpfile_name(char * const tmpfile, const char * const cfgfile)
+static void print_restore_stats(const int profile_number, const alsa_state_stats_t * const stats)
 {
-	strncpy(tmpfile, cfgfile, MAX_FILE_NAME_LENGTH);
-	tmpfile[MAX_FILE_NAME_LENGTH - 1] = '\0';
-	strncpy(tmpfile + strlen(tmpfile), "_alsactl_tmp", MAX_FILE_NAME_LENGTH - strlen(tmpfile));
-	tmpfile[MAX_FILE_NAME_LENGTH - 1] = '\0';
+	if (getenv("MUDITA24_WRITE_STATS") != NULL)
+		g_print("profile %d: %d writes for %d controls in %.1f ms\n",
+			profile_number, stats->writes, stats->controls, stats->usec / 1000.0);
 }
 
 /*
@@ -654,115 +1188,87 @@ void compose_tmpfile_name(char * const tmpfile, const char * const cfgfile)
  */
 int restore_profile(const int profile_number, const int card_number, const char * profile_name, char * cfgfile)
 {
-	int res, max_length;
+	int res;
 	int begin_of_alsa_section, pos_after_alsa_section, profile_nr;
 	char *buffer = NULL;
-	char tmpfile[MAX_FILE_NAME_LENGTH];
-	int get_profile_number(const char * const profile_name_given, const int card_number, char * cfgfile);
+	size_t length;
+	const alsa_scene_t *scene;
+	alsa_state_stats_t stats;
 
 	if ((profile_number < 0) && (profile_name == NULL)) {
 		fprintf(stderr, "Without profile number - profile name for card '%d' must given.\n", card_number);
 		return -EINVAL;
 	}
-	if ((max_length = get_file_size(cfgfile)) < 0) {
-		fprintf(stderr, "Cannot get file size from '%s'.\n", cfgfile);
-		return max_length;
-	}
-	max_length++;
-	if ((buffer = malloc(max_length)) == NULL) {
-		fprintf(stderr, "Cannot allocate memory for reading profiles.\n");
-		fprintf(stderr, "Cannot read settings for card '%d' in profile '%d'.\n", card_number, profile_number);
-		return -ENOBUFS;
+	if ((profile_number >= 0) && ((scene = get_scene(profile_number, card_number, cfgfile)) != NULL)) {
+		if ((res = alsa_state_apply(get_profiles_ctl(), scene, &stats)) < 0)
+			return res;
+		print_restore_stats(profile_number, &stats);
+		return EXIT_SUCCESS;
 	}
-	memset(buffer, '\0', max_length);
-	if ((res = read_profiles_in_buffer(cfgfile, buffer, max_length)) <= 0) {
+	if (((buffer = open_profiles(cfgfile, &length)) == NULL) || (length == 0)) {
+		res = buffer == NULL ? -errno : -EINVAL;
 		if (profile_number < 0) {
 			fprintf(stderr, "Cannot read settings for card '%d' in profile '%s'.\n", card_number, profile_name);
 		} else {
 			fprintf(stderr, "Cannot read settings for card '%d' in profile '%d'.\n", card_number, profile_number);
 		}
-		free(buffer);
-		buffer = NULL;
-		return -EINVAL;
+		close_profiles(buffer, length);
+		return res;
 	}
 	profile_nr = profile_number;
 	if (profile_number < 0) {
-		if ((profile_nr = get_profile_number(profile_name, card_number, cfgfile)) < 0) {
+		if ((profile_nr = get_profile_number_by_name(buffer, profile_name, card_number)) < 0) {
 			fprintf(stderr, "Cannot find profile '%s' for card '%d'.\n", profile_name, card_number);
-			free(buffer);
-			buffer = NULL;
+			close_profiles(buffer, length);
 			return profile_nr;
 		}
 	}
 	if ((begin_of_alsa_section = get_begin_of_alsa_section(buffer, profile_nr, card_number)) < 0) {
 		fprintf(stderr, "Cannot find alsa section for card '%d' in profile '%d'.\n", card_number, profile_nr);
-		free(buffer);
-		buffer = NULL;
+		close_profiles(buffer, length);
 		return begin_of_alsa_section;
 	}
 	pos_after_alsa_section = get_start_of_line(buffer, get_card_end(buffer, profile_nr, card_number));
-	compose_tmpfile_name(tmpfile, cfgfile);
-	if ((res = write_profiles_from_buffer(tmpfile, buffer + begin_of_alsa_section, pos_after_alsa_section - begin_of_alsa_section, 0)) >= 0) {
-		res = save_restore_alsactl_settings(tmpfile, card_number, ALSACTL_OP_RESTORE);
-		unlink(tmpfile);
-	}
-	free(buffer);
-	buffer = NULL;
+	res = alsa_state_restore(get_profiles_ctl(), buffer + begin_of_alsa_section, pos_after_alsa_section - begin_of_alsa_section, &stats);
+	close_profiles(buffer, length);
 
-	if (res > 0)
+	if (res >= 0) {
+		print_restore_stats(profile_nr, &stats);
 		res = EXIT_SUCCESS;
+	}
 
 	return res;
 }
 
-int append_alsactl_settings(const char * const tmpfile, char * const buffer_position, const int max_length)
-{
-	int res;
-
-	res = read_profiles_in_buffer(tmpfile, buffer_position, max_length);
-	if (res >= 0)
-		return EXIT_SUCCESS;
-	return res;
-}
-
 /*
- * insert entry for card in profile with alsactl settings
+ * compose the section for card in profile with the card's settings alsa_settings
  * if profile_number < 0 no profile header is needed
- * if pos_end < 0 the new entry will be appended
  * if profile_name == NULL the profile name header will not be written
+ * returns the section, to be freed with free(), or NULL
  */
-int insert_card(char * const buffer, const int profile_number, const int card_number, const char * const profile_name, const int pos_begin, \
-		const int pos_end, char * const tmpfile, const int max_length)
+static char *compose_card_section(const int profile_number, const int card_number, const char * const profile_name, const char * const alsa_settings)
 {
-	int res;
-	char *buffer_copy = NULL;
+	char *section = NULL;
 	char header[MAX_SEARCH_FIELD_LENGTH];
 	char profile_number_or_card_number_as_str[MAX_NUM_STR_LENGTH];
 	char profile_name_copy[PROFILE_NAME_FIELD_LENGTH];
 	char place_holder;
+	int max_length, length = 0;
 
-	if ((res = save_restore_alsactl_settings(tmpfile, card_number, ALSACTL_OP_STORE)) < 0)
-		return res;
-	if (pos_end >= 0) {
-		if ((buffer_copy = malloc(max_length)) == NULL) {
-			fprintf(stderr, "Cannot allocate memory for reading profiles.\n");
-			fprintf(stderr, "Cannot save settings for card '%d' in profile '%d'.\n", card_number, profile_number);
-			unlink(tmpfile);
-			return -ENOBUFS;
-		}
-		memset(buffer_copy, '\0', max_length);
-		strncpy(buffer_copy, buffer, max_length);
-		buffer_copy[max_length - 1] = '\0';
-		memset(buffer + pos_begin, '\0', max_length - pos_begin);
+	max_length = SECTION_HEADERS_LENGTH + strlen(alsa_settings) + 1;
+	if ((section = malloc(max_length)) == NULL) {
+		fprintf(stderr, "Cannot allocate memory for reading profiles.\n");
+		fprintf(stderr, "Cannot save settings for card '%d' in profile '%d'.\n", card_number, profile_number);
+		return NULL;
 	}
+	section[0] = '\0';
 	if (profile_number > 0) {
 		place_holder = PLACE_HOLDER_NUM;
 		snprintf(profile_number_or_card_number_as_str, MAX_NUM_STR_LENGTH, "%d", profile_number);
 		profile_number_or_card_number_as_str[MAX_NUM_STR_LENGTH - 1] = '\0';
 		compose_search_string(header, PROFILE_HEADER_TEMPL, profile_number_or_card_number_as_str, place_holder, MAX_SEARCH_FIELD_LENGTH);
 		header[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-		snprintf(buffer + strlen(buffer), max_length - strlen(buffer), "%s\n", header);
-		buffer[max_length - 1] = '\0';
+		length += snprintf(section + length, max_length - length, "%s\n", header);
 	}
 	/* compose card header */
 	place_holder = PLACE_HOLDER_NUM;
@@ -770,8 +1276,7 @@ int insert_card(char * const buffer, const int profile_number, const int card_nu
 	profile_number_or_card_number_as_str[MAX_NUM_STR_LENGTH - 1] = '\0';
 	compose_search_string(header, CARD_HEADER_TEMPL, profile_number_or_card_number_as_str, place_holder, MAX_SEARCH_FIELD_LENGTH);
 	header[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-	snprintf(buffer + strlen(buffer), max_length - strlen(buffer), "%s\n", header);
-	buffer[max_length - 1] = '\0';
+	length += snprintf(section + length, max_length - length, "%s\n", header);
 	/* compose profile name header if needed */
 	if (profile_name != NULL) {
 		strncpy(profile_name_copy, profile_name, PROFILE_NAME_FIELD_LENGTH);
@@ -779,118 +1284,113 @@ int insert_card(char * const buffer, const int profile_number, const int card_nu
 		place_holder = PLACE_HOLDER_STR;
 		compose_search_string(header, PROFILE_NAME_TEMPL, profile_name_copy, place_holder, MAX_SEARCH_FIELD_LENGTH);
 		header[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-		snprintf(buffer + strlen(buffer), max_length - strlen(buffer), "%s\n", header);
-		buffer[max_length - 1] = '\0';
+		length += snprintf(section + length, max_length - length, "%s\n", header);
 	}
-	res = append_alsactl_settings(tmpfile, buffer + strlen(buffer), max_length - strlen(buffer));
-	buffer[max_length - 1] = '\0';
-	unlink(tmpfile);
+	length += snprintf(section + length, max_length - length, "%s", alsa_settings);
 	/* compose card footer */
 	place_holder = PLACE_HOLDER_NUM;
-	snprintf(profile_number_or_card_number_as_str, MAX_NUM_STR_LENGTH, "%d", card_number);
-	profile_number_or_card_number_as_str[MAX_NUM_STR_LENGTH - 1] = '\0';
 	compose_search_string(header, CARD_FOOTER_TEMPL, profile_number_or_card_number_as_str, place_holder, MAX_SEARCH_FIELD_LENGTH);
 	header[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-	snprintf(buffer + strlen(buffer), max_length - strlen(buffer), "%s\n", header);
-	buffer[max_length - 1] = '\0';
-	if (pos_end >= 0) {
-		strncpy(buffer + strlen(buffer), buffer_copy + pos_end, max_length - strlen(buffer));
-		free(buffer_copy);
-		buffer_copy = NULL;
-	}
-	if (res >= 0)
-		res = EXIT_SUCCESS;
-		
-	return res;
+	snprintf(section + length, max_length - length, "%s\n", header);
+	section[max_length - 1] = '\0';
+
+	return section;
 }
 
+/*
+ * Store the card's settings as profile_number. Only the card's section is
+ * composed, the rest of the file is copied from its mapping as it is, unless
+ * its sections are damaged or out of order: then the whole file is
+ * reorganized first.
+ */
 int save_profile(const int profile_number, const int card_number, const char * const profile_name, char *cfgfile)
 {
-	int res, profile_begin, profile_end, profile_nr;
-	int card_begin, pos_next_card, card_nr, card_number_max;
-	const int no_profile_header = -1;
-	const int append = -1;
+	int res, lock, pos_begin, pos_end, card_nr, card_begin;
+	int with_profile_header;
 	char *buffer = NULL;
-	char tmpfile[MAX_FILE_NAME_LENGTH];
-	int max_length;
-
-	if ((max_length = get_file_size(cfgfile)) < 0) {
-		fprintf(stderr, "This operation will create a new profiles file '%s'.\n", cfgfile);
-		max_length = 0;
-	}
-	max_length += MAX_PROFILE_SIZE;
-	if ((buffer = malloc(max_length)) == NULL) {
-		fprintf(stderr, "Cannot allocate memory for reading profiles.\n");
+	char *file_buffer = NULL;
+	char *reorganized = NULL;
+	char *alsa_settings = NULL;
+	char *section = NULL;
+	struct iovec pieces[4];
+	size_t file_length = 0;
+	int max_length, length, count;
+
+	if ((lock = lock_profiles(cfgfile)) < 0) {
 		fprintf(stderr, "Cannot save settings for card '%d' in profile '%d'.\n", card_number, profile_number);
-		return -ENOBUFS;
+		return lock;
+	}
+	if ((res = alsa_state_store(get_profiles_ctl(), &alsa_settings)) < 0) {
+		fprintf(stderr, "Cannot read settings of card '%d': %s\n", card_number, snd_strerror(res));
+		unlock_profiles(lock);
+		return res;
 	}
-	memset(buffer, '\0', max_length);
-	compose_tmpfile_name(tmpfile, cfgfile);
 	/* file found */
-	if ((res = open(cfgfile, O_RDONLY | 0400000 /* NOFOLLOW */)) >= 0) {
+	if ((res = open(cfgfile, O_RDONLY | O_NOFOLLOW)) >= 0) {
 		close(res);
-		res = read_profiles_in_buffer(cfgfile, buffer, max_length);
-		if (res > 0)
-			res = reorganize_profiles(buffer, max_length);
+		file_buffer = open_profiles(cfgfile, &file_length);
+	} else {
+		fprintf(stderr, "This operation will create a new profiles file '%s'.\n", cfgfile);
 	}
-	res = strlen(buffer);
-	if (res > 0) {
-		if ((profile_begin = get_profile_begin(buffer, profile_number)) < 0) {
-			if (profile_number < MAX_PROFILES) {
-				for (profile_nr = 1; profile_nr <= MAX_PROFILES; profile_nr++)
-				{
-					if (profile_nr > profile_number) {
-						if ((profile_begin = get_profile_begin(buffer, profile_nr)) >= 0)
-							break;
-					}
-				}
-				if (profile_begin < 0)
-					profile_begin = strlen(buffer);
-			} else {
-				profile_begin = strlen(buffer);
-			}
-			if (profile_begin < strlen(buffer)) {
-				res = insert_card(buffer, profile_number, card_number, profile_name, profile_begin, profile_begin, tmpfile, max_length);
-			} else {
-				res = insert_card(buffer, profile_number, card_number, profile_name, profile_begin, append, tmpfile, max_length);
-			}
-		} else {
-			if ((card_begin = get_card_begin(buffer, profile_number, card_number)) < 0) {
-				card_number_max = get_max_card_number_in_profile(buffer, profile_number);
-				profile_end = get_profile_end(buffer, profile_number);
-				if (card_number_max > card_number) {
-					for (card_nr = 0; card_nr <= card_number_max; card_nr++)
-					{
-						if (card_nr > card_number) {
-							if ((card_begin = get_card_begin(buffer, profile_number, card_number)) >= 0)
-								break;
-						}
-					}
-					if (card_begin < 0)
-						card_begin = profile_end;
-				} else {
-					card_begin = profile_end;
-				}
-				if (card_begin < strlen(buffer)) {
-					res = insert_card(buffer, no_profile_header, card_number, profile_name, card_begin, card_begin, tmpfile, max_length);
-				} else {
-					res = insert_card(buffer, no_profile_header, card_number, profile_name, strlen(buffer), append, tmpfile, max_length);
-				}
-			} else {
-				pos_next_card = get_pos_for_next_card(buffer, profile_number, card_number);
-				res = insert_card(buffer, no_profile_header, card_number, profile_name, card_begin, pos_next_card, tmpfile, max_length);
-			}
+	buffer = file_buffer != NULL ? file_buffer : "";
+	if ((file_buffer != NULL) && (get_irregular_sections_in_buffer(file_buffer) > 0)) {
+		/* room for the file with all headers rewritten */
+		max_length = file_length + (get_sections_in_buffer(file_buffer) + 1) * SECTION_HEADERS_LENGTH + 1;
+		if ((reorganized = malloc(max_length)) == NULL) {
+			fprintf(stderr, "Cannot allocate memory for reading profiles.\n");
+			res = -ENOBUFS;
+			goto __error;
 		}
-	} else {
-		res = insert_card(buffer, profile_number, card_number, profile_name, 0, -1, tmpfile, max_length);
+		reorganize_profiles(file_buffer, reorganized, max_length);
+		buffer = reorganized;
 	}
-	if (res < 0) {
-		fprintf(stderr, "Cannot store profile '%d' for card '%d'.\n", profile_number, card_number);
+	length = strlen(buffer);
+	with_profile_header = 0;
+	if (get_profile_begin(buffer, profile_number) < 0) {
+		/* new profile before the next higher one */
+		if ((pos_begin = get_begin_of_next_profile(buffer, profile_number)) < 0)
+			pos_begin = length;
+		pos_end = pos_begin;
+		with_profile_header = 1;
+	} else if ((pos_begin = get_card_begin(buffer, profile_number, card_number)) < 0) {
+		/* new card before the next higher one in the profile */
+		pos_begin = get_profile_end(buffer, profile_number);
+		for (card_nr = get_max_card_number_in_profile(buffer, profile_number); card_nr > card_number; card_nr--)
+		{
+			if ((card_begin = get_card_begin(buffer, profile_number, card_nr)) >= 0)
+				pos_begin = card_begin;
+		}
+		pos_end = pos_begin;
 	} else {
-		res = write_profiles_from_buffer(cfgfile, buffer, max_length, 1);
+		pos_end = get_pos_for_next_card(buffer, profile_number, card_number);
 	}
-	free(buffer);
-	buffer = NULL;
+	if ((section = compose_card_section(with_profile_header ? profile_number : -1, card_number, profile_name, alsa_settings)) == NULL) {
+		res = -ENOBUFS;
+		goto __error;
+	}
+	/* the introduction is written new, everything before the first profile is dropped */
+	count = 0;
+	pieces[count].iov_base = buffer + profiles_index.first_begin;
+	pieces[count++].iov_len = pos_begin - profiles_index.first_begin;
+	if ((pos_begin > profiles_index.first_begin) && (buffer[pos_begin - 1] != '\n')) {
+		pieces[count].iov_base = "\n";
+		pieces[count++].iov_len = 1;
+	}
+	pieces[count].iov_base = section;
+	pieces[count++].iov_len = strlen(section);
+	pieces[count].iov_base = buffer + pos_end;
+	pieces[count++].iov_len = length - pos_end;
+	res = write_profiles(cfgfile, pieces, count);
+
+ __error:
+	if (res < 0)
+		fprintf(stderr, "Cannot store profile '%d' for card '%d'.\n", profile_number, card_number);
+	free(section);
+	free(reorganized);
+	close_profiles(file_buffer, file_length);
+	invalidate_profiles_index();
+	free(alsa_settings);
+	unlock_profiles(lock);
 
 	if (res > 0)
 		res = EXIT_SUCCESS;
@@ -898,10 +1398,12 @@ int save_profile(const int profile_number, const int card_number, const char * c
 	return res;
 }
 
-int delete_card(const int card_number, char * cfgfile)
+static int delete_card_unlocked(const int card_number, char * cfgfile)
 {
-	int res, profile_number, max_length;
-	void *buffer = NULL;
+	int res, lock, count;
+	char *buffer = NULL;
+	struct iovec *pieces;
+	size_t length;
 
 	if (cfgfile == NULL)
 		cfgfile = DEFAULT_PROFILERC;
@@ -909,56 +1411,43 @@ int delete_card(const int card_number, char * cfgfile)
 	filename_without_tilde[MAX_FILE_NAME_LENGTH - 1] = '\0';
 	subst_tilde_in_filename(filename_without_tilde);
 	cfgfile = filename_without_tilde;
-	if ((res = open(cfgfile, O_RDWR | 0400000 /* O_NOFOLLOW */, FILE_CREA_MODE)) < 0) {
+	if ((res = open(cfgfile, O_RDWR | O_NOFOLLOW, FILE_CREA_MODE)) < 0) {
 		fprintf(stderr, "Cannot open configuration file '%s' for writing.\n", cfgfile);
 		fprintf(stderr, "Cannot save settings for card '%d'.\n", card_number);
 		return -errno;
 	}
 	close(res);
-	if (res >= 0) {
-		if ((max_length = get_file_size(cfgfile)) < 0) {
-			fprintf(stderr, "Cannot get file size for '%s'.\n", cfgfile);
-			return max_length;
-		}
-		max_length++;
-		if ((buffer = malloc(max_length)) == NULL) {
-			fprintf(stderr, "Cannot allocate memory for reading profiles.\n");
-			fprintf(stderr, "Cannot delete card '%d'.\n", card_number);
-			return -ENOBUFS;
-		}
-		memset(buffer, '\0', max_length);
-		res = read_profiles_in_buffer(cfgfile, buffer, max_length);
-		if (res > 0) {
-			for (profile_number = 1; profile_number <= MAX_PROFILES; profile_number++)
-				delete_card_from_profile(buffer, profile_number, card_number, max_length);
-			res = EXIT_SUCCESS;
-		} else {
-			res = NOTFOUND;
-		}
-		res = write_profiles_from_buffer(cfgfile, buffer, max_length, 1);
-		free(buffer);
-		buffer = NULL;
-	} else {
-		res = NOTFOUND;
+	if ((lock = lock_profiles(cfgfile)) < 0) {
+		fprintf(stderr, "Cannot delete card '%d'.\n", card_number);
+		return lock;
 	}
+	if ((buffer = open_profiles(cfgfile, &length)) == NULL) {
+		res = -errno;
+		fprintf(stderr, "Cannot read profiles file '%s'.\n", cfgfile);
+		fprintf(stderr, "Cannot delete card '%d'.\n", card_number);
+		unlock_profiles(lock);
+		return res;
+	}
+	count = get_pieces_without_card(buffer, card_number, &pieces);
+	res = write_profiles(cfgfile, pieces, count);
+	g_free(pieces);
+	close_profiles(buffer, length);
+	invalidate_profiles_index();
+	unlock_profiles(lock);
+	if (res >= 0)
+		validate_scene_cache(card_number, cfgfile);
 	return res;
 }
 
 /*
- * First search profile name. if profile name is found look that this profile
- * name is from the specified card number.
- * if not search next occurence from given profile name.
+ * Search the profile name in the name headers of the given card number.
+ * if the name is used in more than one profile the first in the file wins.
  */
-int get_profile_number(const char * const profile_name_given, const int card_number, char * cfgfile)
+static int get_profile_number_unlocked(const char * const profile_name_given, const int card_number, char * cfgfile)
 {
-	int res, pos_name, pos_name_offset, pos_begin, pos_end, found;
-	int profile_number, pos_profile;
-	void *buffer = NULL;
-	char search_field[MAX_SEARCH_FIELD_LENGTH];
-	char header_templ[MAX_SEARCH_FIELD_LENGTH];
-	char profile_or_card_number_as_str[MAX_NUM_STR_LENGTH];
-	char place_holder;
-	int max_length;
+	int res, profile_number;
+	char *buffer = NULL;
+	size_t length;
 
 	if (strlen(profile_name_given) == 0) {
 		fprintf(stderr, "Profile name for card '%d' must be given.\n", card_number);
@@ -972,159 +1461,82 @@ int get_profile_number(const char * const profile_name_given, const int card_num
 	res = which_cfgfile(&cfgfile);
 	if (res < 0) {
 		profile_number = res;
+	} else if ((buffer = open_profiles(cfgfile, &length)) == NULL) {
+		profile_number = -errno;
 	} else {
-		if ((max_length = get_file_size(cfgfile)) < 0) {
-			fprintf(stderr, "Cannot get file size from '%s'.\n", cfgfile);
-			return max_length;
-		}
-		max_length++;
-		if ((buffer = malloc(max_length)) == NULL) {
-			res = -ENOBUFS;
-			profile_number = res;
-			fprintf(stderr, "Cannot allocate memory for reading profiles.\n");
-			return profile_number;
-		}
-		memset(buffer, '\0', max_length);
-		res = read_profiles_in_buffer(cfgfile, buffer, max_length);
-		if (res > 0) {
-			/* insert profile name in PROFILE_NAME_TEMPL */
-			place_holder = PLACE_HOLDER_STR;
-			compose_search_string(search_field, PROFILE_NAME_TEMPL, profile_name, place_holder, MAX_SEARCH_FIELD_LENGTH);
-			pos_name = 0;
-			pos_name_offset = 0;
-			pos_begin = NOTFOUND;
-			found = 0;
-			while ((pos_name = strstr_icase_blank(buffer + pos_name_offset, search_field)) >= 0)
-			{
-				pos_name += pos_name_offset;
-				/* search begin of section for the given card
-				   from profile name pointer backward */
-				/* insert card number in CARD_HEADER_TEMPL */
-				place_holder = PLACE_HOLDER_NUM;
-				snprintf(profile_or_card_number_as_str, MAX_NUM_STR_LENGTH, "%d", card_number);
-				profile_or_card_number_as_str[MAX_NUM_STR_LENGTH - 1] = '\0';
-				compose_search_string(search_field, CARD_HEADER_TEMPL, profile_or_card_number_as_str, place_holder, MAX_SEARCH_FIELD_LENGTH);
-				search_field[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-				if ((pos_begin = get_begin_of_section(buffer, search_field, TOKEN_SEP, pos_name)) < 0)
-					break;
-				/* searching "[ profile | < card | < /card # >" */
-				/* add "[ profile |" to search_field */
-				strncpy(header_templ, PROFILE_HEADER_TEMPL, MAX_SEARCH_FIELD_LENGTH);
-				*strchr(header_templ, place_holder) = '\0';
-				strncpy(search_field, header_templ, MAX_SEARCH_FIELD_LENGTH);
-				strncpy(search_field + strlen(search_field), TOKEN_SEP, MAX_SEARCH_FIELD_LENGTH - strlen(search_field));
-				/* add "< card |" to search_field */
-				strncpy(header_templ, CARD_HEADER_TEMPL, MAX_SEARCH_FIELD_LENGTH);
-				*strchr(header_templ, place_holder) = '\0';
-				strncpy(search_field + strlen(search_field), header_templ, MAX_SEARCH_FIELD_LENGTH - strlen(search_field));
-				strncpy(search_field + strlen(search_field), TOKEN_SEP, MAX_SEARCH_FIELD_LENGTH - strlen(search_field));
-				search_field[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-				/* add "< card # >" to search_field */
-				compose_search_string(header_templ, CARD_FOOTER_TEMPL, profile_or_card_number_as_str, place_holder, MAX_SEARCH_FIELD_LENGTH);
-				header_templ[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-				strncpy(search_field + strlen(search_field), header_templ, MAX_SEARCH_FIELD_LENGTH - strlen(search_field));
-				search_field[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-				pos_end = get_end_of_section(buffer, search_field, TOKEN_SEP, pos_begin + sizeof(char));
-				if ((pos_name > pos_begin) && (pos_name < pos_end) && (pos_begin >= 0) && (pos_end >= 0)) {
-					found = 1;
-					break;
-				}
-				pos_name_offset = pos_name + sizeof(char);
-				place_holder = PLACE_HOLDER_STR;
-				compose_search_string(search_field, PROFILE_NAME_TEMPL, profile_name, place_holder, MAX_SEARCH_FIELD_LENGTH);
-			}
-			if (found) {
-				place_holder = PLACE_HOLDER_NUM;
-				strncpy(search_field, PROFILE_HEADER_TEMPL, MAX_SEARCH_FIELD_LENGTH);
-				search_field[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-				*strchr(search_field, place_holder) = '\0';
-				if ((pos_profile = get_begin_of_section(buffer, search_field, TOKEN_SEP, pos_begin)) < 0) {
-					profile_number = NOTFOUND;
-				} else {
-					profile_number = get_number_from_header(buffer + pos_profile);
-					/* check profile header syntax */
-					if (get_profile_begin(buffer, profile_number) != pos_profile) {
-						profile_number = -EINVAL;
-						/* only the profile line */
-						strncpy(search_field, buffer + pos_profile, MAX_SEARCH_FIELD_LENGTH);
-						search_field[MAX_SEARCH_FIELD_LENGTH - 1] = '\0';
-						*strchr(search_field, '\n') = '\0';
-						fprintf(stderr, "profile header '%s' has incorrect syntax.\n", search_field);
-						fprintf(stderr, "profile header syntax is '%s'\n" \
-									"by replacing place holder '%c' with profile number.\n", \
-									PROFILE_HEADER_TEMPL, PLACE_HOLDER_NUM);
-						/* check profile number */
-					} else if (profile_number < 1 || profile_number > MAX_PROFILES) {
-						fprintf(stderr, "profile number '%d' is incorrect. the profile number will be in [1 ... %d].\n", \
-									profile_number, MAX_PROFILES);
-						profile_number = -EINVAL;
-					}
-				}
-			} else {
-				profile_number = NOTFOUND;
-			}
-		} else {
-			profile_number = NOTFOUND;
-		}
-		free(buffer);
-		buffer = NULL;
+		profile_number = get_profile_number_by_name(buffer, profile_name, card_number);
+		close_profiles(buffer, length);
 	}
 	return profile_number;
 }
 
-char *get_profile_name(const int profile_number, const int card_number, char * cfgfile)
+/* highest profile number stored for the card, 0 if none */
+static int get_max_profile_number_unlocked(const int card_number, char * cfgfile)
+{
+	int res, profile_number;
+	char *buffer = NULL;
+	size_t length;
+
+	if (cfgfile == NULL)
+		cfgfile = DEFAULT_PROFILERC;
+	res = which_cfgfile(&cfgfile);
+	if ((res < 0) || ((buffer = open_profiles(cfgfile, &length)) == NULL))
+		return 0;
+	profile_number = get_max_profile_number_in_buffer(buffer, card_number);
+	close_profiles(buffer, length);
+	return profile_number;
+}
+
+/*
+ * Compile the profiles of the card, or load them from the scene cache,
+ * ahead of the first recall. Returns the number of profiles compiled.
+ */
+static int preload_profiles_unlocked(const int card_number, char * cfgfile)
+{
+	int res;
+
+	if (cfgfile == NULL)
+		cfgfile = DEFAULT_PROFILERC;
+	if (which_cfgfile(&cfgfile) < 0)
+		return 0;
+	if ((res = validate_scene_cache(card_number, cfgfile)) < 0)
+		return res;
+	return g_hash_table_size(scene_cache.scenes);
+}
+
+static char *get_profile_name_unlocked(const int profile_number, const int card_number, char * cfgfile)
 {
-	int res, max_length;
-	void *buffer = NULL;
+	int res;
+	char *buffer = NULL;
+	size_t length;
 
-	if (profile_number < 1 || profile_number > MAX_PROFILES) {
-		fprintf(stderr, "profile number '%d' is incorrect. the profile number will be in [1 ... %d].\n", \
-					profile_number, MAX_PROFILES);
+	if (profile_number < 1) {
+		fprintf(stderr, "profile number '%d' is incorrect. the profile number must be 1 or higher.\n", profile_number);
 		return NULL;
 	}
+	memset(profile_name, '\0', PROFILE_NAME_FIELD_LENGTH);
 	if (cfgfile == NULL)
 		cfgfile = DEFAULT_PROFILERC;
 	res = which_cfgfile(&cfgfile);
-	if (res < 0) {
-		snprintf(profile_name, PROFILE_NAME_FIELD_LENGTH, "%d", profile_number);
-	} else {
-		if ((max_length = get_file_size(cfgfile)) < 0) {
-			fprintf(stderr, "Cannot get file size from '%s'.\n", cfgfile);
-			snprintf(profile_name, PROFILE_NAME_FIELD_LENGTH, "%d", profile_number);
-			return profile_name;
-		}
-		max_length++;
-		if ((buffer = malloc(max_length)) == NULL) {
-			res = -ENOBUFS;
-			snprintf(profile_name, PROFILE_NAME_FIELD_LENGTH, "%d", profile_number);
-			fprintf(stderr, "Cannot allocate memory for reading profiles.\n");
-			return profile_name;
-		}
-		memset(buffer, '\0', max_length);
-		memset(profile_name, '\0', PROFILE_NAME_FIELD_LENGTH);
-		res = read_profiles_in_buffer(cfgfile, buffer, max_length);
-		if (res > 0) {
-			if ((res = get_pos_name_header_from_card(buffer, profile_number, card_number)) >= 0) {
-				get_profile_name_from_header(buffer + (res * sizeof(char)));
-				profile_name[PROFILE_NAME_FIELD_LENGTH - 1] = '\0';
-			}
-		}
-		free(buffer);
-		buffer = NULL;
-		if (strlen(profile_name) == 0) {
-			snprintf(profile_name, PROFILE_NAME_FIELD_LENGTH, "%d", profile_number);
+	if ((res >= 0) && ((buffer = open_profiles(cfgfile, &length)) != NULL)) {
+		if ((res = get_pos_name_header_from_card(buffer, profile_number, card_number)) >= 0) {
+			get_profile_name_from_header(buffer + (res * sizeof(char)));
+			profile_name[PROFILE_NAME_FIELD_LENGTH - 1] = '\0';
 		}
+		close_profiles(buffer, length);
+	}
+	if (strlen(profile_name) == 0) {
+		snprintf(profile_name, PROFILE_NAME_FIELD_LENGTH, "%d", profile_number);
 	}
 	return profile_name;
 }
 
-int save_restore(const char * const operation, const int profile_number, const int card_number, char * cfgfile, const char * const profile_name)
+static int save_restore_unlocked(const char * const operation, const int profile_number, const int card_number, char * cfgfile, const char * const profile_name)
 {
 	int res;
 
-	if (profile_number < 1 || profile_number > MAX_PROFILES) {
-		fprintf(stderr, "profile number '%d' is incorrect. the profile number will be in [1 ... %d].\n", \
-					profile_number, MAX_PROFILES);
+	if (profile_number < 1) {
+		fprintf(stderr, "profile number '%d' is incorrect. the profile number must be 1 or higher.\n", profile_number);
 		return -EINVAL;
 	}
 	if (cfgfile == NULL)
@@ -1134,26 +1546,29 @@ int save_restore(const char * const operation, const int profile_number, const i
 		filename_without_tilde[MAX_FILE_NAME_LENGTH - 1] = '\0';
 		subst_tilde_in_filename(filename_without_tilde);
 		cfgfile = filename_without_tilde;
-		if ((res = open(cfgfile, O_RDONLY | 0400000 /* O_NOFOLLOW */)) < 0) {
+		if ((res = open(cfgfile, O_RDONLY | O_NOFOLLOW)) < 0) {
 			if ((res = create_dir_from_filename(cfgfile)) < 0) {
 				fprintf(stderr, "Cannot open configuration file '%s' for writing.\n", cfgfile);
 				fprintf(stderr, "Cannot save settings for card '%d' in profile '%d'.\n", card_number, profile_number);
 				return -EACCES;
 			}
-			if ((res = open(cfgfile, O_RDWR | O_CREAT | 0400000 /* O_NOFOLLOW */, FILE_CREA_MODE)) < 0) {
+			if ((res = open(cfgfile, O_RDWR | O_CREAT | O_NOFOLLOW, FILE_CREA_MODE)) < 0) {
 				fprintf(stderr, "Cannot open configuration file '%s' for writing.\n", cfgfile);
 				fprintf(stderr, "Cannot save settings for card '%d' in profile '%d'.\n", card_number, profile_number);
 				return -errno;
 			}
 			unlink(cfgfile);
 		} else {
-			if ((res = open(cfgfile, O_RDWR | 0400000 /* O_NOFOLLOW */, FILE_CREA_MODE)) < 0) {
+			if ((res = open(cfgfile, O_RDWR | O_NOFOLLOW, FILE_CREA_MODE)) < 0) {
 				fprintf(stderr, "Cannot open configuration file '%s' for writing.\n", cfgfile);
 				fprintf(stderr, "Cannot save settings for card '%d' in profile '%d'.\n", card_number, profile_number);
 				return -errno;
 			}
 		}
 		res =  save_profile(profile_number, card_number, profile_name, cfgfile);
+		/* compile the profile now rather than at its first recall */
+		if (res >= 0)
+			validate_scene_cache(card_number, cfgfile);
 	} else if (!strcmp(operation, ALSACTL_OP_RESTORE)) {
 		res = which_cfgfile(&cfgfile);
 		if (res < 0) {
@@ -1175,3 +1590,86 @@ int save_restore(const char * const operation, const int profile_number, const i
 
 	return res < 0 ? -EXIT_FAILURE : EXIT_SUCCESS;
 }
+
+/* a copy for the caller, profile_name is also used while saving */
+static char profile_name_found[PROFILE_NAME_FIELD_LENGTH];
+
+void set_profiles_ctl(snd_ctl_t *handle)
+{
+	pthread_mutex_lock(&profiles_mutex);
+	profiles_ctl = handle;
+	pthread_mutex_unlock(&profiles_mutex);
+}
+
+int save_restore(const char * const operation, const int profile_number, const int card_number, char * cfgfile, const char * const profile_name)
+{
+	int res;
+
+	pthread_mutex_lock(&profiles_mutex);
+	res = save_restore_unlocked(operation, profile_number, card_number, cfgfile, profile_name);
+	pthread_mutex_unlock(&profiles_mutex);
+	return res;
+}
+
+int delete_card(const int card_number, char * cfgfile)
+{
+	int res;
+
+	pthread_mutex_lock(&profiles_mutex);
+	res = delete_card_unlocked(card_number, cfgfile);
+	pthread_mutex_unlock(&profiles_mutex);
+	return res;
+}
+
+int preload_profiles(const int card_number, char * cfgfile)
+{
+	int res;
+
+	pthread_mutex_lock(&profiles_mutex);
+	res = preload_profiles_unlocked(card_number, cfgfile);
+	pthread_mutex_unlock(&profiles_mutex);
+	return res;
+}
+
+int get_profile_number(const char * const profile_name_given, const int card_number, char * cfgfile)
+{
+	int res;
+
+	pthread_mutex_lock(&profiles_mutex);
+	res = get_profile_number_unlocked(profile_name_given, card_number, cfgfile);
+	pthread_mutex_unlock(&profiles_mutex);
+	return res;
+}
+
+int get_max_profile_number(const int card_number, char * cfgfile)
+{
+	int res;
+
+	pthread_mutex_lock(&profiles_mutex);
+	res = get_max_profile_number_unlocked(card_number, cfgfile);
+	pthread_mutex_unlock(&profiles_mutex);
+	return res;
+}
+
+char *get_profile_name(const int profile_number, const int card_number, char * cfgfile)
+{
+	char *name;
+
+	pthread_mutex_lock(&profiles_mutex);
+	if ((name = get_profile_name_unlocked(profile_number, card_number, cfgfile)) != NULL) {
+		strncpy(profile_name_found, name, PROFILE_NAME_FIELD_LENGTH);
+		name = profile_name_found;
+	}
+	pthread_mutex_unlock(&profiles_mutex);
+	return name;
+}
+
+/* Whether 'name' is 'profile_name_given', compared as get_profile_number() does */
+int profile_name_matches(const char * const name, const char * const profile_name_given)
+{
+	char normalized[MAX_SEARCH_FIELD_LENGTH], normalized_given[MAX_SEARCH_FIELD_LENGTH];
+
+	normalize_line(normalized, name, strlen(name));
+	normalize_line(normalized_given, profile_name_given, strlen(profile_name_given));
+	return !strcmp(normalized, normalized_given);
+}
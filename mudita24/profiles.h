@@ -6,6 +6,11 @@
 #include <string.h>
 #include <signal.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
 #include <errno.h>
 #include <assert.h>
 #include <time.h>
@@ -16,10 +21,6 @@
 #define PROGRAM_NAME "mudita24"
 #endif
 
-#ifndef MAX_PROFILES
-#define MAX_PROFILES 4
-#endif
-
 #ifndef MAX_PROFILE_NAME_LENGTH
 #define MAX_PROFILE_NAME_LENGTH 20
 #endif
@@ -42,14 +43,16 @@
 #define PLACE_HOLDER_NUM '#'
 #define PLACE_HOLDER_STR '$'
 
-/* max 32k for every profile */
-#define MAX_PROFILE_SIZE 32768
 #define MAX_SEARCH_FIELD_LENGTH 1024
 #define MAX_FILE_NAME_LENGTH 1024
 #define MAX_NUM_STR_LENGTH 10
 #define TOKEN_SEP "|"
 #define SEP_CHAR ' '
 
+/* room for the headers and footer of one card section in its own profile */
+#define SECTION_HEADERS_LENGTH (sizeof(PROFILE_HEADER_TEMPL) + sizeof(CARD_HEADER_TEMPL) + sizeof(PROFILE_NAME_TEMPL) \
+				+ sizeof(CARD_FOOTER_TEMPL) + 3 * MAX_NUM_STR_LENGTH + PROFILE_NAME_FIELD_LENGTH)
+
 #ifndef NOTFOUND
 #define NOTFOUND -1
 #endif
@@ -57,30 +60,40 @@
 #define ALSACTL_OP_STORE "store"
 #define ALSACTL_OP_RESTORE "restore"
 
-#define DIR_CREA_MODE "0755"	// this must be a string
+#define DIR_CREA_MODE 0755	// this must be a octal number
 #define FILE_CREA_MODE 0644	// this must be a octal number
 
-/* max count of parameters for new_process
- * !first parameter will be the name of the external programm
- * - last parameter will be NULL
- */
-#define MAX_PARAM 10
+/* alsastate.c: card settings in alsactl's file format */
+typedef struct {
+	int controls;		/* elements in the profile that can be written */
+	int writes;		/* writes issued to bring the card to the profile */
+	guint64 usec;		/* time taken by these writes */
+} alsa_state_stats_t;
 
-/* the place from mkdir */
-#ifndef MKDIR
-#define MKDIR "/bin/mkdir"
-#endif
+/* a profile compiled for the card by alsa_state_compile() */
+typedef struct {
+	size_t length;
+	guint8 *records;	/* g_malloc()ed */
+} alsa_scene_t;
 
-/* the place from alsactl */
-#ifndef ALSACTL
-#define ALSACTL "/usr/sbin/alsactl"
-#endif
+#define ALSA_STATE_HASH_INIT 14695981039346656037ULL
+
+int alsa_state_store(snd_ctl_t *handle, char **text);
+int alsa_state_restore(snd_ctl_t *handle, const char *text, size_t length, alsa_state_stats_t *stats);
+int alsa_state_compile(snd_ctl_t *handle, const char *text, size_t length, alsa_scene_t *scene);
+int alsa_state_apply(snd_ctl_t *handle, const alsa_scene_t *scene, alsa_state_stats_t *stats);
+int alsa_state_signature(snd_ctl_t *handle, guint64 *signature);
+guint64 alsa_state_hash(const void *data, size_t length, guint64 hash);
 
 #ifndef __PROFILES_C__
 extern int save_restore(const char * const operation, const int profile_number, const int card_number, char * cfgfile, const char * const profile_name);
 extern char *get_profile_name(const int profile_number, const int card_number, char * cfgfile);
 extern int get_profile_number(const char * const profile_name, const int card_number, char * cfgfile);
+extern int get_max_profile_number(const int card_number, char * cfgfile);
+extern int profile_name_matches(const char * const name, const char * const profile_name_given);
+extern int preload_profiles(const int card_number, char * cfgfile);
 extern int delete_card(const int card_number, char * const cfgfile);
+extern void set_profiles_ctl(snd_ctl_t *handle);
 #endif
 
 #endif /* __PROFILES_H__ */
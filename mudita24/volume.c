@@ -29,12 +29,6 @@
 #define toggle_set(widget, state) \
 	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(widget), state);
 
-#define DAC_VOLUME_NAME	"DAC Volume"
-#define ADC_VOLUME_NAME	"ADC Volume"
-#define IPGA_VOLUME_NAME "IPGA Analog Capture Volume"
-#define DAC_SENSE_NAME	"Output Sensitivity Switch"
-#define ADC_SENSE_NAME	"Input Sensitivity Switch"
-
 static int dac_volumes;
 //static int dac_max = 127; // TER
 //static int adc_max = 127; // TER
@@ -118,36 +112,30 @@ int envy_analog_volume_available(void)
 
 gboolean get_alsa_control_range(SliderScale *sl_scale, gdouble *min, gdouble *max) 
 {
-  const char *cname;
+  control_t cname;
   switch(sl_scale->type)
   {
     case DAC_STRIP:
-      cname = DAC_VOLUME_NAME;
+      cname = CTL_DAC_VOLUME;
     break;
     case ADC_STRIP:
-      cname = ADC_VOLUME_NAME;
+      cname = CTL_ADC_VOLUME;
     break;
     case IPGA_STRIP:
-      cname = IPGA_VOLUME_NAME;
+      cname = CTL_IPGA_VOLUME;
     break;
     default:
       return FALSE;
   }
     
-  snd_ctl_elem_info_t *elem_info;
-  snd_ctl_elem_info_alloca(&elem_info);
-  snd_ctl_elem_info_set_interface(elem_info, SND_CTL_ELEM_IFACE_MIXER);
-  snd_ctl_elem_info_set_name(elem_info, cname);
-  snd_ctl_elem_info_set_numid(elem_info, 0);
-  snd_ctl_elem_info_set_index(elem_info, sl_scale->idx); 
-  int err;
-  if((err = snd_ctl_elem_info(ctl, elem_info)) < 0)
+  const control_range_t *r = control_range(cname, sl_scale->idx);
+  if(r->type == SND_CTL_ELEM_TYPE_NONE)
   {  
-    g_print("get_alsa_control_range: Error reading control info: %s\n", snd_strerror(err));
+    g_print("get_alsa_control_range: Error reading control info: %s\n", snd_strerror(-ENOENT));
     return FALSE;
   }  
-  *min = (gdouble)snd_ctl_elem_info_get_min(elem_info);
-  *max = (gdouble)snd_ctl_elem_info_get_max(elem_info);
+  *min = (gdouble)r->min;
+  *max = (gdouble)r->max;
   return TRUE;
 } 
 
@@ -155,29 +143,24 @@ void scale_add_analog_marks(SliderScale     *sl_scale,
                             GtkPositionType  position,
                             gboolean         draw_legend_p)
 {
-  const char *cname;
+  control_t cname;
   switch(sl_scale->type)
   {
     case DAC_STRIP:
-      cname = DAC_VOLUME_NAME;
+      cname = CTL_DAC_VOLUME;
     break;
     case ADC_STRIP:
-      cname = ADC_VOLUME_NAME;
+      cname = CTL_ADC_VOLUME;
     break;
     case IPGA_STRIP:
-      cname = IPGA_VOLUME_NAME;
+      cname = CTL_IPGA_VOLUME;
     break;
     default:
       return;
   }
     
-  snd_ctl_elem_id_t *elem_id;
-  snd_ctl_elem_id_alloca(&elem_id);
-  snd_ctl_elem_id_set_interface(elem_id, SND_CTL_ELEM_IFACE_MIXER);
-  snd_ctl_elem_id_set_name(elem_id, cname);
-  snd_ctl_elem_id_set_index(elem_id, sl_scale->idx); 
   long dbminl, dbmaxl;
-  if(snd_ctl_get_dB_range(ctl, elem_id, &dbminl, &dbmaxl) < 0)
+  if(control_db_range(cname, sl_scale->idx, &dbminl, &dbmaxl) < 0)
     return;
 
   // Get the nearest max 6dB value below or equal.
@@ -201,7 +184,7 @@ void scale_add_analog_marks(SliderScale     *sl_scale,
   long first = 1;
   for(i = dbminl; i <= dbmaxl; i+= 600)
   {
-    if(snd_ctl_convert_from_dB(ctl, elem_id, i, &ival, 0) < 0)
+    if(control_from_db(cname, sl_scale->idx, i, &ival, 0) < 0)
       continue;
     
     if(!first && ival == lastival)  // Keep going until we find a change.
@@ -549,6 +532,17 @@ gboolean scale_btpress_handler(GtkWidget *widget, GdkEventButton *event, gpointe
   return TRUE;
 }
 
+//
+// End of a slider drag: write the final value now rather than at the
+// end of the write interval. Connected to the slider itself, and returns
+// FALSE so the slider still handles the release.
+//
+gboolean scale_btrelease_handler(GtkWidget *widget, GdkEventButton *event, gpointer data)
+{
+  controls_flush();
+  return FALSE;
+}
+
 //
 // Handle all types of slider scroll changes. 
 gboolean slider_change_value_handler(GtkRange     *range,
@@ -700,13 +694,9 @@ gboolean slider_change_value_handler(GtkRange     *range,
 
 void dac_volume_update(int idx)
 {
-	snd_ctl_elem_value_t *val;
+	snd_ctl_elem_value_t *val = control_value(CTL_DAC_VOLUME, idx);
 	int err;
-	snd_ctl_elem_value_alloca(&val);
-	snd_ctl_elem_value_set_interface(val, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(val, DAC_VOLUME_NAME);
-	snd_ctl_elem_value_set_index(val, idx);
-	if ((err = snd_ctl_elem_read(ctl, val)) < 0) {
+	if ((err = control_read(CTL_DAC_VOLUME, idx)) < 0) {
 		g_print("Unable to read dac volume: %s\n", snd_strerror(err));
 		return;
 	}
@@ -719,13 +709,9 @@ void dac_volume_update(int idx)
 
 void adc_volume_update(int idx)
 {
-	snd_ctl_elem_value_t *val;
+	snd_ctl_elem_value_t *val = control_value(CTL_ADC_VOLUME, idx);
 	int err;
-	snd_ctl_elem_value_alloca(&val);
-	snd_ctl_elem_value_set_interface(val, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(val, ADC_VOLUME_NAME);
-	snd_ctl_elem_value_set_index(val, idx);
-	if ((err = snd_ctl_elem_read(ctl, val)) < 0) {
+	if ((err = control_read(CTL_ADC_VOLUME, idx)) < 0) {
 		g_print("Unable to read adc volume: %s\n", snd_strerror(err));
 		return;
 	}
@@ -734,9 +720,8 @@ void adc_volume_update(int idx)
   if((int)gtk_adjustment_get_value(GTK_ADJUSTMENT(av_adc_volume_adj[idx])) != -snd_ctl_elem_value_get_integer(val, 0))
   	gtk_adjustment_set_value(GTK_ADJUSTMENT(av_adc_volume_adj[idx]),
 				 -snd_ctl_elem_value_get_integer(val, 0));
-	snd_ctl_elem_value_set_name(val, IPGA_VOLUME_NAME);
-	snd_ctl_elem_value_set_index(val, idx);
-	if ((err = snd_ctl_elem_read(ctl, val)) < 0) {
+	val = control_value(CTL_IPGA_VOLUME, idx);
+	if ((err = control_read(CTL_IPGA_VOLUME, idx)) < 0) {
 		g_print("Unable to read ipga volume: %s\n", snd_strerror(err));
 		return;
 	}
@@ -755,13 +740,9 @@ void adc_volume_update(int idx)
 
 void ipga_volume_update(int idx)
 {
-	snd_ctl_elem_value_t *val;
+	snd_ctl_elem_value_t *val = control_value(CTL_IPGA_VOLUME, idx);
 	int err, ipga_vol;
-	snd_ctl_elem_value_alloca(&val);
-	snd_ctl_elem_value_set_interface(val, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(val, IPGA_VOLUME_NAME);
-	snd_ctl_elem_value_set_index(val, idx);
-	if ((err = snd_ctl_elem_read(ctl, val)) < 0) {
+	if ((err = control_read(CTL_IPGA_VOLUME, idx)) < 0) {
 		g_print("Unable to read ipga volume: %s\n", snd_strerror(err));
 		return;
 	}
@@ -772,9 +753,8 @@ void ipga_volume_update(int idx)
 	  gtk_adjustment_set_value(GTK_ADJUSTMENT(av_ipga_volume_adj[idx]),
 				 //-(ipga_vol = snd_ctl_elem_value_get_integer(val, 0)));
          -ipga_vol);
-	snd_ctl_elem_value_set_name(val, ADC_VOLUME_NAME);
-	snd_ctl_elem_value_set_index(val, idx);
-	if ((err = snd_ctl_elem_read(ctl, val)) < 0) {
+	val = control_value(CTL_ADC_VOLUME, idx);
+	if ((err = control_read(CTL_ADC_VOLUME, idx)) < 0) {
 		g_print("Unable to read adc volume: %s\n", snd_strerror(err));
 		return;
 	}
@@ -794,14 +774,10 @@ void ipga_volume_update(int idx)
 
 void dac_sense_update(int idx)
 {
-	snd_ctl_elem_value_t *val;
+	snd_ctl_elem_value_t *val = control_value(CTL_DAC_SENSE, idx);
 	int err;
 	int state;
-	snd_ctl_elem_value_alloca(&val);
-	snd_ctl_elem_value_set_interface(val, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(val, DAC_SENSE_NAME);
-	snd_ctl_elem_value_set_index(val, idx);
-	if ((err = snd_ctl_elem_read(ctl, val)) < 0) {
+	if ((err = control_read(CTL_DAC_SENSE, idx)) < 0) {
 		g_print("Unable to read dac sense: %s\n", snd_strerror(err));
 		return;
 	}
@@ -811,14 +787,10 @@ void dac_sense_update(int idx)
 
 void adc_sense_update(int idx)
 {
-	snd_ctl_elem_value_t *val;
+	snd_ctl_elem_value_t *val = control_value(CTL_ADC_SENSE, idx);
 	int err;
 	int state;
-	snd_ctl_elem_value_alloca(&val);
-	snd_ctl_elem_value_set_interface(val, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(val, ADC_SENSE_NAME);
-	snd_ctl_elem_value_set_index(val, idx);
-	if ((err = snd_ctl_elem_read(ctl, val)) < 0) {
+	if ((err = control_read(CTL_ADC_SENSE, idx)) < 0) {
 		g_print("Unable to read adc sense: %s\n", snd_strerror(err));
 		return;
 	}
@@ -847,25 +819,42 @@ static char temp_label[16];
  *  00h min - FFh max volume. Reading the register
  *  resets the meter to 00h."
  */
-char* peak_level_to_db(int ival) {
-  if (ival != 0) {
-    double value = 20.0 * log10((double)ival/(double)MAX_METERING_LEVEL);
-    //"(Off)"
-    //"0dBFS" <-- seems to cause a resize oscillation, use 0.0dB instead
-    //"0.0dB"
-    //"-0.10"      
-    //"-9.90"
-    //"-48.0"
-    if (value == 0.0)
-      sprintf(temp_label, "0.0dB");
-    else if (value > -10.0)
-      sprintf(temp_label, "%+1.2f", value);
+static char peak_db_labels[MAX_METERING_LEVEL + 1][8];
+
+/*
+ * The labels for all 256 possible peak meter values are formatted once,
+ * at startup, so that updating peak labels needs no log10() or sprintf().
+ */
+void peak_level_db_init(void) {
+  int ival;
+
+  for (ival = 0; ival <= MAX_METERING_LEVEL; ival++) {
+    if (ival != 0) {
+      double value = 20.0 * log10((double)ival/(double)MAX_METERING_LEVEL);
+      //"(Off)"
+      //"0dBFS" <-- seems to cause a resize oscillation, use 0.0dB instead
+      //"0.0dB"
+      //"-0.10"      
+      //"-9.90"
+      //"-48.0"
+      if (value == 0.0)
+	sprintf(peak_db_labels[ival], "0.0dB");
+      else if (value > -10.0)
+	sprintf(peak_db_labels[ival], "%+1.2f", value);
+      else
+	sprintf(peak_db_labels[ival], "%+2.1f", value);
+    }
     else
-      sprintf(temp_label, "%+2.1f", value);
-    return (temp_label);
+      strcpy(peak_db_labels[ival], "(Off)");
   }
-  else
-    return ("(Off)");
+}
+
+char* peak_level_to_db(int ival) {
+  if (ival < 0)
+    ival = 0;
+  else if (ival > MAX_METERING_LEVEL)
+    ival = MAX_METERING_LEVEL;
+  return (peak_db_labels[ival]);
 }
 
 
@@ -986,35 +975,25 @@ void dac_volume_adjust(GtkAdjustment *adj, gpointer data)
 {
 	int idx = (int)(long)data;
 	snd_ctl_elem_value_t *val;
-	int err; //, ival = -(int)adj->value; // TER 
-  int ival = -(int)gtk_adjustment_get_value(adj);
+	int ival = -(int)gtk_adjustment_get_value(adj); // TER
   //printf("dac_volume_adjust cur val:%f new val:%d\n", gtk_adjustment_get_value(adj), ival);
   
-	snd_ctl_elem_value_alloca(&val);
-	snd_ctl_elem_value_set_interface(val, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(val, DAC_VOLUME_NAME);
-	snd_ctl_elem_value_set_index(val, idx);
-	snd_ctl_elem_value_set_integer(val, 0, ival);
-
-	if ((err = snd_ctl_elem_write(ctl, val)) < 0) {
-	  g_print("Unable to write dac volume: %s\n", snd_strerror(err));
-	  sprintf(temp_label, "(Err)");
+	val = control_value(CTL_DAC_VOLUME, idx);
+	control_read(CTL_DAC_VOLUME, idx);
+	if (snd_ctl_elem_value_get_integer(val, 0) != ival) {
+		snd_ctl_elem_value_set_integer(val, 0, ival);
+		control_queue(CTL_DAC_VOLUME, idx);
 	}
-	else if (ival == 0) {
+
+	if (ival == 0) {
 	  sprintf(temp_label, "(Off)");
 	}
 	else {
 	  /* NPM: changed to output dB values. Use of proper ALSA API
 	     snd_ctl_convert_to_dB() to return dB values suggested by
 	     Tim E. Real on linux-audio-devel list. */
-	  snd_ctl_elem_id_t *elem_id;
-	  snd_ctl_elem_id_alloca(&elem_id);
-    //snd_ctl_elem_id_clear(elem_id); 
-	  snd_ctl_elem_id_set_interface(elem_id, SND_CTL_ELEM_IFACE_MIXER);
-	  snd_ctl_elem_id_set_name(elem_id, DAC_VOLUME_NAME);
-	  snd_ctl_elem_id_set_index(elem_id, idx); 
 	  long db_gain = 0;
-	  snd_ctl_convert_to_dB(ctl, elem_id, ival, &db_gain); /* convert ival integer to dB */
+	  control_db(CTL_DAC_VOLUME, idx, ival, &db_gain); /* convert ival integer to dB */
 	  float fval = ((float)db_gain / 100.0);
 	  if (fval <= -10)
 	    sprintf(temp_label, "%+2.1f", fval);
@@ -1029,34 +1008,24 @@ void adc_volume_adjust(GtkAdjustment *adj, gpointer data)
 {
 	int idx = (int)(long)data;
 	snd_ctl_elem_value_t *val;
-	int err; //, ival = -(int)adj->value; // TER
-  int ival = -(int)gtk_adjustment_get_value(adj);
+	int ival = -(int)gtk_adjustment_get_value(adj); // TER
   
-	snd_ctl_elem_value_alloca(&val);
-	snd_ctl_elem_value_set_interface(val, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(val, ADC_VOLUME_NAME);
-	snd_ctl_elem_value_set_index(val, idx);
-	snd_ctl_elem_value_set_integer(val, 0, ival);
-
-	if ((err = snd_ctl_elem_write(ctl, val)) < 0) {
-	  g_print("Unable to write adc volume: %s\n", snd_strerror(err));
-	  sprintf(temp_label, "(Err)");
+	val = control_value(CTL_ADC_VOLUME, idx);
+	control_read(CTL_ADC_VOLUME, idx);
+	if (snd_ctl_elem_value_get_integer(val, 0) != ival) {
+		snd_ctl_elem_value_set_integer(val, 0, ival);
+		control_queue(CTL_ADC_VOLUME, idx);
 	}
-	else if (ival == 0) {
+
+	if (ival == 0) {
 	  sprintf(temp_label, "(Off)");
 	}
 	else {
 	/* NPM: changed to output dB values. Use of proper ALSA API
 	   snd_ctl_convert_to_dB() to return dB values suggested by
 	   Tim E. Real on linux-audio-devel list. */
-	  snd_ctl_elem_id_t *elem_id;
-	  snd_ctl_elem_id_alloca(&elem_id);
-	  //snd_ctl_elem_id_clear(elem_id); 
-	  snd_ctl_elem_id_set_interface(elem_id, SND_CTL_ELEM_IFACE_MIXER);
-	  snd_ctl_elem_id_set_name(elem_id, ADC_VOLUME_NAME);
-    snd_ctl_elem_id_set_index(elem_id, idx); 
 	  long db_gain = 0;
-	  snd_ctl_convert_to_dB(ctl, elem_id, ival, &db_gain);
+	  control_db(CTL_ADC_VOLUME, idx, ival, &db_gain);
 	  float fval = ((float)db_gain / 100.0);
 	  if (fval >= 10)
 	    sprintf(temp_label, "%+2.1f", fval);
@@ -1075,19 +1044,17 @@ void ipga_volume_adjust(GtkAdjustment *adj, gpointer data)
 {
 	int idx = (int)(long)data;
 	snd_ctl_elem_value_t *val;
-	int err;// , ival = -(int)adj->value; // TER
-  int ival = gtk_adjustment_get_value(adj);
+	int ival = gtk_adjustment_get_value(adj); // TER
 	char text[16];
 
-	snd_ctl_elem_value_alloca(&val);
-	snd_ctl_elem_value_set_interface(val, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(val, IPGA_VOLUME_NAME);
-	snd_ctl_elem_value_set_index(val, idx);
-	snd_ctl_elem_value_set_integer(val, 0, ival);
+	val = control_value(CTL_IPGA_VOLUME, idx);
+	control_read(CTL_IPGA_VOLUME, idx);
 	sprintf(text, "%03i", ival);
 	gtk_label_set_text(GTK_LABEL(av_ipga_volume_label[idx]), text);
-	if ((err = snd_ctl_elem_write(ctl, val)) < 0)
-		g_print("Unable to write ipga volume: %s\n", snd_strerror(err));
+	if (snd_ctl_elem_value_get_integer(val, 0) != ival) {
+		snd_ctl_elem_value_set_integer(val, 0, ival);
+		control_queue(CTL_IPGA_VOLUME, idx);
+	}
 }
 
 void dac_sense_toggled(GtkWidget *togglebutton, gpointer data)
@@ -1097,12 +1064,9 @@ void dac_sense_toggled(GtkWidget *togglebutton, gpointer data)
 	snd_ctl_elem_value_t *val;
 	int err;
 
-	snd_ctl_elem_value_alloca(&val);
-	snd_ctl_elem_value_set_interface(val, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(val, DAC_SENSE_NAME);
-	snd_ctl_elem_value_set_index(val, idx);
+	val = control_value(CTL_DAC_SENSE, idx);
 	snd_ctl_elem_value_set_enumerated(val, 0, state);
-	if ((err = snd_ctl_elem_write(ctl, val)) < 0)
+	if ((err = control_write(CTL_DAC_SENSE, idx)) < 0)
 		g_print("Unable to write dac sense: %s\n", snd_strerror(err));
 }
 
@@ -1113,31 +1077,35 @@ void adc_sense_toggled(GtkWidget *togglebutton, gpointer data)
 	snd_ctl_elem_value_t *val;
 	int err;
 
-	snd_ctl_elem_value_alloca(&val);
-	snd_ctl_elem_value_set_interface(val, SND_CTL_ELEM_IFACE_MIXER);
-	snd_ctl_elem_value_set_name(val, ADC_SENSE_NAME);
-	snd_ctl_elem_value_set_index(val, idx);
+	val = control_value(CTL_ADC_SENSE, idx);
 	snd_ctl_elem_value_set_enumerated(val, 0, state);
-	if ((err = snd_ctl_elem_write(ctl, val)) < 0)
+	if ((err = control_write(CTL_ADC_SENSE, idx)) < 0)
 		g_print("Unable to write adc sense: %s\n", snd_strerror(err));
 }
 
 /*
  */
 
+/* Does the card have 'index' of control 'c'? */
+static int analog_control_present(control_t c, int index)
+{
+	return control_range(c, index)->type != SND_CTL_ELEM_TYPE_NONE;
+}
+
+/* The name of 'item' of the sense control 'c', "" if unknown */
+static const char *analog_item_name(control_t c, int item)
+{
+	const char *name = control_item_name(c, 0, item);
+
+	return name != NULL ? name : "";
+}
+
 void analog_volume_init(void)
 {
-	snd_ctl_elem_info_t *info;
 	int i;
 
-	snd_ctl_elem_info_alloca(&info);
-
-	snd_ctl_elem_info_set_interface(info, SND_CTL_ELEM_IFACE_MIXER);
 	for (i = 0; i < 10; i++) {
-		snd_ctl_elem_info_set_name(info, DAC_VOLUME_NAME);
-		snd_ctl_elem_info_set_numid(info, 0);
-		snd_ctl_elem_info_set_index(info, i);
-		if (snd_ctl_elem_info(ctl, info) < 0)
+		if (!analog_control_present(CTL_DAC_VOLUME, i))
 			break;
 		//dac_max = snd_ctl_elem_info_get_max(info); // TER
 	}
@@ -1146,31 +1114,19 @@ void analog_volume_init(void)
 	else
 		dac_volumes = output_channels;
 
-	snd_ctl_elem_info_set_name(info, DAC_SENSE_NAME);
 	for (i = 0; i < dac_volumes; i++) {
-		snd_ctl_elem_info_set_numid(info, 0);
-		snd_ctl_elem_info_set_index(info, i);
-		if (snd_ctl_elem_info(ctl, info) < 0)
+		if (!analog_control_present(CTL_DAC_SENSE, i))
 			break;
 	}
 	dac_senses = i;
 	if (dac_senses > 0) {
-		snd_ctl_elem_info_set_numid(info, 0);
-		snd_ctl_elem_info_set_index(info, 0);
-		snd_ctl_elem_info(ctl, info);
-		dac_sense_items = snd_ctl_elem_info_get_items(info);
-		for (i = 0; i < dac_sense_items; i++) {
-			snd_ctl_elem_info_set_item(info, i);
-			snd_ctl_elem_info(ctl, info);
-			dac_sense_name[i] = strdup(snd_ctl_elem_info_get_item_name(info));
-		}
+		dac_sense_items = control_range(CTL_DAC_SENSE, 0)->max + 1;
+		for (i = 0; i < dac_sense_items; i++)
+			dac_sense_name[i] = strdup(analog_item_name(CTL_DAC_SENSE, i));
 	}
 
 	for (i = 0; i < 10; i++) {
-		snd_ctl_elem_info_set_name(info, ADC_VOLUME_NAME);
-		snd_ctl_elem_info_set_numid(info, 0);
-		snd_ctl_elem_info_set_index(info, i);
-		if (snd_ctl_elem_info(ctl, info) < 0)
+		if (!analog_control_present(CTL_ADC_VOLUME, i))
 			break;
 		//adc_max = snd_ctl_elem_info_get_max(info); // TER
 	}
@@ -1178,31 +1134,19 @@ void analog_volume_init(void)
 		adc_volumes = i;
 	else
 		adc_volumes = input_channels;
-	snd_ctl_elem_info_set_name(info, ADC_SENSE_NAME);
 	for (i = 0; i < adc_volumes; i++) {
-		snd_ctl_elem_info_set_numid(info, 0);
-		snd_ctl_elem_info_set_index(info, i);
-		if (snd_ctl_elem_info(ctl, info) < 0)
+		if (!analog_control_present(CTL_ADC_SENSE, i))
 			break;
 	}
 	adc_senses = i;
 	if (adc_senses > 0) {
-		snd_ctl_elem_info_set_numid(info, 0);
-		snd_ctl_elem_info_set_index(info, 0);
-		snd_ctl_elem_info(ctl, info);
-		adc_sense_items = snd_ctl_elem_info_get_items(info);
-		for (i = 0; i < adc_sense_items; i++) {
-			snd_ctl_elem_info_set_item(info, i);
-			snd_ctl_elem_info(ctl, info);
-			adc_sense_name[i] = strdup(snd_ctl_elem_info_get_item_name(info));
-		}
+		adc_sense_items = control_range(CTL_ADC_SENSE, 0)->max + 1;
+		for (i = 0; i < adc_sense_items; i++)
+			adc_sense_name[i] = strdup(analog_item_name(CTL_ADC_SENSE, i));
 	}
 
 	for (i = 0; i < 10; i++) {
-		snd_ctl_elem_info_set_name(info, IPGA_VOLUME_NAME);
-		snd_ctl_elem_info_set_numid(info, 0);
-		snd_ctl_elem_info_set_index(info, i);
-		if (snd_ctl_elem_info(ctl, info) < 0)
+		if (!analog_control_present(CTL_IPGA_VOLUME, i))
 			break;
 	}
 	if (i < input_channels - 1)